@@ -26,29 +26,18 @@ HANDLE DOKANAPI DokanOpenRequestorToken(PDOKAN_FILE_INFO FileInfo) {
   BOOL status;
   ULONG returnedLength;
   PDOKAN_INSTANCE instance;
-  PDOKAN_OPEN_INFO openInfo;
-  PEVENT_CONTEXT eventContext;
+  PDOKAN_IO_EVENT ioEvent;
   PEVENT_INFORMATION eventInfo;
   HANDLE handle = INVALID_HANDLE_VALUE;
   ULONG eventInfoSize;
-  WCHAR rawDeviceName[MAX_PATH];
 
-  openInfo = (PDOKAN_OPEN_INFO)(UINT_PTR)FileInfo->DokanContext;
-  if (openInfo == NULL) {
+  ioEvent = (PDOKAN_IO_EVENT)(UINT_PTR)FileInfo->DokanContext;
+  if (ioEvent == NULL) {
     return INVALID_HANDLE_VALUE;
   }
 
-  eventContext = openInfo->EventContext;
-  if (eventContext == NULL) {
-    return INVALID_HANDLE_VALUE;
-  }
-
-  instance = openInfo->DokanInstance;
-  if (instance == NULL) {
-    return INVALID_HANDLE_VALUE;
-  }
-
-  if (eventContext->MajorFunction != IRP_MJ_CREATE) {
+  instance = ioEvent->DokanInstance;
+  if (instance == NULL || ioEvent->MajorFunction != IRP_MJ_CREATE) {
     return INVALID_HANDLE_VALUE;
   }
 
@@ -60,12 +49,12 @@ HANDLE DOKANAPI DokanOpenRequestorToken(PDOKAN_FILE_INFO FileInfo) {
 
   RtlZeroMemory(eventInfo, eventInfoSize);
 
-  eventInfo->SerialNumber = eventContext->SerialNumber;
+  eventInfo->SerialNumber = ioEvent->SerialNumber;
 
-  status = SendToDevice(
-      GetRawDeviceName(instance->DeviceName, rawDeviceName, MAX_PATH),
-      IOCTL_GET_ACCESS_TOKEN, eventInfo, eventInfoSize, eventInfo,
-      eventInfoSize, &returnedLength);
+  status = DokanChannelIoControl(&instance->ControlChannel,
+                                 IOCTL_GET_ACCESS_TOKEN, eventInfo,
+                                 eventInfoSize, eventInfo, eventInfoSize,
+                                 &returnedLength);
   if (status) {
     handle = eventInfo->Operation.AccessToken.Handle;
   } else {
@@ -0,0 +1,116 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokani.h"
+
+// Arena of the worker running on the current thread
+static __declspec(thread) PDOKAN_REPLY_ARENA g_ThreadArena = NULL;
+
+VOID DokanInitReplyArena(PDOKAN_REPLY_ARENA Arena) {
+  ZeroMemory(Arena, sizeof(DOKAN_REPLY_ARENA));
+}
+
+VOID DokanDeleteReplyArena(PDOKAN_REPLY_ARENA Arena) {
+  ULONG i;
+
+  DbgPrint("Dokan: reply arena %I64u requests, %I64u malloc\n",
+           Arena->RequestCount, Arena->MallocCount);
+
+  for (i = 0; i < DOKAN_ARENA_SLOT_COUNT; ++i) {
+    free(Arena->Slots[i].Buffer);
+    Arena->Slots[i].Buffer = NULL;
+    Arena->Slots[i].Size = 0;
+  }
+}
+
+VOID DokanSetThreadArena(PDOKAN_REPLY_ARENA Arena) { g_ThreadArena = Arena; }
+
+// The buffer is not zeroed
+PVOID DokanArenaAlloc(ULONG Slot, ULONG Size) {
+  PDOKAN_REPLY_ARENA arena = g_ThreadArena;
+  PDOKAN_ARENA_SLOT slot;
+  ULONG newSize;
+
+  if (arena == NULL || Slot >= DOKAN_ARENA_SLOT_COUNT ||
+      arena->Slots[Slot].InUse || Size > DOKAN_ARENA_MAX_SIZE) {
+    if (arena != NULL) {
+      arena->RequestCount++;
+      arena->MallocCount++;
+    }
+    return malloc(Size);
+  }
+
+  arena->RequestCount++;
+  slot = &arena->Slots[Slot];
+  if (slot->Size < Size) {
+    newSize = (Size + DOKAN_ARENA_GRANULARITY - 1) &
+              ~(DOKAN_ARENA_GRANULARITY - 1);
+    free(slot->Buffer);
+    slot->Size = 0;
+    slot->Buffer = malloc(newSize);
+    arena->MallocCount++;
+    if (slot->Buffer == NULL) {
+      return NULL;
+    }
+    slot->Size = newSize;
+  }
+
+  slot->InUse = TRUE;
+  return slot->Buffer;
+}
+
+VOID DokanArenaFree(PVOID Buffer) {
+  PDOKAN_REPLY_ARENA arena = g_ThreadArena;
+  ULONG i;
+
+  if (Buffer == NULL) {
+    return;
+  }
+  if (arena != NULL) {
+    for (i = 0; i < DOKAN_ARENA_SLOT_COUNT; ++i) {
+      if (arena->Slots[i].Buffer == Buffer) {
+        arena->Slots[i].InUse = FALSE;
+        return;
+      }
+    }
+  }
+  free(Buffer);
+}
+
+// Give the ownership of Buffer to the caller, it must be released with free.
+// Used when a reply outlives the event, e.g. pending requests.
+VOID DokanArenaDetach(PVOID Buffer) {
+  PDOKAN_REPLY_ARENA arena = g_ThreadArena;
+  ULONG i;
+
+  if (arena == NULL || Buffer == NULL) {
+    return;
+  }
+  for (i = 0; i < DOKAN_ARENA_SLOT_COUNT; ++i) {
+    if (arena->Slots[i].Buffer == Buffer) {
+      arena->Slots[i].Buffer = NULL;
+      arena->Slots[i].Size = 0;
+      arena->Slots[i].InUse = FALSE;
+      return;
+    }
+  }
+}
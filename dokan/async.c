@@ -0,0 +1,189 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+/*
+
+Pending requests:
+DispatchRead / DispatchWrite / DispatchCreate
+  DokanAllowPendingRequest
+  callback
+    DokanPendRequest        # returns a heap copy of DOKAN_FILE_INFO
+    return STATUS_PENDING
+  DokanTakePendingRequest
+  DokanStartPendingRequest  # reply buffer handed over to the request
+
+DokanCompleteRequest (any thread, before or after DokanStartPendingRequest)
+
+DokanFinishPendingRequest drops what the caches know of a created or
+written file once the reply is known.
+
+Pending starts at 2. The dispatcher and DokanCompleteRequest both release
+one reference, the last one builds the reply and sends it on the control
+channel of the instance.
+
+*/
+
+// DOKAN_FILE_INFO of the callback allowed to pend on the current thread
+static __declspec(thread) PDOKAN_FILE_INFO g_PendableFileInfo = NULL;
+// Request created by DokanPendRequest during that callback
+static __declspec(thread) PDOKAN_PENDING_REQUEST g_PendingRequest = NULL;
+
+static VOID DokanFinishPendingRequest(PDOKAN_PENDING_REQUEST Request) {
+  PEVENT_INFORMATION eventInfo = Request->EventInfo;
+  PDOKAN_OPEN_INFO openInfo = Request->OpenInfo;
+  PDOKAN_INSTANCE instance = Request->DokanInstance;
+  NTSTATUS status = Request->Status;
+
+  DbgPrint("Dokan: complete pending request %d status = %lx\n",
+           Request->MajorFunction, status);
+
+  if (openInfo != NULL)
+    openInfo->UserContext = Request->FileInfo.Context;
+
+  switch (Request->MajorFunction) {
+  case IRP_MJ_CREATE:
+    if (openInfo != NULL)
+      openInfo->IsDirectory = Request->FileInfo.IsDirectory;
+    FillCreateEventInformation(eventInfo, status, Request->Disposition,
+                               Request->FileInfo.IsDirectory);
+    if (Request->FileName != NULL)
+      DokanInvalidateCreatedFile(instance, Request->FileName, eventInfo);
+    if (!NT_SUCCESS(eventInfo->Status)) {
+      DokanPoolFree(&instance->OpenInfoPool, openInfo);
+      eventInfo->Context = 0;
+    }
+    break;
+  case IRP_MJ_READ:
+    eventInfo->Status = status;
+    eventInfo->BufferLength = 0;
+    if (status == STATUS_SUCCESS) {
+      if (Request->TransferLength == 0) {
+        eventInfo->Status = STATUS_END_OF_FILE;
+      } else {
+        eventInfo->BufferLength = Request->TransferLength;
+        eventInfo->Operation.Read.CurrentByteOffset.QuadPart =
+            Request->ByteOffset + Request->TransferLength;
+      }
+    }
+    break;
+  case IRP_MJ_WRITE:
+    if (Request->FileName != NULL)
+      DokanInfoCacheInvalidate(instance, Request->FileName, FALSE);
+    eventInfo->Status = status;
+    eventInfo->BufferLength = 0;
+    if (status == STATUS_SUCCESS) {
+      eventInfo->BufferLength = Request->TransferLength;
+      eventInfo->Operation.Write.CurrentByteOffset.QuadPart =
+          Request->ByteOffset + Request->TransferLength;
+    }
+    break;
+  }
+
+  // Worker channels belong to their thread, the reply goes through the
+  // control channel. The open info reference is released here.
+  SendEventInformation(instance->ControlChannel.Device, eventInfo,
+                       Request->EventInfoLength, instance);
+
+  if (eventInfo != &Request->InlineEventInfo)
+    free(eventInfo);
+  free(Request->FileName);
+  free(Request);
+}
+
+static VOID DokanReleasePendingRequest(PDOKAN_PENDING_REQUEST Request) {
+  if (InterlockedDecrement(&Request->Pending) == 0) {
+    DokanFinishPendingRequest(Request);
+  }
+}
+
+VOID DokanAllowPendingRequest(PDOKAN_FILE_INFO DokanFileInfo) {
+  g_PendableFileInfo = DokanFileInfo;
+  g_PendingRequest = NULL;
+}
+
+PDOKAN_PENDING_REQUEST DokanTakePendingRequest(NTSTATUS *Status) {
+  PDOKAN_PENDING_REQUEST request = g_PendingRequest;
+
+  g_PendableFileInfo = NULL;
+  g_PendingRequest = NULL;
+
+  if (request != NULL) {
+    if (*Status != STATUS_PENDING) {
+      DbgPrint("Dokan Warning: request pended but callback returned %lx\n",
+               *Status);
+    }
+    *Status = STATUS_PENDING;
+  } else if (*Status == STATUS_PENDING) {
+    DbgPrint("Dokan Error: STATUS_PENDING returned without DokanPendRequest\n");
+    *Status = STATUS_INTERNAL_ERROR;
+  }
+  return request;
+}
+
+VOID DokanStartPendingRequest(PDOKAN_PENDING_REQUEST Request) {
+  DokanReleasePendingRequest(Request);
+}
+
+PDOKAN_FILE_INFO DOKANAPI DokanPendRequest(PDOKAN_FILE_INFO DokanFileInfo) {
+  PDOKAN_PENDING_REQUEST request;
+
+  if (DokanFileInfo == NULL || DokanFileInfo != g_PendableFileInfo) {
+    return NULL;
+  }
+  if (g_PendingRequest != NULL) {
+    return &g_PendingRequest->FileInfo;
+  }
+
+  request = (PDOKAN_PENDING_REQUEST)malloc(sizeof(DOKAN_PENDING_REQUEST));
+  if (request == NULL) {
+    return NULL;
+  }
+  ZeroMemory(request, sizeof(DOKAN_PENDING_REQUEST));
+  CopyMemory(&request->FileInfo, DokanFileInfo, sizeof(DOKAN_FILE_INFO));
+  // the dispatcher frame is gone when the application completes it
+  if (DokanFileInfo->DokanContext != 0) {
+    request->IoEvent = *(PDOKAN_IO_EVENT)(UINT_PTR)DokanFileInfo->DokanContext;
+    request->FileInfo.DokanContext = (ULONG64)&request->IoEvent;
+  }
+  request->Pending = 2;
+  request->Status = STATUS_INTERNAL_ERROR;
+
+  g_PendingRequest = request;
+  return &request->FileInfo;
+}
+
+BOOL DOKANAPI DokanCompleteRequest(PDOKAN_FILE_INFO PendingFileInfo,
+                                   NTSTATUS Status, ULONG TransferLength) {
+  PDOKAN_PENDING_REQUEST request;
+
+  if (PendingFileInfo == NULL) {
+    return FALSE;
+  }
+
+  request =
+      CONTAINING_RECORD(PendingFileInfo, DOKAN_PENDING_REQUEST, FileInfo);
+  request->Status = Status;
+  request->TransferLength = TransferLength;
+  DokanReleasePendingRequest(request);
+  return TRUE;
+}
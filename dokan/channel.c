@@ -0,0 +1,291 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// Channel of the worker running on the current thread
+static __declspec(thread) PDOKAN_DEVICE_CHANNEL g_ThreadChannel = NULL;
+
+static HANDLE DokanDeviceOpen(LPCWSTR RawDeviceName, DWORD FlagsAndAttributes) {
+  return CreateFile(RawDeviceName,                      // lpFileName
+                    GENERIC_READ | GENERIC_WRITE,       // dwDesiredAccess
+                    FILE_SHARE_READ | FILE_SHARE_WRITE, // dwShareMode
+                    NULL,                               // lpSecurityAttributes
+                    OPEN_EXISTING,      // dwCreationDistribution
+                    FlagsAndAttributes, // dwFlagsAndAttributes
+                    NULL                // hTemplateFile
+                    );
+}
+
+static BOOL DokanDeviceIoControl(HANDLE Device, DWORD IoControlCode,
+                                 PVOID InputBuffer, ULONG InputLength,
+                                 PVOID OutputBuffer, ULONG OutputLength,
+                                 PULONG ReturnedLength) {
+  return DeviceIoControl(Device,         // Handle to device
+                         IoControlCode,  // IO Control code
+                         InputBuffer,    // Input Buffer to driver.
+                         InputLength,    // Length of input buffer in bytes.
+                         OutputBuffer,   // Output Buffer from driver.
+                         OutputLength,   // Length of output buffer in bytes.
+                         ReturnedLength, // Bytes placed in buffer.
+                         NULL            // synchronous call
+                         );
+}
+
+static VOID DokanDeviceClose(HANDLE Device) { CloseHandle(Device); }
+
+static const DOKAN_CHANNEL_TRANSPORT g_DeviceTransport = {
+    DokanDeviceOpen, DokanDeviceIoControl, DokanDeviceClose};
+
+// Transport used by all channels, the dokan device unless a test replaced it
+static const DOKAN_CHANNEL_TRANSPORT *g_Transport = &g_DeviceTransport;
+
+VOID DokanSetChannelTransport(const DOKAN_CHANNEL_TRANSPORT *Transport) {
+  g_Transport = Transport != NULL ? Transport : &g_DeviceTransport;
+}
+
+LPWSTR
+GetRawDeviceName(LPCWSTR DeviceName, LPWSTR DestinationBuffer,
+                 rsize_t DestinationBufferSizeInElements) {
+  if (DeviceName && DestinationBuffer && DestinationBufferSizeInElements > 0) {
+    wcscpy_s(DestinationBuffer, DestinationBufferSizeInElements, L"\\\\.");
+    wcscat_s(DestinationBuffer, DestinationBufferSizeInElements, DeviceName);
+  }
+
+  return DestinationBuffer;
+}
+
+VOID DokanInitDeviceChannel(PDOKAN_DEVICE_CHANNEL Channel) {
+  ZeroMemory(Channel, sizeof(DOKAN_DEVICE_CHANNEL));
+  Channel->Device = INVALID_HANDLE_VALUE;
+}
+
+BOOL DokanOpenNamedDeviceChannel(PDOKAN_DEVICE_CHANNEL Channel,
+                                 LPCWSTR RawDeviceName) {
+  if (Channel->RawDeviceName != RawDeviceName) {
+    wcscpy_s(Channel->RawDeviceName,
+             sizeof(Channel->RawDeviceName) / sizeof(WCHAR), RawDeviceName);
+  }
+
+  Channel->Device =
+      g_Transport->Open(Channel->RawDeviceName, Channel->FlagsAndAttributes);
+
+  if (Channel->Device == INVALID_HANDLE_VALUE) {
+    DbgPrint("Dokan Error: CreateFile failed %ws: %d\n",
+             Channel->RawDeviceName, GetLastError());
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+BOOL DokanOpenDeviceChannel(PDOKAN_DEVICE_CHANNEL Channel,
+                            PDOKAN_INSTANCE DokanInstance) {
+  WCHAR rawDeviceName[MAX_PATH];
+
+  return DokanOpenNamedDeviceChannel(
+      Channel,
+      GetRawDeviceName(DokanInstance->DeviceName, rawDeviceName, MAX_PATH));
+}
+
+VOID DokanCloseDeviceChannel(PDOKAN_DEVICE_CHANNEL Channel) {
+  if (Channel->Device != INVALID_HANDLE_VALUE) {
+    g_Transport->Close(Channel->Device);
+    Channel->Device = INVALID_HANDLE_VALUE;
+  }
+}
+
+BOOL DokanReconnectDeviceChannel(PDOKAN_DEVICE_CHANNEL Channel) {
+  DokanCloseDeviceChannel(Channel);
+
+  if (Channel->ReconnectAttempts >= DOKAN_CHANNEL_MAX_RECONNECT) {
+    DbgPrint("Dokan Error: %ws reconnect limit reached\n",
+             Channel->RawDeviceName);
+    return FALSE;
+  }
+  Channel->ReconnectAttempts++;
+
+  if (!DokanOpenNamedDeviceChannel(Channel, Channel->RawDeviceName)) {
+    return FALSE;
+  }
+
+  Channel->ReconnectCount++;
+  DbgPrint("Dokan: %ws reconnected (%d)\n", Channel->RawDeviceName,
+           Channel->ReconnectCount);
+  return TRUE;
+}
+
+BOOL DokanIsChannelBroken(DWORD LastError) {
+  // The handle itself became unusable, the device is still there.
+  // Other errors must end the worker, ERROR_OPERATION_ABORTED in particular
+  // is how the driver releases the pending waits at unmount.
+  return LastError == ERROR_INVALID_HANDLE;
+}
+
+// send a control request on Channel, opening it on first use. The channel
+// is not reconnected here as it may be shared by several threads.
+BOOL DokanChannelIoControl(PDOKAN_DEVICE_CHANNEL Channel, DWORD IoControlCode,
+                           PVOID InputBuffer, ULONG InputLength,
+                           PVOID OutputBuffer, ULONG OutputLength,
+                           PULONG ReturnedLength) {
+  BOOL status;
+
+  if (Channel->Device == INVALID_HANDLE_VALUE &&
+      !DokanOpenNamedDeviceChannel(Channel, Channel->RawDeviceName)) {
+    return FALSE;
+  }
+
+  status = g_Transport->IoControl(Channel->Device, IoControlCode, InputBuffer,
+                                  InputLength, OutputBuffer, OutputLength,
+                                  ReturnedLength);
+  if (!status) {
+    DbgPrint("Dokan Error: Ioctl %x on %ws failed with code %d\n",
+             IoControlCode, Channel->RawDeviceName, GetLastError());
+  }
+  return status;
+}
+
+VOID DokanSetThreadChannel(PDOKAN_DEVICE_CHANNEL Channel) {
+  g_ThreadChannel = Channel;
+}
+
+BOOL DokanDeferEventInformation(HANDLE Handle, PEVENT_INFORMATION EventInfo,
+                                ULONG EventLength) {
+  PDOKAN_DEVICE_CHANNEL channel = g_ThreadChannel;
+
+  if (channel == NULL || !channel->DeferReply ||
+      channel->DeferredReply == NULL || channel->DeferredReplyLength != 0 ||
+      channel->Device != Handle ||
+      EventLength > DOKAN_DEFERRED_REPLY_MAX_SIZE) {
+    return FALSE;
+  }
+
+  CopyMemory(channel->DeferredReply, EventInfo, EventLength);
+  channel->DeferredReplyLength = EventLength;
+  return TRUE;
+}
+
+// Replies to the events of the event ring go back through its completion
+// ring when they fit in a slot. The driver copies BufferLength bytes of
+// Buffer, they must be in the slot.
+static BOOL DokanEventRingReply(HANDLE Handle, PEVENT_INFORMATION EventInfo,
+                                ULONG EventLength) {
+  PDOKAN_DEVICE_CHANNEL channel = g_ThreadChannel;
+  PDOKAN_EVENT_RING eventRing;
+  int wake = 0;
+
+  if (channel == NULL || channel->EventRing == NULL ||
+      channel->Device != Handle || EventLength < sizeof(EVENT_INFORMATION) ||
+      EventInfo->BufferLength >
+          EventLength - FIELD_OFFSET(EVENT_INFORMATION, Buffer)) {
+    return FALSE;
+  }
+  eventRing = channel->EventRing;
+  if (!DokanRingProduce(&eventRing->Complete, EventInfo, EventLength,
+                        EventInfo->SerialNumber, &wake)) {
+    return FALSE;
+  }
+  if (wake) {
+    SetEvent(eventRing->CompleteEvent);
+  }
+  InterlockedIncrement64(&eventRing->Replies);
+  return TRUE;
+}
+
+// wait for the next batch of events, handing the deferred reply over to the
+// driver with the same ioctl when there is one
+BOOL DokanChannelWaitEvents(PDOKAN_DEVICE_CHANNEL Channel, PVOID Buffer,
+                            ULONG BufferLength, PULONG ReturnedLength) {
+  BOOL status;
+
+  if (Channel->DeferredReplyLength > 0) {
+    status = g_Transport->IoControl(
+        Channel->Device, IOCTL_EVENT_INFO_WAIT, Channel->DeferredReply,
+        Channel->DeferredReplyLength, Buffer, BufferLength, ReturnedLength);
+  } else {
+    status = g_Transport->IoControl(Channel->Device, IOCTL_EVENT_WAIT_BATCH,
+                                    NULL, 0, Buffer, BufferLength,
+                                    ReturnedLength);
+  }
+
+  if (status) {
+    Channel->ReconnectAttempts = 0;
+    Channel->DeferredReplyLength = 0;
+  }
+  return status;
+}
+
+VOID DokanChannelDispatchBatch(PDOKAN_DEVICE_CHANNEL Channel,
+                               PEVENT_BATCH Batch, ULONG ReturnedLength,
+                               PDOKAN_EVENT_DISPATCH Dispatch,
+                               PDOKAN_INSTANCE DokanInstance) {
+  PEVENT_CONTEXT context;
+  PEVENT_CONTEXT next;
+  ULONG offset = 0;
+
+  next = EventBatchNext(Batch, ReturnedLength, &offset);
+  while ((context = next) != NULL) {
+    next = EventBatchNext(Batch, ReturnedLength, &offset);
+    // only the last reply of the batch waits for the next ioctl
+    Channel->DeferReply = next == NULL;
+    Dispatch(Channel->Device, context, DokanInstance);
+  }
+  Channel->DeferReply = FALSE;
+}
+
+BOOL DokanChannelSendReply(HANDLE Handle, PEVENT_INFORMATION EventInfo,
+                           ULONG EventLength) {
+  BOOL status;
+  ULONG returnedLength;
+
+  // let the worker send it along with its next wait
+  if (DokanDeferEventInformation(Handle, EventInfo, EventLength)) {
+    return TRUE;
+  }
+  // or through the event ring the event came from
+  if (DokanEventRingReply(Handle, EventInfo, EventLength)) {
+    return TRUE;
+  }
+
+  status = g_Transport->IoControl(Handle, IOCTL_EVENT_INFO, EventInfo,
+                                  EventLength, NULL, 0, &returnedLength);
+  if (!status) {
+    DWORD lastError = GetLastError();
+    if (lastError == ERROR_NOT_FOUND) {
+      // the request timed out, or replies and events are out of step
+      DbgPrint("Dokan Error: no pending request for reply #%X\n",
+               EventInfo->SerialNumber);
+    } else {
+      DbgPrint("Dokan Error: Ioctl failed with code %d\n", lastError);
+    }
+    SetLastError(lastError);
+  }
+  return status;
+}
+
+// fetch the payload of a write too large to travel with its event
+BOOL DokanChannelPullWrite(HANDLE Handle, PEVENT_INFORMATION EventInfo,
+                           ULONG EventLength, PVOID Buffer, ULONG BufferLength,
+                           PULONG ReturnedLength) {
+  return g_Transport->IoControl(Handle, IOCTL_EVENT_WRITE, EventInfo,
+                                EventLength, Buffer, BufferLength,
+                                ReturnedLength);
+}
@@ -25,13 +25,14 @@ VOID DispatchCleanup(HANDLE Handle, PEVENT_CONTEXT EventContext,
                      PDOKAN_INSTANCE DokanInstance) {
   PEVENT_INFORMATION eventInfo;
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   PDOKAN_OPEN_INFO openInfo;
   ULONG sizeOfEventInfo = sizeof(EVENT_INFORMATION);
 
   CheckFileName(EventContext->Operation.Cleanup.FileName);
 
   eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+                             &fileInfo, &ioEvent, &openInfo);
 
   eventInfo->Status = STATUS_SUCCESS; // return success at any case
 
@@ -43,10 +44,23 @@ VOID DispatchCleanup(HANDLE Handle, PEVENT_CONTEXT EventContext,
         EventContext->Operation.Cleanup.FileName, &fileInfo);
   }
 
+  // times of the file are updated at cleanup
+  DokanInfoCacheInvalidate(DokanInstance,
+                           EventContext->Operation.Cleanup.FileName,
+                           fileInfo.DeleteOnClose);
+
+  if (fileInfo.DeleteOnClose) {
+    DokanDirCacheInvalidate(DokanInstance,
+                            EventContext->Operation.Cleanup.FileName, TRUE);
+    DokanFileIdRemove(DokanInstance, EventContext->Operation.Cleanup.FileName);
+    DokanSecurityCacheInvalidate(
+        DokanInstance, EventContext->Operation.Cleanup.FileName, TRUE);
+  }
+
   if (openInfo != NULL)
     openInfo->UserContext = fileInfo.Context;
 
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
 
-  free(eventInfo);
+  DokanArenaFree(eventInfo);
 }
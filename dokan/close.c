@@ -25,6 +25,7 @@ VOID DispatchClose(HANDLE Handle, PEVENT_CONTEXT EventContext,
                    PDOKAN_INSTANCE DokanInstance) {
   PEVENT_INFORMATION eventInfo;
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   PDOKAN_OPEN_INFO openInfo;
   ULONG sizeOfEventInfo = sizeof(EVENT_INFORMATION);
 
@@ -33,7 +34,7 @@ VOID DispatchClose(HANDLE Handle, PEVENT_CONTEXT EventContext,
   CheckFileName(EventContext->Operation.Close.FileName);
 
   eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+                             &fileInfo, &ioEvent, &openInfo);
 
   eventInfo->Status = STATUS_SUCCESS; // return success at any case
 
@@ -49,10 +50,9 @@ VOID DispatchClose(HANDLE Handle, PEVENT_CONTEXT EventContext,
   // SendEventInformation(Handle, eventInfo, length);
 
   if (openInfo != NULL) {
-    EnterCriticalSection(&DokanInstance->CriticalSection);
-    openInfo->OpenCount--;
-    LeaveCriticalSection(&DokanInstance->CriticalSection);
+    // drop the reference taken at create, the last one is released below
+    InterlockedDecrement(&openInfo->OpenCount);
   }
   ReleaseDokanOpenInfo(eventInfo, DokanInstance);
-  free(eventInfo);
+  DokanArenaFree(eventInfo);
 }
@@ -100,6 +100,73 @@ BOOL CreateSuccesStatusCheck(NTSTATUS status, ULONG disposition) {
   return FALSE;
 }
 
+VOID FillCreateEventInformation(PEVENT_INFORMATION EventInfo, NTSTATUS Status,
+                                ULONG Disposition, BOOL IsDirectory) {
+  // FILE_CREATED
+  // FILE_DOES_NOT_EXIST
+  // FILE_EXISTS
+  // FILE_OPENED
+  // FILE_OVERWRITTEN
+  // FILE_SUPERSEDED
+
+  if (!CreateSuccesStatusCheck(Status, Disposition)) {
+    EventInfo->Operation.Create.Information = FILE_DOES_NOT_EXIST;
+    EventInfo->Status = Status;
+
+    if (Status == STATUS_OBJECT_NAME_COLLISION) {
+      EventInfo->Operation.Create.Information = FILE_EXISTS;
+    }
+    return;
+  }
+
+  EventInfo->Status = STATUS_SUCCESS;
+  EventInfo->Operation.Create.Information = FILE_OPENED;
+
+  if (Disposition == FILE_CREATE || Disposition == FILE_OPEN_IF ||
+      Disposition == FILE_OVERWRITE_IF || Disposition == FILE_SUPERSEDE) {
+    EventInfo->Operation.Create.Information = FILE_CREATED;
+
+    if (Status == STATUS_OBJECT_NAME_COLLISION) {
+      if (Disposition == FILE_OPEN_IF) {
+        EventInfo->Operation.Create.Information = FILE_OPENED;
+      } else if (Disposition == FILE_OVERWRITE_IF) {
+        EventInfo->Operation.Create.Information = FILE_OVERWRITTEN;
+      } else if (Disposition == FILE_SUPERSEDE) {
+        EventInfo->Operation.Create.Information = FILE_SUPERSEDED;
+      }
+    }
+  }
+
+  if (Disposition == FILE_OVERWRITE)
+    EventInfo->Operation.Create.Information = FILE_OVERWRITTEN;
+
+  if (IsDirectory)
+    EventInfo->Operation.Create.Flags |= DOKAN_FILE_DIRECTORY;
+}
+
+// drop what the caches know of FileName, which was just made or replaced.
+// The paths below it were missing with it, a probe of \a\x cached as
+// STATUS_OBJECT_PATH_NOT_FOUND must not outlive the creation of \a.
+static VOID DokanInvalidateCreatedPath(PDOKAN_INSTANCE DokanInstance,
+                                       LPCWSTR FileName) {
+  DokanDirCacheInvalidate(DokanInstance, FileName, FALSE);
+  DokanInfoCacheInvalidate(DokanInstance, FileName, FALSE);
+  DokanNegativeCacheInvalidate(DokanInstance, FileName, TRUE);
+  DokanSecurityCacheInvalidate(DokanInstance, FileName, FALSE);
+}
+
+// drop what the caches know of FileName once a create reply says the file
+// was made or replaced
+VOID DokanInvalidateCreatedFile(PDOKAN_INSTANCE DokanInstance,
+                                LPCWSTR FileName,
+                                PEVENT_INFORMATION EventInfo) {
+  if (EventInfo->Operation.Create.Information == FILE_CREATED ||
+      EventInfo->Operation.Create.Information == FILE_OVERWRITTEN ||
+      EventInfo->Operation.Create.Information == FILE_SUPERSEDED) {
+    DokanInvalidateCreatedPath(DokanInstance, FileName);
+  }
+}
+
 VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
                                    // Dokan Device Driver(which is doing
                                    // EVENT_WAIT).
@@ -109,14 +176,19 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
   EVENT_INFORMATION eventInfo;
   NTSTATUS status = STATUS_INSUFFICIENT_RESOURCES;
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   ULONG disposition;
   PDOKAN_OPEN_INFO openInfo = NULL;
   DWORD options;
   DOKAN_IO_SECURITY_CONTEXT ioSecurityContext;
   WCHAR *fileName;
   BOOL childExisted = TRUE;
+  // whether a miss of this open can be remembered and answered
+  BOOL negativeLookup = FALSE;
+  ULONG64 generation = 0;
   WCHAR *origFileName = NULL;
   DWORD origOptions;
+  PDOKAN_PENDING_REQUEST pendingRequest = NULL;
 
   fileName = (WCHAR *)((char *)&EventContext->Operation.Create +
                        EventContext->Operation.Create.FileNameOffset);
@@ -134,7 +206,7 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
 
   // DOKAN_OPEN_INFO is structure for a opened file
   // this will be freed by Close
-  openInfo = malloc(sizeof(DOKAN_OPEN_INFO));
+  openInfo = DokanPoolAlloc(&DokanInstance->OpenInfoPool);
   if (openInfo == NULL) {
     eventInfo.Status = STATUS_INSUFFICIENT_RESOURCES;
     SendEventInformation(Handle, &eventInfo, sizeof(EVENT_INFORMATION), NULL);
@@ -142,9 +214,9 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
   }
   ZeroMemory(openInfo, sizeof(DOKAN_OPEN_INFO));
   openInfo->OpenCount = 2;
-  openInfo->EventContext = EventContext;
   openInfo->DokanInstance = DokanInstance;
-  fileInfo.DokanContext = (ULONG64)openInfo;
+  DokanInitIoEvent(&ioEvent, EventContext, DokanInstance, openInfo,
+                   &fileInfo);
 
   // pass it to driver and when the same handle is used get it back
   eventInfo.Context = (ULONG64)openInfo;
@@ -203,7 +275,19 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
 
   openInfo->EventId = eventId++;
 
-  if (DokanInstance->DokanOperations->ZwCreateFile) {
+  // only plain opens fail on a missing file without side effects,
+  // SL_OPEN_TARGET_DIRECTORY looks at the parent
+  if (disposition == FILE_OPEN &&
+      !(EventContext->Flags & SL_OPEN_TARGET_DIRECTORY)) {
+    negativeLookup = TRUE;
+  }
+
+  if (negativeLookup && DokanNegativeCacheLookup(DokanInstance, fileName,
+                                                 &status, &generation)) {
+    DbgPrint("  known to be missing\n");
+    negativeLookup = FALSE;
+
+  } else if (DokanInstance->DokanOperations->ZwCreateFile) {
 
     SetIOSecurityContext(EventContext, &ioSecurityContext);
 
@@ -233,12 +317,34 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
 
     if (options & FILE_NON_DIRECTORY_FILE && options & FILE_DIRECTORY_FILE)
       status = STATUS_INVALID_PARAMETER;
-    else
+    else {
+      DokanAllowPendingRequest(&fileInfo);
       status = DokanInstance->DokanOperations->ZwCreateFile(
           fileName, &ioSecurityContext, ioSecurityContext.DesiredAccess,
           EventContext->Operation.Create.FileAttributes,
           EventContext->Operation.Create.ShareAccess, disposition, options,
           &fileInfo);
+      pendingRequest = DokanTakePendingRequest(&status);
+    }
+
+    if (pendingRequest != NULL) {
+      pendingRequest->MajorFunction = IRP_MJ_CREATE;
+      pendingRequest->DokanInstance = DokanInstance;
+      pendingRequest->OpenInfo = openInfo;
+      pendingRequest->InlineEventInfo = eventInfo;
+      pendingRequest->EventInfo = &pendingRequest->InlineEventInfo;
+      pendingRequest->EventInfoLength = sizeof(EVENT_INFORMATION);
+      pendingRequest->Disposition = disposition;
+      pendingRequest->FileName = _wcsdup(fileName);
+      if (pendingRequest->FileName == NULL && disposition != FILE_OPEN) {
+        // the caches cannot be told at completion, tell them now
+        DokanInvalidateCreatedPath(DokanInstance, fileName);
+      }
+      if (origFileName)
+        free(origFileName);
+      DokanStartPendingRequest(pendingRequest);
+      return;
+    }
 
     if (CreateSuccesStatusCheck(status, disposition)
       && !childExisted) {
@@ -248,28 +354,25 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
     status = STATUS_NOT_IMPLEMENTED;
   }
 
+  if (negativeLookup && (status == STATUS_OBJECT_NAME_NOT_FOUND ||
+                         status == STATUS_OBJECT_PATH_NOT_FOUND)) {
+    DokanNegativeCacheStore(DokanInstance, fileName, status, generation);
+  }
+
   // save the information about this access in DOKAN_OPEN_INFO
   openInfo->IsDirectory = fileInfo.IsDirectory;
   openInfo->UserContext = fileInfo.Context;
 
-  // FILE_CREATED
-  // FILE_DOES_NOT_EXIST
-  // FILE_EXISTS
-  // FILE_OPENED
-  // FILE_OVERWRITTEN
-  // FILE_SUPERSEDED
-
   DbgPrint("CreateFile status = %lx\n", status);
+  FillCreateEventInformation(&eventInfo, status, disposition,
+                             fileInfo.IsDirectory);
+
+  DokanInvalidateCreatedFile(DokanInstance, fileName, &eventInfo);
+
   if (!CreateSuccesStatusCheck(status, disposition)) {
     if (EventContext->Flags & SL_OPEN_TARGET_DIRECTORY) {
       DbgPrint("SL_OPEN_TARGET_DIRECTORY spcefied\n");
     }
-    eventInfo.Operation.Create.Information = FILE_DOES_NOT_EXIST;
-    eventInfo.Status = status;
-
-    if (status == STATUS_OBJECT_NAME_COLLISION) {
-      eventInfo.Operation.Create.Information = FILE_EXISTS;
-    }
 
     if (STATUS_ACCESS_DENIED == status &&
         DokanInstance->DokanOperations->ZwCreateFile &&
@@ -313,39 +416,14 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
         DbgPrint("Parent CreateFile failed status = %lx\n", status);
       }
     }
-
-  } else {
-
-    eventInfo.Status = STATUS_SUCCESS;
-    eventInfo.Operation.Create.Information = FILE_OPENED;
-
-    if (disposition == FILE_CREATE || disposition == FILE_OPEN_IF ||
-        disposition == FILE_OVERWRITE_IF || disposition == FILE_SUPERSEDE) {
-      eventInfo.Operation.Create.Information = FILE_CREATED;
-
-      if (status == STATUS_OBJECT_NAME_COLLISION) {
-        if (disposition == FILE_OPEN_IF) {
-          eventInfo.Operation.Create.Information = FILE_OPENED;
-        } else if (disposition == FILE_OVERWRITE_IF) {
-          eventInfo.Operation.Create.Information = FILE_OVERWRITTEN;
-        } else if (disposition == FILE_SUPERSEDE) {
-          eventInfo.Operation.Create.Information = FILE_SUPERSEDED;
-        }
-      }
-    }
-
-    if (disposition == FILE_OVERWRITE)
-      eventInfo.Operation.Create.Information = FILE_OVERWRITTEN;
-
-    if (fileInfo.IsDirectory)
-      eventInfo.Operation.Create.Flags |= DOKAN_FILE_DIRECTORY;
   }
 
   if (origFileName)
     free(origFileName);
 
   if (!NT_SUCCESS(eventInfo.Status)) {
-    free((PDOKAN_OPEN_INFO)(UINT_PTR)eventInfo.Context);
+    DokanPoolFree(&DokanInstance->OpenInfoPool,
+                  (PDOKAN_OPEN_INFO)(UINT_PTR)eventInfo.Context);
     eventInfo.Context = 0;
   }
 
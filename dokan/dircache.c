@@ -0,0 +1,145 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// A cached listing: the packed DOKAN_DIR_ENTRY records of the directory as
+// returned by FindFiles follow the header.
+typedef struct _DOKAN_DIR_CACHE_ENTRY {
+  DOKAN_PATH_CACHE_ENTRY Header;
+  /** Number of records */
+  ULONG Count;
+} DOKAN_DIR_CACHE_ENTRY, *PDOKAN_DIR_CACHE_ENTRY;
+
+#define CACHE_ENTRY_RECORDS(Entry) ((PCHAR)((Entry) + 1))
+
+typedef struct _DOKAN_DIR_CACHE_COPY {
+  PDOKAN_DIR_LIST DirList;
+  PDOKAN_INSTANCE DokanInstance;
+  /** Whether a listing was found, even if it could not be copied */
+  BOOL Found;
+} DOKAN_DIR_CACHE_COPY, *PDOKAN_DIR_CACHE_COPY;
+
+static BOOL DirCacheCopy(PDOKAN_PATH_CACHE_ENTRY Entry, PVOID Context) {
+  PDOKAN_DIR_CACHE_ENTRY entry = (PDOKAN_DIR_CACHE_ENTRY)Entry;
+  PDOKAN_DIR_CACHE_COPY copy = Context;
+  PCHAR record = CACHE_ENTRY_RECORDS(entry);
+  ULONG i;
+
+  copy->Found = TRUE;
+  for (i = 0; i < entry->Count; ++i) {
+    PDOKAN_DIR_ENTRY src = (PDOKAN_DIR_ENTRY)record;
+    ULONG size = DOKAN_DIR_ENTRY_SIZE(src->FileNameLength);
+    PDOKAN_DIR_ENTRY dst = DokanDirListAllocEntry(
+        copy->DirList, src->FileNameLength, copy->DokanInstance);
+    if (dst == NULL) {
+      return FALSE;
+    }
+    RtlCopyMemory(dst, src, size);
+    DokanDirListInsert(copy->DirList, dst, TRUE);
+    record += size;
+  }
+  return TRUE;
+}
+
+// copy the cached listing of Path into DirList, which must be empty.
+// On a miss, Generation receives the value to give to DokanDirCacheStore.
+BOOL DokanDirCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                         PDOKAN_DIR_LIST DirList, PULONG64 Generation) {
+  DOKAN_DIR_CACHE_COPY copy;
+
+  copy.DirList = DirList;
+  copy.DokanInstance = DokanInstance;
+  copy.Found = FALSE;
+  if (DokanPathCacheLookup(&DokanInstance->DirCache, Path, 0, DirCacheCopy,
+                           &copy, Generation)) {
+    return TRUE;
+  }
+  // the copy may have failed half way
+  if (copy.Found) {
+    ClearFindData(DirList, DokanInstance);
+  }
+  return FALSE;
+}
+
+// keep a copy of the complete, unfiltered listing of Path
+VOID DokanDirCacheStore(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                        PDOKAN_DIR_LIST DirList, ULONG64 Generation) {
+  PDOKAN_PATH_CACHE cache = &DokanInstance->DirCache;
+  PDOKAN_DIR_CACHE_ENTRY entry;
+  ULONG64 size = sizeof(DOKAN_DIR_CACHE_ENTRY);
+  PCHAR record;
+  ULONG i;
+
+  if (cache->Timeout == 0) {
+    return;
+  }
+
+  for (i = 0; i < DirList->Count; ++i) {
+    size += DOKAN_DIR_ENTRY_SIZE(DirList->Entries[i]->FileNameLength);
+  }
+  if (size > cache->MaxSize / 2) {
+    DbgPrint("Dokan: listing of %I64d bytes not cached\n", size);
+    return;
+  }
+
+  entry = (PDOKAN_DIR_CACHE_ENTRY)DokanPathCacheAllocEntry(Path, size, 0);
+  if (entry == NULL) {
+    return;
+  }
+  entry->Count = DirList->Count;
+  record = CACHE_ENTRY_RECORDS(entry);
+  for (i = 0; i < DirList->Count; ++i) {
+    ULONG recordSize =
+        DOKAN_DIR_ENTRY_SIZE(DirList->Entries[i]->FileNameLength);
+    RtlCopyMemory(record, DirList->Entries[i], recordSize);
+    record += recordSize;
+  }
+  DokanPathCacheInsert(cache, &entry->Header, Generation);
+}
+
+// drop the listings that a change of Path makes stale: the one of its parent
+// directory, its own and, when Subtree is TRUE, the ones below it
+VOID DokanDirCacheInvalidate(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                             BOOL Subtree) {
+  ULONG pathLength;
+  ULONG parentLength;
+
+  if (Path == NULL) {
+    return;
+  }
+
+  pathLength = DokanPathCacheKeyLength(Path);
+  for (parentLength = pathLength; parentLength > 0; --parentLength) {
+    if (Path[parentLength - 1] == L'\\')
+      break;
+  }
+  // keep the backslash only for the root
+  if (parentLength > 1)
+    parentLength--;
+
+  DokanPathCacheInvalidate(&DokanInstance->DirCache, Path, pathLength,
+                           Subtree);
+  if (parentLength > 0 && parentLength < pathLength) {
+    DokanPathCacheInvalidate(&DokanInstance->DirCache, Path, parentLength,
+                             FALSE);
+  }
+}
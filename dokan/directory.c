@@ -27,378 +27,349 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 typedef ULONG ULONG_PTR;
 #endif
 
-/**
-* \struct DOKAN_FIND_DATA
-* \brief Dokan find file list
-*
-* Used by FindFiles
-*/
-typedef struct _DOKAN_FIND_DATA {
-  /**
-  * File data information link
-  */
-  WIN32_FIND_DATAW FindData;
-  /**
-  * Current list entry informations
-  */
-  LIST_ENTRY ListEntry;
-} DOKAN_FIND_DATA, *PDOKAN_FIND_DATA;
-
-VOID DokanFillDirInfo(PFILE_DIRECTORY_INFORMATION Buffer,
-                      PWIN32_FIND_DATAW FindData, ULONG Index,
-                      PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
-
-  Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
-  Buffer->FileNameLength = nameBytes;
-
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
-  ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
-
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
-
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
-
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
-
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
-
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
-}
-
-VOID DokanFillFullDirInfo(PFILE_FULL_DIR_INFORMATION Buffer,
-                          PWIN32_FIND_DATAW FindData, ULONG Index,
-                          PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
-
-  Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
-  Buffer->FileNameLength = nameBytes;
-
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
-  ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
-
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
-
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
-
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
-
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
-
-  Buffer->EaSize = 0;
-
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
-}
-
-VOID DokanFillIdFullDirInfo(PFILE_ID_FULL_DIR_INFORMATION Buffer,
-                            PWIN32_FIND_DATAW FindData, ULONG Index,
-                            PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
-
-  Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
-  Buffer->FileNameLength = nameBytes;
-
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
-  ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
-
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
-
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
-
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
-
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
-
-  Buffer->EaSize = 0;
-  Buffer->FileId.QuadPart = 0;
-
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
-}
-
-VOID DokanFillIdBothDirInfo(PFILE_ID_BOTH_DIR_INFORMATION Buffer,
-                            PWIN32_FIND_DATAW FindData, ULONG Index,
-                            PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
-
-  Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
-  Buffer->FileNameLength = nameBytes;
-  Buffer->ShortNameLength = 0;
-
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
-  ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
-
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
-
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
-
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
-
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
-
-  Buffer->EaSize = 0;
-  Buffer->FileId.QuadPart = 0;
-
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
-}
-
-VOID DokanFillBothDirInfo(PFILE_BOTH_DIR_INFORMATION Buffer,
-                          PWIN32_FIND_DATAW FindData, ULONG Index,
-                          PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
-
-  Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
-  Buffer->FileNameLength = nameBytes;
-  Buffer->ShortNameLength = 0;
-
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
-  ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
-
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
-
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
-
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
-
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
-
-  Buffer->EaSize = 0;
+// where the fields of a FILE_*_INFORMATION directory record are, so that a
+// single encoder can write any class supported by DispatchDirectoryInformation
+typedef struct _DOKAN_DIR_INFO_LAYOUT {
+  ULONG FileInformationClass;
+  /** Size of the record before the name is added */
+  USHORT Size;
+  USHORT FileNameLengthOffset;
+  USHORT FileNameOffset;
+  /** Offset of FileId, 0 when the record has none */
+  USHORT FileIdOffset;
+  /** Whether the record starts like FILE_DIRECTORY_INFORMATION */
+  BOOLEAN HasAttributes;
+} DOKAN_DIR_INFO_LAYOUT, *PDOKAN_DIR_INFO_LAYOUT;
+
+#define DIR_INFO_LAYOUT(Class, Type, FileId, HasAttributes)                    \
+  {                                                                            \
+    Class, sizeof(Type), FIELD_OFFSET(Type, FileNameLength),                   \
+        FIELD_OFFSET(Type, FileName), FileId, HasAttributes                    \
+  }
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+static const DOKAN_DIR_INFO_LAYOUT DirInfoLayouts[] = {
+    DIR_INFO_LAYOUT(FileDirectoryInformation, FILE_DIRECTORY_INFORMATION, 0,
+                    TRUE),
+    DIR_INFO_LAYOUT(FileFullDirectoryInformation, FILE_FULL_DIR_INFORMATION, 0,
+                    TRUE),
+    DIR_INFO_LAYOUT(FileIdFullDirectoryInformation,
+                    FILE_ID_FULL_DIR_INFORMATION,
+                    FIELD_OFFSET(FILE_ID_FULL_DIR_INFORMATION, FileId), TRUE),
+    DIR_INFO_LAYOUT(FileNamesInformation, FILE_NAMES_INFORMATION, 0, FALSE),
+    DIR_INFO_LAYOUT(FileBothDirectoryInformation, FILE_BOTH_DIR_INFORMATION, 0,
+                    TRUE),
+    DIR_INFO_LAYOUT(FileIdBothDirectoryInformation,
+                    FILE_ID_BOTH_DIR_INFORMATION,
+                    FIELD_OFFSET(FILE_ID_BOTH_DIR_INFORMATION, FileId), TRUE),
+};
+
+static const DOKAN_DIR_INFO_LAYOUT *
+DokanDirInfoLayout(FILE_INFORMATION_CLASS DirectoryInfo) {
+  ULONG i;
+
+  for (i = 0; i < sizeof(DirInfoLayouts) / sizeof(DirInfoLayouts[0]); ++i) {
+    if (DirInfoLayouts[i].FileInformationClass == (ULONG)DirectoryInfo) {
+      return &DirInfoLayouts[i];
+    }
+  }
+  return NULL;
 }
 
-VOID DokanFillNamesInfo(PFILE_NAMES_INFORMATION Buffer,
-                        PWIN32_FIND_DATAW FindData, ULONG Index) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+// size of the FILE_*_INFORMATION record of an entry, 8-byte aligned
+ULONG DokanDirEntrySize(FILE_INFORMATION_CLASS DirectoryInfo,
+                        ULONG NameBytes) {
+  const DOKAN_DIR_INFO_LAYOUT *layout = DokanDirInfoLayout(DirectoryInfo);
+  ULONG thisEntrySize = NameBytes;
 
-  Buffer->FileIndex = Index;
-  Buffer->FileNameLength = nameBytes;
+  if (layout != NULL) {
+    thisEntrySize += layout->Size;
+  }
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  // Must be align on a 8-byte boundary.
+  return QuadAlign(thisEntrySize);
 }
 
+// write the record of Entry for the class DirectoryInfo to Buffer. Classes
+// that are not in DirInfoLayouts are rejected by DispatchDirectoryInformation
 ULONG
 DokanFillDirectoryInformation(FILE_INFORMATION_CLASS DirectoryInfo,
                               PVOID Buffer, PULONG LengthRemaining,
-                              PWIN32_FIND_DATAW FindData, ULONG Index,
+                              PDOKAN_DIR_ENTRY Entry, ULONG Index,
                               PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes;
+  const DOKAN_DIR_INFO_LAYOUT *layout = DokanDirInfoLayout(DirectoryInfo);
+  PCHAR record = (PCHAR)Buffer;
+  ULONG nameBytes = Entry->FileNameLength;
   ULONG thisEntrySize;
 
-  nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
-
-  thisEntrySize = nameBytes;
-
-  switch (DirectoryInfo) {
-  case FileDirectoryInformation:
-    thisEntrySize += sizeof(FILE_DIRECTORY_INFORMATION);
-    break;
-  case FileFullDirectoryInformation:
-    thisEntrySize += sizeof(FILE_FULL_DIR_INFORMATION);
-    break;
-  case FileIdFullDirectoryInformation:
-    thisEntrySize += sizeof(FILE_ID_FULL_DIR_INFORMATION);
-    break;
-  case FileNamesInformation:
-    thisEntrySize += sizeof(FILE_NAMES_INFORMATION);
-    break;
-  case FileBothDirectoryInformation:
-    thisEntrySize += sizeof(FILE_BOTH_DIR_INFORMATION);
-    break;
-  case FileIdBothDirectoryInformation:
-    thisEntrySize += sizeof(FILE_ID_BOTH_DIR_INFORMATION);
-    break;
-  default:
-    break;
+  if (layout == NULL) {
+    return 0;
   }
 
-  // Must be align on a 8-byte boundary.
-  thisEntrySize = QuadAlign(thisEntrySize);
-
   // no more memory, don't fill any more
+  thisEntrySize = QuadAlign(layout->Size + nameBytes);
   if (*LengthRemaining < thisEntrySize) {
     DbgPrint("  no memory\n");
     return 0;
   }
 
+  // EaSize and the short name stay empty
   RtlZeroMemory(Buffer, thisEntrySize);
 
-  switch (DirectoryInfo) {
-  case FileDirectoryInformation:
-    DokanFillDirInfo(Buffer, FindData, Index, DokanInstance);
-    break;
-  case FileFullDirectoryInformation:
-    DokanFillFullDirInfo(Buffer, FindData, Index, DokanInstance);
-    break;
-  case FileIdFullDirectoryInformation:
-    DokanFillIdFullDirInfo(Buffer, FindData, Index, DokanInstance);
-    break;
-  case FileNamesInformation:
-    DokanFillNamesInfo(Buffer, FindData, Index);
-    break;
-  case FileBothDirectoryInformation:
-    DokanFillBothDirInfo(Buffer, FindData, Index, DokanInstance);
-    break;
-  case FileIdBothDirectoryInformation:
-    DokanFillIdBothDirInfo(Buffer, FindData, Index, DokanInstance);
-    break;
-  default:
-    break;
+  ((PFILE_NAMES_INFORMATION)Buffer)->FileIndex = Index;
+  *(PULONG)(record + layout->FileNameLengthOffset) = nameBytes;
+
+  if (layout->HasAttributes) {
+    PFILE_DIRECTORY_INFORMATION dirInfo = (PFILE_DIRECTORY_INFORMATION)Buffer;
+
+    dirInfo->CreationTime = Entry->Info.CreationTime;
+    dirInfo->LastAccessTime = Entry->Info.LastAccessTime;
+    dirInfo->LastWriteTime = Entry->Info.LastWriteTime;
+    dirInfo->ChangeTime = Entry->Info.ChangeTime;
+    dirInfo->EndOfFile = Entry->Info.FileSize;
+    dirInfo->AllocationSize = Entry->Info.FileSize;
+    ALIGN_ALLOCATION_SIZE(&dirInfo->AllocationSize,
+                          DokanInstance->DokanOptions);
+    dirInfo->FileAttributes = Entry->Info.FileAttributes;
   }
 
+  if (layout->FileIdOffset != 0) {
+    ((PLARGE_INTEGER)(record + layout->FileIdOffset))->QuadPart =
+        Entry->Info.FileId;
+  }
+
+  RtlCopyMemory(record + layout->FileNameOffset, Entry->FileName, nameBytes);
+
   *LengthRemaining -= thisEntrySize;
 
   return thisEntrySize;
 }
 
-int DokanFillFileDataEx(PWIN32_FIND_DATAW FindData, PDOKAN_FILE_INFO FileInfo,
+// reserve a packed entry for a name of NameBytes in the chunks of the
+// listing, and room for it in Entries
+PDOKAN_DIR_ENTRY DokanDirListAllocEntry(PDOKAN_DIR_LIST DirList,
+                                        ULONG NameBytes,
+                                        PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_DIR_CHUNK chunk = DirList->Chunks;
+  PDOKAN_DIR_ENTRY entry;
+  ULONG entrySize = DOKAN_DIR_ENTRY_SIZE(NameBytes);
+
+  if (DirList->Count == DirList->Capacity) {
+    ULONG capacity = DirList->Capacity ? DirList->Capacity * 2
+                                       : DOKAN_DIR_LIST_INITIAL_CAPACITY;
+    PDOKAN_DIR_ENTRY *entries =
+        realloc(DirList->Entries, capacity * sizeof(PDOKAN_DIR_ENTRY));
+    if (entries == NULL) {
+      return NULL;
+    }
+    DirList->Entries = entries;
+    DirList->Capacity = capacity;
+  }
+
+  if (chunk == NULL || chunk->Used + entrySize > DOKAN_DIR_CHUNK_DATA_SIZE) {
+    chunk = (PDOKAN_DIR_CHUNK)DokanPoolAlloc(&DokanInstance->DirChunkPool);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    chunk->Next = DirList->Chunks;
+    chunk->Used = 0;
+    DirList->Chunks = chunk;
+  }
+
+  entry = (PDOKAN_DIR_ENTRY)((PCHAR)(chunk + 1) + chunk->Used);
+  chunk->Used += entrySize;
+  entry->FileNameLength = NameBytes;
+  entry->FileName[NameBytes / sizeof(WCHAR)] = L'\0';
+  return entry;
+}
+
+// add an entry returned by DokanDirListAllocEntry to the listing
+VOID DokanDirListInsert(PDOKAN_DIR_LIST DirList, PDOKAN_DIR_ENTRY Entry,
                         BOOLEAN InsertTail) {
-  PLIST_ENTRY listHead =
-      ((PDOKAN_OPEN_INFO)(UINT_PTR)FileInfo->DokanContext)->DirListHead;
-  PDOKAN_FIND_DATA findData;
+  if (InsertTail) {
+    DirList->Entries[DirList->Count] = Entry;
+  } else {
+    MoveMemory(&DirList->Entries[1], &DirList->Entries[0],
+               DirList->Count * sizeof(PDOKAN_DIR_ENTRY));
+    DirList->Entries[0] = Entry;
+  }
+  DirList->Count++;
+}
+
+// copy an entry given by the file system to the listing of the open
+static int DokanDirListAdd(PDOKAN_OPEN_INFO OpenInfo, LPCWSTR FileName,
+                           ULONG NameBytes, PDOKAN_FIND_INFO FindInfo,
+                           BOOLEAN InsertTail) {
+  PDOKAN_DIR_LIST dirList = OpenInfo->DirList;
+  PDOKAN_DIR_ENTRY entry;
 
-  findData = (PDOKAN_FIND_DATA)malloc(sizeof(DOKAN_FIND_DATA));
-  if (findData == NULL) {
+  entry = DokanDirListAllocEntry(dirList, NameBytes, OpenInfo->DokanInstance);
+  if (entry == NULL) {
     return 0;
   }
-  ZeroMemory(findData, sizeof(DOKAN_FIND_DATA));
-  InitializeListHead(&findData->ListEntry);
 
-  findData->FindData = *FindData;
+  entry->Info = *FindInfo;
+  if (entry->Info.ChangeTime.QuadPart == 0) {
+    entry->Info.ChangeTime = entry->Info.LastWriteTime;
+  }
+  RtlCopyMemory(entry->FileName, FileName, NameBytes);
+
+  DokanDirListInsert(dirList, entry, InsertTail);
 
-  if (InsertTail)
-    InsertTailList(listHead, &findData->ListEntry);
-  else
-    InsertHeadList(listHead, &findData->ListEntry);
+  // a resumable enumeration stops once the requested page is full
+  if (dirList->Streaming && InsertTail) {
+    if (dirList->Count > dirList->PageStart) {
+      dirList->PageBytes += DokanDirEntrySize(dirList->FileInformationClass,
+                                              entry->FileNameLength);
+    }
+    if (dirList->PageBytes >= dirList->PageBudget) {
+      return 1;
+    }
+  }
   return 0;
 }
 
 int WINAPI DokanFillFileData(PWIN32_FIND_DATAW FindData,
                              PDOKAN_FILE_INFO FileInfo) {
-  return DokanFillFileDataEx(FindData, FileInfo, TRUE);
-}
-
-VOID ClearFindData(PLIST_ENTRY ListHead) {
-  // free all list entries
-  while (!IsListEmpty(ListHead)) {
-    PLIST_ENTRY entry = RemoveHeadList(ListHead);
-    PDOKAN_FIND_DATA find =
-        CONTAINING_RECORD(entry, DOKAN_FIND_DATA, ListEntry);
-    free(find);
-  }
+  PDOKAN_OPEN_INFO openInfo = DokanFileInfoOpenInfo(FileInfo);
+  DOKAN_FIND_INFO findInfo;
+  ULONG nameBytes = (ULONG)wcsnlen(FindData->cFileName, MAX_PATH - 1) *
+                    sizeof(WCHAR);
+
+  findInfo.CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
+  findInfo.CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  findInfo.LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
+  findInfo.LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  findInfo.LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
+  findInfo.LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  findInfo.ChangeTime = findInfo.LastWriteTime;
+  findInfo.FileSize.HighPart = FindData->nFileSizeHigh;
+  findInfo.FileSize.LowPart = FindData->nFileSizeLow;
+  findInfo.FileId = 0;
+  findInfo.FileAttributes = FindData->dwFileAttributes;
+
+  return DokanDirListAdd(openInfo, FindData->cFileName, nameBytes, &findInfo,
+                         TRUE);
 }
 
-// add entry which matches the pattern specifed in EventContext
-// to the buffer specifed in EventInfo
-//
-LONG MatchFiles(PEVENT_CONTEXT EventContext, PEVENT_INFORMATION EventInfo,
-                PLIST_ENTRY FindDataList, BOOLEAN PatternCheck,
-                PDOKAN_INSTANCE DokanInstance) {
-  PLIST_ENTRY thisEntry, listHead, nextEntry;
-
-  ULONG lengthRemaining = EventInfo->BufferLength;
-  PVOID currentBuffer = EventInfo->Buffer;
-  PVOID lastBuffer = currentBuffer;
-  ULONG index = 0;
-
-  PWCHAR pattern = NULL;
+int DOKANAPI DokanFillFindInfo(LPCWSTR FileName, ULONG FileNameLength,
+                               PDOKAN_FIND_INFO FindInfo,
+                               PDOKAN_FILE_INFO DokanFileInfo) {
+  PDOKAN_OPEN_INFO openInfo;
 
-  // search patten is specified
-  if (PatternCheck &&
-      EventContext->Operation.Directory.SearchPatternLength != 0) {
-    pattern = (PWCHAR)(
-        (SIZE_T)&EventContext->Operation.Directory.SearchPatternBase[0] +
-        (SIZE_T)EventContext->Operation.Directory.SearchPatternOffset);
+  if (FileName == NULL || FindInfo == NULL || DokanFileInfo == NULL ||
+      FileNameLength == 0 || FileNameLength > MAXUSHORT) {
+    return 0;
   }
 
-  listHead = FindDataList;
-
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
+  // only valid while a FindFiles callback runs
+  openInfo = DokanFileInfoOpenInfo(DokanFileInfo);
+  if (openInfo == NULL || openInfo->DirList == NULL) {
+    return 0;
+  }
 
-    PDOKAN_FIND_DATA find;
-    nextEntry = thisEntry->Flink;
+  return DokanDirListAdd(openInfo, FileName, FileNameLength * sizeof(WCHAR),
+                         FindInfo, TRUE);
+}
 
-    find = CONTAINING_RECORD(thisEntry, DOKAN_FIND_DATA, ListEntry);
+VOID ClearFindData(PDOKAN_DIR_LIST DirList, PDOKAN_INSTANCE DokanInstance) {
+  // entries live in the chunks, give them all back at once but keep the
+  // array for the next listing
+  while (DirList->Chunks != NULL) {
+    PDOKAN_DIR_CHUNK chunk = DirList->Chunks;
+    DirList->Chunks = chunk->Next;
+    DokanPoolFree(&DokanInstance->DirChunkPool, chunk);
+  }
+  DirList->Count = 0;
+  DirList->Filled = FALSE;
+  DirList->Streaming = FALSE;
+  DirList->ResumeCookie = 0;
+  // a restarted scan may come with another pattern
+  if (DirList->Matcher != NULL) {
+    DokanFreeNameMatcher(DirList->Matcher);
+    DirList->Matcher = NULL;
+  }
+}
 
-    DbgPrintW(L"FileMatch? : %s (%s,%d,%d)\n", find->FindData.cFileName,
-              (pattern ? pattern : L"null"),
-              EventContext->Operation.Directory.FileIndex, index);
+// drop the entries that do not match the search pattern, once per listing,
+// so that FileIndex can be used as an index into the listing
+BOOL FilterFindData(PDOKAN_DIR_LIST DirList, LPCWSTR Pattern) {
+  ULONG i;
+  ULONG count = 0;
+
+  // compiled once per listing, ClearFindData releases it
+  if (DirList->Matcher == NULL) {
+    // pattern match is ignore cases
+    DirList->Matcher = DokanCompileNameExpression(Pattern, TRUE);
+    if (DirList->Matcher == NULL) {
+      return FALSE;
+    }
+  }
 
-    // pattern is not specified or pattern match is ignore cases
-    if (!pattern ||
-        DokanIsNameInExpression(pattern, find->FindData.cFileName, TRUE)) {
+  for (i = 0; i < DirList->Count; ++i) {
+    PDOKAN_DIR_ENTRY entry = DirList->Entries[i];
 
-      if (EventContext->Operation.Directory.FileIndex <= index) {
-        // index+1 is very important, should use next entry index
-        ULONG entrySize = DokanFillDirectoryInformation(
-            EventContext->Operation.Directory.FileInformationClass,
-            currentBuffer, &lengthRemaining, &find->FindData, index + 1,
-            DokanInstance);
-        // buffer is full
-        if (entrySize == 0)
-          break;
+    DbgPrintW(L"FileMatch? : %s (%s)\n", entry->FileName, Pattern);
 
-        // pointer of the current last entry
-        lastBuffer = currentBuffer;
+    // the space of dropped entries is released with their chunk
+    if (DokanMatchName(DirList->Matcher, entry->FileName,
+                       entry->FileNameLength / sizeof(WCHAR))) {
+      DirList->Entries[count++] = entry;
+    }
+  }
+  DirList->Count = count;
+  return TRUE;
+}
 
-        // end if needs to return single entry
-        if (EventContext->Flags & SL_RETURN_SINGLE_ENTRY) {
-          DbgPrint("  =>return single entry\n");
-          index++;
-          break;
-        }
+// add entries of the listing from FileIndex specifed in EventContext
+// to the buffer specifed in EventInfo
+//
+LONG MatchFiles(PEVENT_CONTEXT EventContext, PEVENT_INFORMATION EventInfo,
+                PDOKAN_DIR_LIST DirList, PDOKAN_INSTANCE DokanInstance) {
+  ULONG lengthRemaining = EventInfo->BufferLength;
+  PVOID currentBuffer = EventInfo->Buffer;
+  PVOID lastBuffer = currentBuffer;
+  ULONG index;
+  BOOL assignFileId =
+      DokanInstance->FileIdMap.Enabled &&
+      (EventContext->Operation.Directory.FileInformationClass ==
+           FileIdFullDirectoryInformation ||
+       EventContext->Operation.Directory.FileInformationClass ==
+           FileIdBothDirectoryInformation);
+
+  for (index = EventContext->Operation.Directory.FileIndex;
+       index < DirList->Count; ++index) {
+    PDOKAN_DIR_ENTRY entry = DirList->Entries[index];
+
+    // the ID is kept in the listing for the next pages
+    if (assignFileId && entry->Info.FileId == 0) {
+      entry->Info.FileId = DokanGetFileId(
+          DokanInstance, EventContext->Operation.Directory.DirectoryName,
+          entry->FileName, entry->FileNameLength / sizeof(WCHAR));
+    }
 
-        DbgPrint("  =>return\n");
+    // index+1 is very important, should use next entry index
+    ULONG entrySize = DokanFillDirectoryInformation(
+        EventContext->Operation.Directory.FileInformationClass, currentBuffer,
+        &lengthRemaining, entry, index + 1, DokanInstance);
+    // buffer is full
+    if (entrySize == 0)
+      break;
 
-        // the offset of next entry
-        ((PFILE_BOTH_DIR_INFORMATION)currentBuffer)->NextEntryOffset =
-            entrySize;
+    // pointer of the current last entry
+    lastBuffer = currentBuffer;
 
-        // next buffer position
-        currentBuffer = (PCHAR)currentBuffer + entrySize;
-      }
+    // end if needs to return single entry
+    if (EventContext->Flags & SL_RETURN_SINGLE_ENTRY) {
+      DbgPrint("  =>return single entry\n");
       index++;
+      break;
     }
+
+    // the offset of next entry
+    ((PFILE_BOTH_DIR_INFORMATION)currentBuffer)->NextEntryOffset = entrySize;
+
+    // next buffer position
+    currentBuffer = (PCHAR)currentBuffer + entrySize;
   }
 
   // Since next of the last entry doesn't exist, clear next offset
@@ -410,7 +381,7 @@ LONG MatchFiles(PEVENT_CONTEXT EventContext, PEVENT_INFORMATION EventInfo,
 
   if (index <= EventContext->Operation.Directory.FileIndex) {
 
-    if (thisEntry != listHead)
+    if (index < DirList->Count)
       return -2; // BUFFER_OVERFLOW
 
     return -1; // NO_MORE_FILES
@@ -420,13 +391,14 @@ LONG MatchFiles(PEVENT_CONTEXT EventContext, PEVENT_INFORMATION EventInfo,
 }
 
 VOID AddMissingCurrentAndParentFolder(PEVENT_CONTEXT EventContext,
-                                      PLIST_ENTRY FindDataList,
+                                      PDOKAN_DIR_LIST DirList,
                                       PDOKAN_FILE_INFO fileInfo) {
-  PLIST_ENTRY thisEntry, listHead, nextEntry;
   PWCHAR pattern = NULL;
   BOOLEAN currentFolder = FALSE, parentFolder = FALSE;
-  WIN32_FIND_DATAW findData;
+  PDOKAN_OPEN_INFO openInfo = DokanFileInfoOpenInfo(fileInfo);
+  DOKAN_FIND_INFO findInfo;
   FILETIME systime;
+  ULONG i;
 
   if (EventContext->Operation.Directory.SearchPatternLength != 0) {
     pattern = (PWCHAR)(
@@ -438,59 +410,98 @@ VOID AddMissingCurrentAndParentFolder(PEVENT_CONTEXT EventContext,
       (pattern != NULL && wcscmp(pattern, L"*") != 0))
     return;
 
-  listHead = FindDataList;
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
-
-    PDOKAN_FIND_DATA find;
-    nextEntry = thisEntry->Flink;
-
-    find = CONTAINING_RECORD(thisEntry, DOKAN_FIND_DATA, ListEntry);
+  for (i = 0; i < DirList->Count; ++i) {
+    PDOKAN_DIR_ENTRY entry = DirList->Entries[i];
 
-    if (wcscmp(find->FindData.cFileName, L".") == 0)
+    if (wcscmp(entry->FileName, L".") == 0)
       currentFolder = TRUE;
-    if (wcscmp(find->FindData.cFileName, L"..") == 0)
+    if (wcscmp(entry->FileName, L"..") == 0)
       parentFolder = TRUE;
     if (currentFolder == TRUE && parentFolder == TRUE)
       return; // folders are already there
   }
 
   GetSystemTimeAsFileTime(&systime);
-  ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
-  findData.dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
-  findData.ftCreationTime = systime;
-  findData.ftLastAccessTime = systime;
-  findData.ftLastWriteTime = systime;
+  ZeroMemory(&findInfo, sizeof(DOKAN_FIND_INFO));
+  findInfo.FileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+  findInfo.CreationTime.LowPart = systime.dwLowDateTime;
+  findInfo.CreationTime.HighPart = systime.dwHighDateTime;
+  findInfo.LastAccessTime = findInfo.CreationTime;
+  findInfo.LastWriteTime = findInfo.CreationTime;
   // Folders times should be the real current and parent folder times...
   if (!parentFolder) {
-    findData.cFileName[0] = '.';
-    findData.cFileName[1] = '.';
-    DokanFillFileDataEx(&findData, fileInfo, FALSE);
+    DokanDirListAdd(openInfo, L"..", 2 * sizeof(WCHAR), &findInfo, FALSE);
   }
 
   if (!currentFolder) {
-    findData.cFileName[0] = '.';
-    findData.cFileName[1] = '\0';
-    DokanFillFileDataEx(&findData, fileInfo, FALSE);
+    DokanDirListAdd(openInfo, L".", sizeof(WCHAR), &findInfo, FALSE);
   }
 }
 
+// pull entries from FindFilesResumable until the page that starts at the
+// FileIndex of the query is full or the directory is exhausted
+NTSTATUS PullFindData(PEVENT_CONTEXT EventContext, PDOKAN_DIR_LIST DirList,
+                      LPCWSTR Pattern, PDOKAN_FILE_INFO FileInfo,
+                      PDOKAN_INSTANCE DokanInstance) {
+  NTSTATUS status = STATUS_SUCCESS;
+  ULONG i;
+
+  DirList->Streaming = TRUE;
+  DirList->FileInformationClass =
+      EventContext->Operation.Directory.FileInformationClass;
+  DirList->PageStart = EventContext->Operation.Directory.FileIndex;
+  DirList->PageBudget = (EventContext->Flags & SL_RETURN_SINGLE_ENTRY)
+                            ? 1
+                            : EventContext->Operation.Directory.BufferLength;
+  DirList->PageBytes = 0;
+  for (i = DirList->PageStart; i < DirList->Count; ++i) {
+    PDOKAN_DIR_ENTRY entry = DirList->Entries[i];
+    DirList->PageBytes += DokanDirEntrySize(DirList->FileInformationClass,
+                                            entry->FileNameLength);
+  }
+
+  while (DirList->PageBytes < DirList->PageBudget) {
+    ULONG count = DirList->Count;
+
+    status = DokanInstance->DokanOperations->FindFilesResumable(
+        EventContext->Operation.Directory.DirectoryName, Pattern,
+        DokanFillFileData, &DirList->ResumeCookie, FileInfo);
+    if (status != STATUS_SUCCESS) {
+      break;
+    }
+
+    // a cookie of 0 ends the enumeration, so does a call without progress
+    if (DirList->ResumeCookie == 0 || DirList->Count == count) {
+      DbgPrint("  FindFilesResumable done, %d entries\n", DirList->Count);
+      DirList->Streaming = FALSE;
+      DirList->Filled = TRUE;
+      break;
+    }
+  }
+  return status;
+}
+
 VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
                                   PDOKAN_INSTANCE DokanInstance) {
   PEVENT_INFORMATION eventInfo;
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   PDOKAN_OPEN_INFO openInfo;
   NTSTATUS status = STATUS_SUCCESS;
   ULONG fileInfoClass = EventContext->Operation.Directory.FileInformationClass;
   ULONG sizeOfEventInfo = sizeof(EVENT_INFORMATION) - 8 +
                           EventContext->Operation.Directory.BufferLength;
+  PDOKAN_DIR_LIST dirList;
+  PWCHAR pattern = NULL;
 
   BOOLEAN patternCheck = TRUE;
+  BOOLEAN cacheable = FALSE;
+  ULONG64 generation = 0;
 
   CheckFileName(EventContext->Operation.Directory.DirectoryName);
 
   eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+                             &fileInfo, &ioEvent, &openInfo);
 
   // check whether this is handled FileInfoClass
   if (fileInfoClass != FileDirectoryInformation &&
@@ -506,7 +517,7 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
     eventInfo->BufferLength = 0;
     eventInfo->Status = STATUS_NOT_IMPLEMENTED;
     SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
-    free(eventInfo);
+    DokanArenaFree(eventInfo);
     return;
   }
 
@@ -514,58 +525,109 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   // this buffer length is fixed in MatchFiles funciton
   eventInfo->BufferLength = EventContext->Operation.Directory.BufferLength;
 
-  if (openInfo->DirListHead == NULL) {
-    openInfo->DirListHead = malloc(sizeof(LIST_ENTRY));
-    if (openInfo->DirListHead != NULL) {
-      InitializeListHead(openInfo->DirListHead);
-    } else {
+  if (openInfo->DirList == NULL) {
+    openInfo->DirList = calloc(1, sizeof(DOKAN_DIR_LIST));
+    if (openInfo->DirList == NULL) {
       eventInfo->BufferLength = 0;
       eventInfo->Status = STATUS_NO_MEMORY;
       SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
-      free(eventInfo);
+      DokanArenaFree(eventInfo);
       return;
     }
   }
+  dirList = openInfo->DirList;
 
   if (EventContext->Operation.Directory.FileIndex == 0) {
-    ClearFindData(openInfo->DirListHead);
+    ClearFindData(dirList, DokanInstance);
   }
 
-  if (IsListEmpty(openInfo->DirListHead)) {
+  // search pattern is specified
+  if (EventContext->Operation.Directory.SearchPatternLength != 0) {
+    pattern = (PWCHAR)(
+        (SIZE_T)&EventContext->Operation.Directory.SearchPatternBase[0] +
+        (SIZE_T)EventContext->Operation.Directory.SearchPatternOffset);
+  }
 
-    DbgPrint("###FindFiles %04d\n", openInfo->EventId);
+  if (dirList->Streaming) {
+    // continue the enumeration where the previous page stopped
+    status = PullFindData(EventContext, dirList, pattern ? pattern : L"*",
+                          &fileInfo, DokanInstance);
 
-    // if user defined FindFilesWithPattern
-    if (DokanInstance->DokanOperations->FindFilesWithPattern) {
-      LPCWSTR pattern = L"*";
-
-      // if search pattern is specified
-      if (EventContext->Operation.Directory.SearchPatternLength != 0) {
-        pattern = (PWCHAR)(
-            (SIZE_T)&EventContext->Operation.Directory.SearchPatternBase[0] +
-            (SIZE_T)EventContext->Operation.Directory.SearchPatternOffset);
-      }
+  } else if (!dirList->Filled) {
 
-      patternCheck = FALSE; // do not recheck pattern later in MatchFiles
+    DbgPrint("###FindFiles %04d\n", openInfo->EventId);
 
-      status = DokanInstance->DokanOperations->FindFilesWithPattern(
-          EventContext->Operation.Directory.DirectoryName, pattern,
-          DokanFillFileData, &fileInfo);
+    // discard what a failed listing may have left
+    ClearFindData(dirList, DokanInstance);
+
+    if (DokanDirCacheLookup(DokanInstance,
+                            EventContext->Operation.Directory.DirectoryName,
+                            dirList, &generation)) {
+      DbgPrint("  listing found in cache\n");
+      status = STATUS_SUCCESS;
+      patternCheck = TRUE;
+
+    // if user defined FindFilesResumable, only fill the first page
+    } else if (DOKAN_OPERATIONS_HAS(DokanInstance->DokanOptions,
+                                    FindFilesResumable) &&
+               DokanInstance->DokanOperations->FindFilesResumable) {
+
+      status = PullFindData(EventContext, dirList, pattern ? pattern : L"*",
+                            &fileInfo, DokanInstance);
+      if (status == STATUS_SUCCESS) {
+        // "." and ".." are only looked for in the entries pulled so far,
+        // later entries would be shifted after being returned
+        AddMissingCurrentAndParentFolder(EventContext, dirList, &fileInfo);
+      } else if (status == STATUS_NOT_IMPLEMENTED) {
+        ClearFindData(dirList, DokanInstance);
+      }
 
     } else {
       status = STATUS_NOT_IMPLEMENTED;
     }
 
+    // if user defined FindFilesWithPattern
+    if (status == STATUS_NOT_IMPLEMENTED &&
+        DokanInstance->DokanOperations->FindFilesWithPattern) {
+
+      patternCheck = FALSE; // do not recheck pattern later
+      // only a listing made for "*" is complete enough to be reused
+      cacheable = pattern == NULL || wcscmp(pattern, L"*") == 0;
+
+      status = DokanInstance->DokanOperations->FindFilesWithPattern(
+          EventContext->Operation.Directory.DirectoryName,
+          pattern ? pattern : L"*", DokanFillFileData, &fileInfo);
+    }
+
     if (status == STATUS_NOT_IMPLEMENTED &&
         DokanInstance->DokanOperations->FindFiles) {
 
-      patternCheck = TRUE; // do pattern check later in MachFiles
+      patternCheck = TRUE; // do pattern check later
+      cacheable = TRUE;
 
       // call FileSystem specifeid callback routine
       status = DokanInstance->DokanOperations->FindFiles(
           EventContext->Operation.Directory.DirectoryName, DokanFillFileData,
           &fileInfo);
     }
+
+    if (status == STATUS_SUCCESS && !dirList->Streaming &&
+        !dirList->Filled) {
+      if (cacheable) {
+        DokanDirCacheStore(DokanInstance,
+                           EventContext->Operation.Directory.DirectoryName,
+                           dirList, generation);
+      }
+      AddMissingCurrentAndParentFolder(EventContext, dirList, &fileInfo);
+
+      // the pattern of a directory handle is fixed by its first query,
+      // filter the listing once instead of on every page
+      if (patternCheck && pattern && !FilterFindData(dirList, pattern)) {
+        status = STATUS_NO_MEMORY;
+      } else {
+        dirList->Filled = TRUE;
+      }
+    }
   }
 
   if (status != STATUS_SUCCESS) {
@@ -582,18 +644,14 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
     eventInfo->Operation.Directory.Index =
         EventContext->Operation.Directory.FileIndex;
     // free all of list entries
-    ClearFindData(openInfo->DirListHead);
+    ClearFindData(dirList, DokanInstance);
   } else {
     LONG index;
     eventInfo->Status = STATUS_SUCCESS;
 
-    AddMissingCurrentAndParentFolder(EventContext, openInfo->DirListHead,
-                                     &fileInfo);
-
     DbgPrint("index from %d\n", EventContext->Operation.Directory.FileIndex);
-    // extract entries that match search pattern from FindFiles result
-    index = MatchFiles(EventContext, eventInfo, openInfo->DirListHead,
-                       patternCheck, DokanInstance);
+    // extract entries from the FileIndex of the query
+    index = MatchFiles(EventContext, eventInfo, dirList, DokanInstance);
 
     // there is no matched file
     if (index < 0) {
@@ -612,7 +670,7 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
         DbgPrint("  STATUS_BUFFER_OVERFLOW\n");
         eventInfo->Status = STATUS_BUFFER_OVERFLOW;
       }
-      ClearFindData(openInfo->DirListHead);
+      ClearFindData(dirList, DokanInstance);
     } else {
       DbgPrint("index to %d\n", index);
       eventInfo->Operation.Directory.Index = index;
@@ -624,112 +682,5 @@ VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   // send directory information to driver
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
-  free(eventInfo);
-}
-
-#define DOS_STAR (L'<')
-#define DOS_QM (L'>')
-#define DOS_DOT (L'"')
-
-// check whether Name matches Expression
-// Expression can contain "?"(any one character) and "*" (any string)
-// when IgnoreCase is TRUE, do case insenstive matching
-//
-// http://msdn.microsoft.com/en-us/library/ff546850(v=VS.85).aspx
-// * (asterisk) Matches zero or more characters.
-// ? (question mark) Matches a single character.
-// DOS_DOT Matches either a period or zero characters beyond the name string.
-// DOS_QM Matches any single character or, upon encountering a period or end
-//        of name string, advances the expression to the end of the set of
-//        contiguous DOS_QMs.
-// DOS_STAR Matches zero or more characters until encountering and matching
-//          the final . in the name.
-BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, // matching pattern
-                                      LPCWSTR Name,       // file name
-                                      BOOL IgnoreCase) {
-  ULONG ei = 0;
-  ULONG ni = 0;
-
-  while (Expression[ei] != '\0') {
-
-    if (Expression[ei] == L'*') {
-      ei++;
-      if (Expression[ei] == '\0')
-        return TRUE;
-
-      while (Name[ni] != '\0') {
-        if (DokanIsNameInExpression(&Expression[ei], &Name[ni], IgnoreCase))
-          return TRUE;
-        ni++;
-      }
-
-    } else if (Expression[ei] == DOS_STAR) {
-
-      ULONG p = ni;
-      ULONG lastDot = 0;
-      ei++;
-
-      while (Name[p] != '\0') {
-        if (Name[p] == L'.')
-          lastDot = p;
-        p++;
-      }
-
-      BOOL endReached = FALSE;
-      while (!endReached) {
-
-        endReached = (Name[ni] == '\0' || ni == lastDot);
-
-        if (!endReached) {
-          if (DokanIsNameInExpression(&Expression[ei], &Name[ni], IgnoreCase))
-            return TRUE;
-
-          ni++;
-        }
-      }
-
-    } else if (Expression[ei] == DOS_QM) {
-
-      ei++;
-      if (Name[ni] != L'.') {
-        ni++;
-      } else {
-
-        ULONG p = ni + 1;
-        while (Name[p] != '\0') {
-          if (Name[p] == L'.')
-            break;
-          p++;
-        }
-
-        if (Name[p] == L'.')
-          ni++;
-      }
-
-    } else if (Expression[ei] == DOS_DOT) {
-      ei++;
-
-      if (Name[ni] == L'.')
-        ni++;
-
-    } else {
-      if (Expression[ei] == L'?') {
-        ei++;
-        ni++;
-      } else if (IgnoreCase && towupper(Expression[ei]) == towupper(Name[ni])) {
-        ei++;
-        ni++;
-      } else if (!IgnoreCase && Expression[ei] == Name[ni]) {
-        ei++;
-        ni++;
-      } else {
-        return FALSE;
-      }
-    }
-  }
-
-  if (ei == wcslen(Expression) && ni == wcslen(Name))
-    return TRUE;
-
-  return FALSE;
+  DokanArenaFree(eventInfo);
 }
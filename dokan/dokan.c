@@ -38,6 +38,10 @@ BOOL g_DebugMode = TRUE;
 BOOL g_UseStdErr = FALSE;
 
 CRITICAL_SECTION g_InstanceCriticalSection;
+
+// Process wide channel to the global device, protected by g_GlobalChannelLock
+DOKAN_DEVICE_CHANNEL g_GlobalChannel;
+CRITICAL_SECTION g_GlobalChannelLock;
 LIST_ENTRY g_InstanceList;
 
 VOID DOKANAPI DokanUseStdErr(BOOL Status) { g_UseStdErr = Status; }
@@ -59,6 +63,18 @@ NewDokanInstance() {
 #endif
 
   InitializeListHead(&instance->ListEntry);
+  DokanInitDeviceChannel(&instance->ControlChannel);
+  DokanInitWorkerPool(&instance->WorkerPool);
+  DokanInitObjectPool(&instance->OpenInfoPool, sizeof(DOKAN_OPEN_INFO),
+                      DOKAN_OPEN_INFO_POOL_MAX_FREE);
+  DokanInitObjectPool(&instance->DirChunkPool, DOKAN_DIR_CHUNK_SIZE,
+                      DOKAN_DIR_CHUNK_POOL_MAX_FREE);
+  DokanInitPathCache(&instance->DirCache, "directory", NULL);
+  DokanInitFileIdMap(&instance->FileIdMap);
+  DokanInitPathCache(&instance->InfoCache, "file information", NULL);
+  DokanInitPathCache(&instance->NegativeCache, "negative lookup", NULL);
+  DokanInitVolumeCache(&instance->VolumeCache);
+  DokanInitSecurityCache(&instance->SecurityCache);
 
   EnterCriticalSection(&g_InstanceCriticalSection);
   InsertTailList(&g_InstanceList, &instance->ListEntry);
@@ -69,6 +85,15 @@ NewDokanInstance() {
 
 VOID DeleteDokanInstance(PDOKAN_INSTANCE Instance) {
   DeleteCriticalSection(&Instance->CriticalSection);
+  DokanDeleteWorkerPool(&Instance->WorkerPool);
+  DokanDeleteObjectPool(&Instance->OpenInfoPool);
+  DokanDeleteObjectPool(&Instance->DirChunkPool);
+  DokanDeletePathCache(&Instance->DirCache);
+  DokanDeleteFileIdMap(&Instance->FileIdMap);
+  DokanDeletePathCache(&Instance->InfoCache);
+  DokanDeletePathCache(&Instance->NegativeCache);
+  DokanDeleteVolumeCache(&Instance->VolumeCache);
+  DokanDeleteSecurityCache(&Instance->SecurityCache);
 
   EnterCriticalSection(&g_InstanceCriticalSection);
   RemoveEntryList(&Instance->ListEntry);
@@ -97,6 +122,55 @@ BOOL IsMountPointDriveLetter(LPCWSTR mountPoint) {
   return FALSE;
 }
 
+// whether MountPoint names the mount point of Instance
+BOOL IsInstanceMountPoint(PDOKAN_INSTANCE Instance, LPCWSTR MountPoint) {
+  if (IsMountPointDriveLetter(MountPoint) &&
+      IsMountPointDriveLetter(Instance->MountPoint)) {
+    return towupper(MountPoint[0]) == towupper(Instance->MountPoint[0]);
+  }
+  return _wcsicmp(MountPoint, Instance->MountPoint) == 0;
+}
+
+BOOL DOKANAPI DokanGetCacheStats(LPCWSTR MountPoint, ULONG Cache,
+                                 PDOKAN_CACHE_STATS Stats) {
+  PLIST_ENTRY listEntry;
+  BOOL found = FALSE;
+
+  if (MountPoint == NULL || Stats == NULL || Cache > DOKAN_CACHE_SECURITY) {
+    return FALSE;
+  }
+
+  EnterCriticalSection(&g_InstanceCriticalSection);
+  for (listEntry = g_InstanceList.Flink; listEntry != &g_InstanceList;
+       listEntry = listEntry->Flink) {
+    PDOKAN_INSTANCE instance =
+        CONTAINING_RECORD(listEntry, DOKAN_INSTANCE, ListEntry);
+    if (IsInstanceMountPoint(instance, MountPoint)) {
+      switch (Cache) {
+      case DOKAN_CACHE_DIRECTORY:
+        DokanGetPathCacheStats(&instance->DirCache, Stats);
+        break;
+      case DOKAN_CACHE_FILE_INFO:
+        DokanGetPathCacheStats(&instance->InfoCache, Stats);
+        break;
+      case DOKAN_CACHE_NEGATIVE:
+        DokanGetPathCacheStats(&instance->NegativeCache, Stats);
+        break;
+      case DOKAN_CACHE_VOLUME:
+        DokanGetVolumeCacheStats(&instance->VolumeCache, Stats);
+        break;
+      case DOKAN_CACHE_SECURITY:
+        DokanGetSecurityCacheStats(&instance->SecurityCache, Stats);
+        break;
+      }
+      found = TRUE;
+      break;
+    }
+  }
+  LeaveCriticalSection(&g_InstanceCriticalSection);
+  return found;
+}
+
 BOOL IsValidDriveLetter(WCHAR DriveLetter) {
   return (L'a' <= DriveLetter && DriveLetter <= L'z') ||
          (L'A' <= DriveLetter && DriveLetter <= L'Z');
@@ -170,12 +244,33 @@ void CheckAllocationUnitSectorSize(PDOKAN_OPTIONS DokanOptions) {
             DokanOptions->AllocationUnitSize, DokanOptions->SectorSize);
 }
 
+// Wait until the keep alive thread, every worker and the event ring threads
+// of Instance have ended
+static VOID DokanWaitForThreads(PDOKAN_INSTANCE Instance, HANDLE KeepAlive) {
+  if (KeepAlive != NULL) {
+    WaitForSingleObject(KeepAlive, INFINITE);
+    CloseHandle(KeepAlive);
+  }
+  DokanJoinWorkers(&Instance->WorkerPool);
+  DokanStopEventRing(Instance);
+}
+
 int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
                        PDOKAN_OPERATIONS DokanOperations) {
-  ULONG threadNum = 0;
+  ULONG queueDepth = 0;
+  ULONG maxThreadCount = 0;
+  ULONG idleTimeout = 0;
+  ULONG dirCacheTimeout = 0;
+  ULONG64 dirCacheSize = 0;
+  LPCWSTR fileIdMapFile = NULL;
+  ULONG infoCacheTimeout = 0;
+  ULONG negativeCacheTimeout = 0;
+  ULONG freeSpaceCacheTimeout = 0;
+  ULONG securityCacheTimeout = 0;
+  BOOL caseSensitive;
   ULONG i;
   HANDLE device;
-  HANDLE threadIds[DOKAN_MAX_THREAD];
+  HANDLE keepAlive;
   PDOKAN_INSTANCE instance;
 
   g_DebugMode = DokanOptions->Options & DOKAN_OPTION_DEBUG;
@@ -217,6 +312,49 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
     DokanOptions->ThreadCount = DOKAN_MAX_THREAD - 1;
   }
 
+  if (DOKAN_OPTIONS_HAS(DokanOptions, QueueDepth))
+    queueDepth = DokanOptions->QueueDepth;
+  if (DOKAN_OPTIONS_HAS(DokanOptions, MaxThreadCount))
+    maxThreadCount = DokanOptions->MaxThreadCount;
+  if (DOKAN_OPTIONS_HAS(DokanOptions, ThreadIdleTimeout))
+    idleTimeout = DokanOptions->ThreadIdleTimeout;
+  if (DOKAN_OPTIONS_HAS(DokanOptions, DirectoryCacheTimeout))
+    dirCacheTimeout = DokanOptions->DirectoryCacheTimeout;
+  if (DOKAN_OPTIONS_HAS(DokanOptions, DirectoryCacheSize))
+    dirCacheSize = DokanOptions->DirectoryCacheSize;
+  if (DOKAN_OPTIONS_HAS(DokanOptions, FileIdMapFile))
+    fileIdMapFile = DokanOptions->FileIdMapFile;
+  if (DOKAN_OPTIONS_HAS(DokanOptions, FileInfoCacheTimeout))
+    infoCacheTimeout = DokanOptions->FileInfoCacheTimeout;
+  if (DOKAN_OPTIONS_HAS(DokanOptions, NegativeCacheTimeout))
+    negativeCacheTimeout = DokanOptions->NegativeCacheTimeout;
+  if (DOKAN_OPTIONS_HAS(DokanOptions, FreeSpaceCacheTimeout))
+    freeSpaceCacheTimeout = DokanOptions->FreeSpaceCacheTimeout;
+  if (DOKAN_OPTIONS_HAS(DokanOptions, SecurityCacheTimeout))
+    securityCacheTimeout = DokanOptions->SecurityCacheTimeout;
+  if (queueDepth == 0) {
+    queueDepth =
+        DokanOptions->ThreadCount * DOKAN_DEFAULT_QUEUE_DEPTH_PER_THREAD;
+  } else if (DOKAN_MAX_QUEUE_DEPTH < queueDepth) {
+    DokanDbgPrintW(L"Dokan Error: too many queue depth %d\n", queueDepth);
+    queueDepth = DOKAN_MAX_QUEUE_DEPTH;
+  }
+
+  if (maxThreadCount < DokanOptions->ThreadCount ||
+      (DokanOptions->Options & DOKAN_OPTION_OVERLAPPED_IO)) {
+    maxThreadCount = DokanOptions->ThreadCount;
+  } else if (DOKAN_MAX_WORKER_THREAD < maxThreadCount) {
+    DokanDbgPrintW(L"Dokan Error: too many max thread count %d\n",
+                   maxThreadCount);
+    maxThreadCount = DOKAN_MAX_WORKER_THREAD;
+  }
+  if (idleTimeout == 0) {
+    idleTimeout = DOKAN_DEFAULT_THREAD_IDLE_TIMEOUT;
+  }
+  if (dirCacheSize == 0) {
+    dirCacheSize = DOKAN_DEFAULT_DIR_CACHE_SIZE;
+  }
+
   device = CreateFile(DOKAN_GLOBAL_DEVICE_NAME,           // lpFileName
                       GENERIC_READ | GENERIC_WRITE,       // dwDesiredAccess
                       FILE_SHARE_READ | FILE_SHARE_WRITE, // dwShareMode
@@ -244,10 +382,7 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
       && !CheckDriveLetterAvailability(instance->MountPoint[0])) {
         DokanDbgPrint("Dokan Error: CheckDriveLetterAvailability Failed\n");
         CloseHandle(device);
-
-        EnterCriticalSection(&g_InstanceCriticalSection);
-        RemoveTailList(&g_InstanceList);
-        LeaveCriticalSection(&g_InstanceCriticalSection);
+        DeleteDokanInstance(instance);
         return DOKAN_MOUNT_ERROR;
       }
   }
@@ -259,30 +394,92 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
 
   if (!DokanStart(instance)) {
     CloseHandle(device);
+    DeleteDokanInstance(instance);
     return DOKAN_START_ERROR;
   }
 
+  if (!DokanOpenDeviceChannel(&instance->ControlChannel, instance)) {
+    SendReleaseIRP(instance);
+    DokanDbgPrint("Dokan Error: Failed to open control channel\n");
+    DokanCloseDeviceChannel(&instance->ControlChannel);
+    CloseHandle(device);
+    DeleteDokanInstance(instance);
+    return DOKAN_START_ERROR;
+  }
+
+  if (DokanOptions->Options & DOKAN_OPTION_OVERLAPPED_IO) {
+    instance->IoEngine = DokanCreateIoEngine(instance, queueDepth,
+                                             DokanOptions->ThreadCount);
+    if (instance->IoEngine == NULL) {
+      SendReleaseIRP(instance);
+      DokanDbgPrint("Dokan Error: Failed to start the overlapped engine\n");
+      DokanCloseDeviceChannel(&instance->ControlChannel);
+      CloseHandle(device);
+      DeleteDokanInstance(instance);
+      return DOKAN_START_ERROR;
+    }
+  }
+
+  // the driver may submit to the ring as soon as it is mapped
+  if (!DokanStartEventRing(instance, DokanOptions->ThreadCount)) {
+    SendReleaseIRP(instance);
+    DokanDbgPrint("Dokan Error: Failed to start the event ring\n");
+    DokanStopEventRing(instance);
+    if (instance->IoEngine != NULL) {
+      DokanDeleteIoEngine(instance->IoEngine);
+      instance->IoEngine = NULL;
+    }
+    DokanCloseDeviceChannel(&instance->ControlChannel);
+    CloseHandle(device);
+    DeleteDokanInstance(instance);
+    return DOKAN_START_ERROR;
+  }
+
+  instance->WorkerPool.ThreadLoop =
+      instance->IoEngine != NULL ? DokanIoEngineLoop : DokanLoop;
+  instance->WorkerPool.MinThreads = DokanOptions->ThreadCount;
+  instance->WorkerPool.MaxThreads = maxThreadCount;
+  instance->WorkerPool.IdleTimeout = idleTimeout;
+  caseSensitive = (DokanOptions->Options & DOKAN_OPTION_CASE_SENSITIVE) != 0;
+  DokanStartPathCache(&instance->DirCache, dirCacheTimeout, dirCacheSize, 0,
+                      caseSensitive);
+  DokanStartPathCache(&instance->InfoCache, infoCacheTimeout, 0,
+                      DOKAN_INFO_CACHE_MAX_ENTRIES, caseSensitive);
+  DokanStartPathCache(&instance->NegativeCache, negativeCacheTimeout, 0,
+                      DOKAN_NEGATIVE_CACHE_MAX_ENTRIES, caseSensitive);
+  DokanStartVolumeCache(
+      &instance->VolumeCache, freeSpaceCacheTimeout,
+      (DokanOptions->Options & DOKAN_OPTION_FREE_SPACE_REFRESH) != 0);
+  DokanStartPathCache(&instance->SecurityCache.Paths, securityCacheTimeout, 0,
+                      DOKAN_SECURITY_CACHE_MAX_ENTRIES, caseSensitive);
+  if (DokanOptions->Options & DOKAN_OPTION_FILE_ID_MAP) {
+    DokanStartFileIdMap(&instance->FileIdMap, fileIdMapFile);
+  }
+
   // Start Keep Alive thread
-  threadIds[threadNum++] = (HANDLE)_beginthreadex(NULL, // Security Attributes
-                                                  0,    // stack size
-                                                  DokanKeepAlive,
-                                                  (PVOID)instance, // param
-                                                  0, // create flag
-                                                  NULL);
+  keepAlive = (HANDLE)_beginthreadex(NULL, // Security Attributes
+                                     0,    // stack size
+                                     DokanKeepAlive,
+                                     (PVOID)instance, // param
+                                     0,               // create flag
+                                     NULL);
 
   for (i = 0; i < DokanOptions->ThreadCount; ++i) {
-    threadIds[threadNum++] = (HANDLE)_beginthreadex(NULL, // Security Attributes
-                                                    0,    // stack size
-                                                    DokanLoop,
-                                                    (PVOID)instance, // param
-                                                    0, // create flag
-                                                    NULL);
+    DokanStartWorker(instance);
   }
 
   if (!DokanMount(instance->MountPoint, instance->DeviceName, DokanOptions)) {
-    SendReleaseIRP(instance->DeviceName);
+    SendReleaseIRP(instance);
     DokanDbgPrint("Dokan Error: DokanMount Failed\n");
+    // the released device fails the pending waits, the threads exit
+    DokanWaitForThreads(instance, keepAlive);
+    if (instance->IoEngine != NULL) {
+      DokanDeleteIoEngine(instance->IoEngine);
+      instance->IoEngine = NULL;
+    }
+    DokanCloseDeviceChannel(&instance->ControlChannel);
     CloseHandle(device);
+    DeleteDokanInstance(instance);
     return DOKAN_MOUNT_ERROR;
   }
 
@@ -299,12 +496,16 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
   }
 
   // wait for thread terminations
-  WaitForMultipleObjects(threadNum, threadIds, TRUE, INFINITE);
+  DokanWaitForThreads(instance, keepAlive);
 
-  for (i = 0; i < threadNum; ++i) {
-    CloseHandle(threadIds[i]);
-  }
+  // a refresh queued by the last requests must not run after Unmounted
+  DokanStopVolumeCache(&instance->VolumeCache);
 
+  if (instance->IoEngine != NULL) {
+    DokanDeleteIoEngine(instance->IoEngine);
+    instance->IoEngine = NULL;
+  }
+  DokanCloseDeviceChannel(&instance->ControlChannel);
   CloseHandle(device);
 
   if (DokanOperations->Unmounted) {
@@ -315,6 +516,9 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
     DokanOperations->Unmounted(&fileInfo);
   }
 
+  // no more events, the map cannot change anymore
+  DokanSaveFileIdMap(&instance->FileIdMap);
+
   Sleep(1000);
 
   DbgPrint("\nunload\n");
@@ -324,87 +528,133 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
   return DOKAN_SUCCESS;
 }
 
-LPWSTR
-GetRawDeviceName(LPCWSTR DeviceName, LPWSTR DestinationBuffer,
-                 rsize_t DestinationBufferSizeInElements) {
-  if (DeviceName && DestinationBuffer && DestinationBufferSizeInElements > 0) {
-    wcscpy_s(DestinationBuffer, DestinationBufferSizeInElements, L"\\\\.");
-    wcscat_s(DestinationBuffer, DestinationBufferSizeInElements, DeviceName);
-  }
-
-  return DestinationBuffer;
-}
-
 void ALIGN_ALLOCATION_SIZE(PLARGE_INTEGER size, PDOKAN_OPTIONS DokanOptions) {
   long long r = size->QuadPart % DokanOptions->AllocationUnitSize;
   size->QuadPart =
       (size->QuadPart + (r > 0 ? DokanOptions->AllocationUnitSize - r : 0));
 }
 
-UINT WINAPI DokanLoop(PDOKAN_INSTANCE DokanInstance) {
-  HANDLE device = INVALID_HANDLE_VALUE;
+VOID DokanDispatchEvent(HANDLE Handle, PEVENT_CONTEXT EventContext,
+                        PDOKAN_INSTANCE DokanInstance) {
+  if (EventContext->MountId != DokanInstance->MountId) {
+    DbgPrint("Dokan Error: Invalid MountId (expected:%d, acctual:%d)\n",
+             DokanInstance->MountId, EventContext->MountId);
+    return;
+  }
+
+  switch (EventContext->MajorFunction) {
+  case IRP_MJ_CREATE:
+    DispatchCreate(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_CLEANUP:
+    DispatchCleanup(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_CLOSE:
+    DispatchClose(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_DIRECTORY_CONTROL:
+    DispatchDirectoryInformation(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_READ:
+    DispatchRead(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_WRITE:
+    DispatchWrite(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_QUERY_INFORMATION:
+    DispatchQueryInformation(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_QUERY_VOLUME_INFORMATION:
+    DispatchQueryVolumeInformation(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_LOCK_CONTROL:
+    DispatchLock(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_SET_INFORMATION:
+    DispatchSetInformation(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_FLUSH_BUFFERS:
+    DispatchFlush(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_QUERY_SECURITY:
+    DispatchQuerySecurity(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_SET_SECURITY:
+    DispatchSetSecurity(Handle, EventContext, DokanInstance);
+    break;
+  default:
+    break;
+  }
+}
+
+UINT WINAPI DokanLoop(PVOID Param) {
+  PDOKAN_WORKER worker = (PDOKAN_WORKER)Param;
+  PDOKAN_INSTANCE DokanInstance = worker->DokanInstance;
+  DOKAN_DEVICE_CHANNEL channel;
+  DOKAN_REPLY_ARENA arena;
   char *buffer = NULL;
   BOOL status;
   ULONG returnedLength;
   DWORD result = 0;
   DWORD lastError = 0;
-  WCHAR rawDeviceName[MAX_PATH];
 
-  buffer = malloc(sizeof(char) * EVENT_CONTEXT_MAX_SIZE);
+  buffer = malloc(DokanInstance->EventBufferSize);
   if (buffer == NULL) {
+    DokanWorkerExit(worker, TRUE);
+    result = (DWORD)-1;
+    _endthreadex(result);
+    return result;
+  }
+  RtlZeroMemory(buffer, DokanInstance->EventBufferSize);
+
+  DokanInitDeviceChannel(&channel);
+  if (!DokanOpenDeviceChannel(&channel, DokanInstance)) {
+    free(buffer);
+    DokanWorkerExit(worker, TRUE);
     result = (DWORD)-1;
     _endthreadex(result);
     return result;
   }
-  RtlZeroMemory(buffer, sizeof(char) * EVENT_CONTEXT_MAX_SIZE);
+  // replies are sent with the next wait when this succeeds
+  channel.DeferredReply = malloc(DOKAN_DEFERRED_REPLY_MAX_SIZE);
+  DokanSetThreadChannel(&channel);
+  DokanInitReplyArena(&arena);
+  DokanSetThreadArena(&arena);
 
   status = TRUE;
   while (status) {
 
-    device =
-        CreateFile(GetRawDeviceName(DokanInstance->DeviceName, rawDeviceName,
-                                    MAX_PATH),         // lpFileName
-                   GENERIC_READ | GENERIC_WRITE,       // dwDesiredAccess
-                   FILE_SHARE_READ | FILE_SHARE_WRITE, // dwShareMode
-                   NULL,                               // lpSecurityAttributes
-                   OPEN_EXISTING,                      // dwCreationDistribution
-                   0,                                  // dwFlagsAndAttributes
-                   NULL                                // hTemplateFile
-                   );
-
-    if (device == INVALID_HANDLE_VALUE) {
-      DbgPrint(
-          "Dokan Error: CreateFile failed %ws: %d\n",
-          GetRawDeviceName(DokanInstance->DeviceName, rawDeviceName, MAX_PATH),
-          GetLastError());
-      free(buffer);
-      result = (DWORD)-1;
-      _endthreadex(result);
-      return result;
+    if (!DokanWorkerBeginWait(worker)) {
+      break;
     }
 
-    status = DeviceIoControl(
-        device,           // Handle to device
-        IOCTL_EVENT_WAIT, // IO Control code
-        NULL,             // Input Buffer to driver.
-        0,                // Length of input buffer in bytes.
-        buffer,           // Output Buffer from driver.
-        sizeof(char) *
-            EVENT_CONTEXT_MAX_SIZE, // Length of output buffer in bytes.
-        &returnedLength,            // Bytes placed in buffer.
-        NULL                        // synchronous call
-        );
+    status = DokanChannelWaitEvents(&channel, buffer,
+                                    DokanInstance->EventBufferSize,
+                                    &returnedLength);
+
+    lastError = status ? 0 : GetLastError();
+    if (!DokanWorkerEndWait(worker, status ? (PEVENT_BATCH)buffer : NULL,
+                            status ? returnedLength : 0)) {
+      DbgPrint("Idle thread retired\n");
+      status = TRUE;
+      break;
+    }
 
     if (!status) {
-      lastError = GetLastError();
       DbgPrint("Ioctl failed for wait with code %d.\n", lastError);
+      // A deferred reply is kept and sent again with the next wait: the
+      // driver ignores replies whose IRP has already been completed.
       if (lastError == ERROR_NO_SYSTEM_RESOURCES) {
         DbgPrint("Processing will continue\n");
         status = TRUE;
-        CloseHandle(device);
         Sleep(200);
         continue;
       }
+      if (DokanIsChannelBroken(lastError) &&
+          DokanReconnectDeviceChannel(&channel)) {
+        status = TRUE;
+        continue;
+      }
       DbgPrint("Thread will be terminated\n");
       break;
     }
@@ -412,67 +662,26 @@ UINT WINAPI DokanLoop(PDOKAN_INSTANCE DokanInstance) {
     // printf("#%d got notification %d\n", (ULONG)Param, count++);
 
     if (returnedLength > 0) {
-      PEVENT_CONTEXT context = (PEVENT_CONTEXT)buffer;
-      if (context->MountId != DokanInstance->MountId) {
-        DbgPrint("Dokan Error: Invalid MountId (expected:%d, acctual:%d)\n",
-                 DokanInstance->MountId, context->MountId);
-        CloseHandle(device);
-        continue;
-      }
-
-      switch (context->MajorFunction) {
-      case IRP_MJ_CREATE:
-        DispatchCreate(device, context, DokanInstance);
-        break;
-      case IRP_MJ_CLEANUP:
-        DispatchCleanup(device, context, DokanInstance);
-        break;
-      case IRP_MJ_CLOSE:
-        DispatchClose(device, context, DokanInstance);
-        break;
-      case IRP_MJ_DIRECTORY_CONTROL:
-        DispatchDirectoryInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_READ:
-        DispatchRead(device, context, DokanInstance);
-        break;
-      case IRP_MJ_WRITE:
-        DispatchWrite(device, context, DokanInstance);
-        break;
-      case IRP_MJ_QUERY_INFORMATION:
-        DispatchQueryInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_QUERY_VOLUME_INFORMATION:
-        DispatchQueryVolumeInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_LOCK_CONTROL:
-        DispatchLock(device, context, DokanInstance);
-        break;
-      case IRP_MJ_SET_INFORMATION:
-        DispatchSetInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_FLUSH_BUFFERS:
-        DispatchFlush(device, context, DokanInstance);
-        break;
-      case IRP_MJ_QUERY_SECURITY:
-        DispatchQuerySecurity(device, context, DokanInstance);
-        break;
-      case IRP_MJ_SET_SECURITY:
-        DispatchSetSecurity(device, context, DokanInstance);
-        break;
-      default:
-        break;
-      }
-
+      DokanChannelDispatchBatch(&channel, (PEVENT_BATCH)buffer, returnedLength,
+                                DokanDispatchEvent, DokanInstance);
     } else {
       DbgPrint("ReturnedLength %d\n", returnedLength);
     }
-
-    CloseHandle(device);
   }
 
-  CloseHandle(device);
+  DokanSetThreadChannel(NULL);
+  DokanSetThreadArena(NULL);
+  DokanDeleteReplyArena(&arena);
+  if (channel.DeferredReplyLength > 0 &&
+      channel.Device != INVALID_HANDLE_VALUE) {
+    SendEventInformation(channel.Device, channel.DeferredReply,
+                         channel.DeferredReplyLength, NULL);
+  }
+  free(channel.DeferredReply);
+  DokanCloseDeviceChannel(&channel);
   free(buffer);
+  // a worker leaving on error means the device is going away
+  DokanWorkerExit(worker, !status);
   _endthreadex(result);
 
   return result;
@@ -480,29 +689,12 @@ UINT WINAPI DokanLoop(PDOKAN_INSTANCE DokanInstance) {
 
 VOID SendEventInformation(HANDLE Handle, PEVENT_INFORMATION EventInfo,
                           ULONG EventLength, PDOKAN_INSTANCE DokanInstance) {
-  BOOL status;
-  ULONG returnedLength;
-
   // DbgPrint("###EventInfo->Context %X\n", EventInfo->Context);
   if (DokanInstance != NULL) {
     ReleaseDokanOpenInfo(EventInfo, DokanInstance);
   }
 
-  // send event info to driver
-  status = DeviceIoControl(Handle,           // Handle to device
-                           IOCTL_EVENT_INFO, // IO Control code
-                           EventInfo,        // Input Buffer to driver.
-                           EventLength,      // Length of input buffer in bytes.
-                           NULL,             // Output Buffer from driver.
-                           0,               // Length of output buffer in bytes.
-                           &returnedLength, // Bytes placed in buffer.
-                           NULL             // synchronous call
-                           );
-
-  if (!status) {
-    DWORD errorCode = GetLastError();
-    DbgPrint("Dokan Error: Ioctl failed with code %d\n", errorCode);
-  }
+  DokanChannelSendReply(Handle, EventInfo, EventLength);
 }
 
 VOID CheckFileName(LPWSTR FileName) {
@@ -526,13 +718,16 @@ VOID CheckFileName(LPWSTR FileName) {
 PEVENT_INFORMATION
 DispatchCommon(PEVENT_CONTEXT EventContext, ULONG SizeOfEventInfo,
                PDOKAN_INSTANCE DokanInstance, PDOKAN_FILE_INFO DokanFileInfo,
-               PDOKAN_OPEN_INFO *DokanOpenInfo) {
-  PEVENT_INFORMATION eventInfo = (PEVENT_INFORMATION)malloc(SizeOfEventInfo);
+               PDOKAN_IO_EVENT IoEvent, PDOKAN_OPEN_INFO *DokanOpenInfo) {
+  PEVENT_INFORMATION eventInfo =
+      (PEVENT_INFORMATION)DokanArenaAlloc(DOKAN_ARENA_REPLY, SizeOfEventInfo);
 
   if (eventInfo == NULL) {
     return NULL;
   }
-  RtlZeroMemory(eventInfo, SizeOfEventInfo);
+  // The reply buffer is reused between events, only the header is cleared.
+  // Handlers building structures in Buffer clear what they use.
+  RtlZeroMemory(eventInfo, FIELD_OFFSET(EVENT_INFORMATION, Buffer));
   RtlZeroMemory(DokanFileInfo, sizeof(DOKAN_FILE_INFO));
 
   eventInfo->BufferLength = 0;
@@ -557,6 +752,8 @@ DispatchCommon(PEVENT_CONTEXT EventContext, ULONG SizeOfEventInfo,
   }
 
   *DokanOpenInfo = GetDokanOpenInfo(EventContext, DokanInstance);
+  DokanInitIoEvent(IoEvent, EventContext, DokanInstance, *DokanOpenInfo,
+                   DokanFileInfo);
   if (*DokanOpenInfo == NULL) {
     DbgPrint("error openInfo is NULL\n");
     return eventInfo;
@@ -564,65 +761,97 @@ DispatchCommon(PEVENT_CONTEXT EventContext, ULONG SizeOfEventInfo,
 
   DokanFileInfo->Context = (ULONG64)(*DokanOpenInfo)->UserContext;
   DokanFileInfo->IsDirectory = (UCHAR)(*DokanOpenInfo)->IsDirectory;
-  DokanFileInfo->DokanContext = (ULONG64)(*DokanOpenInfo);
 
   eventInfo->Context = (ULONG64)(*DokanOpenInfo);
 
   return eventInfo;
 }
 
+// The driver keeps the open info in the file context until the close reply,
+// so OpenCount is not 0 here. An event referring to a released open info
+// does not take it, the count never rises again once it dropped to 0.
+// Nothing of the event is kept in the open info, the requests of an open run
+// concurrently, see DOKAN_IO_EVENT.
 PDOKAN_OPEN_INFO
 GetDokanOpenInfo(PEVENT_CONTEXT EventContext, PDOKAN_INSTANCE DokanInstance) {
   PDOKAN_OPEN_INFO openInfo;
-  EnterCriticalSection(&DokanInstance->CriticalSection);
+  LONG count;
+
+  UNREFERENCED_PARAMETER(DokanInstance);
 
   openInfo = (PDOKAN_OPEN_INFO)(UINT_PTR)EventContext->Context;
-  if (openInfo != NULL) {
-    openInfo->OpenCount++;
-    openInfo->EventContext = EventContext;
-    openInfo->DokanInstance = DokanInstance;
+  if (openInfo == NULL) {
+    return NULL;
   }
-  LeaveCriticalSection(&DokanInstance->CriticalSection);
+
+  do {
+    count = openInfo->OpenCount;
+    if (count < 1) {
+      DbgPrint("Dokan Error: event #%X refers to a released open info\n",
+               EventContext->SerialNumber);
+      return NULL;
+    }
+  } while (InterlockedCompareExchange(&openInfo->OpenCount, count + 1,
+                                      count) != count);
+
   return openInfo;
 }
 
+// Describe the request of EventContext to the callbacks given DokanFileInfo.
+// Requests on the same open run concurrently, each has its own IoEvent.
+VOID DokanInitIoEvent(PDOKAN_IO_EVENT IoEvent, PEVENT_CONTEXT EventContext,
+                      PDOKAN_INSTANCE DokanInstance,
+                      PDOKAN_OPEN_INFO OpenInfo,
+                      PDOKAN_FILE_INFO DokanFileInfo) {
+  IoEvent->OpenInfo = OpenInfo;
+  IoEvent->DokanInstance = DokanInstance;
+  IoEvent->SerialNumber = EventContext->SerialNumber;
+  IoEvent->MajorFunction = EventContext->MajorFunction;
+  DokanFileInfo->DokanContext = (ULONG64)IoEvent;
+}
+
+// open info of the request DokanFileInfo was given for, NULL if none
+PDOKAN_OPEN_INFO DokanFileInfoOpenInfo(PDOKAN_FILE_INFO DokanFileInfo) {
+  PDOKAN_IO_EVENT ioEvent =
+      (PDOKAN_IO_EVENT)(UINT_PTR)DokanFileInfo->DokanContext;
+
+  return ioEvent != NULL ? ioEvent->OpenInfo : NULL;
+}
+
 VOID ReleaseDokanOpenInfo(PEVENT_INFORMATION EventInformation,
                           PDOKAN_INSTANCE DokanInstance) {
   PDOKAN_OPEN_INFO openInfo;
-  EnterCriticalSection(&DokanInstance->CriticalSection);
 
   openInfo = (PDOKAN_OPEN_INFO)(UINT_PTR)EventInformation->Context;
-  if (openInfo != NULL) {
-    openInfo->OpenCount--;
-    if (openInfo->OpenCount < 1) {
-      if (openInfo->DirListHead != NULL) {
-        ClearFindData(openInfo->DirListHead);
-        free(openInfo->DirListHead);
-        openInfo->DirListHead = NULL;
-      }
-      if (openInfo->StreamListHead != NULL) {
-        ClearFindStreamData(openInfo->StreamListHead);
-        free(openInfo->StreamListHead);
-        openInfo->StreamListHead = NULL;
-      }
-      free(openInfo);
-      EventInformation->Context = 0;
+  if (openInfo != NULL && InterlockedDecrement(&openInfo->OpenCount) < 1) {
+    // last reference, no other thread can reach openInfo anymore
+    if (openInfo->DirList != NULL) {
+      ClearFindData(openInfo->DirList, DokanInstance);
+      free(openInfo->DirList->Entries);
+      free(openInfo->DirList);
+      openInfo->DirList = NULL;
+    }
+    if (openInfo->StreamListHead != NULL) {
+      ClearFindStreamData(openInfo->StreamListHead);
+      free(openInfo->StreamListHead);
+      openInfo->StreamListHead = NULL;
     }
+    DokanPoolFree(&DokanInstance->OpenInfoPool, openInfo);
+    EventInformation->Context = 0;
   }
-  LeaveCriticalSection(&DokanInstance->CriticalSection);
 }
 
 // ask driver to release all pending IRP to prepare for Unmount.
-BOOL SendReleaseIRP(LPCWSTR DeviceName) {
+BOOL SendReleaseIRP(PDOKAN_INSTANCE DokanInstance) {
   ULONG returnedLength;
-  WCHAR rawDeviceName[MAX_PATH];
 
-  DbgPrint("send release to %ws\n", DeviceName);
+  DbgPrint("send release to %ws\n", DokanInstance->DeviceName);
 
-  if (!SendToDevice(GetRawDeviceName(DeviceName, rawDeviceName, MAX_PATH),
-                    IOCTL_EVENT_RELEASE, NULL, 0, NULL, 0, &returnedLength)) {
+  if (!DokanChannelIoControl(&DokanInstance->ControlChannel,
+                             IOCTL_EVENT_RELEASE, NULL, 0, NULL, 0,
+                             &returnedLength)) {
 
-    DbgPrint("Failed to unmount device:%ws\n", DeviceName);
+    DbgPrint("Failed to unmount device:%ws\n", DokanInstance->DeviceName);
     return FALSE;
   }
 
@@ -646,9 +875,8 @@ BOOL SendGlobalReleaseIRP(LPCWSTR MountPoint) {
 
         DbgPrint("send global release for %ws\n", MountPoint);
 
-        if (!SendToDevice(DOKAN_GLOBAL_DEVICE_NAME, IOCTL_EVENT_RELEASE,
-                          szMountPoint, inputLength, NULL, 0,
-                          &returnedLength)) {
+        if (!SendToDevice(IOCTL_EVENT_RELEASE, szMountPoint, inputLength, NULL,
+                          0, &returnedLength)) {
 
           DbgPrint("Failed to unmount: %ws\n", MountPoint);
           free(szMountPoint);
@@ -701,10 +929,20 @@ BOOL DokanStart(PDOKAN_INSTANCE Instance) {
            sizeof(Instance->UNCName));
 
   eventStart.IrpTimeout = Instance->DokanOptions->Timeout;
+  if (DOKAN_OPTIONS_HAS(Instance->DokanOptions, EventBufferSize))
+    eventStart.EventBufferSize = Instance->DokanOptions->EventBufferSize;
+  if (DOKAN_OPTIONS_HAS(Instance->DokanOptions, MaxBatchCount))
+    eventStart.MaxBatchCount = Instance->DokanOptions->MaxBatchCount;
+  if (!(Instance->DokanOptions->Options & DOKAN_OPTION_DISABLE_MAPPED_IO)) {
+    eventStart.Features |= DOKAN_FEATURE_MAPPED_IO;
+  }
+  if (Instance->DokanOptions->Options & DOKAN_OPTION_EVENT_RING) {
+    // the driver picks the geometry
+    eventStart.Features |= DOKAN_FEATURE_EVENT_RING;
+  }
 
-  SendToDevice(DOKAN_GLOBAL_DEVICE_NAME, IOCTL_EVENT_START, &eventStart,
-               sizeof(EVENT_START), &driverInfo, sizeof(EVENT_DRIVER_INFO),
-               &returnedLength);
+  SendToDevice(IOCTL_EVENT_START, &eventStart, sizeof(EVENT_START),
+               &driverInfo, sizeof(EVENT_DRIVER_INFO), &returnedLength);
 
   if (driverInfo.Status == DOKAN_START_FAILED) {
     if (driverInfo.DriverVersion != eventStart.UserVersion) {
@@ -717,6 +955,14 @@ BOOL DokanStart(PDOKAN_INSTANCE Instance) {
   } else if (driverInfo.Status == DOKAN_MOUNTED) {
     Instance->MountId = driverInfo.MountId;
     Instance->DeviceNumber = driverInfo.DeviceNumber;
+    Instance->EventBufferSize = driverInfo.EventBufferSize;
+    if (Instance->EventBufferSize < EVENT_CONTEXT_MAX_SIZE)
+      Instance->EventBufferSize = EVENT_CONTEXT_MAX_SIZE;
+    Instance->Features = driverInfo.Features;
+    Instance->RingPayloadSize = driverInfo.RingPayloadSize;
+    DbgPrint("Event buffer size %lu, max event size %lu, features %lx\n",
+             driverInfo.EventBufferSize, driverInfo.MaxEventSize,
+             driverInfo.Features);
     wcscpy_s(Instance->DeviceName, sizeof(Instance->DeviceName) / sizeof(WCHAR),
              driverInfo.DeviceName);
     return TRUE;
@@ -726,56 +972,34 @@ BOOL DokanStart(PDOKAN_INSTANCE Instance) {
 
 BOOL DOKANAPI DokanSetDebugMode(ULONG Mode) {
   ULONG returnedLength;
-  return SendToDevice(DOKAN_GLOBAL_DEVICE_NAME, IOCTL_SET_DEBUG_MODE, &Mode,
-                      sizeof(ULONG), NULL, 0, &returnedLength);
+  return SendToDevice(IOCTL_SET_DEBUG_MODE, &Mode, sizeof(ULONG), NULL, 0,
+                      &returnedLength);
 }
 
 BOOL DOKANAPI DokanMountPointsCleanUp() {
     ULONG returnedLength;
-    return SendToDevice(DOKAN_GLOBAL_DEVICE_NAME, IOCTL_MOUNTPOINT_CLEANUP, NULL,
-        0, NULL, 0, &returnedLength);
+    return SendToDevice(IOCTL_MOUNTPOINT_CLEANUP, NULL, 0, NULL, 0,
+                        &returnedLength);
 }
 
-BOOL SendToDevice(LPCWSTR DeviceName, DWORD IoControlCode, PVOID InputBuffer,
-                  ULONG InputLength, PVOID OutputBuffer, ULONG OutputLength,
+// send a control request to the global device over the process wide
+// channel instead of opening the device for every request.
+BOOL SendToDevice(DWORD IoControlCode, PVOID InputBuffer, ULONG InputLength,
+                  PVOID OutputBuffer, ULONG OutputLength,
                   PULONG ReturnedLength) {
-  HANDLE device;
   BOOL status;
 
-  device = CreateFile(DeviceName,                         // lpFileName
-                      GENERIC_READ | GENERIC_WRITE,       // dwDesiredAccess
-                      FILE_SHARE_READ | FILE_SHARE_WRITE, // dwShareMode
-                      NULL,          // lpSecurityAttributes
-                      OPEN_EXISTING, // dwCreationDistribution
-                      0,             // dwFlagsAndAttributes
-                      NULL           // hTemplateFile
-                      );
-
-  if (device == INVALID_HANDLE_VALUE) {
-    DWORD dwErrorCode = GetLastError();
-    DbgPrint("Dokan Error: Failed to open %ws with code %d\n", DeviceName,
-             dwErrorCode);
-    return FALSE;
+  EnterCriticalSection(&g_GlobalChannelLock);
+  status = DokanChannelIoControl(&g_GlobalChannel, IoControlCode, InputBuffer,
+                                 InputLength, OutputBuffer, OutputLength,
+                                 ReturnedLength);
+  if (!status && GetLastError() == ERROR_INVALID_HANDLE) {
+    // the handle went stale, the next request opens a new one
+    DokanCloseDeviceChannel(&g_GlobalChannel);
   }
+  LeaveCriticalSection(&g_GlobalChannelLock);
 
-  status = DeviceIoControl(device,         // Handle to device
-                           IoControlCode,  // IO Control code
-                           InputBuffer,    // Input Buffer to driver.
-                           InputLength,    // Length of input buffer in bytes.
-                           OutputBuffer,   // Output Buffer from driver.
-                           OutputLength,   // Length of output buffer in bytes.
-                           ReturnedLength, // Bytes placed in buffer.
-                           NULL            // synchronous call
-                           );
-
-  CloseHandle(device);
-
-  if (!status) {
-    DbgPrint("DokanError: Ioctl failed with code %d\n", GetLastError());
-    return FALSE;
-  }
-
-  return TRUE;
+  return status;
 }
 
 BOOL DOKANAPI DokanGetMountPointList(PDOKAN_CONTROL list, ULONG length,
@@ -790,8 +1014,8 @@ BOOL DOKANAPI DokanGetMountPointList(PDOKAN_CONTROL list, ULONG length,
   ZeroMemory(dokanControl, DOKAN_MAX_INSTANCES * sizeof(*dokanControl));
   *nbRead = 0;
 
-  if (SendToDevice(DOKAN_GLOBAL_DEVICE_NAME, IOCTL_EVENT_MOUNTPOINT_LIST, NULL,
-                   0, dokanControl, DOKAN_MAX_INSTANCES * sizeof(*dokanControl),
+  if (SendToDevice(IOCTL_EVENT_MOUNTPOINT_LIST, NULL, 0, dokanControl,
+                   DOKAN_MAX_INSTANCES * sizeof(*dokanControl),
                    &returnedLength)) {
     for (int i = 0; i < DOKAN_MAX_INSTANCES; ++i) {
       if (wcscmp(dokanControl[i].DeviceName, L"") == 0) {
@@ -829,6 +1053,12 @@ BOOL WINAPI DllMain(HINSTANCE Instance, DWORD Reason, LPVOID Reserved) {
 #endif
 
     InitializeListHead(&g_InstanceList);
+
+    InitializeCriticalSection(&g_GlobalChannelLock);
+    DokanInitDeviceChannel(&g_GlobalChannel);
+    wcscpy_s(g_GlobalChannel.RawDeviceName,
+             sizeof(g_GlobalChannel.RawDeviceName) / sizeof(WCHAR),
+             DOKAN_GLOBAL_DEVICE_NAME);
   } break;
   case DLL_PROCESS_DETACH: {
     EnterCriticalSection(&g_InstanceCriticalSection);
@@ -843,6 +1073,9 @@ BOOL WINAPI DllMain(HINSTANCE Instance, DWORD Reason, LPVOID Reserved) {
 
     LeaveCriticalSection(&g_InstanceCriticalSection);
     DeleteCriticalSection(&g_InstanceCriticalSection);
+
+    DokanCloseDeviceChannel(&g_GlobalChannel);
+    DeleteCriticalSection(&g_GlobalChannelLock);
   } break;
   default:
     break;
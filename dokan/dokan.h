@@ -54,8 +54,17 @@ extern "C" {
  */
 /** @{ */
 
-/** The current Dokan version (ver 1.0.0). \ref DOKAN_OPTIONS.Version */
-#define DOKAN_VERSION 100
+/** The current Dokan version (ver 1.2.0). \ref DOKAN_OPTIONS.Version */
+#define DOKAN_VERSION 120
+/**
+ * First \ref DOKAN_OPTIONS.Version whose headers have DOKAN_OPTIONS.Size.
+ *
+ * No released header used this version, so a program built with the 1.0 or
+ * 1.1 headers passes a lower Version and only the fields those headers had
+ * are read. From this version on, a field added to DOKAN_OPTIONS is read only
+ * when DOKAN_OPTIONS.Size covers it, the Version is not bumped for it.
+ */
+#define DOKAN_OPTIONS_SIZE_VERSION 120
 /** Minimum Dokan version (ver 1.0.0) accepted. */
 #define DOKAN_MINIMUM_COMPATIBLE_VERSION 100
 /** Maximum number of dokan instances.*/
@@ -92,6 +101,42 @@ extern "C" {
 #define DOKAN_OPTION_CURRENT_SESSION 128
 /** Enable Lockfile/Unlockfile operations. Otherwise Dokan will take care of it */
 #define DOKAN_OPTION_FILELOCK_USER_MODE 256
+/**
+ * Receive events with overlapped requests on an I/O completion port instead
+ * of one blocking request per thread. See \ref DOKAN_OPTIONS.QueueDepth
+ */
+#define DOKAN_OPTION_OVERLAPPED_IO 512
+/**
+ * Give files a 64-bit ID kept by Dokan when GetFileInformation reports a
+ * file index of 0 or FindFiles a FileId of 0. IDs follow renames and are
+ * never reused. See \ref DOKAN_OPTIONS.FileIdMapFile
+ */
+#define DOKAN_OPTION_FILE_ID_MAP 1024
+/**
+ * Answer free space queries made after \ref DOKAN_OPTIONS.FreeSpaceCacheTimeout
+ * with the previous figures while GetDiskFreeSpace is called again from a
+ * thread pool thread, so that they never wait for the file system.
+ */
+#define DOKAN_OPTION_FREE_SPACE_REFRESH 2048
+/**
+ * Always copy large ReadFile and WriteFile buffers through the event buffers.
+ * Otherwise the driver may map the pages of the requester in the process and
+ * pass them to the callbacks directly.
+ */
+#define DOKAN_OPTION_DISABLE_MAPPED_IO 4096
+/**
+ * Paths differing only by case name different files. The caches of the
+ * library then look paths up with their exact spelling, otherwise in any
+ * case.
+ */
+#define DOKAN_OPTION_CASE_SENSITIVE 8192
+/**
+ * Ask the driver for an event ring: events and replies that fit in a slot
+ * go through memory shared with the driver instead of one ioctl each.
+ * ThreadCount more threads serve the ring. Without driver support the mount
+ * runs as if the option was not set.
+ */
+#define DOKAN_OPTION_EVENT_RING 16384
 
 /** @} */
 
@@ -122,6 +167,89 @@ typedef struct _DOKAN_OPTIONS {
   ULONG AllocationUnitSize;
   /** Sector Size of the volume. This will affect the file size. */
   ULONG SectorSize;
+  /*
+  * The fields below are only read when Version is
+  * DOKAN_OPTIONS_SIZE_VERSION or above and the field lies within Size.
+  */
+  /**
+  * Size of this structure, set it to sizeof(DOKAN_OPTIONS). Fields added to
+  * the end of the structure are only read when Size covers them, so a
+  * program built with older headers keeps working.
+  */
+  ULONG Size;
+  /**
+  * Size of the DOKAN_OPERATIONS given to DokanMain, set it to
+  * sizeof(DOKAN_OPERATIONS). Callbacks past it are never called.
+  */
+  ULONG OperationsSize;
+  /**
+  * Number of event requests kept pending in the driver when
+  * \ref DOKAN_OPTION_OVERLAPPED_IO is enabled, independently of ThreadCount.
+  * 0 uses two requests per thread.
+  */
+  ULONG QueueDepth;
+  /**
+  * Maximum number of threads. Dokan starts ThreadCount threads and adds more,
+  * up to this number, while all of them are busy and events are queued.
+  * 0 keeps ThreadCount threads. Ignored with \ref DOKAN_OPTION_OVERLAPPED_IO.
+  */
+  ULONG MaxThreadCount;
+  /**
+  * Time in milliseconds an extra thread stays idle before it exits.
+  * 0 uses the default of 30 seconds.
+  */
+  ULONG ThreadIdleTimeout;
+  /**
+  * Size in bytes of the buffers events are received in. Bigger buffers let
+  * larger writes arrive with their event and more events arrive at once.
+  * 0 uses the default of 32KB, the driver caps it to 1MB.
+  */
+  ULONG EventBufferSize;
+  /**
+  * Maximum number of events a thread receives at once. 0 means no limit.
+  */
+  ULONG MaxBatchCount;
+  /**
+  * Time in milliseconds a directory listing is reused by later FindFiles
+  * requests on the same directory. 0 disables the directory cache.
+  * Listings are dropped earlier when Dokan sees a create, delete, rename or
+  * set information request in the directory.
+  */
+  ULONG DirectoryCacheTimeout;
+  /**
+  * Maximum size in bytes of the directory cache. 0 uses the default of 16MB.
+  */
+  ULONG DirectoryCacheSize;
+  /**
+  * File the IDs of \ref DOKAN_OPTION_FILE_ID_MAP are loaded from at mount
+  * and saved to at unmount. NULL keeps them for the mount only.
+  */
+  LPCWSTR FileIdMapFile;
+  /**
+  * Time in milliseconds the result of GetFileInformation is reused for
+  * later queries on the same file, from any handle. 0 disables the cache.
+  * Writes, set information, locks and cleanups of the file drop it earlier.
+  */
+  ULONG FileInfoCacheTimeout;
+  /**
+  * Time in milliseconds a path ZwCreateFile reported missing is answered
+  * as missing without calling it again. 0 disables the cache.
+  * Creating or renaming to the path drops it earlier. Misses are answered
+  * by the library, the driver still sends each open.
+  */
+  ULONG NegativeCacheTimeout;
+  /**
+  * Time in milliseconds the result of GetDiskFreeSpace is reused for later
+  * volume queries. 0 calls it for each query. The result of
+  * GetVolumeInformation is always kept for the lifetime of the mount.
+  */
+  ULONG FreeSpaceCacheTimeout;
+  /**
+  * Time in milliseconds the descriptor returned by GetFileSecurity is
+  * reused for later queries on the same file. 0 disables the cache.
+  * SetFileSecurity, renames and deletions drop it earlier.
+  */
+  ULONG SecurityCacheTimeout;
 } DOKAN_OPTIONS, *PDOKAN_OPTIONS;
 
 /**
@@ -162,10 +290,28 @@ typedef struct _DOKAN_FILE_INFO {
 
 /**
  * \brief FillFindData Used to add an entry in FindFiles operation
- * \return 1 if buffer is full, otherwise 0 (currently it never returns 1)
+ * \return 1 if buffer is full, otherwise 0. It only returns 1 when called from
+ * \ref DOKAN_OPERATIONS.FindFilesResumable
+ * \see DokanFillFindInfo to add an entry without a WIN32_FIND_DATAW
  */
 typedef int(WINAPI *PFillFindData)(PWIN32_FIND_DATAW, PDOKAN_FILE_INFO);
 
+/**
+ * \struct DOKAN_FIND_INFO
+ * \brief Attributes of an entry added with \ref DokanFillFindInfo
+ */
+typedef struct _DOKAN_FIND_INFO {
+  LARGE_INTEGER CreationTime;
+  LARGE_INTEGER LastAccessTime;
+  LARGE_INTEGER LastWriteTime;
+  /** Time of the last change of the file. 0 uses LastWriteTime */
+  LARGE_INTEGER ChangeTime;
+  LARGE_INTEGER FileSize;
+  /** 64-bit file ID returned with the FileId* information classes */
+  ULONG64 FileId;
+  ULONG FileAttributes;
+} DOKAN_FIND_INFO, *PDOKAN_FIND_INFO;
+
 /**
  * \brief FillFindStreamData Used to add an entry in FindStreams
  * \return 1 if buffer is full, otherwise 0 (currently it never returns 1)
@@ -267,7 +413,8 @@ typedef struct _DOKAN_OPERATIONS {
   * It can be called by different threads at the same time, so the read/context has to be thread safe.
   *
   * \param FileName File path requested by the Kernel on the FileSystem.
-  * \param Buffer Read buffer that has to be filled with the read result.
+  * \param Buffer Read buffer that has to be filled with the read result. Large reads can point
+  * directly to a mapping of the requester's pages, only the first ReadLength bytes are returned.
   * \param BufferLength Buffer length and read size to continue with.
   * \param ReadLength Total data size that has been read.
   * \param Offset Offset from where the read has to be continued.
@@ -289,7 +436,8 @@ typedef struct _DOKAN_OPERATIONS {
   * It can be called by different threads at the same time, sp the write/context has to be thread safe.
   *
   * \param FileName File path requested by the Kernel on the FileSystem.
-  * \param Buffer Data that has to be written.
+  * \param Buffer Data that has to be written. Large writes can point directly to a read-only
+  * mapping of the caller's pages that is only valid until the request is completed.
   * \param NumberOfBytesToWrite Buffer length and write size to continue with.
   * \param NumberOfBytesWritten Total number of bytes that have been written.
   * \param Offset Offset from where the write has to be continued.
@@ -334,7 +482,7 @@ typedef struct _DOKAN_OPERATIONS {
   * \brief FindFiles Dokan API callback
   *
   * List all files in the requested path
-  * \ref DOKAN_OPERATIONS.FindFilesWithPattern is checked first. If it is not implemented or
+  * \ref DOKAN_OPERATIONS.FindFilesResumable and \ref DOKAN_OPERATIONS.FindFilesWithPattern are checked first. If it is not implemented or
   * returns \c STATUS_NOT_IMPLEMENTED, then FindFiles is called, if implemented.
   *
   * \param FileName File path requested by the Kernel on the FileSystem.
@@ -543,6 +691,10 @@ typedef struct _DOKAN_OPERATIONS {
   * Before these methods are called, \ref ZwCreateFile may not be called.
   * (ditto \ref CloseFile and \ref Cleanup)
   *
+  * The result is reused for \ref DOKAN_OPTIONS.FreeSpaceCacheTimeout.
+  * With \ref DOKAN_OPTION_FREE_SPACE_REFRESH it may be called from a thread
+  * pool thread, with a DokanFileInfo that only has DokanOptions set.
+  *
   * \param FreeBytesAvailable Amount of available space.
   * \param TotalNumberOfBytes Total size of storage space
   * \param TotalNumberOfFreeBytes Amount of free space
@@ -574,6 +726,9 @@ typedef struct _DOKAN_OPERATIONS {
   * FileSystemFlags if \ref DOKAN_OPTION_WRITE_PROTECT was
   * specified in DOKAN_OPTIONS when the volume was mounted.
   *
+  * Dokan calls it until it succeeds once and then keeps the result for the
+  * lifetime of the mount.
+  *
   * \param VolumeNameBuffer A pointer to a buffer that receives the name of a specified volume.
   * \param VolumeNameSize The length of a volume name buffer.
   * \param VolumeSerialNumber A pointer to a variable that receives the volume serial number.
@@ -624,6 +779,10 @@ typedef struct _DOKAN_OPERATIONS {
   *
   * Return \c STATUS_BUFFER_OVERFLOW if buffer size is too small.
   *
+  * The descriptor returned is reused for
+  * \ref DOKAN_OPTIONS.SecurityCacheTimeout. Return \c STATUS_NOT_IMPLEMENTED
+  * to get a default descriptor built by Dokan once per mount.
+  *
   * \since Supported since version 0.6.0. The version must be specified in \ref DOKAN_OPTIONS.Version.
   * \param FileName File path requested by the Kernel on the FileSystem.
   * \param SecurityInformation A SECURITY_INFORMATION value that identifies the security information being requested.
@@ -679,6 +838,32 @@ typedef struct _DOKAN_OPERATIONS {
     PFillFindStreamData FillFindStreamData,
     PDOKAN_FILE_INFO DokanFileInfo);
 
+  /**
+  * \brief FindFilesResumable Dokan API callback
+  *
+  * Same as \ref DOKAN_OPERATIONS.FindFilesWithPattern but the directory is listed
+  * in steps, so the first entries are returned before the whole directory is read.
+  * When FillFindData returns 1, the current page is full: save the position of the
+  * next entry in \a ResumeCookie and return. The next call continues from it.
+  * Set \a ResumeCookie to 0 once the last entry was filled.
+  * "." and "..", if listed, have to be filled by the first call.
+  * It is checked before \ref DOKAN_OPERATIONS.FindFilesWithPattern.
+  *
+  * \since Only used when \ref DOKAN_OPTIONS.OperationsSize covers it.
+  * \param PathName Path requested by the Kernel on the FileSystem.
+  * \param SearchPattern Search pattern.
+  * \param FillFindData Callback that has to be called with PWIN32_FIND_DATAW that contains file information.
+  * \param ResumeCookie 0 on the first call, otherwise the value left by the previous call.
+  * \param DokanFileInfo Information about the file or directory.
+  * \return \c STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * \see FindFilesWithPattern
+  */
+  NTSTATUS(DOKAN_CALLBACK *FindFilesResumable)(LPCWSTR PathName,
+    LPCWSTR SearchPattern,
+    PFillFindData FillFindData,
+    PULONG64 ResumeCookie,
+    PDOKAN_FILE_INFO DokanFileInfo);
+
 } DOKAN_OPERATIONS, *PDOKAN_OPERATIONS;
 
 // clang-format on
@@ -778,6 +963,36 @@ BOOL DOKANAPI DokanRemoveMountPointEx(LPCWSTR MountPoint, BOOL Safe);
 BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, LPCWSTR Name,
                                       BOOL IgnoreCase);
 
+/**
+ * \brief Compares two UTF-16 strings of Length characters
+ *
+ * ASCII characters are compared with SSE2 when available, others are
+ * upcased with towupper.
+ *
+ * \param String1 First string, not necessarily null-terminated
+ * \param String2 Second string, not necessarily null-terminated
+ * \param Length Number of characters to compare
+ * \param IgnoreCase Case sensitive or not
+ * \return TRUE if the strings are equal
+ */
+BOOL DOKANAPI DokanEqualUtf16(LPCWSTR String1, LPCWSTR String2, ULONG Length,
+                              BOOL IgnoreCase);
+
+/**
+ * \brief Checks whether a UTF-16 string starts with Prefix
+ *
+ * \param String String to check, not necessarily null-terminated
+ * \param Length Number of characters of String
+ * \param Prefix Prefix to look for, not necessarily null-terminated
+ * \param PrefixLength Number of characters of Prefix
+ * \param IgnoreCase Case sensitive or not
+ * \return TRUE if String starts with Prefix
+ * \see DokanEqualUtf16
+ */
+BOOL DOKANAPI DokanStartsWithUtf16(LPCWSTR String, ULONG Length,
+                                   LPCWSTR Prefix, ULONG PrefixLength,
+                                   BOOL IgnoreCase);
+
 /**
  * \brief Get the version of Dokan.
  * The returned ULONG is the version number without the dots.
@@ -801,6 +1016,112 @@ ULONG DOKANAPI DokanDriverVersion();
  */
 BOOL DOKANAPI DokanResetTimeout(ULONG Timeout, PDOKAN_FILE_INFO DokanFileInfo);
 
+/**
+ * \brief Get the number of threads processing the events of a mount.
+ *
+ * \param MountPoint Mount point of the device.
+ * \param CurrentCount Receives the number of running threads.
+ * \param PeakCount Receives the highest number of threads since the mount.
+ * \return \c TRUE if a mount was found for MountPoint.
+ */
+BOOL DOKANAPI DokanGetThreadCount(LPCWSTR MountPoint, PULONG CurrentCount,
+                                  PULONG PeakCount);
+
+/**
+ * \brief Add an entry to a directory listing without a WIN32_FIND_DATAW.
+ *
+ * Can be called instead of the FillFindData function given to
+ * \ref DOKAN_OPERATIONS.FindFiles, \ref DOKAN_OPERATIONS.FindFilesWithPattern
+ * and \ref DOKAN_OPERATIONS.FindFilesResumable, from within the callback.
+ * The name is copied once and needs neither a null terminator nor to fit in
+ * MAX_PATH.
+ *
+ * \param FileName Name of the entry.
+ * \param FileNameLength Length of FileName in characters.
+ * \param FindInfo Attributes of the entry.
+ * \param DokanFileInfo \ref DOKAN_FILE_INFO given to the callback.
+ * \return Same as \ref PFillFindData.
+ */
+int DOKANAPI DokanFillFindInfo(LPCWSTR FileName, ULONG FileNameLength,
+                               PDOKAN_FIND_INFO FindInfo,
+                               PDOKAN_FILE_INFO DokanFileInfo);
+
+/** Directory listing cache, see \ref DOKAN_OPTIONS.DirectoryCacheTimeout */
+#define DOKAN_CACHE_DIRECTORY 0
+/** File information cache, see \ref DOKAN_OPTIONS.FileInfoCacheTimeout */
+#define DOKAN_CACHE_FILE_INFO 1
+/** Negative lookup cache, see \ref DOKAN_OPTIONS.NegativeCacheTimeout */
+#define DOKAN_CACHE_NEGATIVE 2
+/** Volume information cache, see \ref DOKAN_OPTIONS.FreeSpaceCacheTimeout */
+#define DOKAN_CACHE_VOLUME 3
+/** Security descriptor cache, see \ref DOKAN_OPTIONS.SecurityCacheTimeout */
+#define DOKAN_CACHE_SECURITY 4
+
+/**
+ * \struct DOKAN_CACHE_STATS
+ * \brief Usage of a cache of a mount
+ *
+ * \see DokanGetCacheStats
+ */
+typedef struct _DOKAN_CACHE_STATS {
+  /** Lookups answered by the cache */
+  ULONG64 Hits;
+  /** Lookups that had to call the file system */
+  ULONG64 Misses;
+  /** Entries dropped because of a change */
+  ULONG64 Invalidations;
+  /** Entries currently cached */
+  ULONG EntryCount;
+  /** Bytes currently used by the entries */
+  ULONG64 Size;
+} DOKAN_CACHE_STATS, *PDOKAN_CACHE_STATS;
+
+/**
+ * \brief Get the usage of a cache of a mount.
+ *
+ * \param MountPoint Mount point of the device.
+ * \param Cache One of the DOKAN_CACHE_* values.
+ * \param Stats Receives the usage of the cache.
+ * \return \c TRUE if a mount was found for MountPoint and Cache is valid.
+ */
+BOOL DOKANAPI DokanGetCacheStats(LPCWSTR MountPoint, ULONG Cache,
+                                 PDOKAN_CACHE_STATS Stats);
+
+/**
+ * \brief Keep the current request open after its callback returns.
+ *
+ * Can be called from \ref DOKAN_OPERATIONS.ZwCreateFile,
+ * \ref DOKAN_OPERATIONS.ReadFile and \ref DOKAN_OPERATIONS.WriteFile.
+ * When it succeeds, the callback must return \c STATUS_PENDING and the
+ * request must later be finished with \ref DokanCompleteRequest, from any thread.
+ *
+ * The ReadFile Buffer stays valid until the request is completed.
+ * FileName, the WriteFile Buffer and the SecurityContext of ZwCreateFile are
+ * only valid until the callback returns and must be copied if needed.
+ * The driver timeout still applies: call \ref DokanResetTimeout before
+ * returning \c STATUS_PENDING for long operations.
+ *
+ * \param DokanFileInfo \ref DOKAN_FILE_INFO given to the callback.
+ * \return A copy of DokanFileInfo identifying the pending request, or \c NULL
+ * if the request cannot be kept pending and has to be processed synchronously.
+ */
+PDOKAN_FILE_INFO DOKANAPI DokanPendRequest(PDOKAN_FILE_INFO DokanFileInfo);
+
+/**
+ * \brief Finish a request kept pending with \ref DokanPendRequest.
+ *
+ * DOKAN_FILE_INFO.Context and DOKAN_FILE_INFO.IsDirectory of
+ * PendingFileInfo can be updated before this call. PendingFileInfo must not
+ * be used after it.
+ *
+ * \param PendingFileInfo Value returned by \ref DokanPendRequest.
+ * \param Status Result of the operation, same as the callback would return.
+ * \param TransferLength Number of bytes read or written, ignored for ZwCreateFile.
+ * \return \c FALSE if PendingFileInfo is \c NULL.
+ */
+BOOL DOKANAPI DokanCompleteRequest(PDOKAN_FILE_INFO PendingFileInfo,
+                                   NTSTATUS Status, ULONG TransferLength);
+
 /**
  * \brief Get the handle to Access Token.
  *
@@ -46,6 +46,28 @@ extern "C" {
 
 #define DOKAN_MAX_THREAD 15
 
+// Overlapped event requests kept pending per thread by default
+#define DOKAN_DEFAULT_QUEUE_DEPTH_PER_THREAD 2
+
+#define DOKAN_MAX_QUEUE_DEPTH 128
+
+// Upper bound of DOKAN_OPTIONS.MaxThreadCount
+#define DOKAN_MAX_WORKER_THREAD 64
+
+#define DOKAN_DEFAULT_THREAD_IDLE_TIMEOUT 30000 // in miliseconds
+
+// Whether the DOKAN_OPTIONS given by the caller contains Field
+#define DOKAN_OPTIONS_HAS(Options, Field)                                      \
+  ((Options)->Version >= DOKAN_OPTIONS_SIZE_VERSION &&                         \
+   FIELD_OFFSET(DOKAN_OPTIONS, Field) + sizeof((Options)->Field) <=            \
+       (Options)->Size)
+
+// Whether the DOKAN_OPERATIONS given by the caller contains Field
+#define DOKAN_OPERATIONS_HAS(Options, Field)                                   \
+  (DOKAN_OPTIONS_HAS(Options, OperationsSize) &&                               \
+   FIELD_OFFSET(DOKAN_OPERATIONS, Field) + sizeof(PVOID) <=                    \
+       (Options)->OperationsSize)
+
 // DokanOptions->DebugMode is ON?
 extern BOOL g_DebugMode;
 
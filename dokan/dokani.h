@@ -35,6 +35,504 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 extern "C" {
 #endif
 
+/** Consecutive reopen attempts allowed before a worker gives up its channel */
+#define DOKAN_CHANNEL_MAX_RECONNECT 3
+
+/** Largest reply kept back to be sent along with the next wait */
+#define DOKAN_DEFERRED_REPLY_MAX_SIZE (1024 * 8)
+
+/** Arena slot of the EVENT_INFORMATION reply */
+#define DOKAN_ARENA_REPLY 0
+/** Arena slot of the EVENT_CONTEXT fetched for large writes */
+#define DOKAN_ARENA_WRITE 1
+#define DOKAN_ARENA_SLOT_COUNT 2
+
+/** Arena buffers are allocated by multiples of this size */
+#define DOKAN_ARENA_GRANULARITY (1024 * 4)
+/** Larger requests get a buffer of their own, freed after the event */
+#define DOKAN_ARENA_MAX_SIZE (1024 * 1024 * 4)
+
+/**
+ * \struct DOKAN_ARENA_SLOT
+ * \brief Reusable buffer of a DOKAN_REPLY_ARENA
+ */
+typedef struct _DOKAN_ARENA_SLOT {
+  /** malloc'ed buffer, NULL until first use */
+  PVOID Buffer;
+  /** Size of Buffer in bytes */
+  ULONG Size;
+  /** TRUE between DokanArenaAlloc and DokanArenaFree */
+  BOOL InUse;
+} DOKAN_ARENA_SLOT, *PDOKAN_ARENA_SLOT;
+
+/**
+ * \struct DOKAN_REPLY_ARENA
+ * \brief Per worker buffers reused from one event to the next
+ *
+ * Each slot grows to the largest request seen, up to DOKAN_ARENA_MAX_SIZE.
+ */
+typedef struct _DOKAN_REPLY_ARENA {
+  DOKAN_ARENA_SLOT Slots[DOKAN_ARENA_SLOT_COUNT];
+  /** Number of DokanArenaAlloc calls */
+  ULONG64 RequestCount;
+  /** Number of DokanArenaAlloc calls that had to call malloc */
+  ULONG64 MallocCount;
+} DOKAN_REPLY_ARENA, *PDOKAN_REPLY_ARENA;
+
+/**
+ * \struct DOKAN_EVENT_RING
+ * \brief Rings of IOCTL_EVENT_RING shared with the driver
+ *
+ * Submit carries EVENT_CONTEXTs from the driver, Complete the
+ * EVENT_INFORMATIONs back, see sys/ring.h.
+ */
+typedef struct _DOKAN_EVENT_RING {
+  /** Events submitted by the driver */
+  DOKAN_RING Submit;
+  /** Replies to the events taken from Submit */
+  DOKAN_RING Complete;
+  /** Largest payload of a slot, the same in both rings */
+  ULONG PayloadSize;
+  /** Set by the driver when Submit is no longer empty or is closed */
+  HANDLE SubmitEvent;
+  /** Set for the driver when Complete is no longer empty */
+  HANDLE CompleteEvent;
+  /** Threads consuming Submit */
+  HANDLE *Threads;
+  /** Number of threads in Threads */
+  ULONG ThreadCount;
+  /** Events taken from Submit */
+  volatile LONG64 Events;
+  /** Replies sent through Complete */
+  volatile LONG64 Replies;
+} DOKAN_EVENT_RING, *PDOKAN_EVENT_RING;
+
+/**
+ * \struct DOKAN_DEVICE_CHANNEL
+ * \brief Persistent handle on the raw volume device
+ *
+ * Each worker opens its channel once and reuses it for all wait / reply
+ * cycles instead of opening the device for every event.
+ */
+typedef struct _DOKAN_DEVICE_CHANNEL {
+  /** Handle on the device, INVALID_HANDLE_VALUE when closed */
+  HANDLE Device;
+  /** Raw device name the channel is opened on */
+  WCHAR RawDeviceName[MAX_PATH];
+  /** dwFlagsAndAttributes given to CreateFile, e.g. FILE_FLAG_OVERLAPPED */
+  DWORD FlagsAndAttributes;
+  /** Consecutive reconnect attempts since the last successful ioctl */
+  ULONG ReconnectAttempts;
+  /** Total number of successful reconnects */
+  ULONG ReconnectCount;
+  /**
+  * Reply kept back by SendEventInformation, sent with IOCTL_EVENT_INFO_WAIT.
+  * NULL when the owner does not support deferred replies.
+  */
+  PEVENT_INFORMATION DeferredReply;
+  /** Length of the reply in DeferredReply, 0 when there is none */
+  ULONG DeferredReplyLength;
+  /** Whether the reply of the event being dispatched may be deferred */
+  BOOL DeferReply;
+  /**
+  * Ring the events of the owner come from, their replies go back through it.
+  * NULL for the channels waiting on the driver.
+  */
+  PDOKAN_EVENT_RING EventRing;
+} DOKAN_DEVICE_CHANNEL, *PDOKAN_DEVICE_CHANNEL;
+
+/**
+ * \struct DOKAN_CHANNEL_TRANSPORT
+ * \brief Calls a DOKAN_DEVICE_CHANNEL makes on the device
+ *
+ * CreateFile, DeviceIoControl and CloseHandle on the dokan device by default,
+ * replaced by a loopback in the tests and benchmarks.
+ */
+typedef struct _DOKAN_CHANNEL_TRANSPORT {
+  /** Open RawDeviceName, INVALID_HANDLE_VALUE on failure */
+  HANDLE (*Open)(LPCWSTR RawDeviceName, DWORD FlagsAndAttributes);
+  /** Synchronous ioctl, FALSE with the last error set on failure */
+  BOOL (*IoControl)(HANDLE Device, DWORD IoControlCode, PVOID InputBuffer,
+                    ULONG InputLength, PVOID OutputBuffer, ULONG OutputLength,
+                    PULONG ReturnedLength);
+  /** Close a handle returned by Open */
+  VOID (*Close)(HANDLE Device);
+} DOKAN_CHANNEL_TRANSPORT, *PDOKAN_CHANNEL_TRANSPORT;
+
+/**
+ * \struct DOKAN_IO_REQUEST
+ * \brief Overlapped event request of the I/O completion port engine
+ */
+typedef struct _DOKAN_IO_REQUEST {
+  /** Overlapped structure given to DeviceIoControl */
+  OVERLAPPED Overlapped;
+  /** Receives the EVENT_BATCH */
+  PCHAR Buffer;
+  /** Size of Buffer in bytes */
+  ULONG BufferSize;
+} DOKAN_IO_REQUEST, *PDOKAN_IO_REQUEST;
+
+/**
+ * \struct DOKAN_IO_ENGINE
+ * \brief I/O completion port engine used with DOKAN_OPTION_OVERLAPPED_IO
+ *
+ * QueueDepth requests stay pending in the driver on one overlapped handle.
+ * Worker threads dispatch completed requests and post them again.
+ */
+typedef struct _DOKAN_IO_ENGINE {
+  /** Overlapped channel the requests are pending on */
+  DOKAN_DEVICE_CHANNEL Channel;
+  /** Completion port associated with Channel */
+  HANDLE CompletionPort;
+  /** Number of requests in Requests */
+  ULONG QueueDepth;
+  /** Number of worker threads waiting on CompletionPort */
+  ULONG ThreadCount;
+  /** Requests kept pending in the driver */
+  PDOKAN_IO_REQUEST Requests;
+  /** Requests currently pending, workers stop when it reaches 0 */
+  volatile LONG PendingRequests;
+} DOKAN_IO_ENGINE, *PDOKAN_IO_ENGINE;
+
+/**
+ * \struct DOKAN_WORKER
+ * \brief Thread processing events for a DOKAN_INSTANCE
+ */
+typedef struct _DOKAN_WORKER {
+  /** Entry in DOKAN_WORKER_POOL.Workers or ExitedWorkers */
+  LIST_ENTRY ListEntry;
+  /** Thread handle, closed once the thread has ended */
+  HANDLE Thread;
+  /** Instance the worker belongs to */
+  struct _DOKAN_INSTANCE *DokanInstance;
+  /** TRUE while the worker is waiting for events in the driver */
+  BOOL Waiting;
+  /** GetTickCount64 value when the worker started waiting */
+  ULONGLONG WaitingSince;
+  /** Set by DokanRetireIdleWorkers, the worker exits after its wait */
+  BOOL Retire;
+} DOKAN_WORKER, *PDOKAN_WORKER;
+
+/**
+ * \struct DOKAN_WORKER_POOL
+ * \brief Worker threads of a DOKAN_INSTANCE
+ *
+ * The pool keeps between MinThreads and MaxThreads workers. A worker is added
+ * when a batch reports queued events and no other worker is waiting. Workers
+ * above MinThreads exit after IdleTimeout milliseconds of waiting.
+ * All fields are protected by Lock.
+ */
+typedef struct _DOKAN_WORKER_POOL {
+  CRITICAL_SECTION Lock;
+  /** List of DOKAN_WORKER */
+  LIST_ENTRY Workers;
+  /** DOKAN_WORKER that called DokanWorkerExit, their thread may still run */
+  LIST_ENTRY ExitedWorkers;
+  /** Thread routine of the workers, receives the PDOKAN_WORKER */
+  unsigned(__stdcall *ThreadLoop)(void *);
+  ULONG MinThreads;
+  ULONG MaxThreads;
+  /** Idle time in milliseconds before a worker above MinThreads exits */
+  ULONG IdleTimeout;
+  /** Running workers */
+  ULONG ThreadCount;
+  /** Workers waiting for events in the driver */
+  ULONG WaitingCount;
+  /** Highest ThreadCount reached */
+  ULONG PeakThreadCount;
+  /** Set once a worker stopped on error, no worker is added anymore */
+  BOOL Stopping;
+  /** Signaled when ThreadCount drops to 0 */
+  HANDLE StoppedEvent;
+} DOKAN_WORKER_POOL, *PDOKAN_WORKER_POOL;
+
+/** Free DOKAN_OPEN_INFO kept by an instance for reuse */
+#define DOKAN_OPEN_INFO_POOL_MAX_FREE 1024
+/** Free DOKAN_DIR_CHUNK kept by an instance for reuse */
+#define DOKAN_DIR_CHUNK_POOL_MAX_FREE 64
+
+/**
+ * \struct DOKAN_OBJECT_POOL
+ * \brief Lock-free cache of fixed size objects
+ *
+ * Freed objects are kept in FreeList, up to MaxFree of them, and handed out
+ * again by DokanPoolAlloc. Objects are not zeroed.
+ */
+typedef struct _DOKAN_OBJECT_POOL {
+  /** Free objects, the SLIST_ENTRY overlays the object */
+  SLIST_HEADER FreeList;
+  /** Size of an object, aligned on MEMORY_ALLOCATION_ALIGNMENT */
+  ULONG ObjectSize;
+  /** Maximum number of objects kept in FreeList */
+  LONG MaxFree;
+  /** Objects in FreeList */
+  volatile LONG FreeCount;
+  /** Objects handed out and not freed yet */
+  volatile LONG InUseCount;
+  /** Number of DokanPoolAlloc calls */
+  volatile LONG64 AllocCount;
+  /** Number of DokanPoolAlloc calls that allocated a new object */
+  volatile LONG64 MallocCount;
+} DOKAN_OBJECT_POOL, *PDOKAN_OBJECT_POOL;
+
+/**
+ * \struct DOKAN_IO_EVENT
+ * \brief Request being handled by a callback
+ *
+ * DOKAN_FILE_INFO.DokanContext points to it. It lives in the frame of the
+ * dispatcher, a pending request carries its own copy. The event buffer is
+ * reused once the dispatcher returns, what is needed from it is copied.
+ */
+typedef struct _DOKAN_IO_EVENT {
+  /** Open info of the file, NULL when the event has none */
+  struct _DOKAN_OPEN_INFO *OpenInfo;
+  /** Instance the request came from */
+  struct _DOKAN_INSTANCE *DokanInstance;
+  /** Serial number the driver knows the request by */
+  ULONG SerialNumber;
+  /** IRP_MJ_* of the request */
+  UCHAR MajorFunction;
+} DOKAN_IO_EVENT, *PDOKAN_IO_EVENT;
+
+/**
+ * \struct DOKAN_PENDING_REQUEST
+ * \brief Request kept pending with DokanPendRequest
+ *
+ * Freed once both the dispatcher and DokanCompleteRequest released it.
+ */
+typedef struct _DOKAN_PENDING_REQUEST {
+  /** Copy of the callback DOKAN_FILE_INFO given back to the application */
+  DOKAN_FILE_INFO FileInfo;
+  /** Copy of the request FileInfo.DokanContext points to */
+  DOKAN_IO_EVENT IoEvent;
+  /** References held by the dispatcher and the application */
+  volatile LONG Pending;
+  /** IRP_MJ_CREATE, IRP_MJ_READ or IRP_MJ_WRITE */
+  UCHAR MajorFunction;
+  /** Instance the reply is sent to */
+  struct _DOKAN_INSTANCE *DokanInstance;
+  /** Open info of the file, released when the reply is sent */
+  struct _DOKAN_OPEN_INFO *OpenInfo;
+  /** Reply owned by the request */
+  PEVENT_INFORMATION EventInfo;
+  /** Length of EventInfo in bytes */
+  ULONG EventInfoLength;
+  /** Storage for the create reply, the dispatcher keeps it on its stack */
+  EVENT_INFORMATION InlineEventInfo;
+  /** Offset of the read or write */
+  LONGLONG ByteOffset;
+  /** Create disposition */
+  ULONG Disposition;
+  /** File name of the create or write, its cached data is dropped once the
+   * request completes */
+  LPWSTR FileName;
+  /** Status given to DokanCompleteRequest */
+  NTSTATUS Status;
+  /** Bytes transferred given to DokanCompleteRequest */
+  ULONG TransferLength;
+} DOKAN_PENDING_REQUEST, *PDOKAN_PENDING_REQUEST;
+
+/** Default DOKAN_OPTIONS.DirectoryCacheSize */
+#define DOKAN_DEFAULT_DIR_CACHE_SIZE (16 * 1024 * 1024)
+
+/** Number of hash buckets of a DOKAN_PATH_CACHE */
+#define DOKAN_PATH_CACHE_BUCKETS 1024
+
+/**
+ * \struct DOKAN_PATH_CACHE_ENTRY
+ * \brief Header of a DOKAN_PATH_CACHE entry
+ *
+ * The payload of the cache user follows, then the path.
+ */
+typedef struct _DOKAN_PATH_CACHE_ENTRY {
+  LIST_ENTRY BucketEntry;
+  LIST_ENTRY LruEntry;
+  /** Case-insensitive hash of Path */
+  ULONG Hash;
+  /** Kind of payload, entries of a path differ by Tag */
+  ULONG Tag;
+  /** GetTickCount64 value after which the entry is not used anymore */
+  ULONGLONG Expiry;
+  /** Bytes charged to the cache */
+  ULONG Size;
+  /** Length of Path in characters */
+  ULONG PathLength;
+  /** Path of the entry, not null terminated */
+  LPWSTR Path;
+} DOKAN_PATH_CACHE_ENTRY, *PDOKAN_PATH_CACHE_ENTRY;
+
+struct _DOKAN_PATH_CACHE;
+
+/** Releases an entry and what its payload holds, called with the lock held */
+typedef VOID (*PDOKAN_PATH_CACHE_FREE)(struct _DOKAN_PATH_CACHE *Cache,
+                                       PDOKAN_PATH_CACHE_ENTRY Entry);
+
+/** Copies the payload of a found entry out, called with the lock held */
+typedef BOOL (*PDOKAN_PATH_CACHE_COPY)(PDOKAN_PATH_CACHE_ENTRY Entry,
+                                       PVOID Context);
+
+/**
+ * \struct DOKAN_PATH_CACHE
+ * \brief Entries keyed by file path shared by the handles of a mount
+ *
+ * Entries expire after Timeout. The least recently used ones are dropped
+ * to stay within MaxCount and MaxSize. Invalidating a path drops its
+ * entries and optionally the ones below it.
+ */
+typedef struct _DOKAN_PATH_CACHE {
+  /** Protects all the fields below */
+  CRITICAL_SECTION Lock;
+  /** Name of the cache in debug output */
+  LPCSTR Name;
+  /** Lifetime of an entry in milliseconds, 0 when the cache is disabled */
+  ULONG Timeout;
+  /** Maximum of Size, 0 for no limit */
+  ULONG64 MaxSize;
+  /** Maximum of Count, 0 for no limit */
+  ULONG MaxCount;
+  /** Whether lookups compare paths case sensitively */
+  BOOL CaseSensitive;
+  /** Bytes used by the entries */
+  ULONG64 Size;
+  /** Number of entries */
+  ULONG Count;
+  /** Entries, most recently used first */
+  LIST_ENTRY LruList;
+  /** Entries by path hash */
+  LIST_ENTRY Buckets[DOKAN_PATH_CACHE_BUCKETS];
+  /** Incremented by each invalidation */
+  ULONG64 Generation;
+  ULONG64 Hits;
+  ULONG64 Misses;
+  ULONG64 Invalidations;
+  /** NULL when entries are released with free */
+  PDOKAN_PATH_CACHE_FREE FreeEntry;
+} DOKAN_PATH_CACHE, *PDOKAN_PATH_CACHE;
+
+/** Maximum number of files in DOKAN_INSTANCE.InfoCache */
+#define DOKAN_INFO_CACHE_MAX_ENTRIES 16384
+
+/** Maximum number of paths in DOKAN_INSTANCE.NegativeCache */
+#define DOKAN_NEGATIVE_CACHE_MAX_ENTRIES 16384
+
+/** Number of buckets of DOKAN_SECURITY_CACHE for shared descriptors */
+#define DOKAN_SECURITY_DESCRIPTOR_BUCKETS 64
+
+/** Maximum number of paths in DOKAN_SECURITY_CACHE */
+#define DOKAN_SECURITY_CACHE_MAX_ENTRIES 16384
+
+/** Parts of a descriptor the default descriptors are built for */
+#define DOKAN_SECURITY_PARTS                                                   \
+  (OWNER_SECURITY_INFORMATION | GROUP_SECURITY_INFORMATION |                   \
+   DACL_SECURITY_INFORMATION | SACL_SECURITY_INFORMATION)
+
+/**
+ * \struct DOKAN_SECURITY_CACHE
+ * \brief Security descriptors of a mount
+ *
+ * Paths point to descriptors shared by content, most files of a volume
+ * have one of a few descriptors.
+ */
+typedef struct _DOKAN_SECURITY_CACHE {
+  /**
+   * Descriptors by path and SECURITY_INFORMATION. Its lock protects all the
+   * fields below.
+   */
+  DOKAN_PATH_CACHE Paths;
+  /** Bytes used by the shared descriptors */
+  ULONG64 DescriptorSize;
+  /** Number of shared descriptors */
+  ULONG DescriptorCount;
+  /** Shared descriptors by content hash */
+  LIST_ENTRY DescriptorBuckets[DOKAN_SECURITY_DESCRIPTOR_BUCKETS];
+  /**
+  * Descriptors of DefaultGetFileSecurity by IsDirectory and requested
+  * DOKAN_SECURITY_PARTS, built on first use and kept until the instance
+  * is deleted
+  */
+  PSECURITY_DESCRIPTOR Defaults[2][DOKAN_SECURITY_PARTS + 1];
+  ULONG DefaultLengths[2][DOKAN_SECURITY_PARTS + 1];
+} DOKAN_SECURITY_CACHE, *PDOKAN_SECURITY_CACHE;
+
+/**
+ * \struct DOKAN_VOLUME_INFO
+ * \brief Result of GetVolumeInformation
+ */
+typedef struct _DOKAN_VOLUME_INFO {
+  WCHAR VolumeName[MAX_PATH];
+  DWORD VolumeSerialNumber;
+  DWORD MaximumComponentLength;
+  DWORD FileSystemFlags;
+  WCHAR FileSystemName[MAX_PATH];
+} DOKAN_VOLUME_INFO, *PDOKAN_VOLUME_INFO;
+
+/**
+ * \struct DOKAN_DISK_FREE_SPACE
+ * \brief Result of GetDiskFreeSpace
+ */
+typedef struct _DOKAN_DISK_FREE_SPACE {
+  ULONGLONG FreeBytesAvailable;
+  ULONGLONG TotalNumberOfBytes;
+  ULONGLONG TotalNumberOfFreeBytes;
+} DOKAN_DISK_FREE_SPACE, *PDOKAN_DISK_FREE_SPACE;
+
+/**
+ * \struct DOKAN_VOLUME_CACHE
+ * \brief Volume information and free space of a mount
+ */
+typedef struct _DOKAN_VOLUME_CACHE {
+  /** Protects all the fields below */
+  CRITICAL_SECTION Lock;
+  /** Whether Information holds a successful GetVolumeInformation result */
+  BOOL InformationValid;
+  DOKAN_VOLUME_INFO Information;
+  /** Lifetime of FreeSpace in milliseconds, 0 when it is not cached */
+  ULONG FreeSpaceTimeout;
+  /** Whether expired figures are refreshed in the background */
+  BOOL BackgroundRefresh;
+  /** Whether FreeSpace holds a successful GetDiskFreeSpace result */
+  BOOL FreeSpaceValid;
+  DOKAN_DISK_FREE_SPACE FreeSpace;
+  /** GetTickCount64 value after which FreeSpace has to be refreshed */
+  ULONGLONG FreeSpaceExpiry;
+  /** Whether a background refresh is queued */
+  BOOL Refreshing;
+  /** Manual reset event signaled while no background refresh is queued */
+  HANDLE RefreshDone;
+  ULONG64 Hits;
+  ULONG64 Misses;
+} DOKAN_VOLUME_CACHE, *PDOKAN_VOLUME_CACHE;
+
+/** ID of the root directory in DOKAN_FILE_ID_MAP */
+#define DOKAN_FILE_ID_ROOT 1
+
+/** Initial number of buckets of DOKAN_FILE_ID_MAP, a power of 2 */
+#define DOKAN_FILE_ID_MAP_INITIAL_BUCKETS 1024
+
+/**
+ * \struct DOKAN_FILE_ID_MAP
+ * \brief File IDs assigned by Dokan, see DOKAN_OPTION_FILE_ID_MAP
+ *
+ * Each name is keyed by the ID of its parent directory and its own name,
+ * so renaming a directory does not touch the IDs below it.
+ */
+typedef struct _DOKAN_FILE_ID_MAP {
+  /** Protects all the fields below */
+  CRITICAL_SECTION Lock;
+  /** Whether IDs are assigned */
+  BOOL Enabled;
+  /** File the map is loaded from and saved to, NULL if not persisted */
+  LPWSTR FileName;
+  /** Names by hash of their parent ID and name */
+  struct _DOKAN_FILE_ID_NODE **Buckets;
+  /** Number of Buckets, a power of 2 */
+  ULONG BucketCount;
+  /** Number of names */
+  ULONG64 Count;
+  /** ID given to the next new name, never reused */
+  ULONG64 NextId;
+} DOKAN_FILE_ID_MAP, *PDOKAN_FILE_ID_MAP;
+
 /**
  * \struct DOKAN_INSTANCE
  * \brief Dokan mount instance informations
@@ -62,12 +560,53 @@ typedef struct _DOKAN_INSTANCE {
   ULONG DeviceNumber;
   /** Mount ID */
   ULONG MountId;
+  /** Size of the event buffers granted by the driver */
+  ULONG EventBufferSize;
+  /** DOKAN_FEATURE_* granted by the driver */
+  ULONG Features;
+  /** Slot payload of the event ring granted by the driver */
+  ULONG RingPayloadSize;
 
   /** DOKAN_OPTIONS linked to the mount */
   PDOKAN_OPTIONS DokanOptions;
   /** DOKAN_OPERATIONS linked to the mount */
   PDOKAN_OPERATIONS DokanOperations;
 
+  /** Channel shared by KeepAlive and ResetTimeout requests */
+  DOKAN_DEVICE_CHANNEL ControlChannel;
+
+  /** Completion port engine, NULL unless DOKAN_OPTION_OVERLAPPED_IO is set */
+  PDOKAN_IO_ENGINE IoEngine;
+
+  /** Threads processing the events of the mount */
+  DOKAN_WORKER_POOL WorkerPool;
+
+  /** Event ring mapped by the driver, NULL unless DOKAN_FEATURE_EVENT_RING */
+  PDOKAN_EVENT_RING EventRing;
+
+  /** DOKAN_OPEN_INFO allocator */
+  DOKAN_OBJECT_POOL OpenInfoPool;
+  /** DOKAN_DIR_CHUNK allocator */
+  DOKAN_OBJECT_POOL DirChunkPool;
+
+  /** Directory listings shared by the handles of the mount */
+  DOKAN_PATH_CACHE DirCache;
+
+  /** File IDs of the mount */
+  DOKAN_FILE_ID_MAP FileIdMap;
+
+  /** GetFileInformation results shared by the handles of the mount */
+  DOKAN_PATH_CACHE InfoCache;
+
+  /** Paths recently reported missing */
+  DOKAN_PATH_CACHE NegativeCache;
+
+  /** Volume information and free space */
+  DOKAN_VOLUME_CACHE VolumeCache;
+
+  /** Security descriptors of GetFileSecurity and the default ones */
+  DOKAN_SECURITY_CACHE SecurityCache;
+
   /** Current list entry informations */
   LIST_ENTRY ListEntry;
 } DOKAN_INSTANCE, *PDOKAN_INSTANCE;
@@ -81,48 +620,283 @@ typedef struct _DOKAN_INSTANCE {
 typedef struct _DOKAN_OPEN_INFO {
   /** DOKAN_OPTIONS linked to the mount */
   BOOL IsDirectory;
-  /** Open count on the file */
-  ULONG OpenCount;
-  /** Event context */
-  PEVENT_CONTEXT EventContext;
-  /** Dokan instance linked to the open */
+  /**
+  * Open count on the file, updated with Interlocked functions.
+  * The open info is freed by the release that drops it to 0.
+  */
+  volatile LONG OpenCount;
+  /** Dokan instance linked to the open, set once at create */
   PDOKAN_INSTANCE DokanInstance;
   /** User Context see DOKAN_FILE_INFO.Context */
   ULONG64 UserContext;
   /** Event Id */
   ULONG EventId;
-  /** Directories list. Used by FindFiles */
-  PLIST_ENTRY DirListHead;
+  /** Directory listing. Used by FindFiles */
+  struct _DOKAN_DIR_LIST *DirList;
   /** File streams list. Used by FindStreams */
   PLIST_ENTRY StreamListHead;
 } DOKAN_OPEN_INFO, *PDOKAN_OPEN_INFO;
 
+/**
+* \struct DOKAN_DIR_ENTRY
+* \brief Packed directory entry
+*
+* Attributes and name given by FindFiles, without the unused fixed size names
+* of WIN32_FIND_DATAW. Entries are stored back to back in DOKAN_DIR_CHUNK.
+*/
+typedef struct _DOKAN_DIR_ENTRY {
+  DOKAN_FIND_INFO Info;
+  /** Length of FileName in bytes, without the terminating null */
+  ULONG FileNameLength;
+  /** Null terminated file name */
+  WCHAR FileName[1];
+} DOKAN_DIR_ENTRY, *PDOKAN_DIR_ENTRY;
+
+/** Size of a packed DOKAN_DIR_ENTRY with a name of NameBytes */
+#define DOKAN_DIR_ENTRY_SIZE(NameBytes)                                        \
+  ((FIELD_OFFSET(DOKAN_DIR_ENTRY, FileName) + (NameBytes) + sizeof(WCHAR) +    \
+    7) & ~7)
+
+/** Size of a DOKAN_DIR_CHUNK, header included */
+#define DOKAN_DIR_CHUNK_SIZE (64 * 1024)
+
+/**
+* \struct DOKAN_DIR_CHUNK
+* \brief Block of packed DOKAN_DIR_ENTRY
+*
+* Entries follow the header. Chunks are allocated from the instance
+* DirChunkPool and all released together when the listing is cleared.
+*/
+typedef struct _DOKAN_DIR_CHUNK {
+  /** Previously filled chunk of the listing */
+  struct _DOKAN_DIR_CHUNK *Next;
+  /** Bytes of entries used after the header */
+  ULONG Used;
+  ULONG Reserved;
+} DOKAN_DIR_CHUNK, *PDOKAN_DIR_CHUNK;
+
+/** Bytes of entries a DOKAN_DIR_CHUNK can hold */
+#define DOKAN_DIR_CHUNK_DATA_SIZE                                              \
+  (DOKAN_DIR_CHUNK_SIZE - sizeof(DOKAN_DIR_CHUNK))
+
+/** Name matcher accepting every name, the expression is "*" */
+#define DOKAN_MATCH_ALL 0
+/** Name matcher without wildcards */
+#define DOKAN_MATCH_LITERAL 1
+/** Name matcher of a literal followed by "*" */
+#define DOKAN_MATCH_PREFIX 2
+/** Name matcher of "*" followed by a literal, like "*.ext" */
+#define DOKAN_MATCH_SUFFIX 3
+/** Name matcher running the whole expression */
+#define DOKAN_MATCH_EXPRESSION 4
+
+/** Longest expression DokanIsNameInExpression matches without allocating */
+#define DOKAN_MATCH_STACK_LENGTH 256
+
+/**
+* \struct DOKAN_NAME_MATCHER
+* \brief Compiled DokanIsNameInExpression expression
+*
+* Built once by DokanCompileNameExpression and used by DokanMatchName, which
+* runs in O(name * expression) without recursion. A matcher must not be used
+* by two threads at once.
+*/
+typedef struct _DOKAN_NAME_MATCHER {
+  /** DOKAN_MATCH_* kind of the expression */
+  ULONG Kind;
+  BOOL IgnoreCase;
+  /** Literal part of the expression for the fast paths */
+  LPCWSTR Literal;
+  /** Length of Literal in characters */
+  ULONG LiteralLength;
+  /** Length of Expression in characters */
+  ULONG ExpressionLength;
+  /** Match state buffer, 2 * (ExpressionLength + 1) bytes */
+  PUCHAR States;
+  /** Expression, upcased when IgnoreCase is TRUE */
+  WCHAR Expression[1];
+} DOKAN_NAME_MATCHER, *PDOKAN_NAME_MATCHER;
+
+/** Initial number of entries allocated by a DOKAN_DIR_LIST */
+#define DOKAN_DIR_LIST_INITIAL_CAPACITY 64
+
+/**
+* \struct DOKAN_DIR_LIST
+* \brief Materialized listing of an open directory
+*
+* Entries filled by FindFiles are filtered once by the search pattern, so the
+* entry returned with FileIndex N is Entries[N - 1] and a query resumes at its
+* FileIndex without walking the entries before it.
+* With FindFilesResumable, entries are pulled as the pages are queried.
+*/
+typedef struct _DOKAN_DIR_LIST {
+  /** Listing entries, in the order they are returned */
+  PDOKAN_DIR_ENTRY *Entries;
+  /** Chunks holding the entries, last filled first */
+  PDOKAN_DIR_CHUNK Chunks;
+  /** Number of entries */
+  ULONG Count;
+  /** Number of entries Entries can hold */
+  ULONG Capacity;
+  /** TRUE once FindFiles succeeded and the listing was filtered */
+  BOOL Filled;
+  /** Search pattern of the listing, released by ClearFindData */
+  PDOKAN_NAME_MATCHER Matcher;
+  /** TRUE while FindFilesResumable has entries left */
+  BOOL Streaming;
+  /** Position of FindFilesResumable in the directory */
+  ULONG64 ResumeCookie;
+  /** Class of the query being filled, used to size PageBytes */
+  ULONG FileInformationClass;
+  /** FileIndex of the query being filled */
+  ULONG PageStart;
+  /** Record bytes of the entries pulled from PageStart */
+  ULONG PageBytes;
+  /** Record bytes after which FillFindData reports the page full */
+  ULONG PageBudget;
+} DOKAN_DIR_LIST, *PDOKAN_DIR_LIST;
+
+// Mounted instances, protected by g_InstanceCriticalSection
+extern CRITICAL_SECTION g_InstanceCriticalSection;
+extern LIST_ENTRY g_InstanceList;
+
 BOOL DokanStart(PDOKAN_INSTANCE Instance);
 
-BOOL SendToDevice(LPCWSTR DeviceName, DWORD IoControlCode, PVOID InputBuffer,
-                  ULONG InputLength, PVOID OutputBuffer, ULONG OutputLength,
+BOOL SendToDevice(DWORD IoControlCode, PVOID InputBuffer, ULONG InputLength,
+                  PVOID OutputBuffer, ULONG OutputLength,
                   PULONG ReturnedLength);
 
 LPWSTR
 GetRawDeviceName(LPCWSTR DeviceName, LPWSTR DestinationBuffer,
                  rsize_t DestinationBufferSizeInElements);
 
+VOID DokanInitDeviceChannel(PDOKAN_DEVICE_CHANNEL Channel);
+
+BOOL DokanOpenNamedDeviceChannel(PDOKAN_DEVICE_CHANNEL Channel,
+                                 LPCWSTR RawDeviceName);
+
+BOOL DokanOpenDeviceChannel(PDOKAN_DEVICE_CHANNEL Channel,
+                            PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanCloseDeviceChannel(PDOKAN_DEVICE_CHANNEL Channel);
+
+BOOL DokanReconnectDeviceChannel(PDOKAN_DEVICE_CHANNEL Channel);
+
+BOOL DokanIsChannelBroken(DWORD LastError);
+
+BOOL DokanChannelIoControl(PDOKAN_DEVICE_CHANNEL Channel, DWORD IoControlCode,
+                           PVOID InputBuffer, ULONG InputLength,
+                           PVOID OutputBuffer, ULONG OutputLength,
+                           PULONG ReturnedLength);
+
+VOID DokanSetChannelTransport(const DOKAN_CHANNEL_TRANSPORT *Transport);
+
+VOID DokanSetThreadChannel(PDOKAN_DEVICE_CHANNEL Channel);
+
+BOOL DokanDeferEventInformation(HANDLE Handle, PEVENT_INFORMATION EventInfo,
+                                ULONG EventLength);
+
+BOOL DokanChannelWaitEvents(PDOKAN_DEVICE_CHANNEL Channel, PVOID Buffer,
+                            ULONG BufferLength, PULONG ReturnedLength);
+
+typedef VOID (*PDOKAN_EVENT_DISPATCH)(HANDLE Handle,
+                                      PEVENT_CONTEXT EventContext,
+                                      PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanChannelDispatchBatch(PDOKAN_DEVICE_CHANNEL Channel,
+                               PEVENT_BATCH Batch, ULONG ReturnedLength,
+                               PDOKAN_EVENT_DISPATCH Dispatch,
+                               PDOKAN_INSTANCE DokanInstance);
+
+BOOL DokanChannelSendReply(HANDLE Handle, PEVENT_INFORMATION EventInfo,
+                           ULONG EventLength);
+
+BOOL DokanChannelPullWrite(HANDLE Handle, PEVENT_INFORMATION EventInfo,
+                           ULONG EventLength, PVOID Buffer, ULONG BufferLength,
+                           PULONG ReturnedLength);
+
 void ALIGN_ALLOCATION_SIZE(PLARGE_INTEGER size, PDOKAN_OPTIONS DokanOptions);
 
+void CheckAllocationUnitSectorSize(PDOKAN_OPTIONS DokanOptions);
+
+VOID DokanInitReplyArena(PDOKAN_REPLY_ARENA Arena);
+
+VOID DokanDeleteReplyArena(PDOKAN_REPLY_ARENA Arena);
+
+VOID DokanSetThreadArena(PDOKAN_REPLY_ARENA Arena);
+
+PVOID DokanArenaAlloc(ULONG Slot, ULONG Size);
+
+VOID DokanArenaFree(PVOID Buffer);
+
+VOID DokanArenaDetach(PVOID Buffer);
+
 UINT __stdcall DokanLoop(PVOID Param);
 
+VOID DokanDispatchEvent(HANDLE Handle, PEVENT_CONTEXT EventContext,
+                        PDOKAN_INSTANCE DokanInstance);
+
+PDOKAN_IO_ENGINE
+DokanCreateIoEngine(PDOKAN_INSTANCE DokanInstance, ULONG QueueDepth,
+                    ULONG ThreadCount);
+
+VOID DokanDeleteIoEngine(PDOKAN_IO_ENGINE IoEngine);
+
+UINT WINAPI DokanIoEngineLoop(PVOID Param);
+
+BOOL DokanStartEventRing(PDOKAN_INSTANCE DokanInstance, ULONG ThreadCount);
+
+VOID DokanStopEventRing(PDOKAN_INSTANCE DokanInstance);
+
+UINT WINAPI DokanEventRingLoop(PVOID Param);
+
+VOID DokanInitObjectPool(PDOKAN_OBJECT_POOL Pool, ULONG ObjectSize,
+                         LONG MaxFree);
+
+VOID DokanDeleteObjectPool(PDOKAN_OBJECT_POOL Pool);
+
+PVOID DokanPoolAlloc(PDOKAN_OBJECT_POOL Pool);
+
+VOID DokanPoolFree(PDOKAN_OBJECT_POOL Pool, PVOID Object);
+
+VOID DokanInitWorkerPool(PDOKAN_WORKER_POOL WorkerPool);
+
+VOID DokanDeleteWorkerPool(PDOKAN_WORKER_POOL WorkerPool);
+
+BOOL DokanStartWorker(PDOKAN_INSTANCE DokanInstance);
+
+BOOL DokanWorkerBeginWait(PDOKAN_WORKER Worker);
+
+BOOL DokanWorkerEndWait(PDOKAN_WORKER Worker, PEVENT_BATCH Batch,
+                        ULONG ReturnedLength);
+
+VOID DokanWorkerExit(PDOKAN_WORKER Worker, BOOL Failed);
+
+VOID DokanRetireIdleWorkers(PDOKAN_WORKER_POOL WorkerPool);
+
+VOID DokanJoinWorkers(PDOKAN_WORKER_POOL WorkerPool);
+
 BOOL DokanMount(LPCWSTR MountPoint, LPCWSTR DeviceName,
                 PDOKAN_OPTIONS DokanOptions);
 
 BOOL IsMountPointDriveLetter(LPCWSTR mountPoint);
 
+BOOL IsInstanceMountPoint(PDOKAN_INSTANCE Instance, LPCWSTR MountPoint);
+
 VOID SendEventInformation(HANDLE Handle, PEVENT_INFORMATION EventInfo,
                           ULONG EventLength, PDOKAN_INSTANCE DokanInstance);
 
 PEVENT_INFORMATION
 DispatchCommon(PEVENT_CONTEXT EventContext, ULONG SizeOfEventInfo,
                PDOKAN_INSTANCE DokanInstance, PDOKAN_FILE_INFO DokanFileInfo,
-               PDOKAN_OPEN_INFO *DokanOpenInfo);
+               PDOKAN_IO_EVENT IoEvent, PDOKAN_OPEN_INFO *DokanOpenInfo);
+
+VOID DokanInitIoEvent(PDOKAN_IO_EVENT IoEvent, PEVENT_CONTEXT EventContext,
+                      PDOKAN_INSTANCE DokanInstance,
+                      PDOKAN_OPEN_INFO OpenInfo,
+                      PDOKAN_FILE_INFO DokanFileInfo);
+
+PDOKAN_OPEN_INFO DokanFileInfoOpenInfo(PDOKAN_FILE_INFO DokanFileInfo);
 
 VOID DispatchDirectoryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
                                   PDOKAN_INSTANCE DokanInstance);
@@ -178,24 +952,168 @@ StopDriver(SC_HANDLE SchSCManager, LPCWSTR DriverName);
 BOOLEAN
 ManageDriver(LPCWSTR DriverName, LPCWSTR ServiceName, USHORT Function);
 
-BOOL SendReleaseIRP(LPCWSTR DeviceName);
+BOOL SendReleaseIRP(PDOKAN_INSTANCE DokanInstance);
 
 BOOL SendGlobalReleaseIRP(LPCWSTR MountPoint);
 
 VOID CheckFileName(LPWSTR FileName);
 
-VOID ClearFindData(PLIST_ENTRY ListHead);
+VOID ClearFindData(PDOKAN_DIR_LIST DirList, PDOKAN_INSTANCE DokanInstance);
+
+PDOKAN_DIR_ENTRY DokanDirListAllocEntry(PDOKAN_DIR_LIST DirList,
+                                        ULONG NameBytes,
+                                        PDOKAN_INSTANCE DokanInstance);
+
+VOID DokanDirListInsert(PDOKAN_DIR_LIST DirList, PDOKAN_DIR_ENTRY Entry,
+                        BOOLEAN InsertTail);
+
+int WINAPI DokanFillFileData(PWIN32_FIND_DATAW FindData,
+                             PDOKAN_FILE_INFO FileInfo);
+
+ULONG DokanPathCacheKeyLength(LPCWSTR Path);
+
+VOID DokanInitPathCache(PDOKAN_PATH_CACHE Cache, LPCSTR Name,
+                        PDOKAN_PATH_CACHE_FREE FreeEntry);
+
+VOID DokanStartPathCache(PDOKAN_PATH_CACHE Cache, ULONG Timeout,
+                         ULONG64 MaxSize, ULONG MaxCount,
+                         BOOL CaseSensitive);
+
+VOID DokanDeletePathCache(PDOKAN_PATH_CACHE Cache);
+
+PDOKAN_PATH_CACHE_ENTRY DokanPathCacheAllocEntry(LPCWSTR Path,
+                                                 ULONG64 EntrySize,
+                                                 ULONG Tag);
+
+BOOL DokanPathCacheLookup(PDOKAN_PATH_CACHE Cache, LPCWSTR Path, ULONG Tag,
+                          PDOKAN_PATH_CACHE_COPY Copy, PVOID Context,
+                          PULONG64 Generation);
+
+VOID DokanPathCacheInsert(PDOKAN_PATH_CACHE Cache,
+                          PDOKAN_PATH_CACHE_ENTRY Entry, ULONG64 Generation);
+
+VOID DokanPathCacheInvalidate(PDOKAN_PATH_CACHE Cache, LPCWSTR Path,
+                              ULONG PathLength, BOOL Subtree);
+
+VOID DokanGetPathCacheStats(PDOKAN_PATH_CACHE Cache,
+                            PDOKAN_CACHE_STATS Stats);
+
+BOOL DokanDirCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                         PDOKAN_DIR_LIST DirList, PULONG64 Generation);
+
+VOID DokanDirCacheStore(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                        PDOKAN_DIR_LIST DirList, ULONG64 Generation);
+
+VOID DokanDirCacheInvalidate(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                             BOOL Subtree);
+
+BOOL DokanInfoCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                          PBY_HANDLE_FILE_INFORMATION Information,
+                          PULONG64 Generation);
+
+VOID DokanInfoCacheStore(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                         PBY_HANDLE_FILE_INFORMATION Information,
+                         ULONG64 Generation);
+
+VOID DokanInfoCacheInvalidate(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                              BOOL Subtree);
+
+BOOL DokanNegativeCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                              NTSTATUS *Status, PULONG64 Generation);
+
+VOID DokanNegativeCacheStore(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                             NTSTATUS Status, ULONG64 Generation);
+
+VOID DokanNegativeCacheInvalidate(PDOKAN_INSTANCE DokanInstance,
+                                  LPCWSTR Path, BOOL Subtree);
+
+VOID DokanInitSecurityCache(PDOKAN_SECURITY_CACHE Cache);
+
+VOID DokanDeleteSecurityCache(PDOKAN_SECURITY_CACHE Cache);
+
+BOOL DokanSecurityCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                              SECURITY_INFORMATION SecurityInformation,
+                              PSECURITY_DESCRIPTOR SecurityDescriptor,
+                              ULONG BufferLength, PULONG LengthNeeded,
+                              PULONG64 Generation);
+
+VOID DokanSecurityCacheStore(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                             SECURITY_INFORMATION SecurityInformation,
+                             PSECURITY_DESCRIPTOR SecurityDescriptor,
+                             ULONG Length, ULONG64 Generation);
+
+VOID DokanSecurityCacheInvalidate(PDOKAN_INSTANCE DokanInstance,
+                                  LPCWSTR Path, BOOL Subtree);
+
+VOID DokanGetSecurityCacheStats(PDOKAN_SECURITY_CACHE Cache,
+                                PDOKAN_CACHE_STATS Stats);
+
+VOID DokanInitVolumeCache(PDOKAN_VOLUME_CACHE Cache);
+
+VOID DokanStartVolumeCache(PDOKAN_VOLUME_CACHE Cache, ULONG FreeSpaceTimeout,
+                           BOOL BackgroundRefresh);
+
+VOID DokanStopVolumeCache(PDOKAN_VOLUME_CACHE Cache);
+
+VOID DokanDeleteVolumeCache(PDOKAN_VOLUME_CACHE Cache);
+
+VOID DokanGetVolumeCacheStats(PDOKAN_VOLUME_CACHE Cache,
+                              PDOKAN_CACHE_STATS Stats);
+
+VOID DokanInitFileIdMap(PDOKAN_FILE_ID_MAP Map);
+
+VOID DokanStartFileIdMap(PDOKAN_FILE_ID_MAP Map, LPCWSTR FileName);
+
+BOOL DokanSaveFileIdMap(PDOKAN_FILE_ID_MAP Map);
+
+VOID DokanDeleteFileIdMap(PDOKAN_FILE_ID_MAP Map);
+
+ULONG64 DokanGetFileId(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                       LPCWSTR Name, ULONG NameLength);
+
+VOID DokanFileIdRename(PDOKAN_INSTANCE DokanInstance, LPCWSTR OldPath,
+                       LPCWSTR NewPath);
+
+VOID DokanFileIdRemove(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path);
 
 VOID ClearFindStreamData(PLIST_ENTRY ListHead);
 
+PDOKAN_NAME_MATCHER DokanCompileNameExpression(LPCWSTR Expression,
+                                               BOOL IgnoreCase);
+
+VOID DokanFreeNameMatcher(PDOKAN_NAME_MATCHER Matcher);
+
+BOOL DokanMatchName(PDOKAN_NAME_MATCHER Matcher, LPCWSTR Name,
+                    ULONG NameLength);
+
+VOID DokanUpcaseUtf16(LPWSTR Dest, LPCWSTR Src, ULONG Length);
+
+ULONG DokanHashUtf16(LPCWSTR String, ULONG Length, BOOL IgnoreCase);
+
 UINT WINAPI DokanKeepAlive(PVOID Param);
 
+PDOKAN_INSTANCE NewDokanInstance();
+
+VOID DeleteDokanInstance(PDOKAN_INSTANCE Instance);
+
 PDOKAN_OPEN_INFO
 GetDokanOpenInfo(PEVENT_CONTEXT EventInfomation, PDOKAN_INSTANCE DokanInstance);
 
 VOID ReleaseDokanOpenInfo(PEVENT_INFORMATION EventInfomation,
                           PDOKAN_INSTANCE DokanInstance);
 
+VOID FillCreateEventInformation(PEVENT_INFORMATION EventInfo, NTSTATUS Status,
+                                ULONG Disposition, BOOL IsDirectory);
+
+VOID DokanInvalidateCreatedFile(PDOKAN_INSTANCE DokanInstance,
+                                LPCWSTR FileName, PEVENT_INFORMATION EventInfo);
+
+VOID DokanAllowPendingRequest(PDOKAN_FILE_INFO DokanFileInfo);
+
+PDOKAN_PENDING_REQUEST DokanTakePendingRequest(NTSTATUS *Status);
+
+VOID DokanStartPendingRequest(PDOKAN_PENDING_REQUEST Request);
+
 #ifdef __cplusplus
 }
 #endif
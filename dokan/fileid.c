@@ -0,0 +1,558 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// A name of the map. Nodes only know their parent, a path is resolved from
+// the root one component at a time.
+typedef struct _DOKAN_FILE_ID_NODE {
+  struct _DOKAN_FILE_ID_NODE *Next;
+  ULONG64 Id;
+  ULONG64 ParentId;
+  ULONG Hash;
+  /** Length of Name in characters, not null terminated */
+  USHORT NameLength;
+  WCHAR Name[1];
+} DOKAN_FILE_ID_NODE, *PDOKAN_FILE_ID_NODE;
+
+// The map file is a DOKAN_FILE_ID_MAP_HEADER followed by Count records of
+// Id, ParentId, NameLength and Name, in no particular order.
+typedef struct _DOKAN_FILE_ID_MAP_HEADER {
+  ULONG Magic;
+  ULONG Version;
+  ULONG64 NextId;
+  ULONG64 Count;
+} DOKAN_FILE_ID_MAP_HEADER, *PDOKAN_FILE_ID_MAP_HEADER;
+
+#define DOKAN_FILE_ID_MAP_MAGIC 0x44494b44 // "DKID"
+#define DOKAN_FILE_ID_MAP_VERSION 1
+#define DOKAN_FILE_ID_IO_SIZE (64 * 1024)
+
+typedef struct _DOKAN_FILE_ID_STREAM {
+  HANDLE File;
+  PCHAR Buffer;
+  ULONG Length;
+  ULONG Position;
+} DOKAN_FILE_ID_STREAM, *PDOKAN_FILE_ID_STREAM;
+
+#define FILE_ID_NODE_SIZE(NameLength)                                          \
+  (FIELD_OFFSET(DOKAN_FILE_ID_NODE, Name) + (NameLength) * sizeof(WCHAR))
+
+static ULONG FileIdHash(ULONG64 ParentId, LPCWSTR Name, ULONG NameLength) {
+  ULONG64 mixed = ParentId * 0x9E3779B97F4A7C15ULL;
+  return DokanHashUtf16(Name, NameLength, TRUE) ^ (ULONG)(mixed >> 32);
+}
+
+// link pointing to the node of Name under ParentId, or the NULL link ending
+// its bucket. Called with the lock held
+static PDOKAN_FILE_ID_NODE *FileIdFind(PDOKAN_FILE_ID_MAP Map,
+                                       ULONG64 ParentId, LPCWSTR Name,
+                                       ULONG NameLength, ULONG Hash) {
+  PDOKAN_FILE_ID_NODE *link = &Map->Buckets[Hash & (Map->BucketCount - 1)];
+
+  while (*link != NULL) {
+    PDOKAN_FILE_ID_NODE node = *link;
+    if (node->Hash == Hash && node->ParentId == ParentId &&
+        node->NameLength == NameLength &&
+        DokanEqualUtf16(node->Name, Name, NameLength, TRUE)) {
+      break;
+    }
+    link = &node->Next;
+  }
+  return link;
+}
+
+// called with the lock held
+static VOID FileIdLink(PDOKAN_FILE_ID_MAP Map, PDOKAN_FILE_ID_NODE Node) {
+  PDOKAN_FILE_ID_NODE *bucket;
+
+  // keep about one name per bucket, chains only get longer if this fails
+  if (Map->Count >= Map->BucketCount && Map->BucketCount < 0x80000000) {
+    ULONG count = Map->BucketCount * 2;
+    PDOKAN_FILE_ID_NODE *buckets = calloc(count, sizeof(PDOKAN_FILE_ID_NODE));
+    if (buckets != NULL) {
+      ULONG i;
+      for (i = 0; i < Map->BucketCount; ++i) {
+        while (Map->Buckets[i] != NULL) {
+          PDOKAN_FILE_ID_NODE node = Map->Buckets[i];
+          Map->Buckets[i] = node->Next;
+          node->Next = buckets[node->Hash & (count - 1)];
+          buckets[node->Hash & (count - 1)] = node;
+        }
+      }
+      free(Map->Buckets);
+      Map->Buckets = buckets;
+      Map->BucketCount = count;
+    }
+  }
+
+  bucket = &Map->Buckets[Node->Hash & (Map->BucketCount - 1)];
+  Node->Next = *bucket;
+  *bucket = Node;
+  Map->Count++;
+}
+
+// called with the lock held
+static VOID FileIdUnlink(PDOKAN_FILE_ID_MAP Map, PDOKAN_FILE_ID_NODE *Link) {
+  *Link = (*Link)->Next;
+  Map->Count--;
+}
+
+// ID of Name under ParentId, assigned if Create is TRUE. 0 if not found.
+// Called with the lock held
+static ULONG64 FileIdChild(PDOKAN_FILE_ID_MAP Map, ULONG64 ParentId,
+                           LPCWSTR Name, ULONG NameLength, BOOL Create) {
+  PDOKAN_FILE_ID_NODE *link;
+  PDOKAN_FILE_ID_NODE node;
+  ULONG hash;
+
+  if (NameLength > MAXUSHORT) {
+    return 0;
+  }
+
+  hash = FileIdHash(ParentId, Name, NameLength);
+  link = FileIdFind(Map, ParentId, Name, NameLength, hash);
+  if (*link != NULL) {
+    return (*link)->Id;
+  }
+  if (!Create) {
+    return 0;
+  }
+
+  node = malloc(FILE_ID_NODE_SIZE(NameLength));
+  if (node == NULL) {
+    return 0;
+  }
+  node->Id = Map->NextId++;
+  node->ParentId = ParentId;
+  node->Hash = hash;
+  node->NameLength = (USHORT)NameLength;
+  RtlCopyMemory(node->Name, Name, NameLength * sizeof(WCHAR));
+  FileIdLink(Map, node);
+  return node->Id;
+}
+
+// ID of the first PathLength characters of Path. Called with the lock held
+static ULONG64 FileIdWalk(PDOKAN_FILE_ID_MAP Map, LPCWSTR Path,
+                          ULONG PathLength, BOOL Create) {
+  ULONG64 id = DOKAN_FILE_ID_ROOT;
+  ULONG start = 0;
+
+  while (start < PathLength && id != 0) {
+    ULONG end;
+
+    while (start < PathLength && Path[start] == L'\\')
+      start++;
+    for (end = start; end < PathLength && Path[end] != L'\\'; ++end)
+      ;
+    if (end > start) {
+      id = FileIdChild(Map, id, Path + start, end - start, Create);
+    }
+    start = end;
+  }
+  return id;
+}
+
+// split Path into the length of its parent path and its last name
+static VOID FileIdSplit(LPCWSTR Path, PULONG ParentLength, LPCWSTR *Name,
+                        PULONG NameLength) {
+  ULONG length = (ULONG)wcslen(Path);
+  ULONG i;
+
+  while (length > 0 && Path[length - 1] == L'\\')
+    length--;
+  for (i = length; i > 0 && Path[i - 1] != L'\\'; --i)
+    ;
+  *ParentLength = i;
+  *Name = Path + i;
+  *NameLength = length - i;
+}
+
+static VOID FileIdClear(PDOKAN_FILE_ID_MAP Map) {
+  ULONG i;
+
+  for (i = 0; i < Map->BucketCount; ++i) {
+    while (Map->Buckets[i] != NULL) {
+      PDOKAN_FILE_ID_NODE node = Map->Buckets[i];
+      Map->Buckets[i] = node->Next;
+      free(node);
+    }
+  }
+  Map->Count = 0;
+}
+
+static BOOL FileIdRead(PDOKAN_FILE_ID_STREAM Stream, PVOID Data, ULONG Size) {
+  while (Size > 0) {
+    ULONG length;
+
+    if (Stream->Position == Stream->Length) {
+      if (!ReadFile(Stream->File, Stream->Buffer, DOKAN_FILE_ID_IO_SIZE,
+                    &Stream->Length, NULL) ||
+          Stream->Length == 0) {
+        return FALSE;
+      }
+      Stream->Position = 0;
+    }
+    length = min(Size, Stream->Length - Stream->Position);
+    RtlCopyMemory(Data, Stream->Buffer + Stream->Position, length);
+    Stream->Position += length;
+    Data = (PCHAR)Data + length;
+    Size -= length;
+  }
+  return TRUE;
+}
+
+static BOOL FileIdFlush(PDOKAN_FILE_ID_STREAM Stream) {
+  ULONG written;
+
+  if (Stream->Position == 0) {
+    return TRUE;
+  }
+  if (!WriteFile(Stream->File, Stream->Buffer, Stream->Position, &written,
+                 NULL) ||
+      written != Stream->Position) {
+    return FALSE;
+  }
+  Stream->Position = 0;
+  return TRUE;
+}
+
+static BOOL FileIdWrite(PDOKAN_FILE_ID_STREAM Stream, const VOID *Data,
+                        ULONG Size) {
+  while (Size > 0) {
+    ULONG length;
+
+    if (Stream->Position == DOKAN_FILE_ID_IO_SIZE && !FileIdFlush(Stream)) {
+      return FALSE;
+    }
+    length = min(Size, DOKAN_FILE_ID_IO_SIZE - Stream->Position);
+    RtlCopyMemory(Stream->Buffer + Stream->Position, Data, length);
+    Stream->Position += length;
+    Data = (const CHAR *)Data + length;
+    Size -= length;
+  }
+  return TRUE;
+}
+
+// called before the mount is started
+static VOID FileIdLoad(PDOKAN_FILE_ID_MAP Map) {
+  DOKAN_FILE_ID_STREAM stream;
+  DOKAN_FILE_ID_MAP_HEADER header;
+  ULONG64 i;
+
+  stream.File = CreateFileW(Map->FileName, GENERIC_READ, FILE_SHARE_READ,
+                            NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
+  if (stream.File == INVALID_HANDLE_VALUE) {
+    DbgPrintW(L"Dokan: no file ID map at %s, starting a new one\n",
+              Map->FileName);
+    return;
+  }
+  stream.Buffer = malloc(DOKAN_FILE_ID_IO_SIZE);
+  stream.Length = 0;
+  stream.Position = 0;
+  if (stream.Buffer == NULL) {
+    CloseHandle(stream.File);
+    Map->Enabled = FALSE;
+    return;
+  }
+
+  if (!FileIdRead(&stream, &header, sizeof(header)) ||
+      header.Magic != DOKAN_FILE_ID_MAP_MAGIC ||
+      header.Version != DOKAN_FILE_ID_MAP_VERSION ||
+      header.NextId <= DOKAN_FILE_ID_ROOT) {
+    DbgPrintW(L"Dokan: invalid file ID map %s ignored\n", Map->FileName);
+    free(stream.Buffer);
+    CloseHandle(stream.File);
+    return;
+  }
+  // IDs of the file are never given again, even if its records are lost
+  Map->NextId = header.NextId;
+
+  for (i = 0; i < header.Count; ++i) {
+    ULONG64 id;
+    ULONG64 parentId;
+    USHORT nameLength;
+    PDOKAN_FILE_ID_NODE node;
+
+    if (!FileIdRead(&stream, &id, sizeof(id)) ||
+        !FileIdRead(&stream, &parentId, sizeof(parentId)) ||
+        !FileIdRead(&stream, &nameLength, sizeof(nameLength)) ||
+        id <= DOKAN_FILE_ID_ROOT || id >= header.NextId ||
+        parentId >= header.NextId || nameLength == 0) {
+      break;
+    }
+    node = malloc(FILE_ID_NODE_SIZE(nameLength));
+    if (node == NULL) {
+      break;
+    }
+    if (!FileIdRead(&stream, node->Name, nameLength * sizeof(WCHAR))) {
+      free(node);
+      break;
+    }
+    node->Id = id;
+    node->ParentId = parentId;
+    node->NameLength = nameLength;
+    node->Hash = FileIdHash(parentId, node->Name, nameLength);
+    FileIdLink(Map, node);
+  }
+  if (i < header.Count) {
+    DbgPrintW(L"Dokan: truncated file ID map %s ignored\n", Map->FileName);
+    FileIdClear(Map);
+  }
+  DbgPrint("Dokan: %I64d file IDs loaded\n", Map->Count);
+
+  free(stream.Buffer);
+  CloseHandle(stream.File);
+}
+
+VOID DokanInitFileIdMap(PDOKAN_FILE_ID_MAP Map) {
+  ZeroMemory(Map, sizeof(DOKAN_FILE_ID_MAP));
+  InitializeCriticalSection(&Map->Lock);
+}
+
+VOID DokanStartFileIdMap(PDOKAN_FILE_ID_MAP Map, LPCWSTR FileName) {
+  Map->Buckets =
+      calloc(DOKAN_FILE_ID_MAP_INITIAL_BUCKETS, sizeof(PDOKAN_FILE_ID_NODE));
+  if (Map->Buckets == NULL) {
+    DokanDbgPrint("Dokan Error: file ID map disabled, out of memory\n");
+    return;
+  }
+  Map->BucketCount = DOKAN_FILE_ID_MAP_INITIAL_BUCKETS;
+  Map->NextId = DOKAN_FILE_ID_ROOT + 1;
+  Map->Enabled = TRUE;
+
+  if (FileName != NULL) {
+    Map->FileName = _wcsdup(FileName);
+    if (Map->FileName != NULL) {
+      FileIdLoad(Map);
+    }
+  }
+}
+
+// write the map to a temporary file that then replaces Map->FileName, so
+// that a failure leaves the previous map in place
+BOOL DokanSaveFileIdMap(PDOKAN_FILE_ID_MAP Map) {
+  DOKAN_FILE_ID_STREAM stream;
+  DOKAN_FILE_ID_MAP_HEADER header;
+  SIZE_T nameLength;
+  LPWSTR tempName;
+  BOOL success = TRUE;
+  ULONG i;
+
+  if (!Map->Enabled || Map->FileName == NULL) {
+    return TRUE;
+  }
+
+  nameLength = wcslen(Map->FileName);
+  tempName = malloc((nameLength + 5) * sizeof(WCHAR));
+  stream.Buffer = malloc(DOKAN_FILE_ID_IO_SIZE);
+  stream.Position = 0;
+  if (tempName == NULL || stream.Buffer == NULL) {
+    free(tempName);
+    free(stream.Buffer);
+    return FALSE;
+  }
+  wcscpy_s(tempName, nameLength + 5, Map->FileName);
+  wcscat_s(tempName, nameLength + 5, L".tmp");
+
+  stream.File = CreateFileW(tempName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
+  if (stream.File == INVALID_HANDLE_VALUE) {
+    DbgPrintW(L"Dokan Error: cannot create %s\n", tempName);
+    free(tempName);
+    free(stream.Buffer);
+    return FALSE;
+  }
+
+  EnterCriticalSection(&Map->Lock);
+  header.Magic = DOKAN_FILE_ID_MAP_MAGIC;
+  header.Version = DOKAN_FILE_ID_MAP_VERSION;
+  header.NextId = Map->NextId;
+  header.Count = Map->Count;
+  success = FileIdWrite(&stream, &header, sizeof(header));
+  for (i = 0; success && i < Map->BucketCount; ++i) {
+    PDOKAN_FILE_ID_NODE node;
+    for (node = Map->Buckets[i]; success && node != NULL; node = node->Next) {
+      success = FileIdWrite(&stream, &node->Id, sizeof(node->Id)) &&
+                FileIdWrite(&stream, &node->ParentId, sizeof(node->ParentId)) &&
+                FileIdWrite(&stream, &node->NameLength,
+                            sizeof(node->NameLength)) &&
+                FileIdWrite(&stream, node->Name,
+                            node->NameLength * sizeof(WCHAR));
+    }
+  }
+  LeaveCriticalSection(&Map->Lock);
+
+  success = success && FileIdFlush(&stream);
+  CloseHandle(stream.File);
+  if (success) {
+    success = MoveFileExW(tempName, Map->FileName,
+                          MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+  }
+  if (!success) {
+    DbgPrintW(L"Dokan Error: cannot save the file ID map to %s\n",
+              Map->FileName);
+    DeleteFileW(tempName);
+  }
+
+  free(tempName);
+  free(stream.Buffer);
+  return success;
+}
+
+VOID DokanDeleteFileIdMap(PDOKAN_FILE_ID_MAP Map) {
+  if (Map->Buckets != NULL) {
+    FileIdClear(Map);
+    free(Map->Buckets);
+  }
+  if (Map->FileName != NULL) {
+    free(Map->FileName);
+  }
+  DeleteCriticalSection(&Map->Lock);
+}
+
+// ID of Name in the directory Path, or of Path itself when Name is NULL.
+// Returns 0 when the map is disabled or out of memory.
+ULONG64 DokanGetFileId(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                       LPCWSTR Name, ULONG NameLength) {
+  PDOKAN_FILE_ID_MAP map = &DokanInstance->FileIdMap;
+  ULONG pathLength;
+  ULONG64 id;
+
+  if (!map->Enabled || Path == NULL) {
+    return 0;
+  }
+
+  pathLength = (ULONG)wcslen(Path);
+  if (Name != NULL && NameLength == 2 && Name[0] == L'.' && Name[1] == L'.') {
+    LPCWSTR lastName;
+    ULONG lastNameLength;
+    FileIdSplit(Path, &pathLength, &lastName, &lastNameLength);
+    Name = NULL;
+  } else if (Name != NULL &&
+             (NameLength == 0 || (NameLength == 1 && Name[0] == L'.'))) {
+    Name = NULL;
+  }
+
+  EnterCriticalSection(&map->Lock);
+  id = FileIdWalk(map, Path, pathLength, TRUE);
+  if (id != 0 && Name != NULL) {
+    id = FileIdChild(map, id, Name, NameLength, TRUE);
+  }
+  LeaveCriticalSection(&map->Lock);
+  return id;
+}
+
+// keep the ID of OldPath for NewPath. The names below a renamed directory
+// are keyed by its ID and keep theirs.
+VOID DokanFileIdRename(PDOKAN_INSTANCE DokanInstance, LPCWSTR OldPath,
+                       LPCWSTR NewPath) {
+  PDOKAN_FILE_ID_MAP map = &DokanInstance->FileIdMap;
+  PDOKAN_FILE_ID_NODE *link;
+  PDOKAN_FILE_ID_NODE node = NULL;
+  PDOKAN_FILE_ID_NODE moved;
+  ULONG oldParentLength, oldNameLength, newParentLength, newNameLength;
+  LPCWSTR oldName, newName;
+  ULONG64 parentId;
+  ULONG hash = 0;
+
+  if (!map->Enabled) {
+    return;
+  }
+
+  FileIdSplit(OldPath, &oldParentLength, &oldName, &oldNameLength);
+  FileIdSplit(NewPath, &newParentLength, &newName, &newNameLength);
+  if (oldNameLength == 0 || newNameLength == 0 || newNameLength > MAXUSHORT) {
+    return;
+  }
+
+  EnterCriticalSection(&map->Lock);
+  parentId = FileIdWalk(map, OldPath, oldParentLength, FALSE);
+  if (parentId != 0) {
+    link = FileIdFind(map, parentId, oldName, oldNameLength,
+                      FileIdHash(parentId, oldName, oldNameLength));
+    node = *link;
+    if (node != NULL) {
+      FileIdUnlink(map, link);
+    }
+  }
+
+  // the file replaced by the rename is gone, so is its ID
+  parentId = FileIdWalk(map, NewPath, newParentLength, node != NULL);
+  if (parentId != 0) {
+    hash = FileIdHash(parentId, newName, newNameLength);
+    link = FileIdFind(map, parentId, newName, newNameLength, hash);
+    if (*link != NULL) {
+      PDOKAN_FILE_ID_NODE replaced = *link;
+      FileIdUnlink(map, link);
+      free(replaced);
+    }
+  }
+
+  if (node != NULL) {
+    moved = parentId != 0 ? realloc(node, FILE_ID_NODE_SIZE(newNameLength))
+                          : NULL;
+    if (moved == NULL) {
+      free(node);
+    } else {
+      moved->ParentId = parentId;
+      moved->Hash = hash;
+      moved->NameLength = (USHORT)newNameLength;
+      RtlCopyMemory(moved->Name, newName, newNameLength * sizeof(WCHAR));
+      FileIdLink(map, moved);
+    }
+  }
+  LeaveCriticalSection(&map->Lock);
+}
+
+// forget the ID of a deleted file. A directory can only be deleted once
+// empty, so nothing is left below it.
+VOID DokanFileIdRemove(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path) {
+  PDOKAN_FILE_ID_MAP map = &DokanInstance->FileIdMap;
+  PDOKAN_FILE_ID_NODE *link;
+  ULONG parentLength, nameLength;
+  LPCWSTR name;
+  ULONG64 parentId;
+
+  if (!map->Enabled) {
+    return;
+  }
+
+  FileIdSplit(Path, &parentLength, &name, &nameLength);
+  if (nameLength == 0) {
+    return;
+  }
+
+  EnterCriticalSection(&map->Lock);
+  parentId = FileIdWalk(map, Path, parentLength, FALSE);
+  if (parentId != 0) {
+    link = FileIdFind(map, parentId, name, nameLength,
+                      FileIdHash(parentId, name, nameLength));
+    if (*link != NULL) {
+      PDOKAN_FILE_ID_NODE node = *link;
+      FileIdUnlink(map, link);
+      free(node);
+    }
+  }
+  LeaveCriticalSection(&map->Lock);
+}
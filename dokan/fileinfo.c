@@ -302,8 +302,7 @@ typedef struct _DOKAN_FIND_STREAM_DATA {
 
 int WINAPI DokanFillFindStreamData(PWIN32_FIND_STREAM_DATA FindStreamData,
                                    PDOKAN_FILE_INFO FileInfo) {
-  PLIST_ENTRY listHead =
-      ((PDOKAN_OPEN_INFO)(UINT_PTR)FileInfo->DokanContext)->StreamListHead;
+  PLIST_ENTRY listHead = DokanFileInfoOpenInfo(FileInfo)->StreamListHead;
   PDOKAN_FIND_STREAM_DATA findStreamData;
 
   findStreamData =
@@ -334,8 +333,7 @@ NTSTATUS
 DokanFindStreams(PFILE_STREAM_INFORMATION StreamInfo, PDOKAN_FILE_INFO FileInfo,
                  PEVENT_CONTEXT EventContext, PDOKAN_INSTANCE DokanInstance,
                  PULONG RemainingLength) {
-  PDOKAN_OPEN_INFO openInfo =
-      (PDOKAN_OPEN_INFO)(UINT_PTR)FileInfo->DokanContext;
+  PDOKAN_OPEN_INFO openInfo = DokanFileInfoOpenInfo(FileInfo);
   NTSTATUS status = STATUS_SUCCESS;
 
   if (!DokanInstance->DokanOperations->FindStreams) {
@@ -415,11 +413,13 @@ VOID DispatchQueryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
                               PDOKAN_INSTANCE DokanInstance) {
   PEVENT_INFORMATION eventInfo;
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   BY_HANDLE_FILE_INFORMATION byHandleFileInfo;
   ULONG remainingLength;
   NTSTATUS status = STATUS_INVALID_PARAMETER;
   PDOKAN_OPEN_INFO openInfo;
   ULONG sizeOfEventInfo;
+  ULONG64 generation = 0;
 
   sizeOfEventInfo =
       sizeof(EVENT_INFORMATION) - 8 + EventContext->Operation.File.BufferLength;
@@ -429,21 +429,42 @@ VOID DispatchQueryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   ZeroMemory(&byHandleFileInfo, sizeof(BY_HANDLE_FILE_INFORMATION));
 
   eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+                             &fileInfo, &ioEvent, &openInfo);
 
   eventInfo->BufferLength = EventContext->Operation.File.BufferLength;
+  // information classes are filled field by field
+  RtlZeroMemory(eventInfo->Buffer, eventInfo->BufferLength);
 
   DbgPrint("###GetFileInfo %04d\n", openInfo != NULL ? openInfo->EventId : -1);
 
-  if (DokanInstance->DokanOperations->GetFileInformation) {
+  if (DokanInfoCacheLookup(DokanInstance,
+                           EventContext->Operation.File.FileName,
+                           &byHandleFileInfo, &generation)) {
+    status = STATUS_SUCCESS;
+  } else if (DokanInstance->DokanOperations->GetFileInformation) {
     status = DokanInstance->DokanOperations->GetFileInformation(
         EventContext->Operation.File.FileName, &byHandleFileInfo, &fileInfo);
+    if (status == STATUS_SUCCESS) {
+      DokanInfoCacheStore(DokanInstance, EventContext->Operation.File.FileName,
+                          &byHandleFileInfo, generation);
+    }
   }
 
   remainingLength = eventInfo->BufferLength;
 
   DbgPrint("\tresult =  %lx\n", status);
 
+  // FileInternalInformation, FileIdInformation and FileAllInformation use
+  // the file index, give one to file systems that have none
+  if (status == STATUS_SUCCESS && DokanInstance->FileIdMap.Enabled &&
+      byHandleFileInfo.nFileIndexHigh == 0 &&
+      byHandleFileInfo.nFileIndexLow == 0) {
+    ULONG64 fileId = DokanGetFileId(
+        DokanInstance, EventContext->Operation.File.FileName, NULL, 0);
+    byHandleFileInfo.nFileIndexHigh = (DWORD)(fileId >> 32);
+    byHandleFileInfo.nFileIndexLow = (DWORD)fileId;
+  }
+
   if (status != STATUS_SUCCESS) {
     eventInfo->Status = STATUS_INVALID_PARAMETER;
     eventInfo->BufferLength = 0;
@@ -563,5 +584,5 @@ VOID DispatchQueryInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
     openInfo->UserContext = fileInfo.Context;
 
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
-  free(eventInfo);
+  DokanArenaFree(eventInfo);
 }
@@ -24,6 +24,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 VOID DispatchFlush(HANDLE Handle, PEVENT_CONTEXT EventContext,
                    PDOKAN_INSTANCE DokanInstance) {
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   PEVENT_INFORMATION eventInfo;
   ULONG sizeOfEventInfo = sizeof(EVENT_INFORMATION);
   PDOKAN_OPEN_INFO openInfo;
@@ -32,7 +33,7 @@ VOID DispatchFlush(HANDLE Handle, PEVENT_CONTEXT EventContext,
   CheckFileName(EventContext->Operation.Flush.FileName);
 
   eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+                             &fileInfo, &ioEvent, &openInfo);
 
   DbgPrint("###Flush %04d\n", openInfo != NULL ? openInfo->EventId : -1);
 
@@ -57,5 +58,5 @@ VOID DispatchFlush(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
 
-  free(eventInfo);
+  DokanArenaFree(eventInfo);
 }
@@ -0,0 +1,73 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// A cached GetFileInformation result
+typedef struct _DOKAN_INFO_CACHE_ENTRY {
+  DOKAN_PATH_CACHE_ENTRY Header;
+  BY_HANDLE_FILE_INFORMATION Information;
+} DOKAN_INFO_CACHE_ENTRY, *PDOKAN_INFO_CACHE_ENTRY;
+
+static BOOL InfoCacheCopy(PDOKAN_PATH_CACHE_ENTRY Entry, PVOID Context) {
+  *(PBY_HANDLE_FILE_INFORMATION)Context =
+      ((PDOKAN_INFO_CACHE_ENTRY)Entry)->Information;
+  return TRUE;
+}
+
+// copy the cached information of Path. On a miss, Generation receives the
+// value to give to DokanInfoCacheStore.
+BOOL DokanInfoCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                          PBY_HANDLE_FILE_INFORMATION Information,
+                          PULONG64 Generation) {
+  return DokanPathCacheLookup(&DokanInstance->InfoCache, Path, 0,
+                              InfoCacheCopy, Information, Generation);
+}
+
+// keep the information returned by GetFileInformation for Path
+VOID DokanInfoCacheStore(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                         PBY_HANDLE_FILE_INFORMATION Information,
+                         ULONG64 Generation) {
+  PDOKAN_INFO_CACHE_ENTRY entry;
+
+  if (DokanInstance->InfoCache.Timeout == 0) {
+    return;
+  }
+
+  entry = (PDOKAN_INFO_CACHE_ENTRY)DokanPathCacheAllocEntry(
+      Path, sizeof(DOKAN_INFO_CACHE_ENTRY), 0);
+  if (entry == NULL) {
+    return;
+  }
+  entry->Information = *Information;
+  DokanPathCacheInsert(&DokanInstance->InfoCache, &entry->Header, Generation);
+}
+
+// drop the information of Path and, when Subtree is TRUE, of the files
+// below it
+VOID DokanInfoCacheInvalidate(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                              BOOL Subtree) {
+  if (Path == NULL) {
+    return;
+  }
+  DokanPathCacheInvalidate(&DokanInstance->InfoCache, Path,
+                           DokanPathCacheKeyLength(Path), Subtree);
+}
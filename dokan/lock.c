@@ -25,6 +25,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 VOID DispatchLock(HANDLE Handle, PEVENT_CONTEXT EventContext,
                   PDOKAN_INSTANCE DokanInstance) {
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   PEVENT_INFORMATION eventInfo;
   ULONG sizeOfEventInfo = sizeof(EVENT_INFORMATION);
   PDOKAN_OPEN_INFO openInfo;
@@ -33,7 +34,7 @@ VOID DispatchLock(HANDLE Handle, PEVENT_CONTEXT EventContext,
   CheckFileName(EventContext->Operation.Lock.FileName);
 
   eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+                             &fileInfo, &ioEvent, &openInfo);
 
   DbgPrint("###Lock %04d\n", openInfo != NULL ? openInfo->EventId : -1);
 
@@ -80,10 +81,13 @@ VOID DispatchLock(HANDLE Handle, PEVENT_CONTEXT EventContext,
     DbgPrint("unkown lock function %d\n", EventContext->MinorFunction);
   }
 
+  DokanInfoCacheInvalidate(DokanInstance, EventContext->Operation.Lock.FileName,
+                           FALSE);
+
   if (openInfo != NULL)
     openInfo->UserContext = fileInfo.Context;
 
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
 
-  free(eventInfo);
+  DokanArenaFree(eventInfo);
 }
@@ -0,0 +1,244 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+#define DOS_STAR (L'<')
+#define DOS_QM (L'>')
+#define DOS_DOT (L'"')
+
+static BOOL IsWildcard(WCHAR C) {
+  return C == L'*' || C == L'?' || C == DOS_STAR || C == DOS_QM ||
+         C == DOS_DOT;
+}
+
+// Runs Expression over Name one character at a time, keeping the set of
+// expression positions reachable at the current name position in States.
+// Expression must be upcased when IgnoreCase is TRUE. States holds
+// 2 * (ExpressionLength + 1) bytes.
+//
+// Name position NameLength + 1 stands for every position past the end of
+// the name, where '?' and DOS_QM can step to and only a final '*' matches.
+static BOOL MatchStates(LPCWSTR Expression, ULONG ExpressionLength,
+                        LPCWSTR Name, ULONG NameLength, BOOL IgnoreCase,
+                        PUCHAR States) {
+  PUCHAR current = States;
+  PUCHAR next = States + ExpressionLength + 1;
+  LONG lastDot = -1;
+  ULONG ni, ei;
+
+  for (ni = 0; ni < NameLength; ++ni) {
+    if (Name[ni] == L'.')
+      lastDot = (LONG)ni;
+  }
+
+  ZeroMemory(current, ExpressionLength + 1);
+  current[0] = TRUE;
+
+  for (ni = 0; ni <= NameLength + 1; ++ni) {
+    BOOL inName = ni < NameLength;
+    BOOL alive = FALSE;
+    WCHAR c = inName ? Name[ni] : L'\0';
+    PUCHAR advance = ni <= NameLength ? next : current;
+    PUCHAR swap;
+
+    if (IgnoreCase)
+      c = towupper(c);
+    ZeroMemory(next, ExpressionLength + 1);
+
+    // transitions that do not consume the name only move forward in the
+    // expression, so one ascending pass reaches all of them
+    for (ei = 0; ei < ExpressionLength; ++ei) {
+      if (!current[ei])
+        continue;
+
+      switch (Expression[ei]) {
+      case L'*':
+        if (ei + 1 == ExpressionLength)
+          return TRUE;
+        current[ei + 1] = TRUE;
+        if (inName)
+          next[ei] = TRUE;
+        break;
+      case DOS_STAR:
+        // zero or more characters up to the last dot of the name
+        current[ei + 1] = TRUE;
+        if (inName && (LONG)ni != lastDot && !(ni == 0 && lastDot < 0))
+          next[ei] = TRUE;
+        break;
+      case DOS_QM:
+        // a dot is only consumed when another dot follows it
+        if (inName && c == L'.' && lastDot <= (LONG)ni)
+          current[ei + 1] = TRUE;
+        else
+          advance[ei + 1] = TRUE;
+        break;
+      case DOS_DOT:
+        if (inName && c == L'.')
+          next[ei + 1] = TRUE;
+        else
+          current[ei + 1] = TRUE;
+        break;
+      case L'?':
+        advance[ei + 1] = TRUE;
+        break;
+      default:
+        if (inName && Expression[ei] == c)
+          next[ei + 1] = TRUE;
+        break;
+      }
+    }
+
+    if (current[ExpressionLength] && ni == NameLength)
+      return TRUE;
+
+    for (ei = 0; ei <= ExpressionLength; ++ei) {
+      if (next[ei]) {
+        alive = TRUE;
+        break;
+      }
+    }
+    if (!alive)
+      return FALSE;
+
+    swap = current;
+    current = next;
+    next = swap;
+  }
+
+  return FALSE;
+}
+
+PDOKAN_NAME_MATCHER DokanCompileNameExpression(LPCWSTR Expression,
+                                               BOOL IgnoreCase) {
+  PDOKAN_NAME_MATCHER matcher;
+  ULONG length = (ULONG)wcslen(Expression);
+  ULONG wildcards = 0;
+  ULONG i;
+
+  matcher = malloc(FIELD_OFFSET(DOKAN_NAME_MATCHER, Expression) +
+                   (length + 1) * sizeof(WCHAR) + 2 * (length + 1));
+  if (matcher == NULL) {
+    return NULL;
+  }
+
+  for (i = 0; i < length; ++i) {
+    if (IsWildcard(Expression[i]))
+      wildcards++;
+  }
+  if (IgnoreCase) {
+    DokanUpcaseUtf16(matcher->Expression, Expression, length);
+  } else {
+    RtlCopyMemory(matcher->Expression, Expression, length * sizeof(WCHAR));
+  }
+  matcher->Expression[length] = L'\0';
+  matcher->ExpressionLength = length;
+  matcher->IgnoreCase = IgnoreCase;
+  matcher->States = (PUCHAR)&matcher->Expression[length + 1];
+  matcher->Literal = matcher->Expression;
+  matcher->LiteralLength = length;
+
+  if (length == 1 && Expression[0] == L'*') {
+    matcher->Kind = DOKAN_MATCH_ALL;
+  } else if (wildcards == 0) {
+    matcher->Kind = DOKAN_MATCH_LITERAL;
+  } else if (wildcards == 1 && Expression[length - 1] == L'*') {
+    matcher->Kind = DOKAN_MATCH_PREFIX;
+    matcher->LiteralLength = length - 1;
+  } else if (wildcards == 1 && Expression[0] == L'*') {
+    // *.ext
+    matcher->Kind = DOKAN_MATCH_SUFFIX;
+    matcher->Literal = &matcher->Expression[1];
+    matcher->LiteralLength = length - 1;
+  } else {
+    matcher->Kind = DOKAN_MATCH_EXPRESSION;
+  }
+  return matcher;
+}
+
+VOID DokanFreeNameMatcher(PDOKAN_NAME_MATCHER Matcher) { free(Matcher); }
+
+BOOL DokanMatchName(PDOKAN_NAME_MATCHER Matcher, LPCWSTR Name,
+                    ULONG NameLength) {
+  switch (Matcher->Kind) {
+  case DOKAN_MATCH_ALL:
+    return TRUE;
+  case DOKAN_MATCH_LITERAL:
+    return NameLength == Matcher->LiteralLength &&
+           DokanEqualUtf16(Matcher->Literal, Name, NameLength,
+                        Matcher->IgnoreCase);
+  case DOKAN_MATCH_PREFIX:
+    return NameLength >= Matcher->LiteralLength &&
+           DokanEqualUtf16(Matcher->Literal, Name, Matcher->LiteralLength,
+                        Matcher->IgnoreCase);
+  case DOKAN_MATCH_SUFFIX:
+    return NameLength >= Matcher->LiteralLength &&
+           DokanEqualUtf16(Matcher->Literal,
+                        &Name[NameLength - Matcher->LiteralLength],
+                        Matcher->LiteralLength, Matcher->IgnoreCase);
+  default:
+    return MatchStates(Matcher->Expression, Matcher->ExpressionLength, Name,
+                       NameLength, Matcher->IgnoreCase, Matcher->States);
+  }
+}
+
+// check whether Name matches Expression
+// Expression can contain "?"(any one character) and "*" (any string)
+// when IgnoreCase is TRUE, do case insenstive matching
+//
+// http://msdn.microsoft.com/en-us/library/ff546850(v=VS.85).aspx
+// * (asterisk) Matches zero or more characters.
+// ? (question mark) Matches a single character.
+// DOS_DOT Matches either a period or zero characters beyond the name string.
+// DOS_QM Matches any single character or, upon encountering a period or end
+//        of name string, advances the expression to the end of the set of
+//        contiguous DOS_QMs.
+// DOS_STAR Matches zero or more characters until encountering and matching
+//          the final . in the name.
+BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, // matching pattern
+                                      LPCWSTR Name,       // file name
+                                      BOOL IgnoreCase) {
+  WCHAR expression[DOKAN_MATCH_STACK_LENGTH + 1];
+  UCHAR states[2 * (DOKAN_MATCH_STACK_LENGTH + 1)];
+  ULONG length = (ULONG)wcslen(Expression);
+  PDOKAN_NAME_MATCHER matcher;
+  BOOL match;
+
+  // short expressions are matched without allocating
+  if (length <= DOKAN_MATCH_STACK_LENGTH) {
+    if (IgnoreCase) {
+      DokanUpcaseUtf16(expression, Expression, length);
+    } else {
+      RtlCopyMemory(expression, Expression, length * sizeof(WCHAR));
+    }
+    expression[length] = L'\0';
+    return MatchStates(expression, length, Name, (ULONG)wcslen(Name),
+                       IgnoreCase, states);
+  }
+
+  matcher = DokanCompileNameExpression(Expression, IgnoreCase);
+  if (matcher == NULL) {
+    return FALSE;
+  }
+  match = DokanMatchName(matcher, Name, (ULONG)wcslen(Name));
+  DokanFreeNameMatcher(matcher);
+  return match;
+}
@@ -0,0 +1,73 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// A path the file system reported missing
+typedef struct _DOKAN_NEGATIVE_CACHE_ENTRY {
+  DOKAN_PATH_CACHE_ENTRY Header;
+  /** STATUS_OBJECT_NAME_NOT_FOUND or STATUS_OBJECT_PATH_NOT_FOUND */
+  NTSTATUS Status;
+} DOKAN_NEGATIVE_CACHE_ENTRY, *PDOKAN_NEGATIVE_CACHE_ENTRY;
+
+static BOOL NegativeCacheCopy(PDOKAN_PATH_CACHE_ENTRY Entry, PVOID Context) {
+  *(NTSTATUS *)Context = ((PDOKAN_NEGATIVE_CACHE_ENTRY)Entry)->Status;
+  return TRUE;
+}
+
+// whether Path was recently reported missing, in any spelling unless the
+// mount is case sensitive. On a miss, Generation receives the value to give
+// to DokanNegativeCacheStore.
+BOOL DokanNegativeCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                              NTSTATUS *Status, PULONG64 Generation) {
+  return DokanPathCacheLookup(&DokanInstance->NegativeCache, Path, 0,
+                              NegativeCacheCopy, Status, Generation);
+}
+
+// remember that Path does not exist
+VOID DokanNegativeCacheStore(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                             NTSTATUS Status, ULONG64 Generation) {
+  PDOKAN_NEGATIVE_CACHE_ENTRY entry;
+
+  if (DokanInstance->NegativeCache.Timeout == 0) {
+    return;
+  }
+
+  entry = (PDOKAN_NEGATIVE_CACHE_ENTRY)DokanPathCacheAllocEntry(
+      Path, sizeof(DOKAN_NEGATIVE_CACHE_ENTRY), 0);
+  if (entry == NULL) {
+    return;
+  }
+  entry->Status = Status;
+  DokanPathCacheInsert(&DokanInstance->NegativeCache, &entry->Header,
+                       Generation);
+}
+
+// forget that Path, in any spelling, and when Subtree is TRUE the paths
+// below it were missing
+VOID DokanNegativeCacheInvalidate(PDOKAN_INSTANCE DokanInstance,
+                                  LPCWSTR Path, BOOL Subtree) {
+  if (Path == NULL) {
+    return;
+  }
+  DokanPathCacheInvalidate(&DokanInstance->NegativeCache, Path,
+                           DokanPathCacheKeyLength(Path), Subtree);
+}
@@ -0,0 +1,87 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokani.h"
+
+VOID DokanInitObjectPool(PDOKAN_OBJECT_POOL Pool, ULONG ObjectSize,
+                         LONG MaxFree) {
+  ZeroMemory(Pool, sizeof(DOKAN_OBJECT_POOL));
+  InitializeSListHead(&Pool->FreeList);
+  if (ObjectSize < sizeof(SLIST_ENTRY)) {
+    ObjectSize = sizeof(SLIST_ENTRY);
+  }
+  Pool->ObjectSize = (ObjectSize + MEMORY_ALLOCATION_ALIGNMENT - 1) &
+                     ~(MEMORY_ALLOCATION_ALIGNMENT - 1);
+  Pool->MaxFree = MaxFree;
+}
+
+// Objects still in use are not released
+VOID DokanDeleteObjectPool(PDOKAN_OBJECT_POOL Pool) {
+  PSLIST_ENTRY entry;
+
+  DbgPrint("Dokan: object pool (%d bytes) %I64d alloc, %I64d malloc, "
+           "%d in use\n",
+           Pool->ObjectSize, Pool->AllocCount, Pool->MallocCount,
+           Pool->InUseCount);
+
+  while ((entry = InterlockedPopEntrySList(&Pool->FreeList)) != NULL) {
+    _aligned_free(entry);
+  }
+  Pool->FreeCount = 0;
+}
+
+PVOID DokanPoolAlloc(PDOKAN_OBJECT_POOL Pool) {
+  PSLIST_ENTRY entry;
+
+  InterlockedIncrement64(&Pool->AllocCount);
+
+  entry = InterlockedPopEntrySList(&Pool->FreeList);
+  if (entry != NULL) {
+    InterlockedDecrement(&Pool->FreeCount);
+  } else {
+    // SLIST entries must be aligned on MEMORY_ALLOCATION_ALIGNMENT
+    entry = (PSLIST_ENTRY)_aligned_malloc(Pool->ObjectSize,
+                                          MEMORY_ALLOCATION_ALIGNMENT);
+    if (entry == NULL) {
+      return NULL;
+    }
+    InterlockedIncrement64(&Pool->MallocCount);
+  }
+
+  InterlockedIncrement(&Pool->InUseCount);
+  return entry;
+}
+
+VOID DokanPoolFree(PDOKAN_OBJECT_POOL Pool, PVOID Object) {
+  if (Object == NULL) {
+    return;
+  }
+
+  InterlockedDecrement(&Pool->InUseCount);
+
+  if (InterlockedIncrement(&Pool->FreeCount) > Pool->MaxFree) {
+    InterlockedDecrement(&Pool->FreeCount);
+    _aligned_free(Object);
+    return;
+  }
+  InterlockedPushEntrySList(&Pool->FreeList, (PSLIST_ENTRY)Object);
+}
@@ -0,0 +1,273 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+#include <process.h>
+
+/*
+
+DOKAN_OPTION_OVERLAPPED_IO:
+DokanCreateIoEngine
+  # QueueDepth IOCTL_EVENT_WAIT_BATCH requests pending on one
+  # overlapped handle bound to a completion port
+
+DokanIoEngineLoop (ThreadCount threads, the pool does not grow)
+  GetQueuedCompletionStatus
+  DokanChannelDispatchBatch
+    # replies go through the thread's own synchronous channel
+  DokanPostWaitRequest
+    # the last reply of the batch is sent with IOCTL_EVENT_INFO_WAIT
+
+When a request fails for good it is not posted again. Once no request is
+pending anymore, every worker is woken up with a NULL overlapped and exits.
+
+*/
+
+static VOID DokanStopIoEngineWorkers(PDOKAN_IO_ENGINE IoEngine) {
+  ULONG i;
+  for (i = 0; i < IoEngine->ThreadCount; ++i) {
+    PostQueuedCompletionStatus(IoEngine->CompletionPort, 0, 0, NULL);
+  }
+}
+
+static VOID DokanReleaseIoRequest(PDOKAN_IO_ENGINE IoEngine) {
+  if (InterlockedDecrement(&IoEngine->PendingRequests) == 0) {
+    DbgPrint("Dokan: no more pending event request\n");
+    DokanStopIoEngineWorkers(IoEngine);
+  }
+}
+
+// Post Request again to the driver, along with the reply deferred on
+// Channel if any. Returns FALSE if the request is no longer pending.
+static BOOL DokanPostWaitRequest(PDOKAN_IO_ENGINE IoEngine,
+                                 PDOKAN_IO_REQUEST Request,
+                                 PDOKAN_DEVICE_CHANNEL Channel) {
+  BOOL status;
+  DWORD lastError;
+  PEVENT_INFORMATION reply = NULL;
+  ULONG replyLength = 0;
+
+  if (Channel != NULL && Channel->DeferredReplyLength > 0) {
+    reply = Channel->DeferredReply;
+    replyLength = Channel->DeferredReplyLength;
+    Channel->DeferredReplyLength = 0;
+  }
+
+  ZeroMemory(&Request->Overlapped, sizeof(OVERLAPPED));
+
+  // the input buffer is captured before DeviceIoControl returns
+  status = DeviceIoControl(
+      IoEngine->Channel.Device, // Handle to device
+      reply != NULL ? IOCTL_EVENT_INFO_WAIT
+                    : IOCTL_EVENT_WAIT_BATCH, // IO Control code
+      reply,                                  // Input Buffer to driver.
+      replyLength,          // Length of input buffer in bytes.
+      Request->Buffer,      // Output Buffer from driver.
+      Request->BufferSize,  // Length of output buffer in bytes.
+      NULL,                 // Bytes placed in buffer.
+      &Request->Overlapped  // asynchronous call
+      );
+
+  if (status) {
+    return TRUE;
+  }
+
+  lastError = GetLastError();
+  if (lastError == ERROR_IO_PENDING) {
+    return TRUE;
+  }
+
+  DbgPrint("Ioctl failed for overlapped wait with code %d.\n", lastError);
+  if (reply != NULL) {
+    SendEventInformation(Channel->Device, reply, replyLength, NULL);
+  }
+  return FALSE;
+}
+
+PDOKAN_IO_ENGINE
+DokanCreateIoEngine(PDOKAN_INSTANCE DokanInstance, ULONG QueueDepth,
+                    ULONG ThreadCount) {
+  PDOKAN_IO_ENGINE ioEngine;
+  ULONG i;
+
+  ioEngine = (PDOKAN_IO_ENGINE)malloc(sizeof(DOKAN_IO_ENGINE));
+  if (ioEngine == NULL) {
+    return NULL;
+  }
+  ZeroMemory(ioEngine, sizeof(DOKAN_IO_ENGINE));
+
+  ioEngine->QueueDepth = QueueDepth;
+  ioEngine->ThreadCount = ThreadCount;
+
+  DokanInitDeviceChannel(&ioEngine->Channel);
+  ioEngine->Channel.FlagsAndAttributes = FILE_FLAG_OVERLAPPED;
+  if (!DokanOpenDeviceChannel(&ioEngine->Channel, DokanInstance)) {
+    free(ioEngine);
+    return NULL;
+  }
+
+  ioEngine->CompletionPort = CreateIoCompletionPort(
+      ioEngine->Channel.Device, NULL, (ULONG_PTR)ioEngine, ThreadCount);
+  if (ioEngine->CompletionPort == NULL) {
+    DbgPrint("Dokan Error: CreateIoCompletionPort failed: %d\n",
+             GetLastError());
+    DokanDeleteIoEngine(ioEngine);
+    return NULL;
+  }
+
+  ioEngine->Requests =
+      (PDOKAN_IO_REQUEST)malloc(sizeof(DOKAN_IO_REQUEST) * QueueDepth);
+  if (ioEngine->Requests == NULL) {
+    DokanDeleteIoEngine(ioEngine);
+    return NULL;
+  }
+  ZeroMemory(ioEngine->Requests, sizeof(DOKAN_IO_REQUEST) * QueueDepth);
+
+  for (i = 0; i < QueueDepth; ++i) {
+    PDOKAN_IO_REQUEST request = &ioEngine->Requests[i];
+    request->BufferSize = DokanInstance->EventBufferSize;
+    request->Buffer = (PCHAR)malloc(request->BufferSize);
+    if (request->Buffer == NULL) {
+      DokanDeleteIoEngine(ioEngine);
+      return NULL;
+    }
+  }
+
+  for (i = 0; i < QueueDepth; ++i) {
+    if (!DokanPostWaitRequest(ioEngine, &ioEngine->Requests[i], NULL)) {
+      break;
+    }
+    InterlockedIncrement(&ioEngine->PendingRequests);
+  }
+
+  if (ioEngine->PendingRequests == 0) {
+    DokanDeleteIoEngine(ioEngine);
+    return NULL;
+  }
+
+  DbgPrint("Dokan: overlapped engine started, %d requests for %d threads\n",
+           ioEngine->PendingRequests, ThreadCount);
+  return ioEngine;
+}
+
+// Must not be called while workers are running
+VOID DokanDeleteIoEngine(PDOKAN_IO_ENGINE IoEngine) {
+  LPOVERLAPPED overlapped;
+  ULONG_PTR completionKey;
+  DWORD returnedLength;
+  ULONG i;
+
+  // Requests still pending would complete into freed memory,
+  // cancel them and wait for their completion.
+  if (IoEngine->PendingRequests > 0) {
+    CancelIoEx(IoEngine->Channel.Device, NULL);
+    while (IoEngine->PendingRequests > 0) {
+      overlapped = NULL;
+      GetQueuedCompletionStatus(IoEngine->CompletionPort, &returnedLength,
+                                &completionKey, &overlapped, INFINITE);
+      if (overlapped == NULL) {
+        break;
+      }
+      IoEngine->PendingRequests--;
+    }
+  }
+
+  DokanCloseDeviceChannel(&IoEngine->Channel);
+  if (IoEngine->CompletionPort != NULL) {
+    CloseHandle(IoEngine->CompletionPort);
+  }
+  if (IoEngine->Requests != NULL) {
+    for (i = 0; i < IoEngine->QueueDepth; ++i) {
+      free(IoEngine->Requests[i].Buffer);
+    }
+    free(IoEngine->Requests);
+  }
+  free(IoEngine);
+}
+
+UINT WINAPI DokanIoEngineLoop(PVOID Param) {
+  PDOKAN_WORKER worker = (PDOKAN_WORKER)Param;
+  PDOKAN_INSTANCE dokanInstance = worker->DokanInstance;
+  PDOKAN_IO_ENGINE ioEngine = dokanInstance->IoEngine;
+  DOKAN_DEVICE_CHANNEL channel;
+  DOKAN_REPLY_ARENA arena;
+  PDOKAN_IO_REQUEST request;
+  LPOVERLAPPED overlapped;
+  ULONG_PTR completionKey;
+  DWORD returnedLength;
+  DWORD lastError;
+  BOOL status;
+  DWORD result = 0;
+
+  // synchronous channel for the replies and IOCTL_EVENT_WRITE
+  DokanInitDeviceChannel(&channel);
+  if (!DokanOpenDeviceChannel(&channel, dokanInstance)) {
+    DokanWorkerExit(worker, TRUE);
+    result = (DWORD)-1;
+    _endthreadex(result);
+    return result;
+  }
+  channel.DeferredReply = malloc(DOKAN_DEFERRED_REPLY_MAX_SIZE);
+  DokanSetThreadChannel(&channel);
+  DokanInitReplyArena(&arena);
+  DokanSetThreadArena(&arena);
+
+  while (TRUE) {
+    overlapped = NULL;
+    status = GetQueuedCompletionStatus(ioEngine->CompletionPort,
+                                       &returnedLength, &completionKey,
+                                       &overlapped, INFINITE);
+    if (overlapped == NULL) {
+      // stop request or completion port closed
+      break;
+    }
+
+    request = CONTAINING_RECORD(overlapped, DOKAN_IO_REQUEST, Overlapped);
+
+    if (!status) {
+      lastError = GetLastError();
+      DbgPrint("Overlapped wait failed with code %d.\n", lastError);
+      if (lastError != ERROR_NO_SYSTEM_RESOURCES) {
+        DokanReleaseIoRequest(ioEngine);
+        continue;
+      }
+      Sleep(200);
+    } else if (returnedLength > 0) {
+      DokanChannelDispatchBatch(&channel, (PEVENT_BATCH)request->Buffer,
+                                returnedLength, DokanDispatchEvent,
+                                dokanInstance);
+    }
+
+    if (!DokanPostWaitRequest(ioEngine, request, &channel)) {
+      DokanReleaseIoRequest(ioEngine);
+    }
+  }
+
+  DokanSetThreadChannel(NULL);
+  DokanSetThreadArena(NULL);
+  DokanDeleteReplyArena(&arena);
+  free(channel.DeferredReply);
+  DokanCloseDeviceChannel(&channel);
+  DokanWorkerExit(worker, TRUE);
+  _endthreadex(result);
+
+  return result;
+}
@@ -0,0 +1,277 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+static PLIST_ENTRY PathCacheBucket(PDOKAN_PATH_CACHE Cache, ULONG Hash) {
+  return &Cache->Buckets[Hash % DOKAN_PATH_CACHE_BUCKETS];
+}
+
+// called with the lock held
+static VOID PathCacheFree(PDOKAN_PATH_CACHE Cache,
+                          PDOKAN_PATH_CACHE_ENTRY Entry) {
+  if (Cache->FreeEntry != NULL) {
+    Cache->FreeEntry(Cache, Entry);
+  } else {
+    free(Entry);
+  }
+}
+
+// called with the lock held
+static VOID PathCacheRemove(PDOKAN_PATH_CACHE Cache,
+                            PDOKAN_PATH_CACHE_ENTRY Entry) {
+  RemoveEntryList(&Entry->BucketEntry);
+  RemoveEntryList(&Entry->LruEntry);
+  Cache->Size -= Entry->Size;
+  Cache->Count--;
+  PathCacheFree(Cache, Entry);
+}
+
+// called with the lock held
+static PDOKAN_PATH_CACHE_ENTRY PathCacheFind(PDOKAN_PATH_CACHE Cache,
+                                             LPCWSTR Path, ULONG PathLength,
+                                             ULONG Hash, ULONG Tag) {
+  PLIST_ENTRY bucket = PathCacheBucket(Cache, Hash);
+  PLIST_ENTRY listEntry;
+
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = listEntry->Flink) {
+    PDOKAN_PATH_CACHE_ENTRY entry =
+        CONTAINING_RECORD(listEntry, DOKAN_PATH_CACHE_ENTRY, BucketEntry);
+    if (entry->Hash == Hash && entry->Tag == Tag &&
+        entry->PathLength == PathLength &&
+        DokanEqualUtf16(entry->Path, Path, PathLength,
+                        !Cache->CaseSensitive)) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+// length of the path without a trailing backslash, except for the root
+ULONG DokanPathCacheKeyLength(LPCWSTR Path) {
+  ULONG length = (ULONG)wcslen(Path);
+  if (length > 1 && Path[length - 1] == L'\\')
+    length--;
+  return length;
+}
+
+VOID DokanInitPathCache(PDOKAN_PATH_CACHE Cache, LPCSTR Name,
+                        PDOKAN_PATH_CACHE_FREE FreeEntry) {
+  ULONG i;
+
+  ZeroMemory(Cache, sizeof(DOKAN_PATH_CACHE));
+  InitializeCriticalSection(&Cache->Lock);
+  InitializeListHead(&Cache->LruList);
+  for (i = 0; i < DOKAN_PATH_CACHE_BUCKETS; ++i) {
+    InitializeListHead(&Cache->Buckets[i]);
+  }
+  Cache->Name = Name;
+  Cache->FreeEntry = FreeEntry;
+}
+
+VOID DokanStartPathCache(PDOKAN_PATH_CACHE Cache, ULONG Timeout,
+                         ULONG64 MaxSize, ULONG MaxCount,
+                         BOOL CaseSensitive) {
+  Cache->Timeout = Timeout;
+  Cache->MaxSize = MaxSize;
+  Cache->MaxCount = MaxCount;
+  Cache->CaseSensitive = CaseSensitive;
+}
+
+VOID DokanDeletePathCache(PDOKAN_PATH_CACHE Cache) {
+  DbgPrint("Dokan: %s cache %I64d hits, %I64d misses, "
+           "%I64d invalidations\n",
+           Cache->Name, Cache->Hits, Cache->Misses, Cache->Invalidations);
+
+  while (!IsListEmpty(&Cache->LruList)) {
+    PathCacheRemove(Cache, CONTAINING_RECORD(Cache->LruList.Flink,
+                                             DOKAN_PATH_CACHE_ENTRY, LruEntry));
+  }
+  DeleteCriticalSection(&Cache->Lock);
+}
+
+// allocate an entry of EntrySize bytes, DOKAN_PATH_CACHE_ENTRY first,
+// followed by the key of Path
+PDOKAN_PATH_CACHE_ENTRY DokanPathCacheAllocEntry(LPCWSTR Path,
+                                                 ULONG64 EntrySize,
+                                                 ULONG Tag) {
+  PDOKAN_PATH_CACHE_ENTRY entry;
+  ULONG pathLength = DokanPathCacheKeyLength(Path);
+  ULONG64 size = EntrySize + pathLength * sizeof(WCHAR);
+
+  if (size > MAXULONG) {
+    return NULL;
+  }
+  entry = malloc((SIZE_T)size);
+  if (entry == NULL) {
+    return NULL;
+  }
+  entry->Hash = DokanHashUtf16(Path, pathLength, TRUE);
+  entry->Tag = Tag;
+  entry->Size = (ULONG)size;
+  entry->PathLength = pathLength;
+  entry->Path = (LPWSTR)((PCHAR)entry + EntrySize);
+  RtlCopyMemory(entry->Path, Path, pathLength * sizeof(WCHAR));
+  return entry;
+}
+
+// find the entry of Path and Tag and give it to Copy, under the lock. A
+// FALSE from Copy counts as a miss. Generation receives the value to give
+// to DokanPathCacheInsert after a miss.
+BOOL DokanPathCacheLookup(PDOKAN_PATH_CACHE Cache, LPCWSTR Path, ULONG Tag,
+                          PDOKAN_PATH_CACHE_COPY Copy, PVOID Context,
+                          PULONG64 Generation) {
+  PDOKAN_PATH_CACHE_ENTRY entry;
+  ULONG pathLength;
+  ULONG hash;
+  BOOL found = FALSE;
+
+  if (Cache->Timeout == 0) {
+    return FALSE;
+  }
+
+  pathLength = DokanPathCacheKeyLength(Path);
+  hash = DokanHashUtf16(Path, pathLength, TRUE);
+
+  EnterCriticalSection(&Cache->Lock);
+  entry = PathCacheFind(Cache, Path, pathLength, hash, Tag);
+  if (entry != NULL && GetTickCount64() >= entry->Expiry) {
+    PathCacheRemove(Cache, entry);
+    entry = NULL;
+  }
+  if (entry != NULL) {
+    found = Copy(entry, Context);
+    // most recently used first
+    RemoveEntryList(&entry->LruEntry);
+    InsertHeadList(&Cache->LruList, &entry->LruEntry);
+  }
+  if (found) {
+    Cache->Hits++;
+  } else {
+    Cache->Misses++;
+  }
+  *Generation = Cache->Generation;
+  LeaveCriticalSection(&Cache->Lock);
+
+  return found;
+}
+
+// add an entry from DokanPathCacheAllocEntry in place of the one of the
+// same key. The cache owns Entry from now on: it is freed right away if
+// the cache is disabled, or if something was invalidated since Generation
+// was read, as its content may predate the change.
+VOID DokanPathCacheInsert(PDOKAN_PATH_CACHE Cache,
+                          PDOKAN_PATH_CACHE_ENTRY Entry, ULONG64 Generation) {
+  PDOKAN_PATH_CACHE_ENTRY previous;
+
+  EnterCriticalSection(&Cache->Lock);
+  if (Cache->Timeout == 0 || Cache->Generation != Generation) {
+    PathCacheFree(Cache, Entry);
+    LeaveCriticalSection(&Cache->Lock);
+    return;
+  }
+
+  Entry->Expiry = GetTickCount64() + Cache->Timeout;
+  previous = PathCacheFind(Cache, Entry->Path, Entry->PathLength,
+                           Entry->Hash, Entry->Tag);
+  if (previous != NULL) {
+    PathCacheRemove(Cache, previous);
+  }
+  while (!IsListEmpty(&Cache->LruList) &&
+         ((Cache->MaxCount != 0 && Cache->Count >= Cache->MaxCount) ||
+          (Cache->MaxSize != 0 &&
+           Cache->Size + Entry->Size > Cache->MaxSize))) {
+    PathCacheRemove(Cache, CONTAINING_RECORD(Cache->LruList.Blink,
+                                             DOKAN_PATH_CACHE_ENTRY, LruEntry));
+  }
+  InsertTailList(PathCacheBucket(Cache, Entry->Hash), &Entry->BucketEntry);
+  InsertHeadList(&Cache->LruList, &Entry->LruEntry);
+  Cache->Size += Entry->Size;
+  Cache->Count++;
+  LeaveCriticalSection(&Cache->Lock);
+}
+
+// drop the entries of the first PathLength characters of Path, whatever
+// their tag and spelling, and when Subtree is TRUE the ones below it
+VOID DokanPathCacheInvalidate(PDOKAN_PATH_CACHE Cache, LPCWSTR Path,
+                              ULONG PathLength, BOOL Subtree) {
+  PLIST_ENTRY bucket;
+  PLIST_ENTRY listEntry;
+  ULONG hash;
+
+  if (Cache->Timeout == 0 || Path == NULL) {
+    return;
+  }
+
+  hash = DokanHashUtf16(Path, PathLength, TRUE);
+  bucket = PathCacheBucket(Cache, hash);
+
+  EnterCriticalSection(&Cache->Lock);
+  // entries being made now may predate the change
+  Cache->Generation++;
+  if (Cache->Count == 0) {
+    LeaveCriticalSection(&Cache->Lock);
+    return;
+  }
+
+  listEntry = bucket->Flink;
+  while (listEntry != bucket) {
+    PDOKAN_PATH_CACHE_ENTRY entry =
+        CONTAINING_RECORD(listEntry, DOKAN_PATH_CACHE_ENTRY, BucketEntry);
+    listEntry = listEntry->Flink;
+    if (entry->Hash == hash && entry->PathLength == PathLength &&
+        DokanEqualUtf16(entry->Path, Path, PathLength, TRUE)) {
+      PathCacheRemove(Cache, entry);
+      Cache->Invalidations++;
+    }
+  }
+
+  if (Subtree) {
+    // the root has no separator to add
+    BOOL root = PathLength == 1;
+
+    listEntry = Cache->LruList.Flink;
+    while (listEntry != &Cache->LruList) {
+      PDOKAN_PATH_CACHE_ENTRY entry =
+          CONTAINING_RECORD(listEntry, DOKAN_PATH_CACHE_ENTRY, LruEntry);
+      listEntry = listEntry->Flink;
+      if (entry->PathLength > PathLength &&
+          (root || entry->Path[PathLength] == L'\\') &&
+          DokanEqualUtf16(entry->Path, Path, PathLength, TRUE)) {
+        PathCacheRemove(Cache, entry);
+        Cache->Invalidations++;
+      }
+    }
+  }
+  LeaveCriticalSection(&Cache->Lock);
+}
+
+VOID DokanGetPathCacheStats(PDOKAN_PATH_CACHE Cache,
+                            PDOKAN_CACHE_STATS Stats) {
+  EnterCriticalSection(&Cache->Lock);
+  Stats->Hits = Cache->Hits;
+  Stats->Misses = Cache->Misses;
+  Stats->Invalidations = Cache->Invalidations;
+  Stats->EntryCount = Cache->Count;
+  Stats->Size = Cache->Size;
+  LeaveCriticalSection(&Cache->Lock);
+}
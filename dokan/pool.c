@@ -0,0 +1,290 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokani.h"
+#include <process.h>
+
+/*
+
+DokanStartWorker
+  # MinThreads workers at mount
+
+DokanLoop
+  DokanWorkerBeginWait
+  IOCTL_EVENT_WAIT_BATCH
+  DokanWorkerEndWait
+    # EVENT_BATCH_FLAG_BACKLOG and no waiting worker: DokanStartWorker
+
+DokanKeepAlive
+  DokanRetireIdleWorkers
+    # one worker above MinThreads, waiting for more than IdleTimeout:
+    # Retire is set and its wait is cancelled with CancelSynchronousIo
+    # workers that exited since the last tick and whose thread ended are
+    # freed
+
+DokanWorkerExit
+  # the worker moves to ExitedWorkers, its thread is still running
+
+DokanJoinWorkers
+  # waits for StoppedEvent, then for the thread of each exited worker
+
+A wait is only cancelled while Waiting is set under Lock, so replies and
+IOCTL_EVENT_WRITE requests sent by the worker are never cancelled.
+
+*/
+
+VOID DokanInitWorkerPool(PDOKAN_WORKER_POOL WorkerPool) {
+  ZeroMemory(WorkerPool, sizeof(DOKAN_WORKER_POOL));
+  InitializeCriticalSection(&WorkerPool->Lock);
+  InitializeListHead(&WorkerPool->Workers);
+  InitializeListHead(&WorkerPool->ExitedWorkers);
+  WorkerPool->StoppedEvent = CreateEvent(NULL, TRUE, TRUE, NULL);
+}
+
+static VOID DokanFreeWorker(PDOKAN_WORKER Worker) {
+  CloseHandle(Worker->Thread);
+  free(Worker);
+}
+
+// Free the exited workers whose thread has ended. Lock must be held
+static VOID DokanReapWorkersLocked(PDOKAN_WORKER_POOL WorkerPool) {
+  PLIST_ENTRY entry;
+  PDOKAN_WORKER worker;
+
+  entry = WorkerPool->ExitedWorkers.Flink;
+  while (entry != &WorkerPool->ExitedWorkers) {
+    worker = CONTAINING_RECORD(entry, DOKAN_WORKER, ListEntry);
+    entry = entry->Flink;
+    if (WaitForSingleObject(worker->Thread, 0) == WAIT_OBJECT_0) {
+      RemoveEntryList(&worker->ListEntry);
+      DokanFreeWorker(worker);
+    }
+  }
+}
+
+VOID DokanJoinWorkers(PDOKAN_WORKER_POOL WorkerPool) {
+  LIST_ENTRY exited;
+  PDOKAN_WORKER worker;
+
+  WaitForSingleObject(WorkerPool->StoppedEvent, INFINITE);
+
+  // no worker is left to start another one
+  InitializeListHead(&exited);
+  EnterCriticalSection(&WorkerPool->Lock);
+  while (!IsListEmpty(&WorkerPool->ExitedWorkers)) {
+    InsertTailList(&exited, RemoveHeadList(&WorkerPool->ExitedWorkers));
+  }
+  LeaveCriticalSection(&WorkerPool->Lock);
+
+  while (!IsListEmpty(&exited)) {
+    worker = CONTAINING_RECORD(RemoveHeadList(&exited), DOKAN_WORKER,
+                               ListEntry);
+    WaitForSingleObject(worker->Thread, INFINITE);
+    DokanFreeWorker(worker);
+  }
+}
+
+VOID DokanDeleteWorkerPool(PDOKAN_WORKER_POOL WorkerPool) {
+  if (WorkerPool->StoppedEvent != NULL) {
+    CloseHandle(WorkerPool->StoppedEvent);
+    WorkerPool->StoppedEvent = NULL;
+  }
+  DeleteCriticalSection(&WorkerPool->Lock);
+}
+
+// Lock must be held
+static BOOL DokanStartWorkerLocked(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_WORKER_POOL pool = &DokanInstance->WorkerPool;
+  PDOKAN_WORKER worker;
+
+  worker = (PDOKAN_WORKER)malloc(sizeof(DOKAN_WORKER));
+  if (worker == NULL) {
+    return FALSE;
+  }
+  ZeroMemory(worker, sizeof(DOKAN_WORKER));
+  worker->DokanInstance = DokanInstance;
+
+  // started suspended so that Thread is set before the worker runs
+  worker->Thread = (HANDLE)_beginthreadex(NULL, // Security Attributes
+                                          0,    // stack size
+                                          pool->ThreadLoop,
+                                          (PVOID)worker,    // param
+                                          CREATE_SUSPENDED, // create flag
+                                          NULL);
+  if (worker->Thread == NULL) {
+    DbgPrint("Dokan Error: failed to start worker: %d\n", GetLastError());
+    free(worker);
+    return FALSE;
+  }
+
+  InsertTailList(&pool->Workers, &worker->ListEntry);
+  pool->ThreadCount++;
+  if (pool->ThreadCount > pool->PeakThreadCount) {
+    pool->PeakThreadCount = pool->ThreadCount;
+  }
+  ResetEvent(pool->StoppedEvent);
+
+  ResumeThread(worker->Thread);
+  return TRUE;
+}
+
+BOOL DokanStartWorker(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_WORKER_POOL pool = &DokanInstance->WorkerPool;
+  BOOL started;
+
+  EnterCriticalSection(&pool->Lock);
+  started = DokanStartWorkerLocked(DokanInstance);
+  LeaveCriticalSection(&pool->Lock);
+  return started;
+}
+
+// Returns FALSE if the worker has to exit instead of waiting
+BOOL DokanWorkerBeginWait(PDOKAN_WORKER Worker) {
+  PDOKAN_WORKER_POOL pool = &Worker->DokanInstance->WorkerPool;
+  BOOL wait = TRUE;
+
+  EnterCriticalSection(&pool->Lock);
+  if (Worker->Retire) {
+    wait = FALSE;
+  } else {
+    Worker->Waiting = TRUE;
+    Worker->WaitingSince = GetTickCount64();
+    pool->WaitingCount++;
+  }
+  LeaveCriticalSection(&pool->Lock);
+  return wait;
+}
+
+// Batch is NULL when the wait failed.
+// Returns FALSE if the wait was cancelled to retire the worker.
+BOOL DokanWorkerEndWait(PDOKAN_WORKER Worker, PEVENT_BATCH Batch,
+                        ULONG ReturnedLength) {
+  PDOKAN_INSTANCE instance = Worker->DokanInstance;
+  PDOKAN_WORKER_POOL pool = &instance->WorkerPool;
+  BOOL keep = TRUE;
+
+  EnterCriticalSection(&pool->Lock);
+  Worker->Waiting = FALSE;
+  pool->WaitingCount--;
+
+  if (Batch == NULL) {
+    keep = !Worker->Retire;
+  } else {
+    // events arrived before the cancel, retire on a later tick
+    Worker->Retire = FALSE;
+
+    if (ReturnedLength >= EVENT_BATCH_HEADER_SIZE &&
+        (Batch->Flags & EVENT_BATCH_FLAG_BACKLOG) &&
+        pool->WaitingCount == 0 && pool->ThreadCount < pool->MaxThreads &&
+        !pool->Stopping) {
+      if (DokanStartWorkerLocked(instance)) {
+        DbgPrint("Dokan: worker added, %d running\n", pool->ThreadCount);
+      }
+    }
+  }
+  LeaveCriticalSection(&pool->Lock);
+  return keep;
+}
+
+VOID DokanWorkerExit(PDOKAN_WORKER Worker, BOOL Failed) {
+  PDOKAN_WORKER_POOL pool = &Worker->DokanInstance->WorkerPool;
+
+  EnterCriticalSection(&pool->Lock);
+  if (Failed) {
+    pool->Stopping = TRUE;
+  }
+  RemoveEntryList(&Worker->ListEntry);
+  // the thread is still running, DokanJoinWorkers waits for it
+  InsertTailList(&pool->ExitedWorkers, &Worker->ListEntry);
+  pool->ThreadCount--;
+  DbgPrint("Dokan: worker exit, %d running\n", pool->ThreadCount);
+  if (pool->ThreadCount == 0) {
+    SetEvent(pool->StoppedEvent);
+  }
+  LeaveCriticalSection(&pool->Lock);
+}
+
+VOID DokanRetireIdleWorkers(PDOKAN_WORKER_POOL WorkerPool) {
+  PLIST_ENTRY entry;
+  PDOKAN_WORKER worker;
+  PDOKAN_WORKER candidate = NULL;
+  ULONG retiring = 0;
+  ULONGLONG now = GetTickCount64();
+
+  EnterCriticalSection(&WorkerPool->Lock);
+  DokanReapWorkersLocked(WorkerPool);
+  if (WorkerPool->Stopping) {
+    LeaveCriticalSection(&WorkerPool->Lock);
+    return;
+  }
+
+  for (entry = WorkerPool->Workers.Flink; entry != &WorkerPool->Workers;
+       entry = entry->Flink) {
+    worker = CONTAINING_RECORD(entry, DOKAN_WORKER, ListEntry);
+    if (worker->Retire) {
+      retiring++;
+      // the previous cancel may have reached the thread before its wait
+      if (worker->Waiting) {
+        CancelSynchronousIo(worker->Thread);
+      }
+    } else if (candidate == NULL && worker->Waiting &&
+               now - worker->WaitingSince >= WorkerPool->IdleTimeout) {
+      candidate = worker;
+    }
+  }
+
+  if (candidate != NULL &&
+      WorkerPool->ThreadCount - retiring > WorkerPool->MinThreads) {
+    DbgPrint("Dokan: retire idle worker, %d running\n",
+             WorkerPool->ThreadCount);
+    candidate->Retire = TRUE;
+    CancelSynchronousIo(candidate->Thread);
+  }
+  LeaveCriticalSection(&WorkerPool->Lock);
+}
+
+BOOL DOKANAPI DokanGetThreadCount(LPCWSTR MountPoint, PULONG CurrentCount,
+                                  PULONG PeakCount) {
+  PLIST_ENTRY entry;
+  PDOKAN_INSTANCE instance;
+  BOOL found = FALSE;
+
+  if (MountPoint == NULL || CurrentCount == NULL || PeakCount == NULL) {
+    return FALSE;
+  }
+
+  EnterCriticalSection(&g_InstanceCriticalSection);
+  for (entry = g_InstanceList.Flink; entry != &g_InstanceList;
+       entry = entry->Flink) {
+    instance = CONTAINING_RECORD(entry, DOKAN_INSTANCE, ListEntry);
+    if (IsInstanceMountPoint(instance, MountPoint)) {
+      EnterCriticalSection(&instance->WorkerPool.Lock);
+      *CurrentCount = instance->WorkerPool.ThreadCount;
+      *PeakCount = instance->WorkerPool.PeakThreadCount;
+      LeaveCriticalSection(&instance->WorkerPool.Lock);
+      found = TRUE;
+      break;
+    }
+  }
+  LeaveCriticalSection(&g_InstanceCriticalSection);
+  return found;
+}
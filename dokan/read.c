@@ -28,25 +28,55 @@ VOID DispatchRead(HANDLE Handle, PEVENT_CONTEXT EventContext,
   ULONG readLength = 0;
   NTSTATUS status = STATUS_NOT_IMPLEMENTED;
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   ULONG sizeOfEventInfo;
+  PDOKAN_PENDING_REQUEST pendingRequest;
+  PVOID buffer;
 
-  sizeOfEventInfo =
-      sizeof(EVENT_INFORMATION) - 8 + EventContext->Operation.Read.BufferLength;
+  // large reads go straight to the requester's buffer mapped by the driver
+  if (EventContext->Operation.Read.UserBuffer != 0)
+    sizeOfEventInfo = sizeof(EVENT_INFORMATION);
+  else
+    sizeOfEventInfo = sizeof(EVENT_INFORMATION) - 8 +
+                      EventContext->Operation.Read.BufferLength;
 
   CheckFileName(EventContext->Operation.Read.FileName);
 
   eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+                             &fileInfo, &ioEvent, &openInfo);
 
   DbgPrint("###Read %04d\n", openInfo != NULL ? openInfo->EventId : -1);
 
+  if (EventContext->Operation.Read.UserBuffer != 0)
+    buffer = (PVOID)(ULONG_PTR)EventContext->Operation.Read.UserBuffer;
+  else
+    buffer = eventInfo->Buffer;
+
   if (DokanInstance->DokanOperations->ReadFile) {
+    DokanAllowPendingRequest(&fileInfo);
     status = DokanInstance->DokanOperations->ReadFile(
-        EventContext->Operation.Read.FileName, eventInfo->Buffer,
+        EventContext->Operation.Read.FileName, buffer,
         EventContext->Operation.Read.BufferLength, &readLength,
         EventContext->Operation.Read.ByteOffset.QuadPart, &fileInfo);
   }
 
+  pendingRequest = DokanTakePendingRequest(&status);
+  if (pendingRequest != NULL) {
+    // the buffer stays valid until the request is completed:
+    // the reply leaves the arena and is freed at completion, a mapped
+    // buffer is kept by the driver until the reply
+    DokanArenaDetach(eventInfo);
+    pendingRequest->MajorFunction = IRP_MJ_READ;
+    pendingRequest->DokanInstance = DokanInstance;
+    pendingRequest->OpenInfo = openInfo;
+    pendingRequest->EventInfo = eventInfo;
+    pendingRequest->EventInfoLength = sizeOfEventInfo;
+    pendingRequest->ByteOffset =
+        EventContext->Operation.Read.ByteOffset.QuadPart;
+    DokanStartPendingRequest(pendingRequest);
+    return;
+  }
+
   if (openInfo != NULL)
     openInfo->UserContext = fileInfo.Context;
   eventInfo->BufferLength = 0;
@@ -63,5 +93,5 @@ VOID DispatchRead(HANDLE Handle, PEVENT_CONTEXT EventContext,
   }
 
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
-  free(eventInfo);
+  DokanArenaFree(eventInfo);
 }
@@ -0,0 +1,220 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+#include <process.h>
+
+/*
+
+DOKAN_OPTION_EVENT_RING:
+DokanStart
+  # DOKAN_FEATURE_EVENT_RING in EVENT_START, the driver grants the geometry
+DokanStartEventRing
+  # IOCTL_EVENT_RING maps the submission and completion rings of
+  # sys/ring.h in the process
+
+DokanEventRingLoop (ThreadCount threads, besides the worker pool)
+  DokanRingConsume(Submit)
+  DokanDispatchEvent
+    DokanChannelSendReply
+      # DokanRingProduce(Complete) when the reply fits in a slot,
+      # IOCTL_EVENT_INFO otherwise
+  # sleep on SubmitEvent when Submit is empty
+
+The driver keeps using IOCTL_EVENT_WAIT_BATCH for the events that do not
+fit in the submission ring, the workers run as without the ring. At
+IOCTL_EVENT_RELEASE the driver closes the submission ring: the ring threads
+drain it and leave. The mapping belongs to the driver and goes away with
+the last handle of the process on the device.
+
+*/
+
+static VOID DokanDeleteEventRing(PDOKAN_EVENT_RING EventRing) {
+  if (EventRing->SubmitEvent != NULL) {
+    CloseHandle(EventRing->SubmitEvent);
+  }
+  if (EventRing->CompleteEvent != NULL) {
+    CloseHandle(EventRing->CompleteEvent);
+  }
+  free(EventRing->Threads);
+  free(EventRing);
+}
+
+UINT WINAPI DokanEventRingLoop(PVOID Param) {
+  PDOKAN_INSTANCE DokanInstance = (PDOKAN_INSTANCE)Param;
+  PDOKAN_EVENT_RING eventRing = DokanInstance->EventRing;
+  PDOKAN_RING submit = &eventRing->Submit;
+  DOKAN_DEVICE_CHANNEL channel;
+  DOKAN_REPLY_ARENA arena;
+  PEVENT_CONTEXT eventContext;
+  ULONG length;
+  ULONG serialNumber;
+  DWORD result = 0;
+
+  eventContext = (PEVENT_CONTEXT)malloc(eventRing->PayloadSize);
+  DokanInitDeviceChannel(&channel);
+  // on the device the ring was mapped on
+  if (eventContext == NULL ||
+      !DokanOpenNamedDeviceChannel(
+          &channel, DokanInstance->ControlChannel.RawDeviceName)) {
+    DbgPrint("Dokan Error: event ring thread failed to start\n");
+    free(eventContext);
+    // another ring thread may be waiting for the wakeup
+    SetEvent(eventRing->SubmitEvent);
+    result = (DWORD)-1;
+    _endthreadex(result);
+    return result;
+  }
+  // replies of the events taken from the ring go back through it
+  channel.EventRing = eventRing;
+  DokanSetThreadChannel(&channel);
+  DokanInitReplyArena(&arena);
+  DokanSetThreadArena(&arena);
+
+  for (;;) {
+    if (DokanRingConsume(submit, eventContext, eventRing->PayloadSize,
+                         &length, &serialNumber)) {
+      // DokanRingCommit woke one thread for the whole burst
+      if (DokanRingWakeNext(submit)) {
+        SetEvent(eventRing->SubmitEvent);
+      }
+      if (length < sizeof(EVENT_CONTEXT) || eventContext->Length != length ||
+          eventContext->SerialNumber != serialNumber) {
+        DbgPrint("Dokan Error: malformed event in the ring, length %lu\n",
+                 length);
+        continue;
+      }
+      InterlockedIncrement64(&eventRing->Events);
+      DokanDispatchEvent(channel.Device, eventContext, DokanInstance);
+      continue;
+    }
+
+    // a consume giving up under contention does not mean empty
+    if (DokanRingIsClosed(submit) && DokanRingIsEmpty(submit)) {
+      // pass the wakeup of the driver on to the next thread
+      SetEvent(eventRing->SubmitEvent);
+      break;
+    }
+    if (DokanRingPrepareWait(submit)) {
+      WaitForSingleObject(eventRing->SubmitEvent, INFINITE);
+      DokanRingFinishWait(submit);
+    }
+  }
+
+  DokanSetThreadChannel(NULL);
+  DokanSetThreadArena(NULL);
+  DokanDeleteReplyArena(&arena);
+  DokanCloseDeviceChannel(&channel);
+  free(eventContext);
+  _endthreadex(result);
+  return result;
+}
+
+BOOL DokanStartEventRing(PDOKAN_INSTANCE DokanInstance, ULONG ThreadCount) {
+  PDOKAN_EVENT_RING eventRing;
+  EVENT_RING_MAP ringMap;
+  ULONG returnedLength = 0;
+  ULONG i;
+
+  if (!(DokanInstance->Features & DOKAN_FEATURE_EVENT_RING)) {
+    return TRUE;
+  }
+
+  eventRing = (PDOKAN_EVENT_RING)malloc(sizeof(DOKAN_EVENT_RING));
+  if (eventRing == NULL) {
+    return TRUE;
+  }
+  ZeroMemory(eventRing, sizeof(DOKAN_EVENT_RING));
+  eventRing->Threads = (HANDLE *)malloc(sizeof(HANDLE) * ThreadCount);
+  // auto-reset: DokanRingCommit asks for one wakeup per burst
+  eventRing->SubmitEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  eventRing->CompleteEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (eventRing->Threads == NULL || eventRing->SubmitEvent == NULL ||
+      eventRing->CompleteEvent == NULL) {
+    DokanDeleteEventRing(eventRing);
+    return TRUE;
+  }
+
+  ZeroMemory(&ringMap, sizeof(EVENT_RING_MAP));
+  ringMap.SubmitEvent = (ULONG64)(ULONG_PTR)eventRing->SubmitEvent;
+  ringMap.CompleteEvent = (ULONG64)(ULONG_PTR)eventRing->CompleteEvent;
+  if (!DokanChannelIoControl(&DokanInstance->ControlChannel, IOCTL_EVENT_RING,
+                             &ringMap, sizeof(EVENT_RING_MAP), &ringMap,
+                             sizeof(EVENT_RING_MAP), &returnedLength) ||
+      returnedLength != sizeof(EVENT_RING_MAP)) {
+    // the driver did not publish the ring, every event uses the waits
+    DbgPrint("Dokan: event ring not mapped, using the event waits\n");
+    DokanDeleteEventRing(eventRing);
+    return TRUE;
+  }
+
+  // From here on the driver submits to the ring: it must be served
+  if (!DokanRingAttach(&eventRing->Submit,
+                       (PVOID)(ULONG_PTR)ringMap.SubmitRing,
+                       ringMap.RingSize) ||
+      !DokanRingAttach(&eventRing->Complete,
+                       (PVOID)(ULONG_PTR)ringMap.CompleteRing,
+                       ringMap.RingSize) ||
+      DokanRingPayloadSize(&eventRing->Submit) <
+          DokanInstance->RingPayloadSize) {
+    DokanDbgPrint("Dokan Error: invalid event ring\n");
+    DokanDeleteEventRing(eventRing);
+    return FALSE;
+  }
+  eventRing->PayloadSize = DokanRingPayloadSize(&eventRing->Submit);
+  DokanInstance->EventRing = eventRing;
+
+  for (i = 0; i < ThreadCount; ++i) {
+    HANDLE thread = (HANDLE)_beginthreadex(NULL, // Security Attributes
+                                           0,    // stack size
+                                           DokanEventRingLoop,
+                                           (PVOID)DokanInstance, // param
+                                           0, // create flag
+                                           NULL);
+    if (thread == NULL) {
+      break;
+    }
+    eventRing->Threads[eventRing->ThreadCount++] = thread;
+  }
+  DbgPrint("Dokan: event ring of %lu slots, %lu threads\n",
+           eventRing->Submit.SlotCount, eventRing->ThreadCount);
+  // without a thread the ring would fill up and stay full
+  return eventRing->ThreadCount > 0;
+}
+
+VOID DokanStopEventRing(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_EVENT_RING eventRing = DokanInstance->EventRing;
+  ULONG i;
+
+  if (eventRing == NULL) {
+    return;
+  }
+  // the threads leave once the driver closed the submission ring
+  for (i = 0; i < eventRing->ThreadCount; ++i) {
+    WaitForSingleObject(eventRing->Threads[i], INFINITE);
+    CloseHandle(eventRing->Threads[i]);
+  }
+  DbgPrint("Dokan: %lld events taken from the ring, %lld replies sent "
+           "through it\n",
+           eventRing->Events, eventRing->Replies);
+  DokanInstance->EventRing = NULL;
+  DokanDeleteEventRing(eventRing);
+}
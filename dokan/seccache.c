@@ -0,0 +1,229 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// A descriptor returned by GetFileSecurity, shared by the paths that have
+// the same one.
+typedef struct _DOKAN_SECURITY_DESCRIPTOR_BLOB {
+  LIST_ENTRY BucketEntry;
+  /** Hash of Descriptor */
+  ULONG Hash;
+  /** Number of entries pointing to the descriptor */
+  ULONG References;
+  /** Length of Descriptor in bytes */
+  ULONG Length;
+  UCHAR Descriptor[1];
+} DOKAN_SECURITY_DESCRIPTOR_BLOB, *PDOKAN_SECURITY_DESCRIPTOR_BLOB;
+
+// The descriptor of a path for the SECURITY_INFORMATION in the entry tag
+typedef struct _DOKAN_SECURITY_CACHE_ENTRY {
+  DOKAN_PATH_CACHE_ENTRY Header;
+  PDOKAN_SECURITY_DESCRIPTOR_BLOB Blob;
+} DOKAN_SECURITY_CACHE_ENTRY, *PDOKAN_SECURITY_CACHE_ENTRY;
+
+typedef struct _DOKAN_SECURITY_CACHE_COPY {
+  PSECURITY_DESCRIPTOR SecurityDescriptor;
+  ULONG BufferLength;
+  PULONG LengthNeeded;
+} DOKAN_SECURITY_CACHE_COPY, *PDOKAN_SECURITY_CACHE_COPY;
+
+#define BLOB_SIZE(Length)                                                      \
+  (FIELD_OFFSET(DOKAN_SECURITY_DESCRIPTOR_BLOB, Descriptor) + (Length))
+
+// FNV-1a over the bytes of a descriptor
+static ULONG SecurityDescriptorHash(PUCHAR Descriptor, ULONG Length) {
+  ULONG hash = 2166136261U;
+  ULONG i;
+
+  for (i = 0; i < Length; ++i) {
+    hash = (hash ^ Descriptor[i]) * 16777619U;
+  }
+  return hash;
+}
+
+static PLIST_ENTRY SecurityDescriptorBucket(PDOKAN_SECURITY_CACHE Cache,
+                                            ULONG Hash) {
+  return &Cache->DescriptorBuckets[Hash % DOKAN_SECURITY_DESCRIPTOR_BUCKETS];
+}
+
+// called with the lock held
+static PDOKAN_SECURITY_DESCRIPTOR_BLOB
+SecurityCacheFindBlob(PDOKAN_SECURITY_CACHE Cache, PUCHAR Descriptor,
+                      ULONG Length, ULONG Hash) {
+  PLIST_ENTRY bucket = SecurityDescriptorBucket(Cache, Hash);
+  PLIST_ENTRY listEntry;
+
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = listEntry->Flink) {
+    PDOKAN_SECURITY_DESCRIPTOR_BLOB blob = CONTAINING_RECORD(
+        listEntry, DOKAN_SECURITY_DESCRIPTOR_BLOB, BucketEntry);
+    if (blob->Hash == Hash && blob->Length == Length &&
+        memcmp(blob->Descriptor, Descriptor, Length) == 0) {
+      return blob;
+    }
+  }
+  return NULL;
+}
+
+// called with the lock held, drops the reference of the entry on its blob
+static VOID SecurityCacheFree(PDOKAN_PATH_CACHE Paths,
+                              PDOKAN_PATH_CACHE_ENTRY Entry) {
+  PDOKAN_SECURITY_CACHE cache =
+      CONTAINING_RECORD(Paths, DOKAN_SECURITY_CACHE, Paths);
+  PDOKAN_SECURITY_DESCRIPTOR_BLOB blob =
+      ((PDOKAN_SECURITY_CACHE_ENTRY)Entry)->Blob;
+
+  if (--blob->References == 0) {
+    RemoveEntryList(&blob->BucketEntry);
+    cache->DescriptorSize -= BLOB_SIZE(blob->Length);
+    cache->DescriptorCount--;
+    free(blob);
+  }
+  free(Entry);
+}
+
+static BOOL SecurityCacheCopy(PDOKAN_PATH_CACHE_ENTRY Entry, PVOID Context) {
+  PDOKAN_SECURITY_DESCRIPTOR_BLOB blob =
+      ((PDOKAN_SECURITY_CACHE_ENTRY)Entry)->Blob;
+  PDOKAN_SECURITY_CACHE_COPY copy = Context;
+
+  *copy->LengthNeeded = blob->Length;
+  if (blob->Length <= copy->BufferLength) {
+    RtlCopyMemory(copy->SecurityDescriptor, blob->Descriptor, blob->Length);
+  }
+  return TRUE;
+}
+
+VOID DokanInitSecurityCache(PDOKAN_SECURITY_CACHE Cache) {
+  ULONG i;
+
+  ZeroMemory(Cache, sizeof(DOKAN_SECURITY_CACHE));
+  DokanInitPathCache(&Cache->Paths, "security", SecurityCacheFree);
+  for (i = 0; i < DOKAN_SECURITY_DESCRIPTOR_BUCKETS; ++i) {
+    InitializeListHead(&Cache->DescriptorBuckets[i]);
+  }
+}
+
+VOID DokanDeleteSecurityCache(PDOKAN_SECURITY_CACHE Cache) {
+  ULONG i;
+  ULONG j;
+
+  DbgPrint("Dokan: security cache %d paths sharing %d descriptors\n",
+           Cache->Paths.Count, Cache->DescriptorCount);
+
+  DokanDeletePathCache(&Cache->Paths);
+  for (i = 0; i < 2; ++i) {
+    for (j = 0; j <= DOKAN_SECURITY_PARTS; ++j) {
+      LocalFree(Cache->Defaults[i][j]);
+    }
+  }
+}
+
+// copy the cached descriptor of Path for SecurityInformation. When
+// BufferLength is too small, only LengthNeeded is set. On a miss,
+// Generation receives the value to give to DokanSecurityCacheStore.
+BOOL DokanSecurityCacheLookup(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                              SECURITY_INFORMATION SecurityInformation,
+                              PSECURITY_DESCRIPTOR SecurityDescriptor,
+                              ULONG BufferLength, PULONG LengthNeeded,
+                              PULONG64 Generation) {
+  DOKAN_SECURITY_CACHE_COPY copy;
+
+  copy.SecurityDescriptor = SecurityDescriptor;
+  copy.BufferLength = BufferLength;
+  copy.LengthNeeded = LengthNeeded;
+  return DokanPathCacheLookup(&DokanInstance->SecurityCache.Paths, Path,
+                              SecurityInformation, SecurityCacheCopy, &copy,
+                              Generation);
+}
+
+// keep the descriptor returned by GetFileSecurity for Path, pointing to the
+// copy of another path when they are the same
+VOID DokanSecurityCacheStore(PDOKAN_INSTANCE DokanInstance, LPCWSTR Path,
+                             SECURITY_INFORMATION SecurityInformation,
+                             PSECURITY_DESCRIPTOR SecurityDescriptor,
+                             ULONG Length, ULONG64 Generation) {
+  PDOKAN_SECURITY_CACHE cache = &DokanInstance->SecurityCache;
+  PDOKAN_SECURITY_CACHE_ENTRY entry;
+  PDOKAN_SECURITY_DESCRIPTOR_BLOB blob;
+  PDOKAN_SECURITY_DESCRIPTOR_BLOB shared;
+  ULONG blobHash;
+
+  if (cache->Paths.Timeout == 0 || Length == 0) {
+    return;
+  }
+
+  entry = (PDOKAN_SECURITY_CACHE_ENTRY)DokanPathCacheAllocEntry(
+      Path, sizeof(DOKAN_SECURITY_CACHE_ENTRY), SecurityInformation);
+  if (entry == NULL) {
+    return;
+  }
+
+  // allocated before taking the lock, freed if the descriptor is shared
+  blobHash = SecurityDescriptorHash((PUCHAR)SecurityDescriptor, Length);
+  blob = malloc(BLOB_SIZE(Length));
+  if (blob == NULL) {
+    free(entry);
+    return;
+  }
+  blob->Hash = blobHash;
+  blob->References = 0;
+  blob->Length = Length;
+  RtlCopyMemory(blob->Descriptor, SecurityDescriptor, Length);
+
+  // the lock of the path cache is taken again by DokanPathCacheInsert
+  EnterCriticalSection(&cache->Paths.Lock);
+  shared = SecurityCacheFindBlob(cache, blob->Descriptor, Length, blobHash);
+  if (shared != NULL) {
+    free(blob);
+    blob = shared;
+  } else {
+    InsertTailList(SecurityDescriptorBucket(cache, blobHash),
+                   &blob->BucketEntry);
+    cache->DescriptorSize += BLOB_SIZE(Length);
+    cache->DescriptorCount++;
+  }
+  blob->References++;
+  entry->Blob = blob;
+  DokanPathCacheInsert(&cache->Paths, &entry->Header, Generation);
+  LeaveCriticalSection(&cache->Paths.Lock);
+}
+
+// drop the descriptors of Path and, when Subtree is TRUE, of the files
+// below it
+VOID DokanSecurityCacheInvalidate(PDOKAN_INSTANCE DokanInstance,
+                                  LPCWSTR Path, BOOL Subtree) {
+  if (Path == NULL) {
+    return;
+  }
+  // one entry per SECURITY_INFORMATION asked for, all dropped
+  DokanPathCacheInvalidate(&DokanInstance->SecurityCache.Paths, Path,
+                           DokanPathCacheKeyLength(Path), Subtree);
+}
+
+VOID DokanGetSecurityCacheStats(PDOKAN_SECURITY_CACHE Cache,
+                                PDOKAN_CACHE_STATS Stats) {
+  EnterCriticalSection(&Cache->Paths.Lock);
+  DokanGetPathCacheStats(&Cache->Paths, Stats);
+  Stats->Size += Cache->DescriptorSize;
+  LeaveCriticalSection(&Cache->Paths.Lock);
+}
@@ -21,59 +21,60 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokani.h"
 #include <sddl.h>
-/*
- * DefaultGetFileSecurity build a sddl of the current process user
- * with authenticate user rights for context menu. (New Folder, ...)
- * TODO - Only calcul one time the user group sid
- */
-NTSTATUS DefaultGetFileSecurity(LPCWSTR FileName,
-                                PSECURITY_INFORMATION SecurityInformation,
-                                PSECURITY_DESCRIPTOR SecurityDescriptor,
-                                ULONG BufferLength, PULONG LengthNeeded,
-                                PDOKAN_FILE_INFO DokanFileInfo) {
+// builds the default descriptor of a directory or a file: the current
+// process user and group as owners, with full access for authenticated users
+// for context menu (New Folder, ...). Only the parts in SecurityInformation
+// are kept.
+static PSECURITY_DESCRIPTOR
+BuildDefaultSecurity(BOOL IsDirectory, SECURITY_INFORMATION SecurityInformation,
+                     PULONG Length) {
   WCHAR buffer[1024];
   WCHAR finalBuffer[2048];
   PTOKEN_USER userToken = NULL;
   PTOKEN_GROUPS groupsToken = NULL;
   HANDLE tokenHandle;
   LPTSTR userSidString = NULL, groupSidString = NULL;
-
-  UNREFERENCED_PARAMETER(FileName);
+  LPTSTR pStringBuffer = NULL;
+  PSECURITY_DESCRIPTOR securityDescriptorTmp = NULL;
+  PSECURITY_DESCRIPTOR securityDescriptor = NULL;
+  DWORD returnLength;
+  ULONG size = 0;
 
   if (OpenProcessToken(GetCurrentProcess(), TOKEN_READ, &tokenHandle) ==
       FALSE) {
     DbgPrint("  OpenProcessToken failed: %d\n", GetLastError());
-    return STATUS_NOT_IMPLEMENTED;
+    return NULL;
   }
 
-  DWORD returnLength;
   if (!GetTokenInformation(tokenHandle, TokenUser, buffer, sizeof(buffer),
                            &returnLength)) {
     DbgPrint("  GetTokenInformaiton failed: %d\n", GetLastError());
     CloseHandle(tokenHandle);
-    return STATUS_NOT_IMPLEMENTED;
+    return NULL;
   }
 
   userToken = (PTOKEN_USER)buffer;
   if (!ConvertSidToStringSid(userToken->User.Sid, &userSidString)) {
     DbgPrint("  ConvertSidToStringSid failed: %d\n", GetLastError());
     CloseHandle(tokenHandle);
-    return STATUS_NOT_IMPLEMENTED;
+    return NULL;
   }
 
   if (!GetTokenInformation(tokenHandle, TokenGroups, buffer, sizeof(buffer),
                            &returnLength)) {
     DbgPrint("  GetTokenInformaiton failed: %d\n", GetLastError());
+    LocalFree(userSidString);
     CloseHandle(tokenHandle);
-    return STATUS_NOT_IMPLEMENTED;
+    return NULL;
   }
 
   groupsToken = (PTOKEN_GROUPS)buffer;
   if (groupsToken->GroupCount > 0) {
     if (!ConvertSidToStringSid(groupsToken->Groups[0].Sid, &groupSidString)) {
       DbgPrint("  ConvertSidToStringSid failed: %d\n", GetLastError());
+      LocalFree(userSidString);
       CloseHandle(tokenHandle);
-      return STATUS_NOT_IMPLEMENTED;
+      return NULL;
     }
     swprintf_s(buffer, 1024, L"O:%lsG:%ls", userSidString, groupSidString);
   } else
@@ -84,44 +85,80 @@ NTSTATUS DefaultGetFileSecurity(LPCWSTR FileName,
   CloseHandle(tokenHandle);
 
   // Authenticated users rights
-  if (DokanFileInfo->IsDirectory) {
+  if (IsDirectory) {
     swprintf_s(finalBuffer, 2048, L"%lsD:PAI(A;OICI;FA;;;AU)", buffer);
   } else {
     swprintf_s(finalBuffer, 2048, L"%lsD:AI(A;ID;FA;;;AU)", buffer);
   }
 
-  PSECURITY_DESCRIPTOR SecurityDescriptorTmp = NULL;
-  ULONG Size = 0;
   if (!ConvertStringSecurityDescriptorToSecurityDescriptor(
-          finalBuffer, SDDL_REVISION_1, &SecurityDescriptorTmp, &Size)) {
-    return STATUS_NOT_IMPLEMENTED;
+          finalBuffer, SDDL_REVISION_1, &securityDescriptorTmp, &size)) {
+    return NULL;
   }
 
-  LPTSTR pStringBuffer = NULL;
+  // back and forth through SDDL to drop the parts that were not asked for
   if (!ConvertSecurityDescriptorToStringSecurityDescriptor(
-          SecurityDescriptorTmp, SDDL_REVISION_1, *SecurityInformation,
+          securityDescriptorTmp, SDDL_REVISION_1, SecurityInformation,
           &pStringBuffer, NULL)) {
-    return STATUS_NOT_IMPLEMENTED;
+    LocalFree(securityDescriptorTmp);
+    return NULL;
   }
+  LocalFree(securityDescriptorTmp);
 
-  LocalFree(SecurityDescriptorTmp);
-  SecurityDescriptorTmp = NULL;
-  Size = 0;
+  size = 0;
   if (!ConvertStringSecurityDescriptorToSecurityDescriptor(
-          pStringBuffer, SDDL_REVISION_1, &SecurityDescriptorTmp, &Size)) {
-    return STATUS_NOT_IMPLEMENTED;
+          pStringBuffer, SDDL_REVISION_1, &securityDescriptor, &size)) {
+    securityDescriptor = NULL;
   }
+  LocalFree(pStringBuffer);
 
-  if (Size > BufferLength) {
-    *LengthNeeded = Size;
-    return STATUS_BUFFER_OVERFLOW;
-  }
+  *Length = size;
+  return securityDescriptor;
+}
 
-  memcpy(SecurityDescriptor, SecurityDescriptorTmp, Size);
-  *LengthNeeded = Size;
+// answers with the default descriptor of DokanFileInfo->IsDirectory, built
+// once per mount for each combination of parts asked for
+NTSTATUS DefaultGetFileSecurity(PDOKAN_INSTANCE DokanInstance,
+                                PSECURITY_INFORMATION SecurityInformation,
+                                PSECURITY_DESCRIPTOR SecurityDescriptor,
+                                ULONG BufferLength, PULONG LengthNeeded,
+                                PDOKAN_FILE_INFO DokanFileInfo) {
+  PDOKAN_SECURITY_CACHE cache = &DokanInstance->SecurityCache;
+  ULONG kind = DokanFileInfo->IsDirectory ? 1 : 0;
+  // the default descriptors have nothing but these parts
+  ULONG parts = *SecurityInformation & DOKAN_SECURITY_PARTS;
+  PSECURITY_DESCRIPTOR descriptor;
+  ULONG length = 0;
+
+  EnterCriticalSection(&cache->Paths.Lock);
+  descriptor = cache->Defaults[kind][parts];
+  length = cache->DefaultLengths[kind][parts];
+  LeaveCriticalSection(&cache->Paths.Lock);
+
+  if (descriptor == NULL) {
+    descriptor = BuildDefaultSecurity(kind, parts, &length);
+    if (descriptor == NULL) {
+      return STATUS_NOT_IMPLEMENTED;
+    }
+    EnterCriticalSection(&cache->Paths.Lock);
+    if (cache->Defaults[kind][parts] == NULL) {
+      cache->Defaults[kind][parts] = descriptor;
+      cache->DefaultLengths[kind][parts] = length;
+    } else {
+      // built by another thread in the meantime
+      LocalFree(descriptor);
+      descriptor = cache->Defaults[kind][parts];
+      length = cache->DefaultLengths[kind][parts];
+    }
+    LeaveCriticalSection(&cache->Paths.Lock);
+  }
 
-  LocalFree(pStringBuffer);
-  LocalFree(SecurityDescriptorTmp);
+  // defaults are only freed with the instance
+  *LengthNeeded = length;
+  if (length > BufferLength) {
+    return STATUS_BUFFER_OVERFLOW;
+  }
+  memcpy(SecurityDescriptor, descriptor, length);
 
   return STATUS_SUCCESS;
 }
@@ -130,35 +167,55 @@ VOID DispatchQuerySecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
                            PDOKAN_INSTANCE DokanInstance) {
   PEVENT_INFORMATION eventInfo;
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   PDOKAN_OPEN_INFO openInfo;
   ULONG eventInfoLength;
   NTSTATUS status = STATUS_NOT_IMPLEMENTED;
   ULONG lengthNeeded = 0;
+  ULONG64 generation = 0;
 
   eventInfoLength = sizeof(EVENT_INFORMATION) - 8 +
                     EventContext->Operation.Security.BufferLength;
   CheckFileName(EventContext->Operation.Security.FileName);
 
   eventInfo = DispatchCommon(EventContext, eventInfoLength, DokanInstance,
-                             &fileInfo, &openInfo);
+                             &fileInfo, &ioEvent, &openInfo);
 
   DbgPrint("###GetFileSecurity %04d\n",
            openInfo != NULL ? openInfo->EventId : -1);
 
-  if (DokanInstance->DokanOperations->GetFileSecurity) {
-    status = DokanInstance->DokanOperations->GetFileSecurity(
-        EventContext->Operation.Security.FileName,
-        &EventContext->Operation.Security.SecurityInformation,
-        &eventInfo->Buffer, EventContext->Operation.Security.BufferLength,
-        &lengthNeeded, &fileInfo);
-  }
+  if (DokanInstance->DokanOperations->GetFileSecurity &&
+      DokanSecurityCacheLookup(
+          DokanInstance, EventContext->Operation.Security.FileName,
+          EventContext->Operation.Security.SecurityInformation,
+          &eventInfo->Buffer, EventContext->Operation.Security.BufferLength,
+          &lengthNeeded, &generation)) {
+    status = lengthNeeded <= EventContext->Operation.Security.BufferLength
+                 ? STATUS_SUCCESS
+                 : STATUS_BUFFER_OVERFLOW;
+  } else {
+    if (DokanInstance->DokanOperations->GetFileSecurity) {
+      status = DokanInstance->DokanOperations->GetFileSecurity(
+          EventContext->Operation.Security.FileName,
+          &EventContext->Operation.Security.SecurityInformation,
+          &eventInfo->Buffer, EventContext->Operation.Security.BufferLength,
+          &lengthNeeded, &fileInfo);
+    }
+
+    if (status == STATUS_SUCCESS &&
+        lengthNeeded <= EventContext->Operation.Security.BufferLength) {
+      DokanSecurityCacheStore(
+          DokanInstance, EventContext->Operation.Security.FileName,
+          EventContext->Operation.Security.SecurityInformation,
+          &eventInfo->Buffer, lengthNeeded, generation);
+    }
 
-  if (status == STATUS_NOT_IMPLEMENTED) {
-    status = DefaultGetFileSecurity(
-        EventContext->Operation.Security.FileName,
-        &EventContext->Operation.Security.SecurityInformation,
-        &eventInfo->Buffer, EventContext->Operation.Security.BufferLength,
-        &lengthNeeded, &fileInfo);
+    if (status == STATUS_NOT_IMPLEMENTED) {
+      status = DefaultGetFileSecurity(
+          DokanInstance, &EventContext->Operation.Security.SecurityInformation,
+          &eventInfo->Buffer, EventContext->Operation.Security.BufferLength,
+          &lengthNeeded, &fileInfo);
+    }
   }
 
   eventInfo->Status = status;
@@ -176,13 +233,14 @@ VOID DispatchQuerySecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
   }
 
   SendEventInformation(Handle, eventInfo, eventInfoLength, DokanInstance);
-  free(eventInfo);
+  DokanArenaFree(eventInfo);
 }
 
 VOID DispatchSetSecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
                          PDOKAN_INSTANCE DokanInstance) {
   PEVENT_INFORMATION eventInfo;
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   PDOKAN_OPEN_INFO openInfo;
   ULONG eventInfoLength;
   NTSTATUS status = STATUS_NOT_IMPLEMENTED;
@@ -192,7 +250,7 @@ VOID DispatchSetSecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
   CheckFileName(EventContext->Operation.SetSecurity.FileName);
 
   eventInfo = DispatchCommon(EventContext, eventInfoLength, DokanInstance,
-                             &fileInfo, &openInfo);
+                             &fileInfo, &ioEvent, &openInfo);
 
   DbgPrint("###SetSecurity %04d\n", openInfo != NULL ? openInfo->EventId : -1);
 
@@ -207,6 +265,13 @@ VOID DispatchSetSecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
         &fileInfo);
   }
 
+  if (status == STATUS_SUCCESS) {
+    // inherited entries of the files below may change with a directory
+    DokanSecurityCacheInvalidate(DokanInstance,
+                                 EventContext->Operation.SetSecurity.FileName,
+                                 fileInfo.IsDirectory);
+  }
+
   if (status != STATUS_SUCCESS) {
     eventInfo->Status = STATUS_INVALID_PARAMETER;
     eventInfo->BufferLength = 0;
@@ -216,5 +281,5 @@ VOID DispatchSetSecurity(HANDLE Handle, PEVENT_CONTEXT EventContext,
   }
 
   SendEventInformation(Handle, eventInfo, eventInfoLength, DokanInstance);
-  free(eventInfo);
+  DokanArenaFree(eventInfo);
 }
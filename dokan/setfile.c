@@ -154,7 +154,8 @@ DokanSetLinkInformation(PEVENT_CONTEXT EventContext, PDOKAN_FILE_INFO FileInfo,
 NTSTATUS
 DokanSetRenameInformation(PEVENT_CONTEXT EventContext,
                           PDOKAN_FILE_INFO FileInfo,
-                          PDOKAN_OPERATIONS DokanOperations) {
+                          PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_OPERATIONS DokanOperations = DokanInstance->DokanOperations;
   PDOKAN_RENAME_INFORMATION renameInfo = (PDOKAN_RENAME_INFORMATION)(
       (PCHAR)EventContext + EventContext->Operation.SetFile.BufferOffset);
   NTSTATUS status = STATUS_NOT_IMPLEMENTED;
@@ -191,6 +192,16 @@ DokanSetRenameInformation(PEVENT_CONTEXT EventContext,
   status =
       DokanOperations->MoveFile(EventContext->Operation.SetFile.FileName,
                                 newName, renameInfo->ReplaceIfExists, FileInfo);
+  if (status == STATUS_SUCCESS) {
+    DokanDirCacheInvalidate(DokanInstance, newName, TRUE);
+    DokanInfoCacheInvalidate(DokanInstance, newName, TRUE);
+    DokanNegativeCacheInvalidate(DokanInstance, newName, TRUE);
+    DokanSecurityCacheInvalidate(
+        DokanInstance, EventContext->Operation.SetFile.FileName, TRUE);
+    DokanSecurityCacheInvalidate(DokanInstance, newName, TRUE);
+    DokanFileIdRename(DokanInstance, EventContext->Operation.SetFile.FileName,
+                      newName);
+  }
   free(newName);
   return status;
 }
@@ -216,6 +227,7 @@ VOID DispatchSetInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   PEVENT_INFORMATION eventInfo;
   PDOKAN_OPEN_INFO openInfo;
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   NTSTATUS status = STATUS_NOT_IMPLEMENTED;
   ULONG sizeOfEventInfo = sizeof(EVENT_INFORMATION);
 
@@ -229,7 +241,7 @@ VOID DispatchSetInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   CheckFileName(EventContext->Operation.SetFile.FileName);
 
   eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+                             &fileInfo, &ioEvent, &openInfo);
 
   DbgPrint("###SetFileInfo %04d  %d\n",
            openInfo != NULL ? openInfo->EventId : -1,
@@ -268,8 +280,7 @@ VOID DispatchSetInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   case FileRenameInformation:
   case FileRenameInformationEx:
-    status = DokanSetRenameInformation(EventContext, &fileInfo,
-                                       DokanInstance->DokanOperations);
+    status = DokanSetRenameInformation(EventContext, &fileInfo, DokanInstance);
     break;
 
   case FileValidDataLengthInformation:
@@ -282,6 +293,21 @@ VOID DispatchSetInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
     break;
   }
 
+  // the parent listing holds the attributes, size and times of the file,
+  // a deletion only shows at cleanup
+  if (status == STATUS_SUCCESS &&
+      EventContext->Operation.SetFile.FileInformationClass !=
+          FileDispositionInformation) {
+    BOOL rename = EventContext->Operation.SetFile.FileInformationClass ==
+                      FileRenameInformation ||
+                  EventContext->Operation.SetFile.FileInformationClass ==
+                      FileRenameInformationEx;
+    DokanDirCacheInvalidate(DokanInstance,
+                            EventContext->Operation.SetFile.FileName, rename);
+    DokanInfoCacheInvalidate(DokanInstance,
+                             EventContext->Operation.SetFile.FileName, rename);
+  }
+
   if (openInfo != NULL)
     openInfo->UserContext = fileInfo.Context;
   eventInfo->BufferLength = 0;
@@ -316,5 +342,5 @@ VOID DispatchSetInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   DbgPrint("\tDispatchSetInformation result =  %lx\n", status);
 
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
-  free(eventInfo);
+  DokanArenaFree(eventInfo);
 }
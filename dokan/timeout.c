@@ -26,24 +26,17 @@ BOOL DOKANAPI DokanResetTimeout(ULONG Timeout, PDOKAN_FILE_INFO FileInfo) {
   BOOL status;
   ULONG returnedLength;
   PDOKAN_INSTANCE instance;
-  PDOKAN_OPEN_INFO openInfo;
-  PEVENT_CONTEXT eventContext;
+  PDOKAN_IO_EVENT ioEvent;
   PEVENT_INFORMATION eventInfo;
   ULONG eventInfoSize = sizeof(EVENT_INFORMATION);
-  WCHAR rawDeviceName[MAX_PATH];
 
-  openInfo = (PDOKAN_OPEN_INFO)(UINT_PTR)FileInfo->DokanContext;
-
-  if (openInfo == NULL) {
+  // the request FileInfo was given for, not the last one of the open
+  ioEvent = (PDOKAN_IO_EVENT)(UINT_PTR)FileInfo->DokanContext;
+  if (ioEvent == NULL) {
     return FALSE;
   }
 
-  eventContext = openInfo->EventContext;
-  if (eventContext == NULL) {
-    return FALSE;
-  }
-
-  instance = openInfo->DokanInstance;
+  instance = ioEvent->DokanInstance;
   if (instance == NULL) {
     return FALSE;
   }
@@ -54,57 +47,37 @@ BOOL DOKANAPI DokanResetTimeout(ULONG Timeout, PDOKAN_FILE_INFO FileInfo) {
   }
   RtlZeroMemory(eventInfo, eventInfoSize);
 
-  eventInfo->SerialNumber = eventContext->SerialNumber;
+  eventInfo->SerialNumber = ioEvent->SerialNumber;
   eventInfo->Operation.ResetTimeout.Timeout = Timeout;
 
-  status = SendToDevice(
-      GetRawDeviceName(instance->DeviceName, rawDeviceName, MAX_PATH),
-      IOCTL_RESET_TIMEOUT, eventInfo, eventInfoSize, NULL, 0, &returnedLength);
+  status = DokanChannelIoControl(&instance->ControlChannel,
+                                 IOCTL_RESET_TIMEOUT, eventInfo, eventInfoSize,
+                                 NULL, 0, &returnedLength);
+  if (!status) {
+    DbgPrint("Dokan Error: ResetTimeout failed with code %d\n",
+             GetLastError());
+  }
   free(eventInfo);
   return status;
 }
 
 UINT WINAPI DokanKeepAlive(PDOKAN_INSTANCE DokanInstance) {
-  HANDLE device;
   ULONG ReturnedLength;
-  WCHAR rawDeviceName[MAX_PATH];
 
   while (TRUE) {
 
-    device = CreateFile(
-        GetRawDeviceName(DokanInstance->DeviceName, rawDeviceName, MAX_PATH),
-        GENERIC_READ | GENERIC_WRITE,       // dwDesiredAccess
-        FILE_SHARE_READ | FILE_SHARE_WRITE, // dwShareMode
-        NULL,                               // lpSecurityAttributes
-        OPEN_EXISTING,                      // dwCreationDistribution
-        0,                                  // dwFlagsAndAttributes
-        NULL                                // hTemplateFile
-        );
-
-    if (device == INVALID_HANDLE_VALUE) {
-      DbgPrint(
-          "Dokan Error: DokanKeepAlive CreateFile failed %ws: %d\n",
-          GetRawDeviceName(DokanInstance->DeviceName, rawDeviceName, MAX_PATH),
-          GetLastError());
-      break;
-    }
-
-    BOOL status = DeviceIoControl(device,          // Handle to device
-                                  IOCTL_KEEPALIVE, // IO Control code
-                                  NULL,            // Input Buffer to driver.
-                                  0,    // Length of input buffer in bytes.
-                                  NULL, // Output Buffer from driver.
-                                  0,    // Length of output buffer in bytes.
-                                  &ReturnedLength, // Bytes placed in buffer.
-                                  NULL             // synchronous call
-                                  );
-
-    CloseHandle(device);
+    BOOL status =
+        DokanChannelIoControl(&DokanInstance->ControlChannel, IOCTL_KEEPALIVE,
+                              NULL, 0, NULL, 0, &ReturnedLength);
 
     if (!status) {
+      DbgPrint("Dokan Error: DokanKeepAlive failed %ws: %d\n",
+               DokanInstance->ControlChannel.RawDeviceName, GetLastError());
       break;
     }
 
+    DokanRetireIdleWorkers(&DokanInstance->WorkerPool);
+
     Sleep(DOKAN_KEEPALIVE_TIME);
   }
 
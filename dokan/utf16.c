@@ -0,0 +1,144 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// UTF-16 helpers on counted strings. Blocks of 8 characters that are all
+// ASCII are upcased and compared with SSE2, the other characters one at a
+// time.
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DOKAN_UTF16_SSE2
+#endif
+
+// towupper is a call into the CRT, keep it for non-ASCII characters
+static __inline WCHAR UpcaseChar(WCHAR C) {
+  if (C < 0x80) {
+    return (C >= L'a' && C <= L'z') ? (WCHAR)(C - 0x20) : C;
+  }
+  return (WCHAR)towupper(C);
+}
+
+#ifdef DOKAN_UTF16_SSE2
+
+#define UTF16_BLOCK 8
+
+// TRUE if the 8 characters of Value are below 0x80
+static __inline BOOL IsAsciiBlock(__m128i Value) {
+  __m128i high = _mm_and_si128(Value, _mm_set1_epi16((short)0xFF80));
+  return _mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) ==
+         0xFFFF;
+}
+
+// upcase a block of ASCII characters
+static __inline __m128i UpcaseAsciiBlock(__m128i Value) {
+  __m128i lower =
+      _mm_and_si128(_mm_cmpgt_epi16(Value, _mm_set1_epi16(L'a' - 1)),
+                    _mm_cmplt_epi16(Value, _mm_set1_epi16(L'z' + 1)));
+  return _mm_sub_epi16(Value, _mm_and_si128(lower, _mm_set1_epi16(0x20)));
+}
+
+#endif
+
+VOID DokanUpcaseUtf16(LPWSTR Dest, LPCWSTR Src, ULONG Length) {
+  ULONG i = 0;
+
+#ifdef DOKAN_UTF16_SSE2
+  for (; i + UTF16_BLOCK <= Length; i += UTF16_BLOCK) {
+    __m128i value = _mm_loadu_si128((const __m128i *)&Src[i]);
+    if (IsAsciiBlock(value)) {
+      _mm_storeu_si128((__m128i *)&Dest[i], UpcaseAsciiBlock(value));
+    } else {
+      ULONG j;
+      for (j = i; j < i + UTF16_BLOCK; ++j) {
+        Dest[j] = UpcaseChar(Src[j]);
+      }
+    }
+  }
+#endif
+  for (; i < Length; ++i) {
+    Dest[i] = UpcaseChar(Src[i]);
+  }
+}
+
+BOOL DOKANAPI DokanEqualUtf16(LPCWSTR String1, LPCWSTR String2, ULONG Length,
+                              BOOL IgnoreCase) {
+  ULONG i = 0;
+
+  if (!IgnoreCase) {
+    return memcmp(String1, String2, Length * sizeof(WCHAR)) == 0;
+  }
+
+#ifdef DOKAN_UTF16_SSE2
+  for (; i + UTF16_BLOCK <= Length; i += UTF16_BLOCK) {
+    __m128i value1 = _mm_loadu_si128((const __m128i *)&String1[i]);
+    __m128i value2 = _mm_loadu_si128((const __m128i *)&String2[i]);
+    if (IsAsciiBlock(_mm_or_si128(value1, value2))) {
+      __m128i equal = _mm_cmpeq_epi16(UpcaseAsciiBlock(value1),
+                                      UpcaseAsciiBlock(value2));
+      if (_mm_movemask_epi8(equal) != 0xFFFF)
+        return FALSE;
+    } else {
+      ULONG j;
+      for (j = i; j < i + UTF16_BLOCK; ++j) {
+        if (UpcaseChar(String1[j]) != UpcaseChar(String2[j]))
+          return FALSE;
+      }
+    }
+  }
+#endif
+  for (; i < Length; ++i) {
+    if (UpcaseChar(String1[i]) != UpcaseChar(String2[i]))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL DOKANAPI DokanStartsWithUtf16(LPCWSTR String, ULONG Length,
+                                   LPCWSTR Prefix, ULONG PrefixLength,
+                                   BOOL IgnoreCase) {
+  return PrefixLength <= Length &&
+         DokanEqualUtf16(String, Prefix, PrefixLength, IgnoreCase);
+}
+
+// FNV-1a over the characters, upcased when IgnoreCase is TRUE, so that
+// strings equal for DokanEqualUtf16 have the same hash
+ULONG DokanHashUtf16(LPCWSTR String, ULONG Length, BOOL IgnoreCase) {
+  WCHAR block[64];
+  ULONG hash = 2166136261U;
+  ULONG i = 0;
+
+  while (i < Length) {
+    ULONG count = min(Length - i, (ULONG)(sizeof(block) / sizeof(WCHAR)));
+    LPCWSTR chars = &String[i];
+    ULONG j;
+
+    if (IgnoreCase) {
+      DokanUpcaseUtf16(block, chars, count);
+      chars = block;
+    }
+    for (j = 0; j < count; ++j) {
+      hash = (hash ^ chars[j]) * 16777619U;
+    }
+    i += count;
+  }
+  return hash;
+}
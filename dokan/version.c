@@ -28,7 +28,7 @@ ULONG DOKANAPI DokanDriverVersion() {
   ULONG version = 0;
   ULONG ret = 0;
 
-  if (SendToDevice(DOKAN_GLOBAL_DEVICE_NAME, IOCTL_TEST,
+  if (SendToDevice(IOCTL_TEST,
                    NULL,          // InputBuffer
                    0,             // InputLength
                    &version,      // OutputBuffer
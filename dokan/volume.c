@@ -53,72 +53,270 @@ NTSTATUS DOKAN_CALLBACK DokanGetVolumeInformation(
   return STATUS_SUCCESS;
 }
 
-NTSTATUS
-DokanFsVolumeInformation(PEVENT_INFORMATION EventInfo,
-                         PEVENT_CONTEXT EventContext, PDOKAN_FILE_INFO FileInfo,
-                         PDOKAN_OPERATIONS DokanOperations) {
-  WCHAR volumeName[MAX_PATH];
-  DWORD volumeSerial = 0;
-  DWORD maxComLength = 0;
-  DWORD fsFlags = 0;
-  WCHAR fsName[MAX_PATH];
-  ULONG remainingLength;
-  ULONG bytesToCopy;
-  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+VOID DokanInitVolumeCache(PDOKAN_VOLUME_CACHE Cache) {
+  ZeroMemory(Cache, sizeof(DOKAN_VOLUME_CACHE));
+  InitializeCriticalSection(&Cache->Lock);
+  // signaled: no refresh is queued
+  Cache->RefreshDone = CreateEvent(NULL, TRUE, TRUE, NULL);
+}
 
-  PFILE_FS_VOLUME_INFORMATION volumeInfo =
-      (PFILE_FS_VOLUME_INFORMATION)EventInfo->Buffer;
+VOID DokanStartVolumeCache(PDOKAN_VOLUME_CACHE Cache, ULONG FreeSpaceTimeout,
+                           BOOL BackgroundRefresh) {
+  Cache->FreeSpaceTimeout = FreeSpaceTimeout;
+  Cache->BackgroundRefresh =
+      BackgroundRefresh && FreeSpaceTimeout != 0 && Cache->RefreshDone != NULL;
+}
 
-  remainingLength = EventContext->Operation.Volume.BufferLength;
+// wait for the queued refresh. No new one can be queued once the workers
+// have stopped.
+VOID DokanStopVolumeCache(PDOKAN_VOLUME_CACHE Cache) {
+  if (Cache->RefreshDone == NULL) {
+    return;
+  }
+  WaitForSingleObject(Cache->RefreshDone, INFINITE);
+  // the refresh signals the event with the lock held, wait for it to leave
+  EnterCriticalSection(&Cache->Lock);
+  LeaveCriticalSection(&Cache->Lock);
+}
 
-  if (remainingLength < sizeof(FILE_FS_VOLUME_INFORMATION)) {
-    return STATUS_BUFFER_OVERFLOW;
+VOID DokanDeleteVolumeCache(PDOKAN_VOLUME_CACHE Cache) {
+  DbgPrint("Dokan: volume cache %I64d hits, %I64d misses\n", Cache->Hits,
+           Cache->Misses);
+
+  if (Cache->RefreshDone != NULL) {
+    CloseHandle(Cache->RefreshDone);
   }
+  DeleteCriticalSection(&Cache->Lock);
+}
 
-  RtlZeroMemory(volumeName, sizeof(volumeName));
-  RtlZeroMemory(fsName, sizeof(fsName));
+VOID DokanGetVolumeCacheStats(PDOKAN_VOLUME_CACHE Cache,
+                              PDOKAN_CACHE_STATS Stats) {
+  EnterCriticalSection(&Cache->Lock);
+  Stats->Hits = Cache->Hits;
+  Stats->Misses = Cache->Misses;
+  Stats->Invalidations = 0;
+  Stats->EntryCount = 0;
+  Stats->Size = 0;
+  if (Cache->InformationValid) {
+    Stats->EntryCount++;
+    Stats->Size += sizeof(DOKAN_VOLUME_INFO);
+  }
+  if (Cache->FreeSpaceValid) {
+    Stats->EntryCount++;
+    Stats->Size += sizeof(DOKAN_DISK_FREE_SPACE);
+  }
+  LeaveCriticalSection(&Cache->Lock);
+}
+
+static NTSTATUS CallGetVolumeInformation(PDOKAN_OPERATIONS DokanOperations,
+                                         PDOKAN_FILE_INFO FileInfo,
+                                         PDOKAN_VOLUME_INFO Info) {
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+
+  RtlZeroMemory(Info, sizeof(DOKAN_VOLUME_INFO));
 
   if (DokanOperations->GetVolumeInformation) {
     status = DokanOperations->GetVolumeInformation(
-        volumeName,                         // VolumeNameBuffer
-        sizeof(volumeName) / sizeof(WCHAR), // VolumeNameSize
-        &volumeSerial,                      // VolumeSerialNumber
-        &maxComLength,                      // MaximumComponentLength
-        &fsFlags,                           // FileSystemFlags
-        fsName,                             // FileSystemNameBuffer
-        sizeof(fsName) / sizeof(WCHAR),     // FileSystemNameSize
+        Info->VolumeName,                         // VolumeNameBuffer
+        sizeof(Info->VolumeName) / sizeof(WCHAR), // VolumeNameSize
+        &Info->VolumeSerialNumber,                // VolumeSerialNumber
+        &Info->MaximumComponentLength,            // MaximumComponentLength
+        &Info->FileSystemFlags,                   // FileSystemFlags
+        Info->FileSystemName,                     // FileSystemNameBuffer
+        sizeof(Info->FileSystemName) / sizeof(WCHAR), // FileSystemNameSize
         FileInfo);
   }
 
   if (status == STATUS_NOT_IMPLEMENTED) {
     status = DokanGetVolumeInformation(
-        volumeName,                         // VolumeNameBuffer
-        sizeof(volumeName) / sizeof(WCHAR), // VolumeNameSize
-        &volumeSerial,                      // VolumeSerialNumber
-        &maxComLength,                      // MaximumComponentLength
-        &fsFlags,                           // FileSystemFlags
-        fsName,                             // FileSystemNameBuffer
-        sizeof(fsName) / sizeof(WCHAR),     // FileSystemNameSize
+        Info->VolumeName,                         // VolumeNameBuffer
+        sizeof(Info->VolumeName) / sizeof(WCHAR), // VolumeNameSize
+        &Info->VolumeSerialNumber,                // VolumeSerialNumber
+        &Info->MaximumComponentLength,            // MaximumComponentLength
+        &Info->FileSystemFlags,                   // FileSystemFlags
+        Info->FileSystemName,                     // FileSystemNameBuffer
+        sizeof(Info->FileSystemName) / sizeof(WCHAR), // FileSystemNameSize
+        FileInfo);
+  }
+
+  // the callback may have filled the whole buffers
+  Info->VolumeName[MAX_PATH - 1] = L'\0';
+  Info->FileSystemName[MAX_PATH - 1] = L'\0';
+
+  return status;
+}
+
+static NTSTATUS CallGetDiskFreeSpace(PDOKAN_OPERATIONS DokanOperations,
+                                     PDOKAN_FILE_INFO FileInfo,
+                                     PDOKAN_DISK_FREE_SPACE FreeSpace) {
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+
+  RtlZeroMemory(FreeSpace, sizeof(DOKAN_DISK_FREE_SPACE));
+
+  if (DokanOperations->GetDiskFreeSpace) {
+    status = DokanOperations->GetDiskFreeSpace(
+        &FreeSpace->FreeBytesAvailable,     // FreeBytesAvailable
+        &FreeSpace->TotalNumberOfBytes,     // TotalNumberOfBytes
+        &FreeSpace->TotalNumberOfFreeBytes, // TotalNumberOfFreeBytes
         FileInfo);
   }
 
+  if (status == STATUS_NOT_IMPLEMENTED) {
+    status = DokanGetDiskFreeSpace(
+        &FreeSpace->FreeBytesAvailable,     // FreeBytesAvailable
+        &FreeSpace->TotalNumberOfBytes,     // TotalNumberOfBytes
+        &FreeSpace->TotalNumberOfFreeBytes, // TotalNumberOfFreeBytes
+        FileInfo);
+  }
+
+  return status;
+}
+
+// the volume information does not change while mounted, so the first
+// successful answer is kept
+static NTSTATUS QueryVolumeInformation(PDOKAN_INSTANCE DokanInstance,
+                                       PDOKAN_FILE_INFO FileInfo,
+                                       PDOKAN_VOLUME_INFO Info) {
+  PDOKAN_VOLUME_CACHE cache = &DokanInstance->VolumeCache;
+  NTSTATUS status;
+
+  EnterCriticalSection(&cache->Lock);
+  if (cache->InformationValid) {
+    *Info = cache->Information;
+    cache->Hits++;
+    LeaveCriticalSection(&cache->Lock);
+    return STATUS_SUCCESS;
+  }
+  cache->Misses++;
+  LeaveCriticalSection(&cache->Lock);
+
+  status = CallGetVolumeInformation(DokanInstance->DokanOperations, FileInfo,
+                                    Info);
+  if (status == STATUS_SUCCESS) {
+    EnterCriticalSection(&cache->Lock);
+    cache->Information = *Info;
+    cache->InformationValid = TRUE;
+    LeaveCriticalSection(&cache->Lock);
+  }
+  return status;
+}
+
+static VOID StoreDiskFreeSpace(PDOKAN_VOLUME_CACHE Cache,
+                               PDOKAN_DISK_FREE_SPACE FreeSpace) {
+  EnterCriticalSection(&Cache->Lock);
+  Cache->FreeSpace = *FreeSpace;
+  Cache->FreeSpaceValid = TRUE;
+  Cache->FreeSpaceExpiry = GetTickCount64() + Cache->FreeSpaceTimeout;
+  LeaveCriticalSection(&Cache->Lock);
+}
+
+// thread pool work item queued by QueryDiskFreeSpace
+static DWORD WINAPI RefreshDiskFreeSpace(LPVOID Parameter) {
+  PDOKAN_INSTANCE instance = (PDOKAN_INSTANCE)Parameter;
+  PDOKAN_VOLUME_CACHE cache = &instance->VolumeCache;
+  DOKAN_DISK_FREE_SPACE freeSpace;
+  DOKAN_FILE_INFO fileInfo;
+
+  RtlZeroMemory(&fileInfo, sizeof(DOKAN_FILE_INFO));
+  fileInfo.DokanOptions = instance->DokanOptions;
+
+  // on failure the previous figures stay expired, the next query retries
+  if (CallGetDiskFreeSpace(instance->DokanOperations, &fileInfo,
+                           &freeSpace) == STATUS_SUCCESS) {
+    StoreDiskFreeSpace(cache, &freeSpace);
+  }
+
+  EnterCriticalSection(&cache->Lock);
+  cache->Refreshing = FALSE;
+  SetEvent(cache->RefreshDone);
+  LeaveCriticalSection(&cache->Lock);
+  return 0;
+}
+
+static NTSTATUS QueryDiskFreeSpace(PDOKAN_INSTANCE DokanInstance,
+                                   PDOKAN_FILE_INFO FileInfo,
+                                   PDOKAN_DISK_FREE_SPACE FreeSpace) {
+  PDOKAN_VOLUME_CACHE cache = &DokanInstance->VolumeCache;
+  BOOL refresh = FALSE;
+  BOOL expired;
+  NTSTATUS status;
+
+  if (cache->FreeSpaceTimeout == 0) {
+    return CallGetDiskFreeSpace(DokanInstance->DokanOperations, FileInfo,
+                                FreeSpace);
+  }
+
+  EnterCriticalSection(&cache->Lock);
+  expired = GetTickCount64() >= cache->FreeSpaceExpiry;
+  // expired figures are answered while they are refreshed
+  if (cache->FreeSpaceValid && (!expired || cache->BackgroundRefresh)) {
+    *FreeSpace = cache->FreeSpace;
+    cache->Hits++;
+    if (expired && !cache->Refreshing) {
+      cache->Refreshing = TRUE;
+      ResetEvent(cache->RefreshDone);
+      refresh = TRUE;
+    }
+    LeaveCriticalSection(&cache->Lock);
+
+    if (refresh && !QueueUserWorkItem(RefreshDiskFreeSpace, DokanInstance,
+                                      WT_EXECUTEDEFAULT)) {
+      DbgPrint("Dokan: failed to queue the free space refresh %d\n",
+               GetLastError());
+      EnterCriticalSection(&cache->Lock);
+      cache->Refreshing = FALSE;
+      SetEvent(cache->RefreshDone);
+      LeaveCriticalSection(&cache->Lock);
+    }
+    return STATUS_SUCCESS;
+  }
+  cache->Misses++;
+  LeaveCriticalSection(&cache->Lock);
+
+  status = CallGetDiskFreeSpace(DokanInstance->DokanOperations, FileInfo,
+                                FreeSpace);
+  if (status == STATUS_SUCCESS) {
+    StoreDiskFreeSpace(cache, FreeSpace);
+  }
+  return status;
+}
+
+NTSTATUS
+DokanFsVolumeInformation(PEVENT_INFORMATION EventInfo,
+                         PEVENT_CONTEXT EventContext, PDOKAN_FILE_INFO FileInfo,
+                         PDOKAN_INSTANCE DokanInstance) {
+  DOKAN_VOLUME_INFO info;
+  ULONG remainingLength;
+  ULONG bytesToCopy;
+  NTSTATUS status;
+
+  PFILE_FS_VOLUME_INFORMATION volumeInfo =
+      (PFILE_FS_VOLUME_INFORMATION)EventInfo->Buffer;
+
+  remainingLength = EventContext->Operation.Volume.BufferLength;
+
+  if (remainingLength < sizeof(FILE_FS_VOLUME_INFORMATION)) {
+    return STATUS_BUFFER_OVERFLOW;
+  }
+
+  status = QueryVolumeInformation(DokanInstance, FileInfo, &info);
   if (status != STATUS_SUCCESS) {
     return status;
   }
 
   volumeInfo->VolumeCreationTime.QuadPart = 0;
-  volumeInfo->VolumeSerialNumber = volumeSerial;
+  volumeInfo->VolumeSerialNumber = info.VolumeSerialNumber;
   volumeInfo->SupportsObjects = FALSE;
 
   remainingLength -= FIELD_OFFSET(FILE_FS_VOLUME_INFORMATION, VolumeLabel[0]);
 
-  bytesToCopy = (ULONG)wcslen(volumeName) * sizeof(WCHAR);
+  bytesToCopy = (ULONG)wcslen(info.VolumeName) * sizeof(WCHAR);
   if (remainingLength < bytesToCopy) {
     bytesToCopy = remainingLength;
   }
 
   volumeInfo->VolumeLabelLength = bytesToCopy;
-  RtlCopyMemory(volumeInfo->VolumeLabel, volumeName, bytesToCopy);
+  RtlCopyMemory(volumeInfo->VolumeLabel, info.VolumeName, bytesToCopy);
   remainingLength -= bytesToCopy;
 
   EventInfo->BufferLength =
@@ -130,11 +328,9 @@ DokanFsVolumeInformation(PEVENT_INFORMATION EventInfo,
 NTSTATUS
 DokanFsSizeInformation(PEVENT_INFORMATION EventInfo,
                        PEVENT_CONTEXT EventContext, PDOKAN_FILE_INFO FileInfo,
-                       PDOKAN_OPERATIONS DokanOperations) {
-  ULONGLONG freeBytesAvailable = 0;
-  ULONGLONG totalBytes = 0;
-  ULONGLONG freeBytes = 0;
-  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+                       PDOKAN_INSTANCE DokanInstance) {
+  DOKAN_DISK_FREE_SPACE freeSpace;
+  NTSTATUS status;
 
   ULONG allocationUnitSize = FileInfo->DokanOptions->AllocationUnitSize;
   ULONG sectorSize = FileInfo->DokanOptions->SectorSize;
@@ -147,29 +343,15 @@ DokanFsSizeInformation(PEVENT_INFORMATION EventInfo,
     return STATUS_BUFFER_OVERFLOW;
   }
 
-  if (DokanOperations->GetDiskFreeSpace) {
-    status = DokanOperations->GetDiskFreeSpace(
-        &freeBytesAvailable, // FreeBytesAvailable
-        &totalBytes,         // TotalNumberOfBytes
-        &freeBytes,          // TotalNumberOfFreeBytes
-        FileInfo);
-  }
-
-  if (status == STATUS_NOT_IMPLEMENTED) {
-    status = DokanGetDiskFreeSpace(&freeBytesAvailable, // FreeBytesAvailable
-                                   &totalBytes,         // TotalNumberOfBytes
-                                   &freeBytes, // TotalNumberOfFreeBytes
-                                   FileInfo);
-  }
-
+  status = QueryDiskFreeSpace(DokanInstance, FileInfo, &freeSpace);
   if (status != STATUS_SUCCESS) {
     return status;
   }
 
   sizeInfo->TotalAllocationUnits.QuadPart =
-      totalBytes / allocationUnitSize;
+      freeSpace.TotalNumberOfBytes / allocationUnitSize;
   sizeInfo->AvailableAllocationUnits.QuadPart =
-      freeBytesAvailable / allocationUnitSize;
+      freeSpace.FreeBytesAvailable / allocationUnitSize;
   sizeInfo->SectorsPerAllocationUnit =
 	  allocationUnitSize / sectorSize;
   sizeInfo->BytesPerSector = sectorSize;
@@ -183,15 +365,11 @@ NTSTATUS
 DokanFsAttributeInformation(PEVENT_INFORMATION EventInfo,
                             PEVENT_CONTEXT EventContext,
                             PDOKAN_FILE_INFO FileInfo,
-                            PDOKAN_OPERATIONS DokanOperations) {
-  WCHAR volumeName[MAX_PATH];
-  DWORD volumeSerial;
-  DWORD maxComLength = 0;
-  DWORD fsFlags = 0;
-  WCHAR fsName[MAX_PATH];
+                            PDOKAN_INSTANCE DokanInstance) {
+  DOKAN_VOLUME_INFO info;
   ULONG remainingLength;
   ULONG bytesToCopy;
-  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+  NTSTATUS status;
 
   PFILE_FS_ATTRIBUTE_INFORMATION attrInfo =
       (PFILE_FS_ATTRIBUTE_INFORMATION)EventInfo->Buffer;
@@ -202,50 +380,24 @@ DokanFsAttributeInformation(PEVENT_INFORMATION EventInfo,
     return STATUS_BUFFER_OVERFLOW;
   }
 
-  RtlZeroMemory(volumeName, sizeof(volumeName));
-  RtlZeroMemory(fsName, sizeof(fsName));
-
-  if (DokanOperations->GetVolumeInformation) {
-    status = DokanOperations->GetVolumeInformation(
-        volumeName,                         // VolumeNameBuffer
-        sizeof(volumeName) / sizeof(WCHAR), // VolumeNameSize
-        &volumeSerial,                      // VolumeSerialNumber
-        &maxComLength,                      // MaximumComponentLength
-        &fsFlags,                           // FileSystemFlags
-        fsName,                             // FileSystemNameBuffer
-        sizeof(fsName) / sizeof(WCHAR),     // FileSystemNameSize
-        FileInfo);
-  }
-
-  if (status == STATUS_NOT_IMPLEMENTED) {
-    status = DokanGetVolumeInformation(
-        volumeName,                         // VolumeNameBuffer
-        sizeof(volumeName) / sizeof(WCHAR), // VolumeNameSize
-        &volumeSerial,                      // VolumeSerialNumber
-        &maxComLength,                      // MaximumComponentLength
-        &fsFlags,                           // FileSystemFlags
-        fsName,                             // FileSystemNameBuffer
-        sizeof(fsName) / sizeof(WCHAR),     // FileSystemNameSize
-        FileInfo);
-  }
-
+  status = QueryVolumeInformation(DokanInstance, FileInfo, &info);
   if (status != STATUS_SUCCESS) {
     return status;
   }
 
-  attrInfo->FileSystemAttributes = fsFlags;
-  attrInfo->MaximumComponentNameLength = maxComLength;
+  attrInfo->FileSystemAttributes = info.FileSystemFlags;
+  attrInfo->MaximumComponentNameLength = info.MaximumComponentLength;
 
   remainingLength -=
       FIELD_OFFSET(FILE_FS_ATTRIBUTE_INFORMATION, FileSystemName[0]);
 
-  bytesToCopy = (ULONG)wcslen(fsName) * sizeof(WCHAR);
+  bytesToCopy = (ULONG)wcslen(info.FileSystemName) * sizeof(WCHAR);
   if (remainingLength < bytesToCopy) {
     bytesToCopy = remainingLength;
   }
 
   attrInfo->FileSystemNameLength = bytesToCopy;
-  RtlCopyMemory(attrInfo->FileSystemName, fsName, bytesToCopy);
+  RtlCopyMemory(attrInfo->FileSystemName, info.FileSystemName, bytesToCopy);
   remainingLength -= bytesToCopy;
 
   EventInfo->BufferLength =
@@ -258,11 +410,9 @@ NTSTATUS
 DokanFsFullSizeInformation(PEVENT_INFORMATION EventInfo,
                            PEVENT_CONTEXT EventContext,
                            PDOKAN_FILE_INFO FileInfo,
-                           PDOKAN_OPERATIONS DokanOperations) {
-  ULONGLONG freeBytesAvailable = 0;
-  ULONGLONG totalBytes = 0;
-  ULONGLONG freeBytes = 0;
-  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+                           PDOKAN_INSTANCE DokanInstance) {
+  DOKAN_DISK_FREE_SPACE freeSpace;
+  NTSTATUS status;
 
   ULONG allocationUnitSize = FileInfo->DokanOptions->AllocationUnitSize;
   ULONG sectorSize = FileInfo->DokanOptions->SectorSize;
@@ -275,31 +425,17 @@ DokanFsFullSizeInformation(PEVENT_INFORMATION EventInfo,
     return STATUS_BUFFER_OVERFLOW;
   }
 
-  if (DokanOperations->GetDiskFreeSpace) {
-    status = DokanOperations->GetDiskFreeSpace(
-        &freeBytesAvailable, // FreeBytesAvailable
-        &totalBytes,         // TotalNumberOfBytes
-        &freeBytes,          // TotalNumberOfFreeBytes
-        FileInfo);
-  }
-
-  if (status == STATUS_NOT_IMPLEMENTED) {
-    status = DokanGetDiskFreeSpace(&freeBytesAvailable, // FreeBytesAvailable
-                                   &totalBytes,         // TotalNumberOfBytes
-                                   &freeBytes, // TotalNumberOfFreeBytes
-                                   FileInfo);
-  }
-
+  status = QueryDiskFreeSpace(DokanInstance, FileInfo, &freeSpace);
   if (status != STATUS_SUCCESS) {
     return status;
   }
 
   sizeInfo->TotalAllocationUnits.QuadPart =
-      totalBytes / allocationUnitSize;
+      freeSpace.TotalNumberOfBytes / allocationUnitSize;
   sizeInfo->ActualAvailableAllocationUnits.QuadPart =
-      freeBytes / allocationUnitSize;
+      freeSpace.TotalNumberOfFreeBytes / allocationUnitSize;
   sizeInfo->CallerAvailableAllocationUnits.QuadPart =
-      freeBytesAvailable / allocationUnitSize;
+      freeSpace.FreeBytesAvailable / allocationUnitSize;
   sizeInfo->SectorsPerAllocationUnit =
 	  allocationUnitSize / sectorSize;
   sizeInfo->BytesPerSector = sectorSize;
@@ -313,11 +449,13 @@ VOID DispatchQueryVolumeInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
                                     PDOKAN_INSTANCE DokanInstance) {
   PEVENT_INFORMATION eventInfo;
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   PDOKAN_OPEN_INFO openInfo;
   ULONG sizeOfEventInfo = sizeof(EVENT_INFORMATION) - 8 +
                           EventContext->Operation.Volume.BufferLength;
 
-  eventInfo = (PEVENT_INFORMATION)malloc(sizeOfEventInfo);
+  eventInfo = (PEVENT_INFORMATION)DokanArenaAlloc(DOKAN_ARENA_REPLY,
+                                                 sizeOfEventInfo);
   if (eventInfo == NULL) {
     return;
   }
@@ -334,6 +472,8 @@ VOID DispatchQueryVolumeInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
 
   fileInfo.ProcessId = EventContext->ProcessId;
   fileInfo.DokanOptions = DokanInstance->DokanOptions;
+  // no open info is taken, the callbacks can still reset the timeout
+  DokanInitIoEvent(&ioEvent, EventContext, DokanInstance, NULL, &fileInfo);
 
   eventInfo->Status = STATUS_NOT_IMPLEMENTED;
   eventInfo->BufferLength = 0;
@@ -344,19 +484,19 @@ VOID DispatchQueryVolumeInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   switch (EventContext->Operation.Volume.FsInformationClass) {
   case FileFsVolumeInformation:
     eventInfo->Status = DokanFsVolumeInformation(
-        eventInfo, EventContext, &fileInfo, DokanInstance->DokanOperations);
+        eventInfo, EventContext, &fileInfo, DokanInstance);
     break;
   case FileFsSizeInformation:
     eventInfo->Status = DokanFsSizeInformation(
-        eventInfo, EventContext, &fileInfo, DokanInstance->DokanOperations);
+        eventInfo, EventContext, &fileInfo, DokanInstance);
     break;
   case FileFsAttributeInformation:
     eventInfo->Status = DokanFsAttributeInformation(
-        eventInfo, EventContext, &fileInfo, DokanInstance->DokanOperations);
+        eventInfo, EventContext, &fileInfo, DokanInstance);
     break;
   case FileFsFullSizeInformation:
     eventInfo->Status = DokanFsFullSizeInformation(
-        eventInfo, EventContext, &fileInfo, DokanInstance->DokanOperations);
+        eventInfo, EventContext, &fileInfo, DokanInstance);
     break;
   default:
     DbgPrint("error unknown volume info %d\n",
@@ -364,5 +504,5 @@ VOID DispatchQueryVolumeInformation(HANDLE Handle, PEVENT_CONTEXT EventContext,
   }
 
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, NULL);
-  free(eventInfo);
+  DokanArenaFree(eventInfo);
 }
@@ -30,15 +30,8 @@ BOOL SendWriteRequest(_In_ HANDLE Handle, _In_ PEVENT_INFORMATION EventInfo,
 
   DbgPrint("SendWriteRequest\n");
 
-  status = DeviceIoControl(Handle,            // Handle to device
-                           IOCTL_EVENT_WRITE, // IO Control code
-                           EventInfo,         // Input Buffer to driver.
-                           EventLength,     // Length of input buffer in bytes.
-                           Buffer,          // Output Buffer from driver.
-                           BufferLength,    // Length of output buffer in bytes.
-                           &returnedLength, // Bytes placed in buffer.
-                           NULL             // synchronous call
-                           );
+  status = DokanChannelPullWrite(Handle, EventInfo, EventLength, Buffer,
+                                 BufferLength, &returnedLength);
 
   if (!status) {
     DWORD errorCode = GetLastError();
@@ -63,29 +56,37 @@ VOID DispatchWrite(HANDLE Handle, PEVENT_CONTEXT EventContext,
   ULONG writtenLength = 0;
   NTSTATUS status;
   DOKAN_FILE_INFO fileInfo;
+  DOKAN_IO_EVENT ioEvent;
   BOOL bufferAllocated = FALSE;
   ULONG sizeOfEventInfo = sizeof(EVENT_INFORMATION);
   ULONG returnedLength = 0;
   BOOL SendWriteRequestStatus = TRUE;	// otherwise DokanInstance->DokanOperations->WriteFile cannot be called
   DWORD SendWriteRequestLastError = 0;
+  PDOKAN_PENDING_REQUEST pendingRequest;
 
   eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+                             &fileInfo, &ioEvent, &openInfo);
 
   // Since driver requested bigger memory,
   // allocate enough memory and send it to driver
   if (EventContext->Operation.Write.RequestLength > 0) {
     ULONG contextLength = EventContext->Operation.Write.RequestLength;
-    PEVENT_CONTEXT contextBuf = (PEVENT_CONTEXT)malloc(contextLength);
+    PEVENT_CONTEXT contextBuf =
+        (PEVENT_CONTEXT)DokanArenaAlloc(DOKAN_ARENA_WRITE, contextLength);
     if (contextBuf == NULL) {
-      free(eventInfo);
+      DokanArenaFree(eventInfo);
       return;
     }
 
 	SendWriteRequestStatus = SendWriteRequest(Handle, eventInfo, sizeOfEventInfo, contextBuf,
                      contextLength, &returnedLength, &SendWriteRequestLastError);
-    EventContext = contextBuf;
-    bufferAllocated = TRUE;
+    if (SendWriteRequestStatus) {
+      EventContext = contextBuf;
+      bufferAllocated = TRUE;
+    } else {
+      // the request event still has the file name and offset of the write
+      DokanArenaFree(contextBuf);
+    }
   }
 
   CheckFileName(EventContext->Operation.Write.FileName);
@@ -105,9 +106,15 @@ VOID DispatchWrite(HANDLE Handle, PEVENT_CONTEXT EventContext,
   else {
 	  // for the case SendWriteRequest success
 	  if (DokanInstance->DokanOperations->WriteFile) {
+		  // large payloads are mapped by the driver instead of copied
+		  PVOID buffer =
+			  EventContext->Operation.Write.UserBuffer != 0
+				  ? (PVOID)(ULONG_PTR)EventContext->Operation.Write.UserBuffer
+				  : (PCHAR)EventContext +
+						EventContext->Operation.Write.BufferOffset;
+		  DokanAllowPendingRequest(&fileInfo);
 		  status = DokanInstance->DokanOperations->WriteFile(
-			  EventContext->Operation.Write.FileName,
-			  (PCHAR)EventContext + EventContext->Operation.Write.BufferOffset,
+			  EventContext->Operation.Write.FileName, buffer,
 			  EventContext->Operation.Write.BufferLength, &writtenLength,
 			  EventContext->Operation.Write.ByteOffset.QuadPart, &fileInfo);
 	  }
@@ -116,6 +123,33 @@ VOID DispatchWrite(HANDLE Handle, PEVENT_CONTEXT EventContext,
 	  }
   }
 
+  pendingRequest = DokanTakePendingRequest(&status);
+  if (pendingRequest != NULL) {
+    // the write buffer is only valid during the callback
+    // the reply now belongs to the request, it is freed at completion
+    DokanArenaDetach(eventInfo);
+    pendingRequest->MajorFunction = IRP_MJ_WRITE;
+    pendingRequest->DokanInstance = DokanInstance;
+    pendingRequest->OpenInfo = openInfo;
+    pendingRequest->EventInfo = eventInfo;
+    pendingRequest->EventInfoLength = sizeOfEventInfo;
+    pendingRequest->ByteOffset =
+        EventContext->Operation.Write.ByteOffset.QuadPart;
+    // size and times change, the information cache is told at completion
+    pendingRequest->FileName = _wcsdup(EventContext->Operation.Write.FileName);
+    if (pendingRequest->FileName == NULL)
+      DokanInfoCacheInvalidate(DokanInstance,
+                               EventContext->Operation.Write.FileName, FALSE);
+    DokanStartPendingRequest(pendingRequest);
+    if (bufferAllocated)
+      DokanArenaFree(EventContext);
+    return;
+  }
+
+  // size and times change
+  DokanInfoCacheInvalidate(DokanInstance,
+                           EventContext->Operation.Write.FileName, FALSE);
+
   if (openInfo != NULL)
     openInfo->UserContext = fileInfo.Context;
   eventInfo->Status = status;
@@ -128,8 +162,8 @@ VOID DispatchWrite(HANDLE Handle, PEVENT_CONTEXT EventContext,
   }
 
   SendEventInformation(Handle, eventInfo, sizeOfEventInfo, DokanInstance);
-  free(eventInfo);
+  DokanArenaFree(eventInfo);
 
   if (bufferAllocated)
-    free(EventContext);
+    DokanArenaFree(EventContext);
 }
@@ -514,6 +514,8 @@ int do_fuse_loop(struct fuse *fs, bool mt) {
   mbstowcs(mount, fs->ch->mountpoint.c_str(), MAX_PATH);
 
   dokanOptions->Version = DOKAN_VERSION;
+  dokanOptions->Size = sizeof(DOKAN_OPTIONS);
+  dokanOptions->OperationsSize = sizeof(DOKAN_OPERATIONS);
   dokanOptions->MountPoint = mount;
   dokanOptions->ThreadCount = mt ? FUSE_THREAD_COUNT : 1;
   dokanOptions->Timeout = fs->conf.timeoutInSec * 1000;
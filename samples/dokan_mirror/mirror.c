@@ -81,7 +81,8 @@ static void GetFilePath(PWCHAR filePath, ULONG numberOfElements,
                         LPCWSTR FileName) {
   wcsncpy_s(filePath, numberOfElements, RootDirectory, wcslen(RootDirectory));
   size_t unclen = wcslen(UNCName);
-  if (unclen > 0 && _wcsnicmp(FileName, UNCName, unclen) == 0) {
+  if (unclen > 0 && DokanStartsWithUtf16(FileName, (ULONG)wcslen(FileName),
+                                         UNCName, (ULONG)unclen, TRUE)) {
     if (_wcsnicmp(FileName + unclen, L".", 1) != 0) {
       wcsncat_s(filePath, numberOfElements, FileName + unclen,
                 wcslen(FileName) - unclen);
@@ -1534,6 +1535,8 @@ int __cdecl wmain(ULONG argc, PWCHAR argv[]) {
 
   ZeroMemory(dokanOptions, sizeof(DOKAN_OPTIONS));
   dokanOptions->Version = DOKAN_VERSION;
+  dokanOptions->Size = sizeof(DOKAN_OPTIONS);
+  dokanOptions->OperationsSize = sizeof(DOKAN_OPERATIONS);
   dokanOptions->ThreadCount = 0; // use default
 
   for (command = 1; command < argc; command++) {
@@ -70,7 +70,7 @@ struct ReplicationHandle
 		{
 			wcsncpy_s(filePath, numberOfElements, path.c_str(), wcslen(path.c_str()));
 			size_t unclen = wcslen(UNCName);
-			if (unclen > 0 && _wcsnicmp(FileName, UNCName, unclen) == 0) 
+			if (unclen > 0 && DokanStartsWithUtf16(FileName, (ULONG)wcslen(FileName), UNCName, (ULONG)unclen, TRUE)) 
 			{
 				if (_wcsnicmp(FileName + unclen, L".", 1) != 0) 
 				{
@@ -92,7 +92,7 @@ struct ReplicationHandle
 				wcsncpy_s(&resolved_path[0], DOKAN_MAX_PATH, path.c_str(), wcslen(path.c_str()));
 				size_t unclen = wcslen(UNCName);
 
-				if (unclen > 0 && _wcsnicmp(FileName, UNCName, unclen) == 0) 
+				if (unclen > 0 && DokanStartsWithUtf16(FileName, (ULONG)wcslen(FileName), UNCName, (ULONG)unclen, TRUE)) 
 				{
 					if (_wcsnicmp(FileName + unclen, L".", 1) != 0) 
 					{
@@ -361,7 +361,7 @@ static void DbgPrint(LPCWSTR format, ...) { }
 static void GetFilePath(PWCHAR filePath, ULONG numberOfElements, LPCWSTR FileName) {
   wcsncpy_s(filePath, numberOfElements, RootDirectories[0].path.c_str(), wcslen(RootDirectories[0].path.c_str()));
   size_t unclen = wcslen(UNCName);
-  if (unclen > 0 && _wcsnicmp(FileName, UNCName, unclen) == 0) {
+  if (unclen > 0 && DokanStartsWithUtf16(FileName, (ULONG)wcslen(FileName), UNCName, (ULONG)unclen, TRUE)) {
     if (_wcsnicmp(FileName + unclen, L".", 1) != 0) {
       wcsncat_s(filePath, numberOfElements, FileName + unclen,
                 wcslen(FileName) - unclen);
@@ -2234,6 +2234,8 @@ int __cdecl wmain(ULONG argc, PWCHAR argv[]) {
 
   ZeroMemory(dokanOptions, sizeof(DOKAN_OPTIONS));
   dokanOptions->Version = DOKAN_VERSION;
+  dokanOptions->Size = sizeof(DOKAN_OPTIONS);
+  dokanOptions->OperationsSize = sizeof(DOKAN_OPERATIONS);
   dokanOptions->ThreadCount = 0; // use default
   
   CurrentRootDirectory = 0;
@@ -74,6 +74,12 @@ Return Value:
       __leave;
     }
 
+    if (GetIdentifierType(vcb) == DCB) {
+      DokanServiceHandleCleanup((PDokanDCB)vcb);
+      status = STATUS_SUCCESS;
+      __leave;
+    }
+
     if (GetIdentifierType(vcb) != VCB ||
         !DokanCheckCCB(vcb->Dcb, fileObject->FsContext2)) {
       status = STATUS_SUCCESS;
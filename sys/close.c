@@ -137,7 +137,7 @@ Return Value:
     // eventContext->SerialNumber, 0);
 
     // inform it to user-mode
-    DokanEventNotification(&vcb->Dcb->NotifyEvent, eventContext);
+    DokanQueueEvent(vcb->Dcb, eventContext);
 
     status = STATUS_SUCCESS;
 
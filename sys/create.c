@@ -511,6 +511,9 @@ Return Value:
 
     if (GetIdentifierType(vcb) != VCB) {
       DDbgPrint("  IdentifierType is not vcb\n");
+      if (GetIdentifierType(vcb) == DCB) {
+        DokanServiceHandleCreate((PDokanDCB)vcb);
+      }
       status = STATUS_SUCCESS;
       __leave;
     }
@@ -936,6 +936,8 @@ Return Value:
     controlCode = irpSp->Parameters.DeviceIoControl.IoControlCode;
 
     if (controlCode != IOCTL_EVENT_WAIT && controlCode != IOCTL_EVENT_INFO &&
+        controlCode != IOCTL_EVENT_WAIT_BATCH &&
+        controlCode != IOCTL_EVENT_INFO_WAIT &&
         controlCode != IOCTL_KEEPALIVE) {
 
       DDbgPrint("==> DokanDispatchIoControl\n");
@@ -968,11 +970,21 @@ Return Value:
       status = DokanRegisterPendingIrpForEvent(DeviceObject, Irp);
       break;
 
+    case IOCTL_EVENT_WAIT_BATCH:
+      DDbgPrint("  IOCTL_EVENT_WAIT_BATCH\n");
+      status = DokanRegisterPendingIrpForEvent(DeviceObject, Irp);
+      break;
+
     case IOCTL_EVENT_INFO:
       // DDbgPrint("  IOCTL_EVENT_INFO\n");
       status = DokanCompleteIrp(DeviceObject, Irp);
       break;
 
+    case IOCTL_EVENT_INFO_WAIT:
+      // DDbgPrint("  IOCTL_EVENT_INFO_WAIT\n");
+      status = DokanCompleteIrpAndWait(DeviceObject, Irp);
+      break;
+
     case IOCTL_EVENT_RELEASE:
       DDbgPrint("  IOCTL_EVENT_RELEASE\n");
       status = DokanEventRelease(DeviceObject, Irp);
@@ -983,6 +995,11 @@ Return Value:
       status = DokanEventWrite(DeviceObject, Irp);
       break;
 
+    case IOCTL_EVENT_RING:
+      DDbgPrint("  IOCTL_EVENT_RING\n");
+      status = DokanEventRingMap(DeviceObject, Irp);
+      break;
+
     case IOCTL_KEEPALIVE:
       DDbgPrint("  IOCTL_KEEPALIVE\n");
       if (IsFlagOn(vcb->Flags, VCB_MOUNTED)) {
@@ -1036,6 +1053,8 @@ Return Value:
     }
 
     if (controlCode != IOCTL_EVENT_WAIT && controlCode != IOCTL_EVENT_INFO &&
+        controlCode != IOCTL_EVENT_WAIT_BATCH &&
+        controlCode != IOCTL_EVENT_INFO_WAIT &&
         controlCode != IOCTL_KEEPALIVE) {
 
       DokanPrintNTStatus(status);
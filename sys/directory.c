@@ -145,7 +145,8 @@ DokanQueryDirectory(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
 
   // make a MDL for UserBuffer that can be used later on another thread context
   if (Irp->MdlAddress == NULL) {
-    status = DokanAllocateMdl(Irp, irpSp->Parameters.QueryDirectory.Length);
+    status = DokanAllocateMdl(Irp, irpSp->Parameters.QueryDirectory.Length,
+                              IoWriteAccess);
     if (!NT_SUCCESS(status)) {
       return status;
     }
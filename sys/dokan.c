@@ -459,7 +459,9 @@ VOID DokanCompleteIrpRequest(__in PIRP Irp, __in NTSTATUS Status,
   if (Status != STATUS_PENDING) {
     Irp->IoStatus.Status = Status;
     Irp->IoStatus.Information = Info;
-    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    if (DokanUnmapIrpBuffer(Irp)) {
+      IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    }
   }
   DokanPrintNTStatus(Status);
 }
@@ -587,7 +589,8 @@ DokanCheckCCB(__in PDokanDCB Dcb, __in_opt PDokanCCB Ccb) {
 }
 
 NTSTATUS
-DokanAllocateMdl(__in PIRP Irp, __in ULONG Length) {
+DokanAllocateMdl(__in PIRP Irp, __in ULONG Length,
+                 __in LOCK_OPERATION Operation) {
   if (Irp->MdlAddress == NULL) {
     Irp->MdlAddress = IoAllocateMdl(Irp->UserBuffer, Length, FALSE, FALSE, Irp);
 
@@ -596,7 +599,7 @@ DokanAllocateMdl(__in PIRP Irp, __in ULONG Length) {
       return STATUS_INSUFFICIENT_RESOURCES;
     }
     __try {
-      MmProbeAndLockPages(Irp->MdlAddress, Irp->RequestorMode, IoWriteAccess);
+      MmProbeAndLockPages(Irp->MdlAddress, Irp->RequestorMode, Operation);
 
     } __except (EXCEPTION_EXECUTE_HANDLER) {
       DDbgPrint("    MmProveAndLockPages error\n");
@@ -89,6 +89,18 @@ extern LOOKASIDE_LIST_EX g_DokanEResourceLookasideList;
   MmGetSystemAddressForMdlSafe(mdl, NormalPagePriority)
 #endif
 
+// Priorities used when locked pages are mapped into the service process
+#if _WIN32_WINNT >= _WIN32_WINNT_WIN8
+#define DOKAN_USER_MAPPING_PRIORITY (NormalPagePriority | MdlMappingNoExecute)
+#define DOKAN_USER_MAPPING_PRIORITY_READONLY                                   \
+  (DOKAN_USER_MAPPING_PRIORITY | MdlMappingNoWrite)
+#else
+#define DOKAN_USER_MAPPING_PRIORITY NormalPagePriority
+// pages cannot be mapped read-only, write buffers are copied instead
+#define DOKAN_USER_MAPPING_PRIORITY_READONLY NormalPagePriority
+#endif
+
+#define DRIVER_CONTEXT_MAPPING 1
 #define DRIVER_CONTEXT_EVENT 2
 #define DRIVER_CONTEXT_IRP_ENTRY 3
 
@@ -261,6 +273,34 @@ typedef struct _DokanDiskControlBlock {
   ULONG SessionId;
   IO_REMOVE_LOCK RemoveLock;
 
+  // Process that started the mount, large IO buffers are mapped in it
+  PEPROCESS ServiceProcess;
+  // read/write buffers mapped in ServiceProcess, see mapping.c
+  IRP_LIST MappedIrp;
+  // held while a mapping is removed from ServiceProcess
+  FAST_MUTEX MappingMutex;
+  // handles of ServiceProcess on the disk device
+  LONG ServiceHandleCount;
+  // set once ServiceProcess closed its last handle, nothing is mapped anymore
+  BOOLEAN MappingClosed;
+
+  // negotiated with IOCTL_EVENT_START, see EVENT_DRIVER_INFO
+  ULONG EventBufferSize;
+  ULONG MaxEventSize;
+  ULONG MaxBatchCount;
+  ULONG Features;
+  ULONG RingSlotCount;
+  ULONG RingPayloadSize;
+
+  // rings of IOCTL_EVENT_RING, see ring.c. Changed under EventRingLock and
+  // EventRingMutex.
+  struct _DOKAN_EVENT_RING *EventRing;
+  // events are submitted to EventRing while set
+  BOOLEAN EventRingOpen;
+  KSPIN_LOCK EventRingLock;
+  // held while EventRing is set up, stopped or freed
+  FAST_MUTEX EventRingMutex;
+
 } DokanDCB, *PDokanDCB;
 
 #define IS_DEVICE_READ_ONLY(DeviceObject)                                      \
@@ -514,6 +554,12 @@ DRIVER_DISPATCH DokanRegisterPendingIrpForService;
 
 DRIVER_DISPATCH DokanCompleteIrp;
 
+NTSTATUS
+DokanCompleteEventInformation(__in PDEVICE_OBJECT DeviceObject,
+                              __in PEVENT_INFORMATION EventInfo);
+
+DRIVER_DISPATCH DokanCompleteIrpAndWait;
+
 DRIVER_DISPATCH DokanResetPendingIrpTimeout;
 
 DRIVER_DISPATCH DokanGetAccessToken;
@@ -566,6 +612,20 @@ DokanRegisterPendingIrp(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp,
 VOID DokanEventNotification(__in PIRP_LIST NotifyEvent,
                             __in PEVENT_CONTEXT EventContext);
 
+VOID DokanQueueEvent(__in PDokanDCB Dcb, __in PEVENT_CONTEXT EventContext);
+
+VOID DokanEventRingGrant(__in PDokanDCB Dcb, __in ULONG SlotCount,
+                         __in ULONG PayloadSize);
+
+DRIVER_DISPATCH DokanEventRingMap;
+
+BOOLEAN DokanEventRingSubmit(__in PDokanDCB Dcb,
+                             __in PEVENT_CONTEXT EventContext);
+
+VOID DokanEventRingStop(__in PDokanDCB Dcb);
+
+VOID DokanEventRingFree(__in PDokanDCB Dcb);
+
 VOID DokanCompleteDirectoryControl(__in PIRP_ENTRY IrpEntry,
                                    __in PEVENT_INFORMATION EventInfo);
 
@@ -635,6 +695,26 @@ NTSTATUS DokanRegisterUncProviderSystem(PDokanDCB dcb);
 VOID DokanCompleteIrpRequest(__in PIRP Irp, __in NTSTATUS Status,
                              __in ULONG_PTR Info);
 
+BOOLEAN DokanMapIrpBuffer(__in PDokanDCB Dcb, __in PIRP Irp, __in ULONG Length,
+                          __in LOCK_OPERATION Operation,
+                          __out PULONG64 UserBuffer);
+
+VOID DokanMappedIrpQueued(__in PIRP Irp, __in ULONG SerialNumber);
+
+VOID DokanMappedIrpNotQueued(__in PIRP Irp);
+
+VOID DokanReleaseMappedIrp(__in PDokanDCB Dcb, __in ULONG SerialNumber);
+
+VOID DokanReleaseMappedIrps(__in PDokanDCB Dcb);
+
+VOID DokanReleaseTimeoutMappedIrps(__in PDokanDCB Dcb);
+
+VOID DokanServiceHandleCreate(__in PDokanDCB Dcb);
+
+VOID DokanServiceHandleCleanup(__in PDokanDCB Dcb);
+
+BOOLEAN DokanUnmapIrpBuffer(__in PIRP Irp);
+
 VOID DokanNotifyReportChange0(__in PDokanFCB Fcb, __in PUNICODE_STRING FileName,
                               __in ULONG FilterMatch, __in ULONG Action);
 
@@ -686,7 +766,8 @@ FindMountEntry(__in PDOKAN_GLOBAL dokanGlobal, __in PDOKAN_CONTROL DokanControl,
 VOID PrintIdType(__in VOID *Id);
 
 NTSTATUS
-DokanAllocateMdl(__in PIRP Irp, __in ULONG Length);
+DokanAllocateMdl(__in PIRP Irp, __in ULONG Length,
+                 __in LOCK_OPERATION Operation);
 
 VOID DokanFreeMdl(__in PIRP Irp);
 
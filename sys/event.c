@@ -244,12 +244,25 @@ DokanRegisterPendingIrp(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp,
     return STATUS_INVALID_PARAMETER;
   }
 
+  // the event would never fit in the buffers of the service
+  if (EventContext->Length > vcb->Dcb->MaxEventSize) {
+    DDbgPrint("  Event is too big: %lu (limit %lu)\n", EventContext->Length,
+              vcb->Dcb->MaxEventSize);
+    DokanFreeEventContext(EventContext);
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+
+  // a mapped buffer is in the hands of the service as soon as the IRP can be
+  // cancelled
+  DokanMappedIrpQueued(Irp, EventContext->SerialNumber);
+
   status = RegisterPendingIrpMain(DeviceObject, Irp, EventContext->SerialNumber,
                                   &vcb->Dcb->PendingIrp, Flags, TRUE);
 
   if (status == STATUS_PENDING) {
-    DokanEventNotification(&vcb->Dcb->NotifyEvent, EventContext);
+    DokanQueueEvent(vcb->Dcb, EventContext);
   } else {
+    DokanMappedIrpNotQueued(Irp);
     DokanFreeEventContext(EventContext);
   }
 
@@ -301,26 +314,30 @@ DokanRegisterPendingIrpForService(__in PDEVICE_OBJECT DeviceObject,
 }
 
 // When user-mode file system application returns EventInformation,
-// search corresponding pending IRP and complete it
+// search corresponding pending IRP and complete it.
+// EventInfo comes from IOCTL_EVENT_INFO or from the event ring.
 NTSTATUS
-DokanCompleteIrp(__in PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp) {
+DokanCompleteEventInformation(__in PDEVICE_OBJECT DeviceObject,
+                              __in PEVENT_INFORMATION EventInfo) {
   KIRQL oldIrql;
   PLIST_ENTRY thisEntry, nextEntry, listHead;
   PIRP_ENTRY irpEntry;
   PDokanVCB vcb;
-  PEVENT_INFORMATION eventInfo;
+  BOOLEAN found = FALSE;
 
-  eventInfo = (PEVENT_INFORMATION)Irp->AssociatedIrp.SystemBuffer;
-  ASSERT(eventInfo != NULL);
+  ASSERT(EventInfo != NULL);
 
   // DDbgPrint("==> DokanCompleteIrp [EventInfo #%X]\n",
-  // eventInfo->SerialNumber);
+  // EventInfo->SerialNumber);
 
   vcb = DeviceObject->DeviceExtension;
   if (GetIdentifierType(vcb) != VCB) {
     return STATUS_INVALID_PARAMETER;
   }
 
+  // the service no longer touches the buffer mapped for this event
+  DokanReleaseMappedIrp(vcb->Dcb, EventInfo->SerialNumber);
+
   if (IsUnmountPendingVcb(vcb)) {
     DDbgPrint("      Volume is not mounted\n");
     return STATUS_NO_SUCH_DEVICE;
@@ -345,14 +362,15 @@ DokanCompleteIrp(__in PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp) {
 
     // check whether this is corresponding IRP
 
-    // DDbgPrint("SerialNumber irpEntry %X eventInfo %X\n",
-    // irpEntry->SerialNumber, eventInfo->SerialNumber);
+    // DDbgPrint("SerialNumber irpEntry %X EventInfo %X\n",
+    // irpEntry->SerialNumber, EventInfo->SerialNumber);
 
     // this irpEntry must be freed in this if statement
-    if (irpEntry->SerialNumber != eventInfo->SerialNumber) {
+    if (irpEntry->SerialNumber != EventInfo->SerialNumber) {
       continue;
     }
 
+    found = TRUE;
     RemoveEntryList(thisEntry);
 
     irp = irpEntry->Irp;
@@ -387,47 +405,47 @@ DokanCompleteIrp(__in PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp) {
       return STATUS_NO_SUCH_DEVICE;
     }
 
-    if (eventInfo->Status == STATUS_PENDING) {
+    if (EventInfo->Status == STATUS_PENDING) {
       DDbgPrint(
           "      !!WARNING!! Do not return STATUS_PENDING DokanCompleteIrp!");
     }
 
     switch (irpSp->MajorFunction) {
     case IRP_MJ_DIRECTORY_CONTROL:
-      DokanCompleteDirectoryControl(irpEntry, eventInfo);
+      DokanCompleteDirectoryControl(irpEntry, EventInfo);
       break;
     case IRP_MJ_READ:
-      DokanCompleteRead(irpEntry, eventInfo);
+      DokanCompleteRead(irpEntry, EventInfo);
       break;
     case IRP_MJ_WRITE:
-      DokanCompleteWrite(irpEntry, eventInfo);
+      DokanCompleteWrite(irpEntry, EventInfo);
       break;
     case IRP_MJ_QUERY_INFORMATION:
-      DokanCompleteQueryInformation(irpEntry, eventInfo);
+      DokanCompleteQueryInformation(irpEntry, EventInfo);
       break;
     case IRP_MJ_QUERY_VOLUME_INFORMATION:
-      DokanCompleteQueryVolumeInformation(irpEntry, eventInfo, DeviceObject);
+      DokanCompleteQueryVolumeInformation(irpEntry, EventInfo, DeviceObject);
       break;
     case IRP_MJ_CREATE:
-      DokanCompleteCreate(irpEntry, eventInfo);
+      DokanCompleteCreate(irpEntry, EventInfo);
       break;
     case IRP_MJ_CLEANUP:
-      DokanCompleteCleanup(irpEntry, eventInfo);
+      DokanCompleteCleanup(irpEntry, EventInfo);
       break;
     case IRP_MJ_LOCK_CONTROL:
-      DokanCompleteLock(irpEntry, eventInfo);
+      DokanCompleteLock(irpEntry, EventInfo);
       break;
     case IRP_MJ_SET_INFORMATION:
-      DokanCompleteSetInformation(irpEntry, eventInfo);
+      DokanCompleteSetInformation(irpEntry, EventInfo);
       break;
     case IRP_MJ_FLUSH_BUFFERS:
-      DokanCompleteFlush(irpEntry, eventInfo);
+      DokanCompleteFlush(irpEntry, EventInfo);
       break;
     case IRP_MJ_QUERY_SECURITY:
-      DokanCompleteQuerySecurity(irpEntry, eventInfo);
+      DokanCompleteQuerySecurity(irpEntry, EventInfo);
       break;
     case IRP_MJ_SET_SECURITY:
-      DokanCompleteSetSecurity(irpEntry, eventInfo);
+      DokanCompleteSetSecurity(irpEntry, EventInfo);
       break;
     default:
       DDbgPrint("Unknown IRP %d\n", irpSp->MajorFunction);
@@ -443,12 +461,53 @@ DokanCompleteIrp(__in PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp) {
 
   KeReleaseSpinLock(&vcb->Dcb->PendingIrp.ListLock, oldIrql);
 
-  // DDbgPrint("<== AACompleteIrp [EventInfo #%X]\n", eventInfo->SerialNumber);
+  // DDbgPrint("<== AACompleteIrp [EventInfo #%X]\n", EventInfo->SerialNumber);
 
-  // TODO: should return error
+  if (!found) {
+    // the IRP timed out, or user mode lost track of its serial numbers
+    DDbgPrint("  No pending IRP for EventInfo #%X\n", EventInfo->SerialNumber);
+    return STATUS_NOT_FOUND;
+  }
   return STATUS_SUCCESS;
 }
 
+NTSTATUS
+DokanCompleteIrp(__in PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp) {
+  PEVENT_INFORMATION eventInfo;
+
+  eventInfo = (PEVENT_INFORMATION)Irp->AssociatedIrp.SystemBuffer;
+  ASSERT(eventInfo != NULL);
+
+  return DokanCompleteEventInformation(DeviceObject, eventInfo);
+}
+
+// Reply to a previous event and wait for the next ones in a single call.
+// The EVENT_INFORMATION in the input buffer is completed first, then the
+// IRP is parked in PendingEvent like an IOCTL_EVENT_WAIT_BATCH.
+NTSTATUS
+DokanCompleteIrpAndWait(__in PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp) {
+  PIO_STACK_LOCATION irpSp;
+  ULONG inputLength;
+  NTSTATUS status;
+
+  irpSp = IoGetCurrentIrpStackLocation(Irp);
+  inputLength = irpSp->Parameters.DeviceIoControl.InputBufferLength;
+
+  if (inputLength > 0) {
+    if (inputLength < sizeof(EVENT_INFORMATION)) {
+      DDbgPrint("  Wrong input buffer length\n");
+      return STATUS_INVALID_PARAMETER;
+    }
+    status = DokanCompleteIrp(DeviceObject, Irp);
+    // a late reply is logged by DokanCompleteIrp, the thread still waits
+    if (!NT_SUCCESS(status) && status != STATUS_NOT_FOUND) {
+      return status;
+    }
+  }
+
+  return DokanRegisterPendingIrpForEvent(DeviceObject, Irp);
+}
+
 VOID RemoveSessionDevices(__in PDOKAN_GLOBAL dokanGlobal,
                           __in ULONG sessionId) {
   DDbgPrint("==> RemoveSessionDevices");
@@ -640,11 +699,37 @@ DokanEventStart(__in PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp) {
 
   dcb->FileLockInUserMode = fileLockUserMode;
 
+  // keep the service process alive while large writes can be mapped into it
+  dcb->ServiceProcess = PsGetCurrentProcess();
+  ObReferenceObject(dcb->ServiceProcess);
+
+  dcb->EventBufferSize = eventStart->EventBufferSize;
+  if (dcb->EventBufferSize < EVENT_CONTEXT_MAX_SIZE) {
+    dcb->EventBufferSize = EVENT_CONTEXT_MAX_SIZE;
+  } else if (dcb->EventBufferSize > EVENT_BUFFER_MAX_SIZE) {
+    dcb->EventBufferSize = EVENT_BUFFER_MAX_SIZE;
+  }
+  dcb->MaxEventSize = dcb->EventBufferSize - EVENT_BATCH_HEADER_SIZE;
+  dcb->MaxBatchCount = eventStart->MaxBatchCount;
+  dcb->Features = eventStart->Features & DOKAN_DRIVER_FEATURES;
+  if (dcb->Features & DOKAN_FEATURE_EVENT_RING) {
+    DokanEventRingGrant(dcb, eventStart->RingSlotCount,
+                        eventStart->RingPayloadSize);
+  }
+  DDbgPrint("  EventBufferSize:%lu MaxBatchCount:%lu Features:%lx\n",
+            dcb->EventBufferSize, dcb->MaxBatchCount, dcb->Features);
+
   DDbgPrint("  MountId:%d\n", dcb->MountId);
   driverInfo->DeviceNumber = dokanGlobal->MountId;
   driverInfo->MountId = dokanGlobal->MountId;
   driverInfo->Status = DOKAN_MOUNTED;
   driverInfo->DriverVersion = DOKAN_DRIVER_VERSION;
+  driverInfo->EventBufferSize = dcb->EventBufferSize;
+  driverInfo->MaxEventSize = dcb->MaxEventSize;
+  driverInfo->MaxBatchCount = dcb->MaxBatchCount;
+  driverInfo->Features = dcb->Features;
+  driverInfo->RingSlotCount = dcb->RingSlotCount;
+  driverInfo->RingPayloadSize = dcb->RingPayloadSize;
 
   // SymbolicName is
   // \\DosDevices\\Global\\Volume{D6CC17C5-1734-4085-BCE7-964F1E9F5DE9}
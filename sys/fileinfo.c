@@ -362,16 +362,9 @@ BOOLEAN StartsWith(__in PUNICODE_STRING str, __in PUNICODE_STRING prefix) {
     return FALSE;
   }
 
-  LPCWSTR prefixToUse, stringToCompareTo;
-  prefixToUse = prefix->Buffer;
-  stringToCompareTo = str->Buffer;
-
-  while (*prefixToUse) {
-    if (*prefixToUse++ != *stringToCompareTo++)
-      return FALSE;
-  }
-
-  return TRUE;
+  // compare the counted prefix at once instead of character by character
+  // up to a null the buffer does not have to contain
+  return RtlEqualMemory(str->Buffer, prefix->Buffer, prefix->Length);
 }
 
 VOID FlushFcb(__in PDokanFCB fcb, __in_opt PFILE_OBJECT fileObject) {
@@ -565,6 +565,14 @@ VOID DeleteDeviceDelayed(PDOKAN_GLOBAL dokanGlobal) {
 
               FreeDcbNames(dcb);
 
+              // the service kept no handle to clean it up
+              DokanEventRingFree(dcb);
+
+              if (dcb->ServiceProcess != NULL) {
+                ObDereferenceObject(dcb->ServiceProcess);
+                dcb->ServiceProcess = NULL;
+              }
+
               DDbgPrint("  Delete the volume device. ReferenceCount %lu \n",
                         deviceEntry->VolumeDeviceObject->ReferenceCount);
               IoDeleteDevice(deviceEntry->VolumeDeviceObject);
@@ -1350,6 +1358,10 @@ DokanCreateDiskDevice(__in PDRIVER_OBJECT DriverObject, __in ULONG MountId,
     DokanInitIrpList(&dcb->PendingIrp);
     DokanInitIrpList(&dcb->PendingEvent);
     DokanInitIrpList(&dcb->NotifyEvent);
+    DokanInitIrpList(&dcb->MappedIrp);
+    ExInitializeFastMutex(&dcb->MappingMutex);
+    KeInitializeSpinLock(&dcb->EventRingLock);
+    ExInitializeFastMutex(&dcb->EventRingMutex);
 
     KeInitializeEvent(&dcb->ReleaseEvent, NotificationEvent, FALSE);
     ExInitializeResourceLite(&dcb->Resource);
@@ -0,0 +1,465 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokan.h"
+
+/*
+
+Large read and write buffers are mapped in the service process so that
+user-mode works on the caller's pages instead of on copies.
+
+DokanDispatchRead / DokanDispatchWrite
+  DokanMapIrpBuffer           # the mapping enters Dcb->MappedIrp
+  DokanRegisterPendingIrp
+    DokanMappedIrpQueued      # the service may use the mapping from now on
+
+IOCTL_EVENT_INFO:
+  DokanCompleteIrp
+    DokanReleaseMappedIrp     # the service is done with the mapping
+    DokanCompleteRead / DokanCompleteWrite
+      DokanCompleteIrpRequest
+        DokanUnmapIrpBuffer   # unmap, then complete
+
+The pages must stay mapped as long as the service can touch them. When the
+IRP is completed before the reply (cancel, timeout, unmount),
+DokanUnmapIrpBuffer parks it. The late reply, DokanReleaseMappedIrps or,
+after another IrpTimeout, DokanReleaseTimeoutMappedIrps then unmaps and
+completes it.
+
+The user addresses only exist as long as the service process does. When the
+service closes its last handle on the disk device, which also happens while
+a crashed process is torn down, DokanServiceHandleCleanup unmaps everything
+from the process context, event rings included, and completes the parked
+IRPs. Nothing is mapped for the mount afterwards.
+
+Paging IO is never mapped, and writes are only mapped where the mapping can
+be made read-only.
+
+*/
+
+typedef struct _DOKAN_IRP_MAPPING {
+  // in Dcb->MappedIrp until freed
+  LIST_ENTRY ListEntry;
+  // in a local list while the parked IRP is being completed
+  LIST_ENTRY CompleteEntry;
+  PIRP Irp;
+  PDokanDCB Dcb;
+  // NULL once unmapped, only changed under Dcb->MappingMutex
+  PVOID UserAddress;
+  PMDL Mdl;
+  PEPROCESS Process;
+  PIO_WORKITEM WorkItem;
+  ULONG SerialNumber;
+  // when a parked IRP is completed without reply
+  LARGE_INTEGER TickCount;
+  // the service may access the mapping
+  BOOLEAN InUse;
+  // the IRP was completed while InUse
+  BOOLEAN Parked;
+} DOKAN_IRP_MAPPING, *PDOKAN_IRP_MAPPING;
+
+// Maps Length bytes of the IRP buffer in the service process.
+// Only buffers made of whole pages are mapped, this way the service does not
+// see any data of the caller that is outside of the request.
+BOOLEAN DokanMapIrpBuffer(__in PDokanDCB Dcb, __in PIRP Irp, __in ULONG Length,
+                          __in LOCK_OPERATION Operation,
+                          __out PULONG64 UserBuffer) {
+  PDOKAN_IRP_MAPPING mapping;
+  KAPC_STATE apcState;
+  PVOID address = NULL;
+  BOOLEAN closed;
+  KIRQL oldIrql;
+
+  if (!(Dcb->Features & DOKAN_FEATURE_MAPPED_IO) ||
+      Dcb->ServiceProcess == NULL || Dcb->MappingClosed ||
+      KeGetCurrentIrql() > APC_LEVEL || (Length & (PAGE_SIZE - 1)) != 0) {
+    return FALSE;
+  }
+
+  // pages of the cache or of an image section are not handed to user-mode
+  if (Irp->Flags & IRP_PAGING_IO) {
+    return FALSE;
+  }
+
+#if _WIN32_WINNT < _WIN32_WINNT_WIN8
+  // MdlMappingNoWrite is not available, the service could modify the data
+  // being written: copy it instead
+  if (Operation == IoReadAccess) {
+    return FALSE;
+  }
+#endif
+
+  if (Irp->MdlAddress == NULL) {
+    if (((ULONG_PTR)Irp->UserBuffer & (PAGE_SIZE - 1)) != 0 ||
+        !NT_SUCCESS(DokanAllocateMdl(Irp, Length, Operation))) {
+      return FALSE;
+    }
+  }
+
+  if (Irp->MdlAddress->Next != NULL ||
+      MmGetMdlByteOffset(Irp->MdlAddress) != 0 ||
+      MmGetMdlByteCount(Irp->MdlAddress) != Length) {
+    return FALSE;
+  }
+
+  mapping = ExAllocatePool(sizeof(DOKAN_IRP_MAPPING));
+  if (mapping == NULL) {
+    return FALSE;
+  }
+  RtlZeroMemory(mapping, sizeof(DOKAN_IRP_MAPPING));
+  InitializeListHead(&mapping->ListEntry);
+  InitializeListHead(&mapping->CompleteEntry);
+
+  mapping->WorkItem = IoAllocateWorkItem(Dcb->DeviceObject);
+  if (mapping->WorkItem == NULL) {
+    ExFreePool(mapping);
+    return FALSE;
+  }
+
+  KeStackAttachProcess(Dcb->ServiceProcess, &apcState);
+  __try {
+    // the service only reads the buffer of a write
+    address = MmMapLockedPagesSpecifyCache(
+        Irp->MdlAddress, UserMode, MmCached, NULL, FALSE,
+        Operation == IoReadAccess ? DOKAN_USER_MAPPING_PRIORITY_READONLY
+                                  : DOKAN_USER_MAPPING_PRIORITY);
+  } __except (EXCEPTION_EXECUTE_HANDLER) {
+    DDbgPrint("  MmMapLockedPagesSpecifyCache error\n");
+    address = NULL;
+  }
+  KeUnstackDetachProcess(&apcState);
+
+  if (address == NULL) {
+    IoFreeWorkItem(mapping->WorkItem);
+    ExFreePool(mapping);
+    return FALSE;
+  }
+
+  ObReferenceObject(Dcb->ServiceProcess);
+  mapping->Irp = Irp;
+  mapping->Dcb = Dcb;
+  mapping->UserAddress = address;
+  mapping->Mdl = Irp->MdlAddress;
+  mapping->Process = Dcb->ServiceProcess;
+
+  // DokanServiceHandleCleanup may have run since the check above
+  KeAcquireSpinLock(&Dcb->MappedIrp.ListLock, &oldIrql);
+  closed = Dcb->MappingClosed;
+  if (!closed) {
+    InsertTailList(&Dcb->MappedIrp.ListHead, &mapping->ListEntry);
+  }
+  KeReleaseSpinLock(&Dcb->MappedIrp.ListLock, oldIrql);
+
+  if (closed) {
+    KeStackAttachProcess(mapping->Process, &apcState);
+    MmUnmapLockedPages(address, mapping->Mdl);
+    KeUnstackDetachProcess(&apcState);
+    ObDereferenceObject(mapping->Process);
+    IoFreeWorkItem(mapping->WorkItem);
+    ExFreePool(mapping);
+    return FALSE;
+  }
+
+  Irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_MAPPING] = mapping;
+
+  *UserBuffer = (ULONG64)(ULONG_PTR)address;
+  return TRUE;
+}
+
+// Dcb->MappingMutex must be held
+static VOID DokanUnmapUserAddress(__in PDOKAN_IRP_MAPPING Mapping) {
+  KAPC_STATE apcState;
+
+  if (Mapping->UserAddress == NULL) {
+    return;
+  }
+  KeStackAttachProcess(Mapping->Process, &apcState);
+  MmUnmapLockedPages(Mapping->UserAddress, Mapping->Mdl);
+  KeUnstackDetachProcess(&apcState);
+  Mapping->UserAddress = NULL;
+}
+
+static VOID DokanFreeIrpMapping(__in PDOKAN_IRP_MAPPING Mapping) {
+  PDokanDCB dcb = Mapping->Dcb;
+  KIRQL oldIrql;
+
+  Mapping->Irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_MAPPING] = NULL;
+
+  ExAcquireFastMutex(&dcb->MappingMutex);
+  KeAcquireSpinLock(&dcb->MappedIrp.ListLock, &oldIrql);
+  RemoveEntryList(&Mapping->ListEntry);
+  KeReleaseSpinLock(&dcb->MappedIrp.ListLock, oldIrql);
+  // already done by DokanServiceHandleCleanup if the service went away
+  DokanUnmapUserAddress(Mapping);
+  ExReleaseFastMutex(&dcb->MappingMutex);
+
+  ObDereferenceObject(Mapping->Process);
+  IoFreeWorkItem(Mapping->WorkItem);
+  ExFreePool(Mapping);
+}
+
+static PDOKAN_IRP_MAPPING DokanGetIrpMapping(__in PIRP Irp) {
+  UCHAR majorFunction = IoGetCurrentIrpStackLocation(Irp)->MajorFunction;
+
+  if (majorFunction != IRP_MJ_READ && majorFunction != IRP_MJ_WRITE) {
+    return NULL;
+  }
+  return Irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_MAPPING];
+}
+
+// Marks the mapping of Irp as used by the service until SerialNumber is
+// replied. Must be called before the IRP can be cancelled.
+VOID DokanMappedIrpQueued(__in PIRP Irp, __in ULONG SerialNumber) {
+  PDOKAN_IRP_MAPPING mapping = DokanGetIrpMapping(Irp);
+  KIRQL oldIrql;
+
+  if (mapping == NULL) {
+    return;
+  }
+
+  KeAcquireSpinLock(&mapping->Dcb->MappedIrp.ListLock, &oldIrql);
+  mapping->SerialNumber = SerialNumber;
+  mapping->InUse = TRUE;
+  KeReleaseSpinLock(&mapping->Dcb->MappedIrp.ListLock, oldIrql);
+}
+
+// The event of Irp was not queued after all
+VOID DokanMappedIrpNotQueued(__in PIRP Irp) {
+  PDOKAN_IRP_MAPPING mapping = DokanGetIrpMapping(Irp);
+  KIRQL oldIrql;
+
+  if (mapping == NULL) {
+    return;
+  }
+
+  KeAcquireSpinLock(&mapping->Dcb->MappedIrp.ListLock, &oldIrql);
+  mapping->InUse = FALSE;
+  KeReleaseSpinLock(&mapping->Dcb->MappedIrp.ListLock, oldIrql);
+}
+
+static VOID DokanCompleteParkedIrp(__in PDOKAN_IRP_MAPPING Mapping) {
+  PIRP irp = Mapping->Irp;
+
+  DDbgPrint("  Complete parked IRP #%X\n", Mapping->SerialNumber);
+  DokanFreeIrpMapping(Mapping);
+  IoCompleteRequest(irp, IO_NO_INCREMENT);
+}
+
+static VOID DokanCompleteParkedIrps(__in PLIST_ENTRY CompleteList) {
+  PLIST_ENTRY entry;
+  PDOKAN_IRP_MAPPING mapping;
+
+  while (!IsListEmpty(CompleteList)) {
+    entry = RemoveHeadList(CompleteList);
+    mapping = CONTAINING_RECORD(entry, DOKAN_IRP_MAPPING, CompleteEntry);
+    DokanCompleteParkedIrp(mapping);
+  }
+}
+
+// Takes the mapping out of the service hands. Returns TRUE if its IRP was
+// parked and has to be completed by the caller. ListLock must be held.
+static BOOLEAN DokanMappingNotInUseLocked(__in PDOKAN_IRP_MAPPING Mapping) {
+  if (!Mapping->InUse) {
+    return FALSE;
+  }
+  Mapping->InUse = FALSE;
+  return Mapping->Parked;
+}
+
+// The service replied to SerialNumber and no longer uses its mapping.
+// Completes the IRP when it was parked meanwhile.
+VOID DokanReleaseMappedIrp(__in PDokanDCB Dcb, __in ULONG SerialNumber) {
+  PLIST_ENTRY listHead, thisEntry;
+  PDOKAN_IRP_MAPPING mapping = NULL;
+  BOOLEAN parked = FALSE;
+  KIRQL oldIrql;
+
+  KeAcquireSpinLock(&Dcb->MappedIrp.ListLock, &oldIrql);
+  listHead = &Dcb->MappedIrp.ListHead;
+  for (thisEntry = listHead->Flink; thisEntry != listHead;
+       thisEntry = thisEntry->Flink) {
+    mapping = CONTAINING_RECORD(thisEntry, DOKAN_IRP_MAPPING, ListEntry);
+    if (mapping->InUse && mapping->SerialNumber == SerialNumber) {
+      parked = DokanMappingNotInUseLocked(mapping);
+      break;
+    }
+  }
+  KeReleaseSpinLock(&Dcb->MappedIrp.ListLock, oldIrql);
+
+  if (parked) {
+    DokanCompleteParkedIrp(mapping);
+  }
+}
+
+// Completes the IRPs parked for longer than IrpTimeout, the service is not
+// going to reply anymore. It gets an access violation if it still uses the
+// mapping.
+VOID DokanReleaseTimeoutMappedIrps(__in PDokanDCB Dcb) {
+  LIST_ENTRY completeList;
+  PLIST_ENTRY listHead, thisEntry;
+  PDOKAN_IRP_MAPPING mapping;
+  LARGE_INTEGER tickCount;
+  KIRQL oldIrql;
+
+  InitializeListHead(&completeList);
+  KeQueryTickCount(&tickCount);
+
+  KeAcquireSpinLock(&Dcb->MappedIrp.ListLock, &oldIrql);
+  listHead = &Dcb->MappedIrp.ListHead;
+  for (thisEntry = listHead->Flink; thisEntry != listHead;
+       thisEntry = thisEntry->Flink) {
+    mapping = CONTAINING_RECORD(thisEntry, DOKAN_IRP_MAPPING, ListEntry);
+    if (mapping->InUse && mapping->Parked &&
+        mapping->TickCount.QuadPart <= tickCount.QuadPart &&
+        DokanMappingNotInUseLocked(mapping)) {
+      DDbgPrint("  Timeout parked IRP #%X\n", mapping->SerialNumber);
+      InsertTailList(&completeList, &mapping->CompleteEntry);
+    }
+  }
+  KeReleaseSpinLock(&Dcb->MappedIrp.ListLock, oldIrql);
+
+  DokanCompleteParkedIrps(&completeList);
+}
+
+// The mount goes away, nobody will reply to the parked IRPs
+VOID DokanReleaseMappedIrps(__in PDokanDCB Dcb) {
+  LIST_ENTRY completeList;
+  PLIST_ENTRY listHead, thisEntry;
+  PDOKAN_IRP_MAPPING mapping;
+  KIRQL oldIrql;
+
+  InitializeListHead(&completeList);
+
+  KeAcquireSpinLock(&Dcb->MappedIrp.ListLock, &oldIrql);
+  listHead = &Dcb->MappedIrp.ListHead;
+  for (thisEntry = listHead->Flink; thisEntry != listHead;
+       thisEntry = thisEntry->Flink) {
+    mapping = CONTAINING_RECORD(thisEntry, DOKAN_IRP_MAPPING, ListEntry);
+    if (DokanMappingNotInUseLocked(mapping)) {
+      InsertTailList(&completeList, &mapping->CompleteEntry);
+    }
+  }
+  KeReleaseSpinLock(&Dcb->MappedIrp.ListLock, oldIrql);
+
+  DokanCompleteParkedIrps(&completeList);
+}
+
+// A handle of the service process on the disk device was opened
+VOID DokanServiceHandleCreate(__in PDokanDCB Dcb) {
+  if (Dcb->ServiceProcess != NULL &&
+      PsGetCurrentProcess() == Dcb->ServiceProcess) {
+    InterlockedIncrement(&Dcb->ServiceHandleCount);
+  }
+}
+
+// A handle of the service process on the disk device was cleaned up.
+// After the last one no reply can arrive anymore: every mapping is removed
+// while the process address space still exists and the parked IRPs are
+// completed.
+VOID DokanServiceHandleCleanup(__in PDokanDCB Dcb) {
+  LIST_ENTRY completeList;
+  PLIST_ENTRY listHead, thisEntry;
+  PDOKAN_IRP_MAPPING mapping;
+  KIRQL oldIrql;
+
+  if (Dcb->ServiceProcess == NULL ||
+      PsGetCurrentProcess() != Dcb->ServiceProcess ||
+      InterlockedDecrement(&Dcb->ServiceHandleCount) != 0) {
+    return;
+  }
+
+  DDbgPrint("  Service closed its last handle, remove the mappings\n");
+  InitializeListHead(&completeList);
+
+  // no mapping is added or freed while the list is walked
+  ExAcquireFastMutex(&Dcb->MappingMutex);
+  KeAcquireSpinLock(&Dcb->MappedIrp.ListLock, &oldIrql);
+  Dcb->MappingClosed = TRUE;
+  KeReleaseSpinLock(&Dcb->MappedIrp.ListLock, oldIrql);
+
+  listHead = &Dcb->MappedIrp.ListHead;
+  for (thisEntry = listHead->Flink; thisEntry != listHead;
+       thisEntry = thisEntry->Flink) {
+    mapping = CONTAINING_RECORD(thisEntry, DOKAN_IRP_MAPPING, ListEntry);
+    DokanUnmapUserAddress(mapping);
+
+    KeAcquireSpinLock(&Dcb->MappedIrp.ListLock, &oldIrql);
+    if (DokanMappingNotInUseLocked(mapping)) {
+      InsertTailList(&completeList, &mapping->CompleteEntry);
+    }
+    KeReleaseSpinLock(&Dcb->MappedIrp.ListLock, oldIrql);
+  }
+  ExReleaseFastMutex(&Dcb->MappingMutex);
+
+  DokanCompleteParkedIrps(&completeList);
+
+  // the event rings are mapped in the process as well
+  DokanEventRingFree(Dcb);
+}
+
+static IO_WORKITEM_ROUTINE DokanCompleteMappedIrp;
+
+static VOID DokanCompleteMappedIrp(__in PDEVICE_OBJECT DeviceObject,
+                                   __in_opt PVOID Context) {
+  PIRP irp = Context;
+
+  UNREFERENCED_PARAMETER(DeviceObject);
+
+  DokanFreeIrpMapping(irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_MAPPING]);
+  IoCompleteRequest(irp, IO_NO_INCREMENT);
+}
+
+// Removes the mapping of Irp before it is completed.
+// Returns FALSE when the completion is done later: the service still uses
+// the mapping or the IRQL is too high to unmap.
+BOOLEAN DokanUnmapIrpBuffer(__in PIRP Irp) {
+  PDOKAN_IRP_MAPPING mapping = DokanGetIrpMapping(Irp);
+  BOOLEAN inUse;
+  KIRQL oldIrql;
+
+  if (mapping == NULL) {
+    return TRUE;
+  }
+
+  KeAcquireSpinLock(&mapping->Dcb->MappedIrp.ListLock, &oldIrql);
+  inUse = mapping->InUse;
+  if (inUse) {
+    mapping->Parked = TRUE;
+    DokanUpdateTimeout(&mapping->TickCount, mapping->Dcb->IrpTimeout);
+  }
+  KeReleaseSpinLock(&mapping->Dcb->MappedIrp.ListLock, oldIrql);
+
+  if (inUse) {
+    DDbgPrint("  Park IRP #%X until the service replies\n",
+              mapping->SerialNumber);
+    return FALSE;
+  }
+
+  // user mappings can only be removed at APC_LEVEL or below
+  if (KeGetCurrentIrql() > APC_LEVEL) {
+    IoQueueWorkItem(mapping->WorkItem, DokanCompleteMappedIrp,
+                    DelayedWorkQueue, Irp);
+    return FALSE;
+  }
+
+  DokanFreeIrpMapping(mapping);
+  return TRUE;
+}
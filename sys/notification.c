@@ -43,18 +43,34 @@ DokanDispatchRead
   DokanRegisterPendingIrp
     # add IRP_MJ_READ to PendingIrp list
     DokanRegisterPendingIrpMain(PendingIrp)
-        # put MJ_READ event into NotifyEvent
-    DokanEventNotification(NotifyEvent, EventContext)
+    DokanQueueEvent
+      # copy MJ_READ event into the event ring, see ring.c
+      DokanEventRingSubmit
+      # or put it into NotifyEvent
+      DokanEventNotification(NotifyEvent, EventContext)
 
 IOCTL_EVENT_WAIT:
   DokanRegisterPendingIrpForEvent
     # add this irp to PendingEvent list
     DokanRegisterPendingIrpMain(PendingEvent)
 
+IOCTL_EVENT_WAIT_BATCH:
+  same as IOCTL_EVENT_WAIT but NotificationLoop packs as many
+  NotifyEvent entries as fit in the output buffer (EVENT_BATCH),
+  up to the MaxBatchCount negotiated by IOCTL_EVENT_START
+  EVENT_BATCH_FLAG_BACKLOG is set when events are left in NotifyEvent
+
 IOCTL_EVENT_INFO:
   DokanCompleteIrp
     DokanCompleteRead
 
+IOCTL_EVENT_INFO_WAIT:
+  DokanCompleteIrpAndWait
+    # reply carried in the input buffer
+    DokanCompleteIrp
+    # then wait like IOCTL_EVENT_WAIT_BATCH
+    DokanRegisterPendingIrpForEvent
+
 */
 
 #include "dokan.h"
@@ -138,6 +154,16 @@ VOID DokanEventNotification(__in PIRP_LIST NotifyEvent,
   KeSetEvent(&NotifyEvent->NotEmpty, IO_NO_INCREMENT, FALSE);
 }
 
+// Hands an event of the mount to user-mode: through the event ring when
+// there is room in it, otherwise to the waits of the workers
+VOID DokanQueueEvent(__in PDokanDCB Dcb, __in PEVENT_CONTEXT EventContext) {
+  if (DokanEventRingSubmit(Dcb, EventContext)) {
+    DokanFreeEventContext(EventContext);
+    return;
+  }
+  DokanEventNotification(&Dcb->NotifyEvent, EventContext);
+}
+
 VOID ReleasePendingIrp(__in PIRP_LIST PendingIrp) {
   PLIST_ENTRY listHead;
   LIST_ENTRY completeList;
@@ -201,7 +227,9 @@ VOID ReleaseNotifyEvent(__in PIRP_LIST NotifyEvent) {
   KeReleaseSpinLock(&NotifyEvent->ListLock, oldIrql);
 }
 
-VOID NotificationLoop(__in PIRP_LIST PendingIrp, __in PIRP_LIST NotifyEvent) {
+// MaxBatchCount limits the events packed in one EVENT_BATCH, 0 for no limit
+VOID NotificationLoop(__in PIRP_LIST PendingIrp, __in PIRP_LIST NotifyEvent,
+                      __in ULONG MaxBatchCount) {
   PDRIVER_EVENT_CONTEXT driverEventContext;
   PLIST_ENTRY listHead;
   PIRP_ENTRY irpEntry;
@@ -212,6 +240,7 @@ VOID NotificationLoop(__in PIRP_LIST PendingIrp, __in PIRP_LIST NotifyEvent) {
   ULONG eventLen;
   ULONG bufferLen;
   PVOID buffer;
+  BOOLEAN backlog;
 
   DDbgPrint("=> NotificationLoop\n");
 
@@ -273,6 +302,46 @@ VOID NotificationLoop(__in PIRP_LIST PendingIrp, __in PIRP_LIST NotifyEvent) {
       InsertTailList(&NotifyEvent->ListHead, &driverEventContext->ListEntry);
       // marks as STATUS_INSUFFICIENT_RESOURCES
       irpEntry->SerialNumber = 0;
+    } else if (irpEntry->IrpSp->Parameters.DeviceIoControl.IoControlCode ==
+                   IOCTL_EVENT_WAIT_BATCH ||
+               irpEntry->IrpSp->Parameters.DeviceIoControl.IoControlCode ==
+                   IOCTL_EVENT_INFO_WAIT) {
+      PEVENT_BATCH batch = buffer;
+      PEVENT_CONTEXT frame;
+
+      EventBatchInit(batch);
+      frame = EventBatchAppend(batch, bufferLen, eventLen);
+      if (frame == NULL) {
+        // header does not fit with the first event
+        InsertTailList(&NotifyEvent->ListHead, &driverEventContext->ListEntry);
+        irpEntry->SerialNumber = 0;
+        InsertTailList(&completeList, &irpEntry->ListEntry);
+        continue;
+      }
+
+      // pack as many queued events as the buffer can hold
+      for (;;) {
+        RtlCopyMemory(frame, &driverEventContext->EventContext, eventLen);
+        if (driverEventContext->Completed) {
+          KeSetEvent(driverEventContext->Completed, IO_NO_INCREMENT, FALSE);
+        }
+        ExFreePool(driverEventContext);
+
+        if (IsListEmpty(&NotifyEvent->ListHead) ||
+            (MaxBatchCount != 0 && batch->Count >= MaxBatchCount)) {
+          break;
+        }
+        driverEventContext = CONTAINING_RECORD(NotifyEvent->ListHead.Flink,
+                                               DRIVER_EVENT_CONTEXT, ListEntry);
+        eventLen = driverEventContext->EventContext.Length;
+        frame = EventBatchAppend(batch, bufferLen, eventLen);
+        if (frame == NULL) {
+          break;
+        }
+        RemoveHeadList(&NotifyEvent->ListHead);
+      }
+      // save batch length
+      irpEntry->SerialNumber = batch->Length;
     } else {
       // let's copy EVENT_CONTEXT
       RtlCopyMemory(buffer, &driverEventContext->EventContext, eventLen);
@@ -287,6 +356,9 @@ VOID NotificationLoop(__in PIRP_LIST PendingIrp, __in PIRP_LIST NotifyEvent) {
     InsertTailList(&completeList, &irpEntry->ListEntry);
   }
 
+  // no waiting IRP was left for these events
+  backlog = !IsListEmpty(&NotifyEvent->ListHead);
+
   DDbgPrint("Clear Events...\n");
   KeClearEvent(&NotifyEvent->NotEmpty);
   DDbgPrint("Notify event cleared\n");
@@ -307,6 +379,14 @@ VOID NotificationLoop(__in PIRP_LIST PendingIrp, __in PIRP_LIST NotifyEvent) {
       irp->IoStatus.Information = 0;
       irp->IoStatus.Status = STATUS_INSUFFICIENT_RESOURCES;
     } else {
+      if (backlog &&
+          (irpEntry->IrpSp->Parameters.DeviceIoControl.IoControlCode ==
+               IOCTL_EVENT_WAIT_BATCH ||
+           irpEntry->IrpSp->Parameters.DeviceIoControl.IoControlCode ==
+               IOCTL_EVENT_INFO_WAIT)) {
+        ((PEVENT_BATCH)irp->AssociatedIrp.SystemBuffer)->Flags |=
+            EVENT_BATCH_FLAG_BACKLOG;
+      }
       irp->IoStatus.Information = irpEntry->SerialNumber;
       irp->IoStatus.Status = STATUS_SUCCESS;
     }
@@ -343,10 +423,11 @@ VOID NotificationThread(__in PDokanDCB Dcb) {
 
     if (status != STATUS_WAIT_0) {
       if (status == STATUS_WAIT_1 || status == STATUS_WAIT_2) {
-        NotificationLoop(&Dcb->PendingEvent, &Dcb->NotifyEvent);
+        NotificationLoop(&Dcb->PendingEvent, &Dcb->NotifyEvent,
+                         Dcb->MaxBatchCount);
       } else {
         NotificationLoop(&Dcb->Global->PendingService,
-                         &Dcb->Global->NotifyService);
+                         &Dcb->Global->NotifyService, 0);
       }
     }
   } while (status != STATUS_WAIT_0);
@@ -449,6 +530,8 @@ NTSTATUS DokanEventRelease(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
 
   ReleasePendingIrp(&dcb->PendingIrp);
   ReleasePendingIrp(&dcb->PendingEvent);
+  DokanReleaseMappedIrps(dcb);
+  DokanEventRingStop(dcb);
   DokanStopCheckThread(dcb);
   DokanStopEventNotificationThread(dcb);
 
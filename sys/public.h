@@ -27,9 +27,14 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <minwindef.h>
 #endif
 
-#define DOKAN_DRIVER_VERSION 0x0000190
+#define DOKAN_DRIVER_VERSION 0x0000191
 
+#include "ring.h"
+
+// Default size of the event buffers, see EVENT_START.EventBufferSize
 #define EVENT_CONTEXT_MAX_SIZE (1024 * 32)
+// Upper bound of the negotiated event buffer size
+#define EVENT_BUFFER_MAX_SIZE (1024 * 1024)
 
 #define IOCTL_TEST                                                             \
   CTL_CODE(FILE_DEVICE_UNKNOWN, 0x800, METHOD_BUFFERED, FILE_ANY_ACCESS)
@@ -52,6 +57,14 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #define IOCTL_EVENT_WRITE                                                      \
   CTL_CODE(FILE_DEVICE_UNKNOWN, 0x806, METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
 
+#define IOCTL_EVENT_WAIT_BATCH                                                 \
+  CTL_CODE(FILE_DEVICE_UNKNOWN, 0x807, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+// Input: optional EVENT_INFORMATION answering a previous event.
+// Output: same as IOCTL_EVENT_WAIT_BATCH.
+#define IOCTL_EVENT_INFO_WAIT                                                  \
+  CTL_CODE(FILE_DEVICE_UNKNOWN, 0x808, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
 #define IOCTL_KEEPALIVE                                                        \
   CTL_CODE(FILE_DEVICE_UNKNOWN, 0x809, METHOD_NEITHER, FILE_ANY_ACCESS)
 
@@ -70,6 +83,10 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #define IOCTL_MOUNTPOINT_CLEANUP                                            \
   CTL_CODE(FILE_DEVICE_UNKNOWN, 0x80E, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
+// Input and output: EVENT_RING_MAP
+#define IOCTL_EVENT_RING                                                       \
+  CTL_CODE(FILE_DEVICE_UNKNOWN, 0x80F, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
 #define DRIVER_FUNC_INSTALL 0x01
 #define DRIVER_FUNC_REMOVE 0x02
 
@@ -205,6 +222,9 @@ typedef struct _DIRECTORY_CONTEXT {
 
 typedef struct _READ_CONTEXT {
   LARGE_INTEGER ByteOffset;
+  // Address of the caller's buffer mapped in the service process.
+  // 0 when the data is returned in EVENT_INFORMATION.Buffer.
+  ULONG64 UserBuffer;
   ULONG BufferLength;
   ULONG FileNameLength;
   WCHAR FileName[1];
@@ -212,6 +232,10 @@ typedef struct _READ_CONTEXT {
 
 typedef struct _WRITE_CONTEXT {
   LARGE_INTEGER ByteOffset;
+  // Address of the payload mapped read-only in the service process.
+  // 0 when the payload follows the file name at BufferOffset or has to be
+  // pulled with IOCTL_EVENT_WRITE.
+  ULONG64 UserBuffer;
   ULONG BufferLength;
   ULONG BufferOffset;
   ULONG RequestLength;
@@ -304,6 +328,89 @@ typedef struct _EVENT_CONTEXT {
 #define WRITE_MAX_SIZE                                                         \
   (EVENT_CONTEXT_MAX_SIZE - sizeof(EVENT_CONTEXT) - 256 * sizeof(WCHAR))
 
+/*
+ * Output of IOCTL_EVENT_WAIT_BATCH.
+ * The header is followed by Count EVENT_CONTEXT frames. Each frame starts
+ * at an EVENT_BATCH_ALIGNMENT boundary and is EVENT_CONTEXT.Length bytes
+ * long. Length is the number of bytes used in the buffer, header included.
+ * Flags is a combination of EVENT_BATCH_FLAG_* values.
+ *
+ * The helpers below only rely on the frame lengths so the layout can be
+ * built and walked outside of the driver.
+ */
+typedef struct _EVENT_BATCH {
+  ULONG Count;
+  ULONG Length;
+  ULONG Flags;
+} EVENT_BATCH, *PEVENT_BATCH;
+
+// Events were still queued in the driver when the batch was completed
+#define EVENT_BATCH_FLAG_BACKLOG 1
+
+#define EVENT_BATCH_ALIGNMENT 8
+#define EVENT_BATCH_ALIGN(len)                                                 \
+  (((len) + (EVENT_BATCH_ALIGNMENT - 1)) & ~(EVENT_BATCH_ALIGNMENT - 1))
+#define EVENT_BATCH_HEADER_SIZE EVENT_BATCH_ALIGN(sizeof(EVENT_BATCH))
+
+static __inline VOID EventBatchInit(PEVENT_BATCH Batch) {
+  Batch->Count = 0;
+  Batch->Length = EVENT_BATCH_HEADER_SIZE;
+  Batch->Flags = 0;
+}
+
+// Reserve a frame of EventLength bytes at the end of the batch.
+// Returns NULL when the frame does not fit in BatchSize.
+static __inline PEVENT_CONTEXT EventBatchAppend(PEVENT_BATCH Batch,
+                                                ULONG BatchSize,
+                                                ULONG EventLength) {
+  PEVENT_CONTEXT frame;
+  ULONG newLength;
+
+  if (EventLength < sizeof(ULONG) || Batch->Length > BatchSize ||
+      EventLength > BatchSize - Batch->Length) {
+    return NULL;
+  }
+
+  frame = (PEVENT_CONTEXT)((PCHAR)Batch + Batch->Length);
+  newLength = Batch->Length + EventLength;
+  Batch->Length = EVENT_BATCH_ALIGN(newLength) > BatchSize
+                      ? BatchSize
+                      : EVENT_BATCH_ALIGN(newLength);
+  Batch->Count++;
+  return frame;
+}
+
+// Walk the frames of a batch received in a buffer of ReturnedLength bytes.
+// Offset must be 0 on the first call. Returns NULL at the end of the batch
+// or when a frame is malformed.
+static __inline PEVENT_CONTEXT EventBatchNext(PEVENT_BATCH Batch,
+                                              ULONG ReturnedLength,
+                                              PULONG Offset) {
+  PEVENT_CONTEXT frame;
+  ULONG length = Batch->Length;
+
+  if (ReturnedLength < EVENT_BATCH_HEADER_SIZE) {
+    return NULL;
+  }
+  if (length > ReturnedLength) {
+    length = ReturnedLength;
+  }
+  if (*Offset == 0) {
+    *Offset = EVENT_BATCH_HEADER_SIZE;
+  }
+  if (*Offset >= length || length - *Offset < sizeof(ULONG)) {
+    return NULL;
+  }
+
+  frame = (PEVENT_CONTEXT)((PCHAR)Batch + *Offset);
+  if (frame->Length < sizeof(ULONG) || frame->Length > length - *Offset) {
+    return NULL;
+  }
+
+  *Offset = EVENT_BATCH_ALIGN(*Offset + frame->Length);
+  return frame;
+}
+
 typedef struct _EVENT_INFORMATION {
   ULONG SerialNumber;
   NTSTATUS Status;
@@ -345,12 +452,37 @@ typedef struct _EVENT_INFORMATION {
 #define DOKAN_EVENT_CURRENT_SESSION 16
 #define DOKAN_EVENT_FILELOCK_USER_MODE 32
 
+// Optional protocol features, negotiated by IOCTL_EVENT_START
+// READ_CONTEXT and WRITE_CONTEXT can carry a mapped UserBuffer
+#define DOKAN_FEATURE_MAPPED_IO 1
+// Events and replies can go through the rings of IOCTL_EVENT_RING
+#define DOKAN_FEATURE_EVENT_RING 2
+#define DOKAN_DRIVER_FEATURES                                                  \
+  (DOKAN_FEATURE_MAPPED_IO | DOKAN_FEATURE_EVENT_RING)
+
+// Geometry of the event rings, see EVENT_START.RingSlotCount
+#define DOKAN_EVENT_RING_DEFAULT_SLOTS 64
+#define DOKAN_EVENT_RING_DEFAULT_PAYLOAD (4096 - sizeof(DOKAN_RING_SLOT))
+// Largest ring granted, each of the two rings
+#define DOKAN_EVENT_RING_MAX_SIZE (4 * 1024 * 1024)
+
 typedef struct _EVENT_DRIVER_INFO {
   ULONG DriverVersion;
   ULONG Status;
   ULONG DeviceNumber;
   ULONG MountId;
   WCHAR DeviceName[64];
+  // Values granted for the mount, see EVENT_START
+  ULONG EventBufferSize;
+  // Largest EVENT_CONTEXT sent to user-mode: it fits in an event buffer
+  // with the EVENT_BATCH header. Bigger writes are mapped or pulled with
+  // IOCTL_EVENT_WRITE.
+  ULONG MaxEventSize;
+  ULONG MaxBatchCount;
+  ULONG Features;
+  // Geometry of both event rings when Features has DOKAN_FEATURE_EVENT_RING
+  ULONG RingSlotCount;
+  ULONG RingPayloadSize;
 } EVENT_DRIVER_INFO, *PEVENT_DRIVER_INFO;
 
 typedef struct _EVENT_START {
@@ -360,8 +492,45 @@ typedef struct _EVENT_START {
   WCHAR MountPoint[260];
   WCHAR UNCName[64];
   ULONG IrpTimeout;
+  // Size of the buffers user-mode waits for events with.
+  // 0 means EVENT_CONTEXT_MAX_SIZE, capped to EVENT_BUFFER_MAX_SIZE.
+  ULONG EventBufferSize;
+  // Maximum number of events in one EVENT_BATCH, 0 means no limit
+  ULONG MaxBatchCount;
+  // DOKAN_FEATURE_* supported by user-mode
+  ULONG Features;
+  // Slots of each event ring and payload bytes of a slot, 0 for the
+  // defaults. The driver may grant less, see EVENT_DRIVER_INFO.
+  ULONG RingSlotCount;
+  ULONG RingPayloadSize;
 } EVENT_START, *PEVENT_START;
 
+/*
+ * Input and output of IOCTL_EVENT_RING, sent once per mount by the process
+ * that sent IOCTL_EVENT_START on a handle of the disk device.
+ *
+ * The driver maps two rings of RingSize bytes in the process (see ring.h):
+ * - SubmitRing carries EVENT_CONTEXT from the driver. SubmitEvent is set on
+ *   an empty to non-empty transition and when the ring is closed at unmount.
+ *   Events that do not fit or find the ring full go to IOCTL_EVENT_WAIT*.
+ * - CompleteRing carries EVENT_INFORMATION to the driver. User-mode sets
+ *   CompleteEvent when DokanRingCommit asks for a wakeup. A reply only goes
+ *   there when its BufferLength bytes follow it in the slot, the others use
+ *   IOCTL_EVENT_INFO.
+ *
+ * The mapping stays valid until the process closes its last handle on the
+ * disk device.
+ */
+typedef struct _EVENT_RING_MAP {
+  // in: event handles of the calling process
+  ULONG64 SubmitEvent;
+  ULONG64 CompleteEvent;
+  // out: addresses in the calling process
+  ULONG64 SubmitRing;
+  ULONG64 CompleteRing;
+  ULONG RingSize;
+} EVENT_RING_MAP, *PEVENT_RING_MAP;
+
 #pragma warning(push)
 #pragma warning(disable : 4201)
 typedef struct _DOKAN_RENAME_INFORMATION {
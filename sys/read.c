@@ -62,6 +62,7 @@ Return Value:
 
     DDbgPrint("==> DokanRead\n");
 
+    Irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_MAPPING] = NULL;
     irpSp = IoGetCurrentIrpStackLocation(Irp);
     fileObject = irpSp->FileObject;
 
@@ -139,7 +140,8 @@ Return Value:
     // make a MDL for UserBuffer that can be used later on another thread
     // context
     if (Irp->MdlAddress == NULL) {
-      status = DokanAllocateMdl(Irp, irpSp->Parameters.Read.Length);
+      status = DokanAllocateMdl(Irp, irpSp->Parameters.Read.Length,
+                                IoWriteAccess);
       if (!NT_SUCCESS(status)) {
         __leave;
       }
@@ -212,6 +214,14 @@ Return Value:
     // user-mode file system application can return this size
     eventContext->Operation.Read.BufferLength = irpSp->Parameters.Read.Length;
 
+    // large reads are written in place by user-mode instead of being copied
+    // from the reply
+    if (bufferLength >= EVENT_CONTEXT_MAX_SIZE &&
+        DokanMapIrpBuffer(vcb->Dcb, Irp, bufferLength, IoWriteAccess,
+                          &eventContext->Operation.Read.UserBuffer)) {
+      DDbgPrint("  Read buffer mapped\n");
+    }
+
     // copy the accessed file name
     eventContext->Operation.Read.FileNameLength = fcb->FileName.Length;
     RtlCopyMemory(eventContext->Operation.Read.FileName, fcb->FileName.Buffer,
@@ -311,8 +321,14 @@ VOID DokanCompleteRead(__in PIRP_ENTRY IrpEntry,
     status = STATUS_INSUFFICIENT_RESOURCES;
 
   } else {
-    RtlZeroMemory(buffer, bufferLen);
-    RtlCopyMemory(buffer, EventInfo->Buffer, EventInfo->BufferLength);
+    if (irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_MAPPING] != NULL) {
+      // user-mode already wrote the data in the mapped buffer
+      RtlZeroMemory((PCHAR)buffer + EventInfo->BufferLength,
+                    bufferLen - EventInfo->BufferLength);
+    } else {
+      RtlZeroMemory(buffer, bufferLen);
+      RtlCopyMemory(buffer, EventInfo->Buffer, EventInfo->BufferLength);
+    }
 
     // read length which is actually read
     readLength = EventInfo->BufferLength;
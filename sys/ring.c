@@ -0,0 +1,496 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokan.h"
+
+/*
+
+Event rings, negotiated with DOKAN_FEATURE_EVENT_RING
+
+IOCTL_EVENT_START:
+  DokanEventRingGrant           # geometry in EVENT_DRIVER_INFO
+
+IOCTL_EVENT_RING:
+  DokanEventRingMap
+    # allocate both rings, map them in the service process, start
+    # EventRingThread
+
+IRP_MJ_READ:
+  DokanRegisterPendingIrp
+    DokanQueueEvent
+      DokanEventRingSubmit      # copy the event in the submission ring,
+                                # SubmitEvent on empty to non-empty
+
+EventRingThread:
+  # copy each reply out of the completion ring, sleep on CompleteEvent
+  # when it is empty
+  DokanCompleteEventInformation
+
+IOCTL_EVENT_RELEASE:
+  DokanEventRingStop            # close the submission ring, the service
+                                # threads leave, EventRingThread ends
+
+DokanServiceHandleCleanup / device deletion:
+  DokanEventRingFree            # unmap from the service process and free
+
+The pages are allocated by the driver and mapped in the service like the
+IRP buffers of mapping.c, with the same lifetime: the mapping stays until
+the service closes its last handle on the disk device, or the device is
+deleted if the service never had one.
+
+The driver never trusts the shared memory: the geometry is kept in the
+DOKAN_RING views and each reply is copied out of its slot before use.
+
+*/
+
+typedef struct _DOKAN_EVENT_RING {
+  PDokanDCB Dcb;
+  // pages of both rings, RingSize bytes each
+  PMDL Mdl;
+  PVOID SystemAddress;
+  ULONG RingSize;
+  // address in Process, NULL once unmapped
+  PVOID UserAddress;
+  PEPROCESS Process;
+  DOKAN_RING Submit;
+  DOKAN_RING Complete;
+  PKEVENT SubmitEvent;
+  PKEVENT CompleteEvent;
+  // reply being completed, copied out of the completion ring
+  PEVENT_INFORMATION Reply;
+  ULONG ReplySize;
+  PKTHREAD Thread;
+  KEVENT StopEvent;
+} DOKAN_EVENT_RING, *PDOKAN_EVENT_RING;
+
+// Rings start on a cache line
+#define DOKAN_EVENT_RING_ALIGN(len)                                            \
+  (((len) + (DOKAN_RING_CACHE_LINE - 1)) & ~(DOKAN_RING_CACHE_LINE - 1))
+
+VOID DokanEventRingGrant(__in PDokanDCB Dcb, __in ULONG SlotCount,
+                         __in ULONG PayloadSize) {
+  ULONG slotCount = DOKAN_EVENT_RING_DEFAULT_SLOTS;
+  ULONG payloadSize;
+
+  payloadSize = PayloadSize != 0 ? PayloadSize
+                                 : (ULONG)DOKAN_EVENT_RING_DEFAULT_PAYLOAD;
+  // bigger events never go through the ring
+  if (payloadSize > Dcb->MaxEventSize) {
+    payloadSize = Dcb->MaxEventSize;
+  }
+  if (payloadSize < sizeof(EVENT_CONTEXT)) {
+    payloadSize = sizeof(EVENT_CONTEXT);
+  }
+  // use the whole slot
+  payloadSize = DokanRingSlotSize(payloadSize) - sizeof(DOKAN_RING_SLOT);
+
+  if (SlotCount != 0) {
+    // largest power of two not above the request
+    for (slotCount = 2; slotCount <= SlotCount / 2 &&
+                        slotCount < DOKAN_RING_MAX_SLOTS;
+         slotCount *= 2) {
+    }
+  }
+  while (slotCount > 2 &&
+         (DokanRingSize(slotCount, payloadSize) == 0 ||
+          DokanRingSize(slotCount, payloadSize) > DOKAN_EVENT_RING_MAX_SIZE)) {
+    slotCount /= 2;
+  }
+
+  if (DokanRingSize(slotCount, payloadSize) == 0 ||
+      DokanRingSize(slotCount, payloadSize) > DOKAN_EVENT_RING_MAX_SIZE) {
+    DDbgPrint("  Event ring not granted\n");
+    Dcb->Features &= ~DOKAN_FEATURE_EVENT_RING;
+    return;
+  }
+  Dcb->RingSlotCount = slotCount;
+  Dcb->RingPayloadSize = payloadSize;
+  DDbgPrint("  Event ring: %lu slots of %lu bytes\n", slotCount, payloadSize);
+}
+
+static VOID DokanEventRingComplete(__in PDOKAN_EVENT_RING Ring) {
+  PDokanVCB vcb = Ring->Dcb->Vcb;
+  PEVENT_INFORMATION reply = Ring->Reply;
+  ULONG length;
+  ULONG tag;
+
+  while (DokanRingConsume(&Ring->Complete, reply, Ring->ReplySize, &length,
+                          &tag)) {
+    if (length < sizeof(EVENT_INFORMATION)) {
+      DDbgPrint("  Event ring: short reply %lu\n", length);
+      continue;
+    }
+    // Completions read BufferLength bytes from the reply: they must be in
+    // the copy. Replies with a larger buffer use IOCTL_EVENT_INFO.
+    if (reply->BufferLength >
+        length - FIELD_OFFSET(EVENT_INFORMATION, Buffer)) {
+      DDbgPrint("  Event ring: reply #%X does not hold its buffer\n",
+                reply->SerialNumber);
+      reply->Status = STATUS_INVALID_PARAMETER;
+      reply->BufferLength = 0;
+    }
+    DokanCompleteEventInformation(vcb->DeviceObject, reply);
+  }
+}
+
+KSTART_ROUTINE EventRingThread;
+VOID EventRingThread(__in PDOKAN_EVENT_RING Ring) {
+  PVOID events[2];
+  NTSTATUS status;
+
+  DDbgPrint("==> EventRingThread\n");
+
+  events[0] = &Ring->StopEvent;
+  events[1] = Ring->CompleteEvent;
+
+  do {
+    DokanEventRingComplete(Ring);
+
+    if (DokanRingPrepareWait(&Ring->Complete)) {
+      status = KeWaitForMultipleObjects(2, events, WaitAny, Executive,
+                                        KernelMode, FALSE, NULL, NULL);
+      DokanRingFinishWait(&Ring->Complete);
+    } else {
+      status = KeReadStateEvent(&Ring->StopEvent) ? STATUS_WAIT_0
+                                                  : STATUS_WAIT_1;
+    }
+  } while (status != STATUS_WAIT_0);
+
+  DDbgPrint("<== EventRingThread\n");
+  PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+static VOID DokanEventRingDelete(__in PDOKAN_EVENT_RING Ring) {
+  if (Ring->SystemAddress != NULL) {
+    MmUnmapLockedPages(Ring->SystemAddress, Ring->Mdl);
+  }
+  if (Ring->Mdl != NULL) {
+    MmFreePagesFromMdl(Ring->Mdl);
+    ExFreePool(Ring->Mdl);
+  }
+  if (Ring->SubmitEvent != NULL) {
+    ObDereferenceObject(Ring->SubmitEvent);
+  }
+  if (Ring->CompleteEvent != NULL) {
+    ObDereferenceObject(Ring->CompleteEvent);
+  }
+  if (Ring->Process != NULL) {
+    ObDereferenceObject(Ring->Process);
+  }
+  if (Ring->Reply != NULL) {
+    ExFreePool(Ring->Reply);
+  }
+  ExFreePool(Ring);
+}
+
+// Allocates the pages of both rings and initializes them
+static NTSTATUS DokanEventRingAllocate(__in PDOKAN_EVENT_RING Ring) {
+  PHYSICAL_ADDRESS lowAddress;
+  PHYSICAL_ADDRESS highAddress;
+  PHYSICAL_ADDRESS skipBytes;
+  ULONG length;
+
+  Ring->RingSize = DokanRingSize(Ring->Dcb->RingSlotCount,
+                                 Ring->Dcb->RingPayloadSize);
+  if (Ring->RingSize == 0) {
+    return STATUS_INVALID_PARAMETER;
+  }
+  length = (ULONG)ROUND_TO_PAGES(DOKAN_EVENT_RING_ALIGN(Ring->RingSize) * 2);
+
+  lowAddress.QuadPart = 0;
+  highAddress.QuadPart = (LONGLONG)-1;
+  skipBytes.QuadPart = 0;
+  // zeroed pages, nothing of the kernel is shown to the service
+  Ring->Mdl = MmAllocatePagesForMdlEx(lowAddress, highAddress, skipBytes,
+                                      length, MmCached,
+                                      MM_ALLOCATE_FULLY_REQUIRED);
+  if (Ring->Mdl == NULL) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+  if (MmGetMdlByteCount(Ring->Mdl) != length) {
+    MmFreePagesFromMdl(Ring->Mdl);
+    ExFreePool(Ring->Mdl);
+    Ring->Mdl = NULL;
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+
+  Ring->SystemAddress = MmGetSystemAddressForMdlNormalSafe(Ring->Mdl);
+  if (Ring->SystemAddress == NULL) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+
+  if (!DokanRingInit(&Ring->Submit, Ring->SystemAddress,
+                     Ring->Dcb->RingSlotCount, Ring->Dcb->RingPayloadSize) ||
+      !DokanRingInit(&Ring->Complete,
+                     (PCHAR)Ring->SystemAddress +
+                         DOKAN_EVENT_RING_ALIGN(Ring->RingSize),
+                     Ring->Dcb->RingSlotCount, Ring->Dcb->RingPayloadSize)) {
+    return STATUS_INVALID_PARAMETER;
+  }
+
+  Ring->ReplySize = DokanRingPayloadSize(&Ring->Complete);
+  Ring->Reply = ExAllocatePool(Ring->ReplySize);
+  if (Ring->Reply == NULL) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+  return STATUS_SUCCESS;
+}
+
+static NTSTATUS DokanEventRingReferenceEvent(__in ULONG64 Handle,
+                                             __out PKEVENT *Event) {
+  return ObReferenceObjectByHandle((HANDLE)(ULONG_PTR)Handle,
+                                   EVENT_MODIFY_STATE | SYNCHRONIZE,
+                                   *ExEventObjectType, UserMode,
+                                   (PVOID *)Event, NULL);
+}
+
+// Dcb->EventRingMutex must be held
+static NTSTATUS DokanEventRingStart(__in PDOKAN_EVENT_RING Ring) {
+  HANDLE thread;
+  NTSTATUS status;
+
+  KeInitializeEvent(&Ring->StopEvent, NotificationEvent, FALSE);
+
+  status = PsCreateSystemThread(&thread, THREAD_ALL_ACCESS, NULL, NULL, NULL,
+                                (PKSTART_ROUTINE)EventRingThread, Ring);
+  if (!NT_SUCCESS(status)) {
+    return status;
+  }
+
+  status = ObReferenceObjectByHandle(thread, THREAD_ALL_ACCESS, NULL,
+                                     KernelMode, (PVOID *)&Ring->Thread, NULL);
+  if (!NT_SUCCESS(status)) {
+    // the thread is running: it must be gone before the ring is freed
+    Ring->Thread = NULL;
+    KeSetEvent(&Ring->StopEvent, IO_NO_INCREMENT, FALSE);
+    ZwWaitForSingleObject(thread, FALSE, NULL);
+  }
+  ZwClose(thread);
+  return status;
+}
+
+// Dcb->EventRingMutex must be held
+static VOID DokanEventRingStopLocked(__in PDokanDCB Dcb) {
+  PDOKAN_EVENT_RING ring = Dcb->EventRing;
+  KIRQL oldIrql;
+
+  if (ring == NULL || ring->Thread == NULL) {
+    return;
+  }
+
+  KeAcquireSpinLock(&Dcb->EventRingLock, &oldIrql);
+  Dcb->EventRingOpen = FALSE;
+  KeReleaseSpinLock(&Dcb->EventRingLock, oldIrql);
+
+  // the threads of the service waiting on the ring leave
+  DokanRingClose(&ring->Submit);
+  KeSetEvent(ring->SubmitEvent, IO_NO_INCREMENT, FALSE);
+
+  KeSetEvent(&ring->StopEvent, IO_NO_INCREMENT, FALSE);
+  KeWaitForSingleObject(ring->Thread, Executive, KernelMode, FALSE, NULL);
+  ObDereferenceObject(ring->Thread);
+  ring->Thread = NULL;
+}
+
+NTSTATUS
+DokanEventRingMap(__in PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp) {
+  PIO_STACK_LOCATION irpSp = IoGetCurrentIrpStackLocation(Irp);
+  PEVENT_RING_MAP ringMap = Irp->AssociatedIrp.SystemBuffer;
+  PDOKAN_EVENT_RING ring;
+  PDokanVCB vcb;
+  PDokanDCB dcb;
+  BOOLEAN published = FALSE;
+  NTSTATUS status;
+  KIRQL oldIrql;
+
+  DDbgPrint("==> DokanEventRingMap\n");
+
+  vcb = DeviceObject->DeviceExtension;
+  if (GetIdentifierType(vcb) != VCB) {
+    return STATUS_INVALID_PARAMETER;
+  }
+  dcb = vcb->Dcb;
+
+  if (irpSp->Parameters.DeviceIoControl.InputBufferLength !=
+          sizeof(EVENT_RING_MAP) ||
+      irpSp->Parameters.DeviceIoControl.OutputBufferLength !=
+          sizeof(EVENT_RING_MAP) ||
+      ringMap == NULL) {
+    return STATUS_INVALID_PARAMETER;
+  }
+
+  // the rings only exist in the process that started the mount
+  if (!(dcb->Features & DOKAN_FEATURE_EVENT_RING) ||
+      dcb->ServiceProcess == NULL ||
+      PsGetCurrentProcess() != dcb->ServiceProcess) {
+    return STATUS_ACCESS_DENIED;
+  }
+
+  if (IsUnmountPendingVcb(vcb)) {
+    return STATUS_NO_SUCH_DEVICE;
+  }
+
+  ring = ExAllocatePool(sizeof(DOKAN_EVENT_RING));
+  if (ring == NULL) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+  RtlZeroMemory(ring, sizeof(DOKAN_EVENT_RING));
+  ring->Dcb = dcb;
+
+  ExAcquireFastMutex(&dcb->EventRingMutex);
+  __try {
+    // DokanServiceHandleCleanup frees the ring after setting MappingClosed
+    if (dcb->EventRing != NULL || dcb->MappingClosed) {
+      status = STATUS_INVALID_DEVICE_STATE;
+      __leave;
+    }
+
+    status = DokanEventRingReferenceEvent(ringMap->SubmitEvent,
+                                          &ring->SubmitEvent);
+    if (!NT_SUCCESS(status)) {
+      __leave;
+    }
+    status = DokanEventRingReferenceEvent(ringMap->CompleteEvent,
+                                          &ring->CompleteEvent);
+    if (!NT_SUCCESS(status)) {
+      __leave;
+    }
+
+    status = DokanEventRingAllocate(ring);
+    if (!NT_SUCCESS(status)) {
+      __leave;
+    }
+
+    __try {
+      ring->UserAddress = MmMapLockedPagesSpecifyCache(
+          ring->Mdl, UserMode, MmCached, NULL, FALSE,
+          DOKAN_USER_MAPPING_PRIORITY);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+      DDbgPrint("  MmMapLockedPagesSpecifyCache error\n");
+      ring->UserAddress = NULL;
+    }
+    if (ring->UserAddress == NULL) {
+      status = STATUS_INSUFFICIENT_RESOURCES;
+      __leave;
+    }
+    ring->Process = dcb->ServiceProcess;
+    ObReferenceObject(ring->Process);
+
+    status = DokanEventRingStart(ring);
+    if (!NT_SUCCESS(status)) {
+      MmUnmapLockedPages(ring->UserAddress, ring->Mdl);
+      ring->UserAddress = NULL;
+      __leave;
+    }
+
+    KeAcquireSpinLock(&dcb->EventRingLock, &oldIrql);
+    dcb->EventRing = ring;
+    dcb->EventRingOpen = TRUE;
+    KeReleaseSpinLock(&dcb->EventRingLock, oldIrql);
+    published = TRUE;
+
+    ringMap->SubmitRing = (ULONG64)(ULONG_PTR)ring->UserAddress;
+    ringMap->CompleteRing = (ULONG64)(ULONG_PTR)(
+        (PCHAR)ring->UserAddress + DOKAN_EVENT_RING_ALIGN(ring->RingSize));
+    ringMap->RingSize = ring->RingSize;
+    Irp->IoStatus.Information = sizeof(EVENT_RING_MAP);
+    DDbgPrint("  Event rings mapped at %p\n", ring->UserAddress);
+  } __finally {
+    ExReleaseFastMutex(&dcb->EventRingMutex);
+    if (!published) {
+      DokanEventRingDelete(ring);
+    }
+  }
+
+  DDbgPrint("<== DokanEventRingMap\n");
+  return status;
+}
+
+// Copies EventContext in the submission ring. Returns FALSE when there is
+// no ring, it is full or the event is too big: the caller queues the event
+// in NotifyEvent instead.
+BOOLEAN DokanEventRingSubmit(__in PDokanDCB Dcb,
+                             __in PEVENT_CONTEXT EventContext) {
+  PDOKAN_EVENT_RING ring;
+  BOOLEAN submitted = FALSE;
+  KIRQL oldIrql;
+  int wake = 0;
+
+  // unlocked check, most mounts do not use the ring
+  if (Dcb->EventRing == NULL) {
+    return FALSE;
+  }
+
+  ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
+  KeAcquireSpinLock(&Dcb->EventRingLock, &oldIrql);
+  ring = Dcb->EventRing;
+  if (ring != NULL && Dcb->EventRingOpen &&
+      DokanRingProduce(&ring->Submit, EventContext, EventContext->Length,
+                       EventContext->SerialNumber, &wake)) {
+    submitted = TRUE;
+    if (wake) {
+      KeSetEvent(ring->SubmitEvent, IO_NO_INCREMENT, FALSE);
+    }
+  }
+  KeReleaseSpinLock(&Dcb->EventRingLock, oldIrql);
+
+  return submitted;
+}
+
+// The mount goes away: no more events go to the ring and the replies left
+// in it are completed. The pages stay mapped for the service threads.
+VOID DokanEventRingStop(__in PDokanDCB Dcb) {
+  ExAcquireFastMutex(&Dcb->EventRingMutex);
+  DokanEventRingStopLocked(Dcb);
+  ExReleaseFastMutex(&Dcb->EventRingMutex);
+}
+
+// Removes the ring from the service process and frees it. Called from the
+// process context by DokanServiceHandleCleanup, or when the device is
+// deleted.
+VOID DokanEventRingFree(__in PDokanDCB Dcb) {
+  PDOKAN_EVENT_RING ring;
+  KAPC_STATE apcState;
+  KIRQL oldIrql;
+
+  ExAcquireFastMutex(&Dcb->EventRingMutex);
+  ring = Dcb->EventRing;
+  if (ring == NULL) {
+    ExReleaseFastMutex(&Dcb->EventRingMutex);
+    return;
+  }
+  DokanEventRingStopLocked(Dcb);
+
+  KeAcquireSpinLock(&Dcb->EventRingLock, &oldIrql);
+  Dcb->EventRing = NULL;
+  KeReleaseSpinLock(&Dcb->EventRingLock, oldIrql);
+
+  if (ring->UserAddress != NULL) {
+    KeStackAttachProcess(ring->Process, &apcState);
+    MmUnmapLockedPages(ring->UserAddress, ring->Mdl);
+    KeUnstackDetachProcess(&apcState);
+    ring->UserAddress = NULL;
+  }
+  ExReleaseFastMutex(&Dcb->EventRingMutex);
+
+  DDbgPrint("  Event rings freed\n");
+  DokanEventRingDelete(ring);
+}
@@ -0,0 +1,431 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RING_H_
+#define RING_H_
+
+/*
+
+Shared memory ring:
+
+  DOKAN_RING_HEADER | SlotCount x (DOKAN_RING_SLOT + payload)
+
+Bounded multi-producer / multi-consumer queue of fixed-size slots. Each
+slot carries a sequence number telling whose turn it is:
+
+  Sequence == position                 slot free, producer may reserve it
+  Sequence == position + 1             slot published, consumer may take it
+  Sequence == position + SlotCount     released for the next lap
+
+Producers and consumers claim a position with a compare-exchange on Tail
+and Head, fill or read the slot in place, then hand it over by storing the
+next sequence number. The memory only holds offsets, so it can be mapped at
+different addresses by the driver and the user-mode library.
+
+A DOKAN_RING is the private view of one side. The geometry is captured in
+it once, by DokanRingInit or DokanRingAttach, and never read back from the
+shared memory: the other side may change the header at any time without
+making this side index outside of the ring. For the same reason the
+compare-exchange loops give up after DOKAN_RING_MAX_SPIN attempts, the ring
+then looks full or empty.
+
+Wakeups: a consumer that finds the ring empty registers in Waiters with
+DokanRingPrepareWait and checks the ring again before sleeping. A producer
+only has to signal the consumers when DokanRingCommit reports waiters, so
+there is at most one wakeup per empty to non-empty transition. Consumers
+pass it on with DokanRingWakeNext while slots are left.
+
+This file only depends on the compiler and can be used outside of Windows.
+
+*/
+
+#if defined(_MSC_VER)
+typedef LONG DOKAN_RING_LONG;
+typedef ULONG DOKAN_RING_ULONG;
+#define DokanRingCompareExchange(Target, Exchange, Comparand)                  \
+  InterlockedCompareExchange((Target), (Exchange), (Comparand))
+#define DokanRingMemoryBarrier() MemoryBarrier()
+#define DokanRingCopy(Destination, Source, Length)                             \
+  RtlCopyMemory((Destination), (Source), (Length))
+#else
+#include <stdint.h>
+typedef int32_t DOKAN_RING_LONG;
+typedef uint32_t DOKAN_RING_ULONG;
+#define DokanRingCompareExchange(Target, Exchange, Comparand)                  \
+  __sync_val_compare_and_swap((Target), (Comparand), (Exchange))
+#define DokanRingMemoryBarrier() __sync_synchronize()
+#define DokanRingCopy(Destination, Source, Length)                             \
+  __builtin_memcpy((Destination), (Source), (Length))
+#endif
+
+#define DOKAN_RING_MAGIC 0x474E5244 // 'DRNG'
+#define DOKAN_RING_CACHE_LINE 64
+#define DOKAN_RING_ALIGNMENT 8
+#define DOKAN_RING_ALIGN(len)                                                  \
+  (((len) + (DOKAN_RING_ALIGNMENT - 1)) & ~(DOKAN_RING_ALIGNMENT - 1))
+#define DOKAN_RING_MAX_SLOTS 0x10000
+#define DOKAN_RING_MAX_PAYLOAD 0x1000000
+// Failed compare-exchanges before an operation gives up
+#define DOKAN_RING_MAX_SPIN 4096
+
+// The owner of the ring no longer produces nor consumes
+#define DOKAN_RING_FLAG_CLOSED 1
+
+// Tail, Head and Waiters are on their own cache line so that producers and
+// consumers do not invalidate each other's line.
+typedef struct _DOKAN_RING_HEADER {
+  DOKAN_RING_ULONG Magic;
+  // Number of slots, power of two
+  DOKAN_RING_ULONG SlotCount;
+  // Bytes from one slot to the next, DOKAN_RING_SLOT included
+  DOKAN_RING_ULONG SlotSize;
+  // DOKAN_RING_FLAG_*
+  volatile DOKAN_RING_LONG Flags;
+  char Padding0[DOKAN_RING_CACHE_LINE - 4 * sizeof(DOKAN_RING_ULONG)];
+  // Next position to produce
+  volatile DOKAN_RING_LONG Tail;
+  char Padding1[DOKAN_RING_CACHE_LINE - sizeof(DOKAN_RING_LONG)];
+  // Next position to consume
+  volatile DOKAN_RING_LONG Head;
+  char Padding2[DOKAN_RING_CACHE_LINE - sizeof(DOKAN_RING_LONG)];
+  // Consumers about to sleep on an empty ring
+  volatile DOKAN_RING_LONG Waiters;
+  char Padding3[DOKAN_RING_CACHE_LINE - sizeof(DOKAN_RING_LONG)];
+} DOKAN_RING_HEADER, *PDOKAN_RING_HEADER;
+
+typedef struct _DOKAN_RING_SLOT {
+  volatile DOKAN_RING_LONG Sequence;
+  // Payload bytes in use
+  DOKAN_RING_ULONG Length;
+  // Producer defined, e.g. serial number of the event
+  DOKAN_RING_ULONG Tag;
+  DOKAN_RING_ULONG Reserved;
+  // payload follows
+} DOKAN_RING_SLOT, *PDOKAN_RING_SLOT;
+
+#define DOKAN_RING_SLOT_PAYLOAD(Slot) ((void *)((PDOKAN_RING_SLOT)(Slot) + 1))
+
+// View of a ring, see above
+typedef struct _DOKAN_RING {
+  PDOKAN_RING_HEADER Header;
+  DOKAN_RING_ULONG SlotCount;
+  DOKAN_RING_ULONG SlotSize;
+} DOKAN_RING, *PDOKAN_RING;
+
+// Difference between two positions, valid across wraparound
+static __inline DOKAN_RING_LONG DokanRingDistance(DOKAN_RING_LONG To,
+                                                  DOKAN_RING_LONG From) {
+  return (DOKAN_RING_LONG)((DOKAN_RING_ULONG)To - (DOKAN_RING_ULONG)From);
+}
+
+static __inline DOKAN_RING_LONG
+DokanRingAdd(DOKAN_RING_LONG Position, DOKAN_RING_ULONG Count) {
+  return (DOKAN_RING_LONG)((DOKAN_RING_ULONG)Position + Count);
+}
+
+static __inline DOKAN_RING_ULONG
+DokanRingSlotSize(DOKAN_RING_ULONG PayloadSize) {
+  return (DOKAN_RING_ULONG)DOKAN_RING_ALIGN(sizeof(DOKAN_RING_SLOT) +
+                                            PayloadSize);
+}
+
+static __inline DOKAN_RING_ULONG DokanRingPayloadSize(PDOKAN_RING Ring) {
+  return Ring->SlotSize - (DOKAN_RING_ULONG)sizeof(DOKAN_RING_SLOT);
+}
+
+// Bytes needed for a ring, 0 if the parameters are invalid or too large
+static __inline DOKAN_RING_ULONG DokanRingSize(DOKAN_RING_ULONG SlotCount,
+                                               DOKAN_RING_ULONG PayloadSize) {
+  DOKAN_RING_ULONG slotSize;
+
+  if (SlotCount < 2 || (SlotCount & (SlotCount - 1)) != 0 ||
+      SlotCount > DOKAN_RING_MAX_SLOTS || PayloadSize > DOKAN_RING_MAX_PAYLOAD) {
+    return 0;
+  }
+  slotSize = DokanRingSlotSize(PayloadSize);
+  if (slotSize > (0xFFFFFFFF - sizeof(DOKAN_RING_HEADER)) / SlotCount) {
+    return 0;
+  }
+  return (DOKAN_RING_ULONG)sizeof(DOKAN_RING_HEADER) + slotSize * SlotCount;
+}
+
+static __inline PDOKAN_RING_SLOT DokanRingSlot(PDOKAN_RING Ring,
+                                               DOKAN_RING_LONG Position) {
+  DOKAN_RING_ULONG index = (DOKAN_RING_ULONG)Position & (Ring->SlotCount - 1);
+  return (PDOKAN_RING_SLOT)((char *)(Ring->Header + 1) +
+                            index * Ring->SlotSize);
+}
+
+// Memory must be DokanRingSize(SlotCount, PayloadSize) bytes long and
+// aligned on DOKAN_RING_ALIGNMENT. Returns 0 on invalid parameters.
+static __inline int DokanRingInit(PDOKAN_RING Ring, void *Memory,
+                                  DOKAN_RING_ULONG SlotCount,
+                                  DOKAN_RING_ULONG PayloadSize) {
+  PDOKAN_RING_HEADER header = (PDOKAN_RING_HEADER)Memory;
+  DOKAN_RING_ULONG i;
+  char *p;
+
+  if (Memory == 0 || DokanRingSize(SlotCount, PayloadSize) == 0) {
+    return 0;
+  }
+  for (p = (char *)header; p < (char *)(header + 1); ++p) {
+    *p = 0;
+  }
+  header->Magic = DOKAN_RING_MAGIC;
+  header->SlotCount = SlotCount;
+  header->SlotSize = DokanRingSlotSize(PayloadSize);
+  Ring->Header = header;
+  Ring->SlotCount = SlotCount;
+  Ring->SlotSize = header->SlotSize;
+  for (i = 0; i < SlotCount; ++i) {
+    PDOKAN_RING_SLOT slot = DokanRingSlot(Ring, (DOKAN_RING_LONG)i);
+    slot->Sequence = (DOKAN_RING_LONG)i;
+    slot->Length = 0;
+    slot->Tag = 0;
+    slot->Reserved = 0;
+  }
+  DokanRingMemoryBarrier();
+  return 1;
+}
+
+// Use a ring initialized by the other side. Size is the size of the shared
+// memory. Returns 0 when the header does not describe a ring fitting in it.
+static __inline int DokanRingAttach(PDOKAN_RING Ring, void *Memory,
+                                    DOKAN_RING_ULONG Size) {
+  PDOKAN_RING_HEADER header = (PDOKAN_RING_HEADER)Memory;
+  DOKAN_RING_ULONG slotCount;
+  DOKAN_RING_ULONG slotSize;
+  DOKAN_RING_ULONG ringSize;
+
+  if (header == 0 || Size < sizeof(DOKAN_RING_HEADER) ||
+      header->Magic != DOKAN_RING_MAGIC) {
+    return 0;
+  }
+  // read once, the other side may still change the memory
+  slotCount = header->SlotCount;
+  slotSize = header->SlotSize;
+  if (slotSize < sizeof(DOKAN_RING_SLOT) ||
+      slotSize % DOKAN_RING_ALIGNMENT != 0) {
+    return 0;
+  }
+  ringSize = DokanRingSize(slotCount, slotSize - sizeof(DOKAN_RING_SLOT));
+  if (ringSize == 0 || ringSize > Size) {
+    return 0;
+  }
+  Ring->Header = header;
+  Ring->SlotCount = slotCount;
+  Ring->SlotSize = slotSize;
+  return 1;
+}
+
+// Reserve the next free slot. Returns NULL when the ring is full.
+// The slot must be published with DokanRingCommit.
+static __inline PDOKAN_RING_SLOT DokanRingReserve(PDOKAN_RING Ring,
+                                                  DOKAN_RING_LONG *Position) {
+  PDOKAN_RING_HEADER header = Ring->Header;
+  DOKAN_RING_LONG position = header->Tail;
+  DOKAN_RING_LONG distance;
+  PDOKAN_RING_SLOT slot;
+  DOKAN_RING_ULONG spin;
+
+  for (spin = 0; spin < DOKAN_RING_MAX_SPIN; ++spin) {
+    slot = DokanRingSlot(Ring, position);
+    distance = DokanRingDistance(slot->Sequence, position);
+    DokanRingMemoryBarrier();
+    if (distance == 0) {
+      DOKAN_RING_LONG previous = DokanRingCompareExchange(
+          &header->Tail, DokanRingAdd(position, 1), position);
+      if (previous == position) {
+        *Position = position;
+        return slot;
+      }
+      position = previous;
+    } else if (distance < 0) {
+      // still used by the previous lap
+      return 0;
+    } else {
+      position = header->Tail;
+    }
+  }
+  return 0;
+}
+
+// Publish a reserved slot. Returns non-zero when the ring was empty and
+// consumers may be sleeping: they must be woken up.
+static __inline int DokanRingCommit(PDOKAN_RING Ring, PDOKAN_RING_SLOT Slot,
+                                    DOKAN_RING_LONG Position) {
+  DokanRingMemoryBarrier();
+  Slot->Sequence = DokanRingAdd(Position, 1);
+  // order the publication before reading Waiters,
+  // pairs with the barrier of DokanRingPrepareWait
+  DokanRingMemoryBarrier();
+  // Slots before Position are still queued: their own commit or the
+  // consumer draining them takes care of the wakeup.
+  return Ring->Header->Waiters != 0 && Ring->Header->Head == Position;
+}
+
+// Take the next published slot. Returns NULL when the ring is empty.
+// The slot must be given back with DokanRingRelease.
+static __inline PDOKAN_RING_SLOT DokanRingAcquire(PDOKAN_RING Ring,
+                                                  DOKAN_RING_LONG *Position) {
+  PDOKAN_RING_HEADER header = Ring->Header;
+  DOKAN_RING_LONG position = header->Head;
+  DOKAN_RING_LONG distance;
+  PDOKAN_RING_SLOT slot;
+  DOKAN_RING_ULONG spin;
+
+  for (spin = 0; spin < DOKAN_RING_MAX_SPIN; ++spin) {
+    slot = DokanRingSlot(Ring, position);
+    distance = DokanRingDistance(slot->Sequence, DokanRingAdd(position, 1));
+    DokanRingMemoryBarrier();
+    if (distance == 0) {
+      DOKAN_RING_LONG previous = DokanRingCompareExchange(
+          &header->Head, DokanRingAdd(position, 1), position);
+      if (previous == position) {
+        *Position = position;
+        return slot;
+      }
+      position = previous;
+    } else if (distance < 0) {
+      // not produced yet
+      return 0;
+    } else {
+      position = header->Head;
+    }
+  }
+  return 0;
+}
+
+// Make an acquired slot available to producers again
+static __inline void DokanRingRelease(PDOKAN_RING Ring, PDOKAN_RING_SLOT Slot,
+                                      DOKAN_RING_LONG Position) {
+  DokanRingMemoryBarrier();
+  Slot->Sequence = DokanRingAdd(Position, Ring->SlotCount);
+}
+
+static __inline int DokanRingIsEmpty(PDOKAN_RING Ring) {
+  DOKAN_RING_LONG position = Ring->Header->Head;
+  PDOKAN_RING_SLOT slot = DokanRingSlot(Ring, position);
+  return DokanRingDistance(slot->Sequence, DokanRingAdd(position, 1)) < 0;
+}
+
+static __inline int DokanRingAddWaiters(PDOKAN_RING Ring,
+                                        DOKAN_RING_LONG Count) {
+  PDOKAN_RING_HEADER header = Ring->Header;
+  DOKAN_RING_LONG waiters;
+  DOKAN_RING_ULONG spin;
+
+  for (spin = 0; spin < DOKAN_RING_MAX_SPIN; ++spin) {
+    waiters = header->Waiters;
+    if (DokanRingCompareExchange(&header->Waiters, waiters + Count,
+                                 waiters) == waiters) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Register the caller as waiting consumer. Returns non-zero when the ring
+// is still empty: the caller sleeps, then calls DokanRingFinishWait.
+// Returns 0 when the caller must not sleep, it is not registered then.
+static __inline int DokanRingPrepareWait(PDOKAN_RING Ring) {
+  if (!DokanRingAddWaiters(Ring, 1)) {
+    return 0;
+  }
+  DokanRingMemoryBarrier();
+  if (DokanRingIsEmpty(Ring)) {
+    return 1;
+  }
+  DokanRingAddWaiters(Ring, -1);
+  return 0;
+}
+
+static __inline void DokanRingFinishWait(PDOKAN_RING Ring) {
+  DokanRingAddWaiters(Ring, -1);
+}
+
+// A consumer that took a slot passes the wakeup on when more slots are
+// queued and other consumers sleep, DokanRingCommit wakes only one.
+static __inline int DokanRingWakeNext(PDOKAN_RING Ring) {
+  return Ring->Header->Waiters > 0 && !DokanRingIsEmpty(Ring);
+}
+
+static __inline void DokanRingClose(PDOKAN_RING Ring) {
+  Ring->Header->Flags |= DOKAN_RING_FLAG_CLOSED;
+  DokanRingMemoryBarrier();
+}
+
+static __inline int DokanRingIsClosed(PDOKAN_RING Ring) {
+  return (Ring->Header->Flags & DOKAN_RING_FLAG_CLOSED) != 0;
+}
+
+// Copy helpers on top of Reserve/Commit and Acquire/Release.
+// DokanRingProduce returns 0 when the ring is full or Length too large.
+static __inline int DokanRingProduce(PDOKAN_RING Ring, const void *Payload,
+                                     DOKAN_RING_ULONG Length,
+                                     DOKAN_RING_ULONG Tag, int *Wake) {
+  DOKAN_RING_LONG position;
+  PDOKAN_RING_SLOT slot;
+
+  if (Length > DokanRingPayloadSize(Ring)) {
+    return 0;
+  }
+  slot = DokanRingReserve(Ring, &position);
+  if (slot == 0) {
+    return 0;
+  }
+  DokanRingCopy(DOKAN_RING_SLOT_PAYLOAD(slot), Payload, Length);
+  slot->Length = Length;
+  slot->Tag = Tag;
+  *Wake = DokanRingCommit(Ring, slot, position);
+  return 1;
+}
+
+// Returns 0 when the ring is empty. Payloads larger than BufferSize are
+// truncated, Length receives the copied length.
+static __inline int DokanRingConsume(PDOKAN_RING Ring, void *Buffer,
+                                     DOKAN_RING_ULONG BufferSize,
+                                     DOKAN_RING_ULONG *Length,
+                                     DOKAN_RING_ULONG *Tag) {
+  DOKAN_RING_LONG position;
+  PDOKAN_RING_SLOT slot;
+  DOKAN_RING_ULONG length;
+
+  slot = DokanRingAcquire(Ring, &position);
+  if (slot == 0) {
+    return 0;
+  }
+  // read once and bound, the producer may be the other side
+  length = slot->Length;
+  if (length > DokanRingPayloadSize(Ring)) {
+    length = DokanRingPayloadSize(Ring);
+  }
+  if (length > BufferSize) {
+    length = BufferSize;
+  }
+  DokanRingCopy(Buffer, DOKAN_RING_SLOT_PAYLOAD(slot), length);
+  *Length = length;
+  *Tag = slot->Tag;
+  DokanRingRelease(Ring, slot, position);
+  return 1;
+}
+
+#endif // RING_H_
@@ -105,7 +105,7 @@ DokanDispatchQuerySecurity(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
       // make a MDL for UserBuffer that can be used later on another thread
       // context
       if (Irp->MdlAddress == NULL) {
-        status = DokanAllocateMdl(Irp, bufferLength);
+        status = DokanAllocateMdl(Irp, bufferLength, IoWriteAccess);
         if (!NT_SUCCESS(status)) {
           DokanFreeEventContext(eventContext);
           __leave;
@@ -283,10 +283,10 @@ DokanDispatchSetSecurity(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
     eventLength =
         sizeof(EVENT_CONTEXT) + securityDescLength + fcb->FileName.Length + 3;
 
-    if (EVENT_CONTEXT_MAX_SIZE < eventLength) {
+    if (vcb->Dcb->MaxEventSize < eventLength) {
       // TODO: Handle this case like DispatchWrite.
       DDbgPrint("    SecurityDescriptor is too big: %d (limit %d)\n",
-                eventLength, EVENT_CONTEXT_MAX_SIZE);
+                eventLength, vcb->Dcb->MaxEventSize);
       status = STATUS_INSUFFICIENT_RESOURCES;
       __leave;
     }
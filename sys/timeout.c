@@ -295,6 +295,7 @@ Routine Description:
                   "Check Keep Alive yet.\n");
       } else {
         ReleaseTimeoutPendingIrp(Dcb);
+        DokanReleaseTimeoutMappedIrps(Dcb);
         DokanCheckKeepAlive(Dcb);
       }
       KeQuerySystemTime(&LastTime);
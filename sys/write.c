@@ -37,11 +37,13 @@ DokanDispatchWrite(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
   BOOLEAN isNonCached = FALSE;
   BOOLEAN isSynchronousIo = FALSE;
   BOOLEAN fcbLocked = FALSE;
+  ULONG64 userBuffer = 0;
 
   __try {
 
     DDbgPrint("==> DokanWrite\n");
 
+    Irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_MAPPING] = NULL;
     irpSp = IoGetCurrentIrpStackLocation(Irp);
     fileObject = irpSp->FileObject;
 
@@ -144,6 +146,15 @@ DokanDispatchWrite(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
     eventLength = sizeof(EVENT_CONTEXT) + irpSp->Parameters.Write.Length +
                   fcb->FileName.Length;
 
+    // too big to be sent with the event, try to let user-mode read it in
+    // place before falling back to IOCTL_EVENT_WRITE
+    if (eventLength > vcb->Dcb->MaxEventSize &&
+        DokanMapIrpBuffer(vcb->Dcb, Irp, irpSp->Parameters.Write.Length,
+                          IoReadAccess, &userBuffer)) {
+      DDbgPrint("  Write buffer mapped\n");
+      eventLength = sizeof(EVENT_CONTEXT) + fcb->FileName.Length;
+    }
+
     eventContext = AllocateEventContext(vcb->Dcb, Irp, eventLength, ccb);
 
     // no more memory!
@@ -204,9 +215,13 @@ DokanDispatchWrite(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
         fcb->FileName.Length + sizeof(WCHAR); // adds last null char
 
     // copies the content to write to EventContext
-    RtlCopyMemory((PCHAR)eventContext +
-                      eventContext->Operation.Write.BufferOffset,
-                  buffer, irpSp->Parameters.Write.Length);
+    if (userBuffer != 0) {
+      eventContext->Operation.Write.UserBuffer = userBuffer;
+    } else {
+      RtlCopyMemory((PCHAR)eventContext +
+                        eventContext->Operation.Write.BufferOffset,
+                    buffer, irpSp->Parameters.Write.Length);
+    }
 
     // copies file name
     eventContext->Operation.Write.FileNameLength = fcb->FileName.Length;
@@ -215,7 +230,7 @@ DokanDispatchWrite(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
 
     // When eventlength is less than event notification buffer,
     // returns it to user-mode using pending event.
-    if (eventLength <= EVENT_CONTEXT_MAX_SIZE) {
+    if (eventLength <= vcb->Dcb->MaxEventSize) {
 
       DDbgPrint("   Offset %d:%d, Length %d\n",
                 irpSp->Parameters.Write.ByteOffset.HighPart,
@@ -0,0 +1,229 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "../dokan/fileinfo.h"
+
+/*
+
+Reply arena of the workers
+
+Events are dispatched on a thread that has an arena, like DokanLoop sets
+one up, then on a thread without. Once the slots have grown to the
+largest reply, events up to DOKAN_ARENA_MAX_SIZE no longer call malloc.
+
+*/
+
+#define ARENA_TEST_NAME L"\\arena.bin"
+
+typedef struct _ARENA_OP {
+  const char *Name;
+  UCHAR MajorFunction;
+  ULONG BufferLength;
+} ARENA_OP;
+
+static const ARENA_OP g_ArenaOps[] = {
+    {"flush", IRP_MJ_FLUSH_BUFFERS, 0},
+    {"query 4KB", IRP_MJ_QUERY_INFORMATION, 4096},
+    {"read 64KB", IRP_MJ_READ, 64 * 1024},
+    {"read 1MB", IRP_MJ_READ, 1024 * 1024},
+    {"read 8MB", IRP_MJ_READ, 8 * 1024 * 1024},
+};
+
+static NTSTATUS DOKAN_CALLBACK ArenaTestRead(LPCWSTR FileName, LPVOID Buffer,
+                                             DWORD BufferLength,
+                                             LPDWORD ReadLength,
+                                             LONGLONG Offset,
+                                             PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileName);
+  UNREFERENCED_PARAMETER(Offset);
+  UNREFERENCED_PARAMETER(FileInfo);
+
+  // the reply is only as long as what was read
+  *(PUCHAR)Buffer = 1;
+  *ReadLength = BufferLength;
+  return STATUS_SUCCESS;
+}
+
+static NTSTATUS DOKAN_CALLBACK
+ArenaTestGetFileInformation(LPCWSTR FileName,
+                            LPBY_HANDLE_FILE_INFORMATION Buffer,
+                            PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileName);
+  UNREFERENCED_PARAMETER(FileInfo);
+
+  Buffer->dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+  return STATUS_SUCCESS;
+}
+
+static DOKAN_OPERATIONS g_ArenaOperations = {0};
+
+static DOKAN_OPTIONS g_ArenaOptions;
+
+static PDOKAN_INSTANCE ArenaTestMount(VOID) {
+  g_ArenaOperations.ReadFile = ArenaTestRead;
+  g_ArenaOperations.GetFileInformation = ArenaTestGetFileInformation;
+  ZeroMemory(&g_ArenaOptions, sizeof(DOKAN_OPTIONS));
+  return TestMount(&g_ArenaOperations, &g_ArenaOptions);
+}
+
+// Dispatch Op once, the event is reused by the caller
+static VOID ArenaTestDispatch(PDOKAN_INSTANCE Instance,
+                              PEVENT_CONTEXT EventContext) {
+  switch (EventContext->MajorFunction) {
+  case IRP_MJ_FLUSH_BUFFERS:
+    DispatchFlush(TestMountHandle(), EventContext, Instance);
+    break;
+  case IRP_MJ_QUERY_INFORMATION:
+    DispatchQueryInformation(TestMountHandle(), EventContext, Instance);
+    break;
+  case IRP_MJ_READ:
+    DispatchRead(TestMountHandle(), EventContext, Instance);
+    break;
+  }
+}
+
+static PEVENT_CONTEXT ArenaTestEvent(const ARENA_OP *Op,
+                                     PDOKAN_OPEN_INFO OpenInfo) {
+  PEVENT_CONTEXT eventContext =
+      TestNewEvent(Op->MajorFunction, OpenInfo, sizeof(ARENA_TEST_NAME));
+
+  if (eventContext == NULL) {
+    return NULL;
+  }
+  switch (Op->MajorFunction) {
+  case IRP_MJ_FLUSH_BUFFERS:
+    TestSetName(eventContext->Operation.Flush.FileName,
+                &eventContext->Operation.Flush.FileNameLength,
+                ARENA_TEST_NAME);
+    break;
+  case IRP_MJ_QUERY_INFORMATION:
+    eventContext->Operation.File.FileInformationClass = FileBasicInformation;
+    eventContext->Operation.File.BufferLength = Op->BufferLength;
+    TestSetName(eventContext->Operation.File.FileName,
+                &eventContext->Operation.File.FileNameLength,
+                ARENA_TEST_NAME);
+    break;
+  case IRP_MJ_READ:
+    eventContext->Operation.Read.BufferLength = Op->BufferLength;
+    TestSetName(eventContext->Operation.Read.FileName,
+                &eventContext->Operation.Read.FileNameLength,
+                ARENA_TEST_NAME);
+    break;
+  }
+  return eventContext;
+}
+
+VOID ArenaTest(VOID) {
+  const ULONG opCount = sizeof(g_ArenaOps) / sizeof(g_ArenaOps[0]);
+  PEVENT_CONTEXT events[sizeof(g_ArenaOps) / sizeof(g_ArenaOps[0])];
+  DOKAN_REPLY_ARENA arena;
+  PDOKAN_INSTANCE instance;
+  PDOKAN_OPEN_INFO openInfo;
+  ULONG64 mallocCount;
+  ULONG round;
+  ULONG i;
+
+  instance = ArenaTestMount();
+  openInfo = TestOpen(instance, FALSE);
+  for (i = 0; i < opCount; ++i) {
+    events[i] = ArenaTestEvent(&g_ArenaOps[i], openInfo);
+  }
+  DokanInitReplyArena(&arena);
+  DokanSetThreadArena(&arena);
+
+  // the reply slot grows with the first event of each larger size
+  for (i = 0; i < opCount; ++i) {
+    ArenaTestDispatch(instance, events[i]);
+    CHECK(TestLastReply(NULL)->Status == STATUS_SUCCESS);
+  }
+  CHECK(arena.RequestCount == opCount);
+  CHECK(arena.Slots[DOKAN_ARENA_REPLY].Size >= 1024 * 1024);
+  CHECK(arena.Slots[DOKAN_ARENA_REPLY].Size <= DOKAN_ARENA_MAX_SIZE);
+  CHECK(!arena.Slots[DOKAN_ARENA_REPLY].InUse);
+
+  // then only replies larger than DOKAN_ARENA_MAX_SIZE call malloc
+  mallocCount = arena.MallocCount;
+  for (round = 0; round < 10; ++round) {
+    for (i = 0; i < opCount; ++i) {
+      ArenaTestDispatch(instance, events[i]);
+    }
+  }
+  CHECK(arena.RequestCount == 11 * opCount);
+  CHECK(arena.MallocCount == mallocCount + 10);
+
+  DokanSetThreadArena(NULL);
+  DokanDeleteReplyArena(&arena);
+  for (i = 0; i < opCount; ++i) {
+    free(events[i]);
+  }
+  TestClose(instance, openInfo);
+  TestUnmount(instance);
+  TestFreeThreadReply();
+}
+
+VOID ArenaBench(VOID) {
+  const ULONG byteBudget = 256 * 1024 * 1024;
+  DOKAN_REPLY_ARENA arena;
+  PDOKAN_INSTANCE instance;
+  PDOKAN_OPEN_INFO openInfo;
+  PEVENT_CONTEXT eventContext;
+  LARGE_INTEGER start;
+  double arenaSeconds;
+  double mallocSeconds;
+  ULONG count;
+  ULONG i, j;
+
+  instance = ArenaTestMount();
+  openInfo = TestOpen(instance, FALSE);
+  printf("%-16s %14s %14s %14s %14s\n", "op", "allocs/op", "malloc/op",
+         "arena ns/op", "malloc ns/op");
+  for (i = 0; i < sizeof(g_ArenaOps) / sizeof(g_ArenaOps[0]); ++i) {
+    eventContext = ArenaTestEvent(&g_ArenaOps[i], openInfo);
+    count = min(1000000, byteBudget / (g_ArenaOps[i].BufferLength + 4096));
+
+    DokanInitReplyArena(&arena);
+    DokanSetThreadArena(&arena);
+    QueryPerformanceCounter(&start);
+    for (j = 0; j < count; ++j) {
+      ArenaTestDispatch(instance, eventContext);
+    }
+    arenaSeconds = TestElapsed(start);
+    DokanSetThreadArena(NULL);
+
+    // what every event did before the arena
+    QueryPerformanceCounter(&start);
+    for (j = 0; j < count; ++j) {
+      ArenaTestDispatch(instance, eventContext);
+    }
+    mallocSeconds = TestElapsed(start);
+
+    printf("%-16s %14.3f %14.5f %14.1f %14.1f\n", g_ArenaOps[i].Name,
+           (double)arena.RequestCount / count,
+           (double)arena.MallocCount / count, arenaSeconds * 1e9 / count,
+           mallocSeconds * 1e9 / count);
+    DokanDeleteReplyArena(&arena);
+    free(eventContext);
+  }
+  TestClose(instance, openInfo);
+  TestUnmount(instance);
+  TestFreeThreadReply();
+}
@@ -0,0 +1,176 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+// Frame lengths cycled through by the tests, including odd ones
+static const ULONG g_FrameLengths[] = {
+    sizeof(EVENT_CONTEXT), sizeof(EVENT_CONTEXT) + 1,
+    sizeof(EVENT_CONTEXT) + 7, sizeof(EVENT_CONTEXT) + 522, sizeof(ULONG),
+    sizeof(EVENT_CONTEXT) + 4096};
+
+#define FRAME_LENGTH_COUNT (sizeof(g_FrameLengths) / sizeof(g_FrameLengths[0]))
+
+static CHAR g_Batch[EVENT_CONTEXT_MAX_SIZE];
+
+// Pack frames until the buffer is full, each frame starts with its Length
+// and is filled with its index. Returns the number of frames packed.
+static ULONG BatchPack(PEVENT_BATCH Batch, ULONG BatchSize, ULONG MaxCount) {
+  PEVENT_CONTEXT frame;
+  ULONG length;
+  ULONG count = 0;
+
+  EventBatchInit(Batch);
+  while (count < MaxCount) {
+    length = g_FrameLengths[count % FRAME_LENGTH_COUNT];
+    frame = EventBatchAppend(Batch, BatchSize, length);
+    if (frame == NULL) {
+      break;
+    }
+    CHECK(((ULONG_PTR)frame - (ULONG_PTR)Batch) % EVENT_BATCH_ALIGNMENT == 0);
+    FillMemory(frame, length, (BYTE)count);
+    frame->Length = length;
+    count++;
+  }
+  CHECK(Batch->Count == count);
+  CHECK(Batch->Length <= BatchSize);
+  return count;
+}
+
+// Walk the frames and check they come back in order, intact
+static ULONG BatchUnpack(PEVENT_BATCH Batch, ULONG ReturnedLength) {
+  PEVENT_CONTEXT frame;
+  ULONG offset = 0;
+  ULONG count = 0;
+  ULONG i;
+
+  while ((frame = EventBatchNext(Batch, ReturnedLength, &offset)) != NULL) {
+    PUCHAR data = (PUCHAR)frame;
+
+    CHECK(frame->Length == g_FrameLengths[count % FRAME_LENGTH_COUNT]);
+    for (i = sizeof(ULONG); i < frame->Length; ++i) {
+      if (data[i] != (UCHAR)count) {
+        CHECK(data[i] == (UCHAR)count);
+        break;
+      }
+    }
+    count++;
+  }
+  return count;
+}
+
+static VOID BatchTestRoundTrip(VOID) {
+  PEVENT_BATCH batch = (PEVENT_BATCH)g_Batch;
+  ULONG count;
+  ULONG size;
+
+  // every buffer size, from too small for the header to the full buffer
+  for (size = 0; size <= 3 * sizeof(EVENT_CONTEXT) + 64; ++size) {
+    count = BatchPack(batch, size < EVENT_BATCH_HEADER_SIZE
+                                 ? EVENT_BATCH_HEADER_SIZE
+                                 : size,
+                      MAXULONG);
+    CHECK(BatchUnpack(batch, batch->Length) == count);
+  }
+
+  count = BatchPack(batch, sizeof(g_Batch), MAXULONG);
+  CHECK(count > FRAME_LENGTH_COUNT);
+  CHECK(BatchUnpack(batch, batch->Length) == count);
+  // the driver may report more bytes than the batch uses
+  CHECK(BatchUnpack(batch, sizeof(g_Batch)) == count);
+
+  // a full buffer refuses any frame
+  CHECK(EventBatchAppend(batch, batch->Length, sizeof(ULONG)) == NULL);
+
+  count = BatchPack(batch, sizeof(g_Batch), 3);
+  CHECK(count == 3);
+  CHECK(BatchUnpack(batch, batch->Length) == 3);
+}
+
+static VOID BatchTestMalformed(VOID) {
+  PEVENT_BATCH batch = (PEVENT_BATCH)g_Batch;
+  PEVENT_CONTEXT frame;
+  ULONG offset;
+  ULONG length;
+
+  // frames shorter than their Length field are refused by Append
+  EventBatchInit(batch);
+  CHECK(EventBatchAppend(batch, sizeof(g_Batch), 0) == NULL);
+  CHECK(EventBatchAppend(batch, sizeof(g_Batch), sizeof(ULONG) - 1) == NULL);
+  CHECK(batch->Count == 0);
+
+  // nothing is read out of a truncated header
+  BatchPack(batch, sizeof(g_Batch), 4);
+  offset = 0;
+  CHECK(EventBatchNext(batch, EVENT_BATCH_HEADER_SIZE - 1, &offset) == NULL);
+
+  // a short read stops at the last complete frame
+  length = batch->Length;
+  CHECK(BatchUnpack(batch, length - EVENT_BATCH_ALIGNMENT) == 3);
+
+  // a frame claiming more than the batch holds ends the walk
+  frame = (PEVENT_CONTEXT)(g_Batch + EVENT_BATCH_HEADER_SIZE);
+  frame->Length = length;
+  offset = 0;
+  CHECK(EventBatchNext(batch, length, &offset) == NULL);
+
+  // as does a frame shorter than its Length field
+  frame->Length = sizeof(ULONG) - 1;
+  offset = 0;
+  CHECK(EventBatchNext(batch, length, &offset) == NULL);
+
+  // an empty batch has no frame
+  EventBatchInit(batch);
+  offset = 0;
+  CHECK(EventBatchNext(batch, batch->Length, &offset) == NULL);
+}
+
+VOID BatchTest(VOID) {
+  BatchTestRoundTrip();
+  BatchTestMalformed();
+}
+
+VOID BatchBench(VOID) {
+  PEVENT_BATCH batch = (PEVENT_BATCH)g_Batch;
+  const ULONG rounds = 200000;
+  LARGE_INTEGER start;
+  ULONG64 frames = 0;
+  double seconds;
+  ULONG i;
+
+  QueryPerformanceCounter(&start);
+  for (i = 0; i < rounds; ++i) {
+    PEVENT_CONTEXT frame;
+    ULONG offset = 0;
+
+    EventBatchInit(batch);
+    while ((frame = EventBatchAppend(batch, sizeof(g_Batch),
+                                     sizeof(EVENT_CONTEXT))) != NULL) {
+      frame->Length = sizeof(EVENT_CONTEXT);
+    }
+    while (EventBatchNext(batch, batch->Length, &offset) != NULL) {
+      frames++;
+    }
+  }
+  seconds = TestElapsed(start);
+  printf("%llu frames packed and walked, %.1f ns/frame\n", frames,
+         seconds * 1e9 / frames);
+}
@@ -0,0 +1,393 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+Device channel over a loopback transport
+
+The loopback stands in for the driver: it queues EventCount events, hands
+them out by batches of up to MaxBatch events and records the replies.
+Once every event has been handed out, waits fail with
+ERROR_OPERATION_ABORTED like they do when the driver releases them at
+unmount. Every call the channel makes on the transport is counted, which
+gives the number of user / kernel transitions per event of each mode.
+
+*/
+
+#define LOOPBACK_DEVICE_NAME L"\\\\.\\DokanLoopback"
+
+typedef struct _LOOPBACK {
+  ULONG EventCount;
+  ULONG MaxBatch;
+  ULONG NextEvent;
+  // reply received for each serial number - 1
+  PUCHAR Replied;
+  // replies for events that were already completed
+  ULONG Ignored;
+  // value of the handle currently open, bumped to break the channel
+  ULONG_PTR Generation;
+  ULONG64 Opens;
+  ULONG64 Closes;
+  ULONG64 Waits;
+  ULONG64 ReplyWaits;
+  ULONG64 Replies;
+  ULONG64 Controls;
+} LOOPBACK;
+
+static LOOPBACK g_Loopback;
+
+static CHAR g_Buffer[EVENT_CONTEXT_MAX_SIZE];
+
+static HANDLE LoopbackOpen(LPCWSTR RawDeviceName, DWORD FlagsAndAttributes) {
+  UNREFERENCED_PARAMETER(FlagsAndAttributes);
+
+  if (wcscmp(RawDeviceName, LOOPBACK_DEVICE_NAME) != 0) {
+    SetLastError(ERROR_FILE_NOT_FOUND);
+    return INVALID_HANDLE_VALUE;
+  }
+  g_Loopback.Opens++;
+  return (HANDLE)++g_Loopback.Generation;
+}
+
+static VOID LoopbackClose(HANDLE Device) {
+  UNREFERENCED_PARAMETER(Device);
+  g_Loopback.Closes++;
+}
+
+// Returns FALSE, like the driver does with STATUS_NOT_FOUND, for a reply
+// whose event is not pending anymore
+static BOOL LoopbackComplete(PEVENT_INFORMATION EventInfo, ULONG Length) {
+  ULONG serial;
+
+  CHECK(Length >= sizeof(EVENT_INFORMATION));
+  serial = EventInfo->SerialNumber;
+  CHECK(serial >= 1 && serial <= g_Loopback.NextEvent);
+  if (serial < 1 || serial > g_Loopback.NextEvent ||
+      g_Loopback.Replied[serial - 1]) {
+    g_Loopback.Ignored++;
+    return FALSE;
+  }
+  g_Loopback.Replied[serial - 1] = 1;
+  return TRUE;
+}
+
+static BOOL LoopbackDeliver(PVOID OutputBuffer, ULONG OutputLength,
+                            PULONG ReturnedLength) {
+  PEVENT_BATCH batch = (PEVENT_BATCH)OutputBuffer;
+  PEVENT_CONTEXT context;
+
+  if (g_Loopback.NextEvent == g_Loopback.EventCount) {
+    SetLastError(ERROR_OPERATION_ABORTED);
+    return FALSE;
+  }
+
+  EventBatchInit(batch);
+  while (batch->Count < g_Loopback.MaxBatch &&
+         g_Loopback.NextEvent < g_Loopback.EventCount) {
+    context = EventBatchAppend(batch, OutputLength, sizeof(EVENT_CONTEXT));
+    if (context == NULL) {
+      break;
+    }
+    ZeroMemory(context, sizeof(EVENT_CONTEXT));
+    context->Length = sizeof(EVENT_CONTEXT);
+    context->SerialNumber = ++g_Loopback.NextEvent;
+    context->MajorFunction = IRP_MJ_FLUSH_BUFFERS;
+  }
+  if (g_Loopback.NextEvent < g_Loopback.EventCount) {
+    batch->Flags |= EVENT_BATCH_FLAG_BACKLOG;
+  }
+  *ReturnedLength = batch->Length;
+  return TRUE;
+}
+
+static BOOL LoopbackIoControl(HANDLE Device, DWORD IoControlCode,
+                              PVOID InputBuffer, ULONG InputLength,
+                              PVOID OutputBuffer, ULONG OutputLength,
+                              PULONG ReturnedLength) {
+  *ReturnedLength = 0;
+  if (Device != (HANDLE)g_Loopback.Generation) {
+    SetLastError(ERROR_INVALID_HANDLE);
+    return FALSE;
+  }
+
+  switch (IoControlCode) {
+  case IOCTL_EVENT_WAIT_BATCH:
+    g_Loopback.Waits++;
+    return LoopbackDeliver(OutputBuffer, OutputLength, ReturnedLength);
+  case IOCTL_EVENT_INFO_WAIT:
+    // an unknown reply does not fail the wait
+    g_Loopback.ReplyWaits++;
+    LoopbackComplete((PEVENT_INFORMATION)InputBuffer, InputLength);
+    return LoopbackDeliver(OutputBuffer, OutputLength, ReturnedLength);
+  case IOCTL_EVENT_INFO:
+    g_Loopback.Replies++;
+    if (!LoopbackComplete((PEVENT_INFORMATION)InputBuffer, InputLength)) {
+      SetLastError(ERROR_NOT_FOUND);
+      return FALSE;
+    }
+    return TRUE;
+  default:
+    g_Loopback.Controls++;
+    return TRUE;
+  }
+}
+
+static const DOKAN_CHANNEL_TRANSPORT g_LoopbackTransport = {
+    LoopbackOpen, LoopbackIoControl, LoopbackClose};
+
+static VOID LoopbackDispatch(HANDLE Handle, PEVENT_CONTEXT EventContext,
+                             PDOKAN_INSTANCE DokanInstance) {
+  EVENT_INFORMATION eventInfo;
+
+  UNREFERENCED_PARAMETER(DokanInstance);
+
+  ZeroMemory(&eventInfo, sizeof(EVENT_INFORMATION));
+  eventInfo.SerialNumber = EventContext->SerialNumber;
+  DokanChannelSendReply(Handle, &eventInfo, sizeof(EVENT_INFORMATION));
+}
+
+static VOID LoopbackReset(ULONG EventCount, ULONG MaxBatch) {
+  free(g_Loopback.Replied);
+  ZeroMemory(&g_Loopback, sizeof(LOOPBACK));
+  g_Loopback.EventCount = EventCount;
+  g_Loopback.MaxBatch = MaxBatch;
+  g_Loopback.Generation = 0x100;
+  g_Loopback.Replied = (PUCHAR)calloc(EventCount + 1, 1);
+}
+
+static ULONG64 LoopbackDeviceCalls(VOID) {
+  return g_Loopback.Opens + g_Loopback.Closes + g_Loopback.Waits +
+         g_Loopback.ReplyWaits + g_Loopback.Replies + g_Loopback.Controls;
+}
+
+static BOOL LoopbackAllReplied(VOID) {
+  ULONG i;
+
+  for (i = 0; i < g_Loopback.EventCount; ++i) {
+    if (!g_Loopback.Replied[i]) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// Wait / dispatch cycle of DokanLoop, minus the worker pool
+static DWORD LoopbackServe(PDOKAN_DEVICE_CHANNEL Channel, BOOL OpenPerWait) {
+  ULONG returnedLength;
+  DWORD lastError;
+  BOOL status;
+
+  DokanSetThreadChannel(Channel);
+  do {
+    if (OpenPerWait) {
+      // what every wait cost before the channel was kept open
+      DokanCloseDeviceChannel(Channel);
+      DokanOpenNamedDeviceChannel(Channel, LOOPBACK_DEVICE_NAME);
+    }
+    status = DokanChannelWaitEvents(Channel, g_Buffer, sizeof(g_Buffer),
+                                    &returnedLength);
+    if (status) {
+      DokanChannelDispatchBatch(Channel, (PEVENT_BATCH)g_Buffer,
+                                returnedLength, LoopbackDispatch, NULL);
+    }
+  } while (status);
+  lastError = GetLastError();
+
+  DokanSetThreadChannel(NULL);
+  if (Channel->DeferredReplyLength > 0) {
+    DokanChannelSendReply(Channel->Device, Channel->DeferredReply,
+                          Channel->DeferredReplyLength);
+  }
+  return lastError;
+}
+
+typedef struct _LOOPBACK_MODE {
+  const char *Name;
+  ULONG MaxBatch;
+  BOOL DeferReply;
+  BOOL OpenPerWait;
+} LOOPBACK_MODE;
+
+static const LOOPBACK_MODE g_Modes[] = {
+    {"open per event", 1, FALSE, TRUE}, {"persistent", 1, FALSE, FALSE},
+    {"reply+wait", 1, TRUE, FALSE},     {"batch 8", 8, TRUE, FALSE},
+    {"batch 64", 64, TRUE, FALSE},
+};
+
+static DWORD LoopbackRunMode(const LOOPBACK_MODE *Mode, ULONG EventCount) {
+  DOKAN_DEVICE_CHANNEL channel;
+  DWORD lastError;
+
+  LoopbackReset(EventCount, Mode->MaxBatch);
+  DokanInitDeviceChannel(&channel);
+  if (Mode->DeferReply) {
+    channel.DeferredReply =
+        (PEVENT_INFORMATION)malloc(DOKAN_DEFERRED_REPLY_MAX_SIZE);
+  }
+  if (!DokanOpenNamedDeviceChannel(&channel, LOOPBACK_DEVICE_NAME)) {
+    free(channel.DeferredReply);
+    return GetLastError();
+  }
+  lastError = LoopbackServe(&channel, Mode->OpenPerWait);
+  DokanCloseDeviceChannel(&channel);
+  free(channel.DeferredReply);
+  return lastError;
+}
+
+static VOID ChannelTestModes(VOID) {
+  const ULONG eventCount = 1000;
+  ULONG i;
+
+  for (i = 0; i < sizeof(g_Modes) / sizeof(g_Modes[0]); ++i) {
+    const LOOPBACK_MODE *mode = &g_Modes[i];
+    ULONG batches = (eventCount + mode->MaxBatch - 1) / mode->MaxBatch;
+
+    CHECK(LoopbackRunMode(mode, eventCount) == ERROR_OPERATION_ABORTED);
+    CHECK(LoopbackAllReplied());
+    CHECK(g_Loopback.Opens == (mode->OpenPerWait ? batches + 2 : 1));
+    CHECK(g_Loopback.Closes == g_Loopback.Opens);
+    if (mode->DeferReply) {
+      // one plain wait to start, then each wait carries the last reply of
+      // the previous batch. That of the last batch is sent again after the
+      // final wait failed, and refused as its event is not pending anymore.
+      CHECK(g_Loopback.Waits == 1);
+      CHECK(g_Loopback.ReplyWaits == batches);
+      CHECK(g_Loopback.Replies == eventCount - batches + 1);
+      CHECK(g_Loopback.Ignored == 1);
+    } else {
+      CHECK(g_Loopback.Waits == batches + 1);
+      CHECK(g_Loopback.ReplyWaits == 0);
+      CHECK(g_Loopback.Replies == eventCount);
+      CHECK(g_Loopback.Ignored == 0);
+    }
+  }
+}
+
+static VOID ChannelTestReconnect(VOID) {
+  DOKAN_DEVICE_CHANNEL channel;
+  ULONG returnedLength;
+  ULONG i;
+
+  CHECK(DokanIsChannelBroken(ERROR_INVALID_HANDLE));
+  CHECK(!DokanIsChannelBroken(ERROR_OPERATION_ABORTED));
+  CHECK(!DokanIsChannelBroken(ERROR_NO_SYSTEM_RESOURCES));
+
+  LoopbackReset(4, 4);
+  DokanInitDeviceChannel(&channel);
+  channel.DeferredReply =
+      (PEVENT_INFORMATION)malloc(DOKAN_DEFERRED_REPLY_MAX_SIZE);
+  CHECK(DokanOpenNamedDeviceChannel(&channel, LOOPBACK_DEVICE_NAME));
+  DokanSetThreadChannel(&channel);
+
+  CHECK(DokanChannelWaitEvents(&channel, g_Buffer, sizeof(g_Buffer),
+                               &returnedLength));
+  DokanChannelDispatchBatch(&channel, (PEVENT_BATCH)g_Buffer, returnedLength,
+                            LoopbackDispatch, NULL);
+  CHECK(g_Loopback.Replies == 3);
+  CHECK(channel.DeferredReplyLength == sizeof(EVENT_INFORMATION));
+
+  // the handle goes stale: the deferred reply is kept for the next channel
+  g_Loopback.Generation++;
+  CHECK(!DokanChannelWaitEvents(&channel, g_Buffer, sizeof(g_Buffer),
+                                &returnedLength));
+  CHECK(GetLastError() == ERROR_INVALID_HANDLE);
+  CHECK(channel.DeferredReplyLength == sizeof(EVENT_INFORMATION));
+  CHECK(DokanReconnectDeviceChannel(&channel));
+  CHECK(channel.ReconnectCount == 1);
+
+  // the reply goes with the next wait, which ends like an unmount
+  CHECK(!DokanChannelWaitEvents(&channel, g_Buffer, sizeof(g_Buffer),
+                                &returnedLength));
+  CHECK(GetLastError() == ERROR_OPERATION_ABORTED);
+  CHECK(g_Loopback.ReplyWaits == 1);
+  CHECK(LoopbackAllReplied());
+
+  // a reply nobody waits for anymore is reported
+  CHECK(!DokanChannelSendReply(channel.Device, channel.DeferredReply,
+                               channel.DeferredReplyLength));
+  CHECK(GetLastError() == ERROR_NOT_FOUND);
+
+  // reconnects stop after DOKAN_CHANNEL_MAX_RECONNECT failed waits in a row
+  channel.ReconnectAttempts = 0;
+  for (i = 0; i < DOKAN_CHANNEL_MAX_RECONNECT; ++i) {
+    g_Loopback.Generation++;
+    CHECK(!DokanChannelWaitEvents(&channel, g_Buffer, sizeof(g_Buffer),
+                                  &returnedLength));
+    CHECK(DokanReconnectDeviceChannel(&channel));
+  }
+  CHECK(!DokanReconnectDeviceChannel(&channel));
+  CHECK(channel.Device == INVALID_HANDLE_VALUE);
+
+  DokanSetThreadChannel(NULL);
+  free(channel.DeferredReply);
+}
+
+static VOID ChannelTestIoControl(VOID) {
+  DOKAN_DEVICE_CHANNEL channel;
+  ULONG returnedLength;
+
+  LoopbackReset(0, 1);
+  DokanInitDeviceChannel(&channel);
+  wcscpy_s(channel.RawDeviceName,
+           sizeof(channel.RawDeviceName) / sizeof(WCHAR),
+           LOOPBACK_DEVICE_NAME);
+
+  // control requests open the channel once and keep it
+  CHECK(DokanChannelIoControl(&channel, IOCTL_KEEPALIVE, NULL, 0, NULL, 0,
+                              &returnedLength));
+  CHECK(DokanChannelIoControl(&channel, IOCTL_KEEPALIVE, NULL, 0, NULL, 0,
+                              &returnedLength));
+  CHECK(g_Loopback.Opens == 1);
+  CHECK(g_Loopback.Controls == 2);
+  DokanCloseDeviceChannel(&channel);
+  CHECK(g_Loopback.Closes == 1);
+}
+
+VOID ChannelTest(VOID) {
+  DokanSetChannelTransport(&g_LoopbackTransport);
+  ChannelTestModes();
+  ChannelTestReconnect();
+  ChannelTestIoControl();
+  DokanSetChannelTransport(NULL);
+}
+
+VOID ChannelBench(VOID) {
+  const ULONG eventCount = 1000000;
+  LARGE_INTEGER start;
+  double seconds;
+  ULONG i;
+
+  DokanSetChannelTransport(&g_LoopbackTransport);
+  printf("%-16s %14s %14s %14s\n", "mode", "calls/event", "ns/event",
+         "events/s");
+  for (i = 0; i < sizeof(g_Modes) / sizeof(g_Modes[0]); ++i) {
+    QueryPerformanceCounter(&start);
+    LoopbackRunMode(&g_Modes[i], eventCount);
+    seconds = TestElapsed(start);
+    CHECK(LoopbackAllReplied());
+    printf("%-16s %14.3f %14.1f %14.0f\n", g_Modes[i].Name,
+           (double)LoopbackDeviceCalls() / eventCount,
+           seconds * 1e9 / eventCount, eventCount / seconds);
+  }
+  DokanSetChannelTransport(NULL);
+}
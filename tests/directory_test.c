@@ -0,0 +1,299 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "../dokan/fileinfo.h"
+
+/*
+
+Directory listings served page by page
+
+A synthetic directory of EntryCount files is listed through
+DispatchDirectoryInformation the way the driver does it: every query
+starts at the index the previous reply ended at. The listing is made
+once, each page then costs the entries it returns whatever its position,
+so the time per entry stays flat from 10k to 1M entries.
+
+With FindFilesResumable the directory is read as the pages are queried:
+the first page comes after the entries it holds instead of after the
+whole directory, which the benchmark compares with FindFiles.
+
+*/
+
+#define DIR_TEST_NAME L"\\dir"
+#define DIR_TEST_NAME_DIGITS 7
+
+typedef struct _DIR_TEST {
+  PDOKAN_INSTANCE Instance;
+  PDOKAN_OPEN_INFO OpenInfo;
+  ULONG EntryCount;
+  ULONG FindFilesCalls;
+  // entries given to FillFindData so far
+  ULONG Filled;
+} DIR_TEST;
+
+static DIR_TEST g_DirTest;
+
+static DOKAN_OPERATIONS g_DirOperations = {0};
+
+static DOKAN_OPTIONS g_DirOptions;
+
+// "file" followed by Index on DIR_TEST_NAME_DIGITS digits
+static VOID DirTestEntryName(PWCHAR Name, ULONG Index) {
+  ULONG i;
+
+  wcscpy_s(Name, MAX_PATH, L"file");
+  for (i = DIR_TEST_NAME_DIGITS; i > 0; --i) {
+    Name[4 + i - 1] = (WCHAR)(L'0' + Index % 10);
+    Index /= 10;
+  }
+  Name[4 + DIR_TEST_NAME_DIGITS] = L'\0';
+}
+
+static NTSTATUS DOKAN_CALLBACK DirTestFindFiles(LPCWSTR FileName,
+                                                PFillFindData FillFindData,
+                                                PDOKAN_FILE_INFO FileInfo) {
+  WIN32_FIND_DATAW findData;
+  ULONG i;
+
+  UNREFERENCED_PARAMETER(FileName);
+
+  g_DirTest.FindFilesCalls++;
+  ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
+  findData.dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+  for (i = 0; i < g_DirTest.EntryCount; ++i) {
+    DirTestEntryName(findData.cFileName, i);
+    findData.nFileSizeLow = i;
+    FillFindData(&findData, FileInfo);
+  }
+  g_DirTest.Filled += g_DirTest.EntryCount;
+  return STATUS_SUCCESS;
+}
+
+// the cookie is the index of the next entry
+static NTSTATUS DOKAN_CALLBACK DirTestFindFilesResumable(
+    LPCWSTR PathName, LPCWSTR SearchPattern, PFillFindData FillFindData,
+    PULONG64 ResumeCookie, PDOKAN_FILE_INFO FileInfo) {
+  WIN32_FIND_DATAW findData;
+  ULONG i;
+
+  UNREFERENCED_PARAMETER(PathName);
+  UNREFERENCED_PARAMETER(SearchPattern);
+
+  g_DirTest.FindFilesCalls++;
+  ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
+  findData.dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+  for (i = (ULONG)*ResumeCookie; i < g_DirTest.EntryCount; ++i) {
+    DirTestEntryName(findData.cFileName, i);
+    findData.nFileSizeLow = i;
+    g_DirTest.Filled++;
+    if (FillFindData(&findData, FileInfo)) {
+      *ResumeCookie = i + 1;
+      return STATUS_SUCCESS;
+    }
+  }
+  *ResumeCookie = 0;
+  return STATUS_SUCCESS;
+}
+
+static VOID DirTestMount(ULONG EntryCount, BOOL Resumable) {
+  ZeroMemory(&g_DirTest, sizeof(DIR_TEST));
+  ZeroMemory(&g_DirOptions, sizeof(DOKAN_OPTIONS));
+  g_DirOperations.FindFiles = Resumable ? NULL : DirTestFindFiles;
+  g_DirOperations.FindFilesResumable =
+      Resumable ? DirTestFindFilesResumable : NULL;
+
+  g_DirTest.EntryCount = EntryCount;
+  g_DirTest.Instance = TestMount(&g_DirOperations, &g_DirOptions);
+  g_DirTest.OpenInfo = TestOpen(g_DirTest.Instance, TRUE);
+}
+
+static VOID DirTestUnmount(VOID) {
+  TestClose(g_DirTest.Instance, g_DirTest.OpenInfo);
+  TestUnmount(g_DirTest.Instance);
+  TestFreeThreadReply();
+}
+
+// Query the page of BufferLength bytes that starts at FileIndex. Returns
+// the status of the reply, Index receives where the next page starts.
+static NTSTATUS DirTestQuery(ULONG FileIndex, ULONG BufferLength,
+                             PULONG Index) {
+  PEVENT_CONTEXT eventContext =
+      TestNewEvent(IRP_MJ_DIRECTORY_CONTROL, g_DirTest.OpenInfo,
+                   sizeof(DIR_TEST_NAME));
+  PEVENT_INFORMATION reply;
+  NTSTATUS status;
+
+  if (eventContext == NULL) {
+    return STATUS_NO_MEMORY;
+  }
+  eventContext->Operation.Directory.FileInformationClass =
+      FileIdBothDirectoryInformation;
+  eventContext->Operation.Directory.FileIndex = FileIndex;
+  eventContext->Operation.Directory.BufferLength = BufferLength;
+  TestSetName(eventContext->Operation.Directory.DirectoryName,
+              &eventContext->Operation.Directory.DirectoryNameLength,
+              DIR_TEST_NAME);
+
+  DispatchDirectoryInformation(TestMountHandle(), eventContext,
+                               g_DirTest.Instance);
+
+  reply = TestLastReply(NULL);
+  status = reply != NULL ? reply->Status : STATUS_UNSUCCESSFUL;
+  if (reply != NULL) {
+    *Index = reply->Operation.Directory.Index;
+  }
+  free(eventContext);
+  return status;
+}
+
+// List the whole directory by pages of BufferLength bytes, returns the
+// number of entries, Pages receives the number of queries that returned
+// some. With Check, every entry must come once and in order.
+static ULONG DirTestList(ULONG BufferLength, BOOL Check, PULONG Pages) {
+  WCHAR expected[MAX_PATH];
+  ULONG fileIndex = 0;
+  ULONG entries = 0;
+  ULONG index;
+  NTSTATUS status;
+
+  *Pages = 0;
+  while ((status = DirTestQuery(fileIndex, BufferLength, &index)) ==
+         STATUS_SUCCESS) {
+    PEVENT_INFORMATION reply = TestLastReply(NULL);
+    PFILE_ID_BOTH_DIR_INFORMATION record =
+        (PFILE_ID_BOTH_DIR_INFORMATION)reply->Buffer;
+
+    (*Pages)++;
+    for (;;) {
+      entries++;
+      if (Check) {
+        // "." and ".." come first
+        if (entries == 1) {
+          wcscpy_s(expected, MAX_PATH, L".");
+        } else if (entries == 2) {
+          wcscpy_s(expected, MAX_PATH, L"..");
+        } else {
+          DirTestEntryName(expected, entries - 3);
+        }
+        CHECK(record->FileIndex == entries);
+        CHECK(record->FileNameLength == wcslen(expected) * sizeof(WCHAR));
+        CHECK(memcmp(record->FileName, expected, record->FileNameLength) ==
+              0);
+      }
+      if (record->NextEntryOffset == 0) {
+        break;
+      }
+      record = (PFILE_ID_BOTH_DIR_INFORMATION)((PCHAR)record +
+                                               record->NextEntryOffset);
+    }
+    CHECK(index == entries);
+    fileIndex = index;
+  }
+  // the query past the last entry ends the listing
+  CHECK(status == STATUS_NO_MORE_FILES);
+  CHECK(index == fileIndex);
+  return entries;
+}
+
+VOID DirectoryTest(VOID) {
+  const ULONG entryCount = 1000;
+  ULONG index;
+  ULONG pages;
+
+  DirTestMount(entryCount, FALSE);
+  CHECK(DirTestList(4096, TRUE, &pages) == entryCount + 2);
+  CHECK(pages > 1);
+  CHECK(g_DirTest.FindFilesCalls == 1);
+
+  // a query from index 0 starts a new listing
+  CHECK(DirTestList(64 * 1024, TRUE, &pages) == entryCount + 2);
+  CHECK(g_DirTest.FindFilesCalls == 2);
+  DirTestUnmount();
+
+  DirTestMount(0, FALSE);
+  CHECK(DirTestList(4096, TRUE, &pages) == 2);
+  DirTestUnmount();
+
+  // the first page only reads about what it returns
+  DirTestMount(entryCount, TRUE);
+  CHECK(DirTestQuery(0, 4096, &index) == STATUS_SUCCESS);
+  CHECK(g_DirTest.FindFilesCalls == 1);
+  // about the entries of the page were read, "." and ".." being added
+  CHECK(g_DirTest.Filled >= index - 2 && g_DirTest.Filled < 2 * index);
+  CHECK(DirTestList(4096, TRUE, &pages) == entryCount + 2);
+  CHECK(g_DirTest.FindFilesCalls > pages / 2);
+  DirTestUnmount();
+
+  DirTestMount(0, TRUE);
+  CHECK(DirTestList(4096, TRUE, &pages) == 2);
+  DirTestUnmount();
+}
+
+VOID DirectoryBench(VOID) {
+  const ULONG entryCounts[] = {10000, 100000, 1000000};
+  const ULONG pageSizes[] = {4096, 64 * 1024};
+  LARGE_INTEGER start;
+  double seconds;
+  ULONG entries;
+  ULONG pages;
+  ULONG i, j;
+
+  printf("%-16s %14s %14s %14s %14s\n", "entries", "page bytes", "pages",
+         "ns/entry", "entries/s");
+  for (i = 0; i < sizeof(entryCounts) / sizeof(entryCounts[0]); ++i) {
+    for (j = 0; j < sizeof(pageSizes) / sizeof(pageSizes[0]); ++j) {
+      DirTestMount(entryCounts[i], FALSE);
+      QueryPerformanceCounter(&start);
+      entries = DirTestList(pageSizes[j], FALSE, &pages);
+      seconds = TestElapsed(start);
+      CHECK(entries == entryCounts[i] + 2);
+      printf("%-16lu %14lu %14lu %14.1f %14.0f\n", entryCounts[i],
+             pageSizes[j], pages, seconds * 1e9 / entries, entries / seconds);
+      DirTestUnmount();
+    }
+  }
+
+  // time to the first page of 4KB, then to the last
+  printf("\n%-16s %14s %14s %14s %14s\n", "entries", "first page us",
+         "resumable us", "all ns/entry", "resumable ns");
+  for (i = 0; i < sizeof(entryCounts) / sizeof(entryCounts[0]); ++i) {
+    double first[2];
+    double all[2];
+    ULONG index;
+    BOOL resumable;
+
+    for (resumable = FALSE; resumable <= TRUE; ++resumable) {
+      DirTestMount(entryCounts[i], resumable);
+      QueryPerformanceCounter(&start);
+      CHECK(DirTestQuery(0, 4096, &index) == STATUS_SUCCESS);
+      first[resumable] = TestElapsed(start);
+      QueryPerformanceCounter(&start);
+      entries = DirTestList(4096, FALSE, &pages);
+      all[resumable] = TestElapsed(start);
+      CHECK(entries == entryCounts[i] + 2);
+      DirTestUnmount();
+    }
+    printf("%-16lu %14.1f %14.1f %14.1f %14.1f\n", entryCounts[i],
+           first[FALSE] * 1e6, first[TRUE] * 1e6,
+           all[FALSE] * 1e9 / entries, all[TRUE] * 1e9 / entries);
+  }
+}
@@ -0,0 +1,197 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+Packed store of the directory listings
+
+Entries given to DokanFillFileData are appended to the 64KB chunks of the
+listing of the open, ClearFindData gives the chunks back to the pool of
+the instance. The benchmark reports the memory held per entry next to
+the WIN32_FIND_DATAW per entry kept before, and the fill throughput with
+a cold and a warm chunk pool.
+
+*/
+
+typedef struct _DIR_STORE {
+  PDOKAN_INSTANCE Instance;
+  PDOKAN_OPEN_INFO OpenInfo;
+  EVENT_CONTEXT EventContext;
+  DOKAN_IO_EVENT IoEvent;
+  DOKAN_FILE_INFO FileInfo;
+} DIR_STORE;
+
+static DOKAN_OPERATIONS g_DirStoreOperations = {0};
+
+static DOKAN_OPTIONS g_DirStoreOptions;
+
+// what a FindFiles callback running on a directory open would see
+static VOID DirStoreOpen(DIR_STORE *Store) {
+  ZeroMemory(Store, sizeof(DIR_STORE));
+  ZeroMemory(&g_DirStoreOptions, sizeof(DOKAN_OPTIONS));
+  Store->Instance = TestMount(&g_DirStoreOperations, &g_DirStoreOptions);
+  Store->OpenInfo = TestOpen(Store->Instance, TRUE);
+  Store->OpenInfo->DirList = calloc(1, sizeof(DOKAN_DIR_LIST));
+  CHECK(Store->OpenInfo->DirList != NULL);
+  Store->EventContext.MajorFunction = IRP_MJ_DIRECTORY_CONTROL;
+  DokanInitIoEvent(&Store->IoEvent, &Store->EventContext, Store->Instance,
+                   Store->OpenInfo, &Store->FileInfo);
+}
+
+static VOID DirStoreClose(DIR_STORE *Store) {
+  TestClose(Store->Instance, Store->OpenInfo);
+  TestUnmount(Store->Instance);
+}
+
+// name of entry Index, "file" followed by the decimal index and ".txt"
+static VOID DirStoreName(PWCHAR Name, ULONG Index) {
+  WCHAR digits[16];
+  ULONG count = 0;
+  ULONG i;
+
+  do {
+    digits[count++] = (WCHAR)(L'0' + Index % 10);
+    Index /= 10;
+  } while (Index != 0);
+  wcscpy_s(Name, MAX_PATH, L"file");
+  for (i = 0; i < count; ++i) {
+    Name[4 + i] = digits[count - i - 1];
+  }
+  Name[4 + count] = L'\0';
+  wcscat_s(Name, MAX_PATH, L".txt");
+}
+
+static VOID DirStoreFill(DIR_STORE *Store, ULONG EntryCount) {
+  WIN32_FIND_DATAW findData;
+  ULONG i;
+
+  ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
+  findData.dwFileAttributes = FILE_ATTRIBUTE_ARCHIVE;
+  for (i = 0; i < EntryCount; ++i) {
+    DirStoreName(findData.cFileName, i);
+    findData.nFileSizeLow = i;
+    DokanFillFileData(&findData, &Store->FileInfo);
+  }
+}
+
+// bytes held by the listing: its chunks and its array of entries
+static SIZE_T DirStoreFootprint(PDOKAN_DIR_LIST DirList, PULONG Chunks) {
+  PDOKAN_DIR_CHUNK chunk;
+
+  *Chunks = 0;
+  for (chunk = DirList->Chunks; chunk != NULL; chunk = chunk->Next) {
+    (*Chunks)++;
+  }
+  return (SIZE_T)*Chunks * DOKAN_DIR_CHUNK_SIZE +
+         (SIZE_T)DirList->Capacity * sizeof(PDOKAN_DIR_ENTRY);
+}
+
+VOID DirStoreTest(VOID) {
+  const ULONG entryCount = 20000;
+  PDOKAN_OBJECT_POOL pool;
+  PDOKAN_DIR_LIST dirList;
+  DIR_STORE store;
+  WCHAR name[MAX_PATH];
+  SIZE_T used = 0;
+  LONG64 mallocCount;
+  ULONG chunks;
+  ULONG i;
+
+  DirStoreOpen(&store);
+  dirList = store.OpenInfo->DirList;
+  pool = &store.Instance->DirChunkPool;
+
+  DirStoreFill(&store, entryCount);
+  CHECK(dirList->Count == entryCount);
+  for (i = 0; i < entryCount; ++i) {
+    PDOKAN_DIR_ENTRY entry = dirList->Entries[i];
+
+    DirStoreName(name, i);
+    CHECK(entry->FileNameLength == wcslen(name) * sizeof(WCHAR));
+    CHECK(wcscmp(entry->FileName, name) == 0);
+    CHECK(entry->Info.FileSize.QuadPart == i);
+    CHECK(entry->Info.FileAttributes == FILE_ATTRIBUTE_ARCHIVE);
+    // entries are 8-byte aligned for the attributes
+    CHECK(((ULONG_PTR)entry & 7) == 0);
+    used += DOKAN_DIR_ENTRY_SIZE(entry->FileNameLength);
+  }
+
+  // chunks are only left behind when the next entry does not fit
+  DirStoreFootprint(dirList, &chunks);
+  CHECK(pool->InUseCount == (LONG)chunks);
+  CHECK(used <= (SIZE_T)chunks * DOKAN_DIR_CHUNK_DATA_SIZE);
+  CHECK(used > (SIZE_T)(chunks - 1) * (DOKAN_DIR_CHUNK_DATA_SIZE -
+                                       DOKAN_DIR_ENTRY_SIZE(MAX_PATH * 2)));
+
+  // cleared in one go, the chunks are kept for the next listing
+  ClearFindData(dirList, store.Instance);
+  CHECK(dirList->Count == 0);
+  CHECK(dirList->Chunks == NULL);
+  CHECK(pool->InUseCount == 0);
+  CHECK(pool->FreeCount ==
+        (LONG)min(chunks, (ULONG)DOKAN_DIR_CHUNK_POOL_MAX_FREE));
+
+  mallocCount = pool->MallocCount;
+  DirStoreFill(&store, entryCount);
+  CHECK(dirList->Count == entryCount);
+  CHECK(pool->MallocCount - mallocCount ==
+        (LONG64)(chunks - min(chunks, (ULONG)DOKAN_DIR_CHUNK_POOL_MAX_FREE)));
+
+  DirStoreClose(&store);
+}
+
+VOID DirStoreBench(VOID) {
+  const ULONG entryCounts[] = {10000, 100000, 1000000};
+  LARGE_INTEGER start;
+  DIR_STORE store;
+  double coldSeconds;
+  double warmSeconds;
+  SIZE_T footprint;
+  ULONG chunks;
+  ULONG i;
+
+  printf("%-16s %14s %14s %14s %14s\n", "entries", "bytes/entry",
+         "before", "cold ns/entry", "warm ns/entry");
+  for (i = 0; i < sizeof(entryCounts) / sizeof(entryCounts[0]); ++i) {
+    DirStoreOpen(&store);
+
+    QueryPerformanceCounter(&start);
+    DirStoreFill(&store, entryCounts[i]);
+    coldSeconds = TestElapsed(start);
+    footprint = DirStoreFootprint(store.OpenInfo->DirList, &chunks);
+
+    // the chunks the pool kept are reused
+    ClearFindData(store.OpenInfo->DirList, store.Instance);
+    QueryPerformanceCounter(&start);
+    DirStoreFill(&store, entryCounts[i]);
+    warmSeconds = TestElapsed(start);
+
+    // before, each entry was a pooled WIN32_FIND_DATAW
+    printf("%-16lu %14.1f %14.1f %14.1f %14.1f\n", entryCounts[i],
+           (double)footprint / entryCounts[i],
+           (double)(sizeof(WIN32_FIND_DATAW) + sizeof(PVOID)),
+           coldSeconds * 1e9 / entryCounts[i],
+           warmSeconds * 1e9 / entryCounts[i]);
+    DirStoreClose(&store);
+  }
+}
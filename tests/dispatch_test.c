@@ -0,0 +1,145 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+Requests of one open dispatched from concurrent threads
+
+Every thread flushes the same open, the callback resets the timeout of its
+request. The reset and the reply must carry the serial number of the event
+the thread dispatched, whatever the other threads do on the open at the
+same time.
+
+*/
+
+#define DISPATCH_TEST_NAME L"\\shared.txt"
+
+typedef struct _DISPATCH_RUN {
+  PDOKAN_INSTANCE Instance;
+  PDOKAN_OPEN_INFO OpenInfo;
+  ULONG EventsPerThread;
+  // requests whose reset or reply carried another serial number
+  volatile LONG Mismatches;
+  volatile LONG Callbacks;
+} DISPATCH_RUN;
+
+static NTSTATUS DOKAN_CALLBACK DispatchTestFlush(LPCWSTR FileName,
+                                                 PDOKAN_FILE_INFO FileInfo) {
+  DISPATCH_RUN *run = (DISPATCH_RUN *)(UINT_PTR)FileInfo->Context;
+
+  UNREFERENCED_PARAMETER(FileName);
+
+  InterlockedIncrement(&run->Callbacks);
+  DokanResetTimeout(30000, FileInfo);
+  // only a create can ask for the token of the requestor
+  if (DokanOpenRequestorToken(FileInfo) != INVALID_HANDLE_VALUE) {
+    InterlockedIncrement(&run->Mismatches);
+  }
+  return STATUS_SUCCESS;
+}
+
+static UINT WINAPI DispatchTestThread(PVOID Param) {
+  DISPATCH_RUN *run = (DISPATCH_RUN *)Param;
+  PEVENT_CONTEXT eventContext;
+  PEVENT_INFORMATION reply;
+  ULONG i;
+
+  for (i = 0; i < run->EventsPerThread; ++i) {
+    eventContext =
+        TestNewEvent(IRP_MJ_FLUSH_BUFFERS, run->OpenInfo,
+                     sizeof(DISPATCH_TEST_NAME));
+    if (eventContext == NULL) {
+      InterlockedIncrement(&run->Mismatches);
+      break;
+    }
+    TestSetName(eventContext->Operation.Flush.FileName,
+                &eventContext->Operation.Flush.FileNameLength,
+                DISPATCH_TEST_NAME);
+
+    DispatchFlush(TestMountHandle(), eventContext, run->Instance);
+
+    reply = TestLastReply(NULL);
+    if (TestLastResetSerial() != eventContext->SerialNumber ||
+        reply == NULL || reply->SerialNumber != eventContext->SerialNumber ||
+        reply->Status != STATUS_SUCCESS) {
+      InterlockedIncrement(&run->Mismatches);
+    }
+    free(eventContext);
+  }
+  TestFreeThreadReply();
+  return 0;
+}
+
+static DOKAN_OPERATIONS g_DispatchOperations = {0};
+
+static VOID DispatchRun(DISPATCH_RUN *Run, ULONG ThreadCount,
+                        ULONG EventsPerThread) {
+  static DOKAN_OPTIONS options;
+
+  ZeroMemory(Run, sizeof(DISPATCH_RUN));
+  ZeroMemory(&options, sizeof(DOKAN_OPTIONS));
+  g_DispatchOperations.FlushFileBuffers = DispatchTestFlush;
+
+  Run->Instance = TestMount(&g_DispatchOperations, &options);
+  Run->OpenInfo = TestOpen(Run->Instance, FALSE);
+  Run->OpenInfo->UserContext = (ULONG64)Run;
+  Run->EventsPerThread = EventsPerThread;
+
+  TestRunThreads(ThreadCount, DispatchTestThread, Run);
+
+  // every request gave its reference back
+  CHECK(Run->OpenInfo->OpenCount == 1);
+  TestClose(Run->Instance, Run->OpenInfo);
+  TestUnmount(Run->Instance);
+}
+
+VOID DispatchTest(VOID) {
+  const ULONG threadCount = 8;
+  const ULONG eventsPerThread = 2000;
+  DISPATCH_RUN run;
+
+  DispatchRun(&run, threadCount, eventsPerThread);
+  CHECK(run.Mismatches == 0);
+  CHECK(run.Callbacks == (LONG)(threadCount * eventsPerThread));
+  CHECK(g_TestMountCounters.ResetTimeouts == threadCount * eventsPerThread);
+  CHECK(g_TestMountCounters.Replies == threadCount * eventsPerThread);
+}
+
+VOID DispatchBench(VOID) {
+  const ULONG eventCount = 400000;
+  const ULONG threadCounts[] = {1, 2, 4, 8, 16};
+  LARGE_INTEGER start;
+  DISPATCH_RUN run;
+  double seconds;
+  ULONG i;
+
+  printf("%-16s %14s %14s\n", "threads", "ns/event", "events/s");
+  for (i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); ++i) {
+    QueryPerformanceCounter(&start);
+    DispatchRun(&run, threadCounts[i], eventCount / threadCounts[i]);
+    seconds = TestElapsed(start);
+    CHECK(run.Mismatches == 0);
+    printf("%-16lu %14.1f %14.0f\n", threadCounts[i],
+           seconds * 1e9 / eventCount, eventCount / seconds);
+  }
+}
@@ -0,0 +1,242 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+File ID map
+
+IDs are given once per name, kept across renames, never reused, and
+survive an unmount through the map file. The benchmark fills directories
+of 1000 files up to 10M names and measures lookups and renames of random
+files.
+
+*/
+
+#define FILE_ID_TEST_MAP L"dokan_test_fileid.map"
+#define FILE_ID_FILES_PER_DIR 1000
+
+static DOKAN_OPERATIONS g_FileIdOperations = {0};
+
+static DOKAN_OPTIONS g_FileIdOptions;
+
+static WCHAR g_FileIdMapPath[MAX_PATH];
+
+static PDOKAN_INSTANCE FileIdTestMount(LPCWSTR MapFile) {
+  ZeroMemory(&g_FileIdOptions, sizeof(DOKAN_OPTIONS));
+  g_FileIdOptions.Options = DOKAN_OPTION_FILE_ID_MAP;
+  g_FileIdOptions.FileIdMapFile = MapFile;
+  return TestMount(&g_FileIdOperations, &g_FileIdOptions);
+}
+
+// Append the decimal Value to Path
+static VOID FileIdTestAppend(PWCHAR Path, LPCWSTR Prefix, ULONG Value) {
+  WCHAR digits[16];
+  ULONG count = 0;
+  SIZE_T length;
+
+  do {
+    digits[count++] = (WCHAR)(L'0' + Value % 10);
+    Value /= 10;
+  } while (Value != 0);
+  wcscat_s(Path, MAX_PATH, Prefix);
+  length = wcslen(Path);
+  while (count > 0) {
+    Path[length++] = digits[--count];
+  }
+  Path[length] = L'\0';
+}
+
+// \d<File / FILE_ID_FILES_PER_DIR>\f<File>, with Suffix appended
+static VOID FileIdTestPath(PWCHAR Path, ULONG File, LPCWSTR Suffix) {
+  Path[0] = L'\0';
+  FileIdTestAppend(Path, L"\\d", File / FILE_ID_FILES_PER_DIR);
+  FileIdTestAppend(Path, L"\\f", File);
+  wcscat_s(Path, MAX_PATH, Suffix);
+}
+
+static ULONG64 FileIdOf(PDOKAN_INSTANCE Instance, LPCWSTR Path) {
+  return DokanGetFileId(Instance, Path, NULL, 0);
+}
+
+static VOID FileIdTestAssign(VOID) {
+  PDOKAN_INSTANCE instance = FileIdTestMount(NULL);
+  ULONG64 a, x, y, b, b2;
+
+  // IDs are given in order and stay with their name
+  a = FileIdOf(instance, L"\\a");
+  x = FileIdOf(instance, L"\\a\\x");
+  y = DokanGetFileId(instance, L"\\a", L"y", 1);
+  b = FileIdOf(instance, L"\\b");
+  CHECK(a > DOKAN_FILE_ID_ROOT && a < x && x < y && y < b);
+  CHECK(FileIdOf(instance, L"\\A\\X") == x);
+  CHECK(FileIdOf(instance, L"\\a\\y\\") == y);
+  CHECK(FileIdOf(instance, L"\\") == DOKAN_FILE_ID_ROOT);
+  CHECK(DokanGetFileId(instance, L"\\a", L".", 1) == a);
+  CHECK(DokanGetFileId(instance, L"\\a", L"..", 2) == DOKAN_FILE_ID_ROOT);
+
+  // the names below a renamed directory keep their IDs
+  DokanFileIdRename(instance, L"\\a", L"\\c");
+  CHECK(FileIdOf(instance, L"\\c") == a);
+  CHECK(FileIdOf(instance, L"\\c\\x") == x);
+  DokanFileIdRename(instance, L"\\c\\y", L"\\y");
+  CHECK(FileIdOf(instance, L"\\y") == y);
+  CHECK(instance->FileIdMap.Count == 4);
+
+  // a rename over an existing name drops its ID
+  DokanFileIdRename(instance, L"\\y", L"\\b");
+  CHECK(FileIdOf(instance, L"\\b") == y);
+  CHECK(instance->FileIdMap.Count == 3);
+
+  // IDs are never given again
+  DokanFileIdRemove(instance, L"\\b");
+  b2 = FileIdOf(instance, L"\\b");
+  CHECK(b2 > b && b2 != y);
+
+  TestUnmount(instance);
+}
+
+static VOID FileIdTestPersist(VOID) {
+  PDOKAN_INSTANCE instance;
+  ULONG64 ids[64];
+  WCHAR path[MAX_PATH];
+  ULONG64 nextId;
+  ULONG64 id;
+  HANDLE file;
+  ULONG written;
+  ULONG i;
+
+  GetTempPathW(MAX_PATH, g_FileIdMapPath);
+  wcscat_s(g_FileIdMapPath, MAX_PATH, FILE_ID_TEST_MAP);
+  DeleteFileW(g_FileIdMapPath);
+
+  // a missing map file starts an empty map
+  instance = FileIdTestMount(g_FileIdMapPath);
+  CHECK(instance->FileIdMap.Enabled);
+  CHECK(instance->FileIdMap.Count == 0);
+  for (i = 0; i < 64; ++i) {
+    FileIdTestPath(path, i * 100, L"");
+    ids[i] = FileIdOf(instance, path);
+  }
+  DokanFileIdRename(instance, L"\\d0", L"\\renamed");
+  nextId = instance->FileIdMap.NextId;
+  CHECK(DokanSaveFileIdMap(&instance->FileIdMap));
+  TestUnmount(instance);
+
+  // the IDs and the next ID come back from the file
+  instance = FileIdTestMount(g_FileIdMapPath);
+  CHECK(instance->FileIdMap.NextId == nextId);
+  CHECK(FileIdOf(instance, L"\\renamed\\f0") == ids[0]);
+  for (i = 10; i < 64; ++i) {
+    FileIdTestPath(path, i * 100, L"");
+    CHECK(FileIdOf(instance, path) == ids[i]);
+  }
+  CHECK(instance->FileIdMap.NextId == nextId);
+  id = FileIdOf(instance, L"\\new");
+  CHECK(id == nextId);
+  TestUnmount(instance);
+
+  // a truncated map is dropped, its IDs are still not given again
+  file = CreateFileW(g_FileIdMapPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                     FILE_ATTRIBUTE_NORMAL, NULL);
+  CHECK(file != INVALID_HANDLE_VALUE);
+  if (file != INVALID_HANDLE_VALUE) {
+    // header of fileid.c announcing 10 names that are not there
+    ULONG header[6] = {0x44494b44, 1, (ULONG)nextId, 0, 10, 0};
+    CHECK(WriteFile(file, header, sizeof(header), &written, NULL));
+    CloseHandle(file);
+  }
+  instance = FileIdTestMount(g_FileIdMapPath);
+  CHECK(instance->FileIdMap.Enabled);
+  CHECK(instance->FileIdMap.Count == 0);
+  CHECK(FileIdOf(instance, L"\\renamed") == nextId);
+  TestUnmount(instance);
+
+  // so is a map of another format
+  file = CreateFileW(g_FileIdMapPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                     FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file != INVALID_HANDLE_VALUE) {
+    CHECK(WriteFile(file, "not a map", 9, &written, NULL));
+    CloseHandle(file);
+  }
+  instance = FileIdTestMount(g_FileIdMapPath);
+  CHECK(instance->FileIdMap.Count == 0);
+  CHECK(FileIdOf(instance, L"\\a") == DOKAN_FILE_ID_ROOT + 1);
+  TestUnmount(instance);
+
+  DeleteFileW(g_FileIdMapPath);
+}
+
+VOID FileIdTest(VOID) {
+  FileIdTestAssign();
+  FileIdTestPersist();
+}
+
+VOID FileIdBench(VOID) {
+  const ULONG nameCounts[] = {100000, 1000000, 10000000};
+  const ULONG opCount = 1000000;
+  PDOKAN_INSTANCE instance;
+  WCHAR path[MAX_PATH];
+  WCHAR newPath[MAX_PATH];
+  LARGE_INTEGER start;
+  double fillSeconds, lookupSeconds, renameSeconds;
+  ULONG seed;
+  ULONG i, j;
+
+  printf("%-16s %14s %14s %14s\n", "names", "fill ns", "lookup ns",
+         "rename ns");
+  for (i = 0; i < sizeof(nameCounts) / sizeof(nameCounts[0]); ++i) {
+    instance = FileIdTestMount(NULL);
+
+    QueryPerformanceCounter(&start);
+    for (j = 0; j < nameCounts[i]; ++j) {
+      FileIdTestPath(path, j, L"");
+      FileIdOf(instance, path);
+    }
+    fillSeconds = TestElapsed(start);
+
+    seed = 12345;
+    QueryPerformanceCounter(&start);
+    for (j = 0; j < opCount; ++j) {
+      seed = seed * 1103515245 + 12345;
+      FileIdTestPath(path, seed % nameCounts[i], L"");
+      FileIdOf(instance, path);
+    }
+    lookupSeconds = TestElapsed(start);
+
+    // every rename moves a distinct file to a new name in its directory
+    QueryPerformanceCounter(&start);
+    for (j = 0; j < opCount && j < nameCounts[i]; ++j) {
+      FileIdTestPath(path, j, L"");
+      FileIdTestPath(newPath, j, L".old");
+      DokanFileIdRename(instance, path, newPath);
+    }
+    renameSeconds = TestElapsed(start);
+    CHECK(instance->FileIdMap.Count ==
+          nameCounts[i] + nameCounts[i] / FILE_ID_FILES_PER_DIR);
+
+    printf("%-16lu %14.1f %14.1f %14.1f\n", nameCounts[i],
+           fillSeconds * 1e9 / nameCounts[i], lookupSeconds * 1e9 / opCount,
+           renameSeconds * 1e9 / min(opCount, nameCounts[i]));
+    TestUnmount(instance);
+  }
+}
@@ -0,0 +1,343 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <process.h>
+#include "test.h"
+
+/*
+
+Mount without a driver
+
+TestMount sets up a DOKAN_INSTANCE the way DokanMain does, minus the
+device and the workers. Tests build events with TestNewEvent and give them
+to the Dispatch* functions on their own threads. Replies and control
+requests go to a recording transport: each thread can read back the last
+reply it sent and the serial number of its last IOCTL_RESET_TIMEOUT. The
+IOCTL_EVENT_WRITE of a thread is answered with the event it gave to
+TestSetPulledWrite, copied like the driver does. Replies of threads the test
+does not own, like the event ring threads of the library, go to the hook of
+TestSetReplyHook. After TestGrantEventRing, IOCTL_EVENT_RING maps rings held
+in g_TestEventRing: the test plays the driver on them.
+
+*/
+
+#define TEST_DEVICE_NAME L"\\\\.\\DokanTest"
+#define TEST_DEVICE_HANDLE ((HANDLE)0x7E57)
+
+TEST_MOUNT_COUNTERS g_TestMountCounters;
+
+TEST_EVENT_RING g_TestEventRing;
+
+// takes the IOCTL_EVENT_INFO of every thread instead of the recording
+static TEST_REPLY_HOOK g_TestReplyHook = NULL;
+
+static volatile LONG g_TestSerialNumber = 0;
+
+// last reply of the thread
+static __declspec(thread) PEVENT_INFORMATION g_TestReply = NULL;
+static __declspec(thread) ULONG g_TestReplyLength = 0;
+static __declspec(thread) ULONG g_TestReplyCapacity = 0;
+static __declspec(thread) ULONG g_TestResetSerial = 0;
+static __declspec(thread) PEVENT_CONTEXT g_TestPulledWrite = NULL;
+
+static HANDLE TestMountOpen(LPCWSTR RawDeviceName, DWORD FlagsAndAttributes) {
+  UNREFERENCED_PARAMETER(FlagsAndAttributes);
+
+  if (wcscmp(RawDeviceName, TEST_DEVICE_NAME) != 0) {
+    SetLastError(ERROR_FILE_NOT_FOUND);
+    return INVALID_HANDLE_VALUE;
+  }
+  return TEST_DEVICE_HANDLE;
+}
+
+static VOID TestMountClose(HANDLE Device) { UNREFERENCED_PARAMETER(Device); }
+
+static BOOL TestMountRecordReply(PEVENT_INFORMATION EventInfo, ULONG Length) {
+  if (Length > g_TestReplyCapacity) {
+    PEVENT_INFORMATION reply = (PEVENT_INFORMATION)realloc(g_TestReply, Length);
+    if (reply == NULL) {
+      SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+      return FALSE;
+    }
+    g_TestReply = reply;
+    g_TestReplyCapacity = Length;
+  }
+  CopyMemory(g_TestReply, EventInfo, Length);
+  g_TestReplyLength = Length;
+  InterlockedIncrement64(&g_TestMountCounters.Replies);
+  return TRUE;
+}
+
+static BOOL TestMountPullWrite(PEVENT_INFORMATION EventInfo, PVOID Buffer,
+                               ULONG BufferLength, PULONG ReturnedLength) {
+  PEVENT_CONTEXT eventContext = g_TestPulledWrite;
+
+  InterlockedIncrement64(&g_TestMountCounters.PulledWrites);
+  // no event means the request was cancelled meanwhile
+  if (eventContext == NULL ||
+      eventContext->SerialNumber != EventInfo->SerialNumber) {
+    SetLastError(ERROR_OPERATION_ABORTED);
+    return FALSE;
+  }
+  if (BufferLength < eventContext->Length) {
+    SetLastError(ERROR_INSUFFICIENT_BUFFER);
+    return FALSE;
+  }
+  CopyMemory(Buffer, eventContext, eventContext->Length);
+  *ReturnedLength = eventContext->Length;
+  return TRUE;
+}
+
+// Rings placed like DokanEventRingMap does, both in one allocation
+static BOOL TestMapEventRing(PEVENT_RING_MAP RingMap, PULONG ReturnedLength) {
+  TEST_EVENT_RING *ring = &g_TestEventRing;
+  ULONG offset;
+
+  ring->RingSize = DokanRingSize(ring->SlotCount, ring->PayloadSize);
+  if (ring->RingSize == 0 || ring->Memory != NULL) {
+    SetLastError(ERROR_INVALID_FUNCTION);
+    return FALSE;
+  }
+  offset = (ring->RingSize + DOKAN_RING_CACHE_LINE - 1) &
+           ~(DOKAN_RING_CACHE_LINE - 1);
+  ring->Memory = calloc(2, offset);
+  CHECK(ring->Memory != NULL);
+  if (ring->Memory == NULL) {
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return FALSE;
+  }
+  CHECK(DokanRingInit(&ring->Submit, ring->Memory, ring->SlotCount,
+                      ring->PayloadSize));
+  CHECK(DokanRingInit(&ring->Complete, (PCHAR)ring->Memory + offset,
+                      ring->SlotCount, ring->PayloadSize));
+  ring->SubmitEvent = (HANDLE)(ULONG_PTR)RingMap->SubmitEvent;
+  ring->CompleteEvent = (HANDLE)(ULONG_PTR)RingMap->CompleteEvent;
+
+  RingMap->SubmitRing = (ULONG64)(ULONG_PTR)ring->Memory;
+  RingMap->CompleteRing = (ULONG64)(ULONG_PTR)((PCHAR)ring->Memory + offset);
+  RingMap->RingSize = ring->RingSize;
+  *ReturnedLength = sizeof(EVENT_RING_MAP);
+  return TRUE;
+}
+
+static BOOL TestMountIoControl(HANDLE Device, DWORD IoControlCode,
+                               PVOID InputBuffer, ULONG InputLength,
+                               PVOID OutputBuffer, ULONG OutputLength,
+                               PULONG ReturnedLength) {
+  UNREFERENCED_PARAMETER(Device);
+
+  *ReturnedLength = 0;
+  switch (IoControlCode) {
+  case IOCTL_EVENT_INFO:
+    if (g_TestReplyHook != NULL) {
+      return g_TestReplyHook((PEVENT_INFORMATION)InputBuffer, InputLength);
+    }
+    return TestMountRecordReply((PEVENT_INFORMATION)InputBuffer, InputLength);
+  case IOCTL_EVENT_WRITE:
+    CHECK(InputLength >= sizeof(EVENT_INFORMATION));
+    return TestMountPullWrite((PEVENT_INFORMATION)InputBuffer, OutputBuffer,
+                              OutputLength, ReturnedLength);
+  case IOCTL_EVENT_RING:
+    CHECK(InputLength == sizeof(EVENT_RING_MAP));
+    CHECK(OutputLength == sizeof(EVENT_RING_MAP));
+    return TestMapEventRing((PEVENT_RING_MAP)OutputBuffer, ReturnedLength);
+  case IOCTL_RESET_TIMEOUT:
+    CHECK(InputLength >= sizeof(EVENT_INFORMATION));
+    g_TestResetSerial = ((PEVENT_INFORMATION)InputBuffer)->SerialNumber;
+    InterlockedIncrement64(&g_TestMountCounters.ResetTimeouts);
+    return TRUE;
+  default:
+    InterlockedIncrement64(&g_TestMountCounters.Controls);
+    return TRUE;
+  }
+}
+
+static const DOKAN_CHANNEL_TRANSPORT g_TestMountTransport = {
+    TestMountOpen, TestMountIoControl, TestMountClose};
+
+PDOKAN_INSTANCE TestMount(PDOKAN_OPERATIONS Operations,
+                          PDOKAN_OPTIONS Options) {
+  PDOKAN_INSTANCE instance = NewDokanInstance();
+
+  CHECK(instance != NULL);
+  if (instance == NULL) {
+    return NULL;
+  }
+  ZeroMemory(&g_TestMountCounters, sizeof(TEST_MOUNT_COUNTERS));
+  DokanSetChannelTransport(&g_TestMountTransport);
+
+  if (Options->Version == 0) {
+    Options->Version = DOKAN_VERSION;
+    Options->Size = sizeof(DOKAN_OPTIONS);
+    Options->OperationsSize = sizeof(DOKAN_OPERATIONS);
+  }
+  CheckAllocationUnitSectorSize(Options);
+  instance->DokanOptions = Options;
+  instance->DokanOperations = Operations;
+  // opened before any dispatch, like DokanMain does
+  CHECK(DokanOpenNamedDeviceChannel(&instance->ControlChannel,
+                                    TEST_DEVICE_NAME));
+
+  DokanStartPathCache(&instance->DirCache, Options->DirectoryCacheTimeout,
+                      Options->DirectoryCacheSize != 0
+                          ? Options->DirectoryCacheSize
+                          : DOKAN_DEFAULT_DIR_CACHE_SIZE,
+                      0, FALSE);
+  DokanStartPathCache(&instance->InfoCache, Options->FileInfoCacheTimeout, 0,
+                      DOKAN_INFO_CACHE_MAX_ENTRIES, FALSE);
+  DokanStartPathCache(&instance->NegativeCache, Options->NegativeCacheTimeout,
+                      0, DOKAN_NEGATIVE_CACHE_MAX_ENTRIES, FALSE);
+  DokanStartVolumeCache(
+      &instance->VolumeCache, Options->FreeSpaceCacheTimeout,
+      (Options->Options & DOKAN_OPTION_FREE_SPACE_REFRESH) != 0);
+  DokanStartPathCache(&instance->SecurityCache.Paths,
+                      Options->SecurityCacheTimeout, 0,
+                      DOKAN_SECURITY_CACHE_MAX_ENTRIES, FALSE);
+  if (Options->Options & DOKAN_OPTION_FILE_ID_MAP) {
+    DokanStartFileIdMap(&instance->FileIdMap, Options->FileIdMapFile);
+  }
+  return instance;
+}
+
+VOID TestUnmount(PDOKAN_INSTANCE Instance) {
+  if (Instance == NULL) {
+    return;
+  }
+  if (Instance->EventRing != NULL) {
+    // what IOCTL_EVENT_RELEASE does, then DokanMain
+    TestCloseEventRing();
+    DokanStopEventRing(Instance);
+  }
+  DokanStopVolumeCache(&Instance->VolumeCache);
+  DokanCloseDeviceChannel(&Instance->ControlChannel);
+  DeleteDokanInstance(Instance);
+  DokanSetChannelTransport(NULL);
+  g_TestReplyHook = NULL;
+  free(g_TestEventRing.Memory);
+  ZeroMemory(&g_TestEventRing, sizeof(TEST_EVENT_RING));
+}
+
+HANDLE TestMountHandle(VOID) { return TEST_DEVICE_HANDLE; }
+
+VOID TestGrantEventRing(PDOKAN_INSTANCE Instance, ULONG SlotCount,
+                        ULONG PayloadSize) {
+  ZeroMemory(&g_TestEventRing, sizeof(TEST_EVENT_RING));
+  g_TestEventRing.SlotCount = SlotCount;
+  g_TestEventRing.PayloadSize = PayloadSize;
+  Instance->Features |= DOKAN_FEATURE_EVENT_RING;
+  Instance->RingPayloadSize = PayloadSize;
+}
+
+VOID TestSetReplyHook(TEST_REPLY_HOOK Hook) { g_TestReplyHook = Hook; }
+
+VOID TestCloseEventRing(VOID) {
+  if (g_TestEventRing.Memory != NULL) {
+    DokanRingClose(&g_TestEventRing.Submit);
+    SetEvent(g_TestEventRing.SubmitEvent);
+  }
+}
+
+PDOKAN_OPEN_INFO TestOpen(PDOKAN_INSTANCE Instance, BOOL IsDirectory) {
+  PDOKAN_OPEN_INFO openInfo = DokanPoolAlloc(&Instance->OpenInfoPool);
+
+  CHECK(openInfo != NULL);
+  if (openInfo == NULL) {
+    return NULL;
+  }
+  ZeroMemory(openInfo, sizeof(DOKAN_OPEN_INFO));
+  // the reference the driver holds until the close reply
+  openInfo->OpenCount = 1;
+  openInfo->IsDirectory = IsDirectory;
+  openInfo->DokanInstance = Instance;
+  return openInfo;
+}
+
+VOID TestClose(PDOKAN_INSTANCE Instance, PDOKAN_OPEN_INFO OpenInfo) {
+  EVENT_INFORMATION eventInfo;
+
+  ZeroMemory(&eventInfo, sizeof(EVENT_INFORMATION));
+  eventInfo.Context = (ULONG64)OpenInfo;
+  ReleaseDokanOpenInfo(&eventInfo, Instance);
+  CHECK(eventInfo.Context == 0);
+}
+
+PEVENT_CONTEXT TestNewEvent(UCHAR MajorFunction, PDOKAN_OPEN_INFO OpenInfo,
+                            ULONG ExtraLength) {
+  ULONG length = sizeof(EVENT_CONTEXT) + ExtraLength;
+  PEVENT_CONTEXT eventContext = (PEVENT_CONTEXT)calloc(1, length);
+
+  CHECK(eventContext != NULL);
+  if (eventContext == NULL) {
+    return NULL;
+  }
+  eventContext->Length = length;
+  eventContext->SerialNumber = InterlockedIncrement(&g_TestSerialNumber);
+  eventContext->ProcessId = 42;
+  eventContext->MajorFunction = MajorFunction;
+  eventContext->Context = (ULONG64)OpenInfo;
+  return eventContext;
+}
+
+ULONG TestSetName(PWCHAR FileName, PULONG FileNameLength, LPCWSTR Name) {
+  ULONG length = (ULONG)wcslen(Name) * sizeof(WCHAR);
+
+  CopyMemory(FileName, Name, length + sizeof(WCHAR));
+  *FileNameLength = length;
+  return length;
+}
+
+PEVENT_INFORMATION TestLastReply(PULONG Length) {
+  if (Length != NULL) {
+    *Length = g_TestReplyLength;
+  }
+  return g_TestReplyLength != 0 ? g_TestReply : NULL;
+}
+
+ULONG TestLastResetSerial(VOID) { return g_TestResetSerial; }
+
+VOID TestSetPulledWrite(PEVENT_CONTEXT EventContext) {
+  g_TestPulledWrite = EventContext;
+}
+
+VOID TestFreeThreadReply(VOID) {
+  free(g_TestReply);
+  g_TestReply = NULL;
+  g_TestReplyLength = 0;
+  g_TestReplyCapacity = 0;
+}
+
+VOID TestRunThreads(ULONG ThreadCount, UINT(WINAPI *Start)(PVOID),
+                    PVOID Context) {
+  HANDLE threads[TEST_MAX_THREADS];
+  ULONG i;
+
+  CHECK(ThreadCount <= TEST_MAX_THREADS);
+  for (i = 0; i < ThreadCount && i < TEST_MAX_THREADS; ++i) {
+    threads[i] = (HANDLE)_beginthreadex(NULL, 0, Start, Context, 0, NULL);
+    CHECK(threads[i] != NULL);
+  }
+  for (i = 0; i < ThreadCount && i < TEST_MAX_THREADS; ++i) {
+    if (threads[i] != NULL) {
+      WaitForSingleObject(threads[i], INFINITE);
+      CloseHandle(threads[i]);
+    }
+  }
+}
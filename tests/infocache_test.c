@@ -0,0 +1,296 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "../dokan/fileinfo.h"
+
+/*
+
+File information cache seen from DispatchQueryInformation
+
+Queries of a file are answered from the cache until a write, a set
+information, a lock or a cleanup of the file drops its entry: the test
+counts the GetFileInformation calls each of them lets through.
+
+*/
+
+#define INFO_TEST_NAME L"\\info.txt"
+#define INFO_TEST_SIZE 4096
+
+static volatile LONG g_InfoCalls = 0;
+
+static NTSTATUS DOKAN_CALLBACK
+InfoTestGetFileInformation(LPCWSTR FileName,
+                           LPBY_HANDLE_FILE_INFORMATION Buffer,
+                           PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileName);
+  UNREFERENCED_PARAMETER(FileInfo);
+
+  InterlockedIncrement(&g_InfoCalls);
+  Buffer->dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+  Buffer->nFileSizeLow = INFO_TEST_SIZE;
+  Buffer->nNumberOfLinks = 1;
+  return STATUS_SUCCESS;
+}
+
+static NTSTATUS DOKAN_CALLBACK
+InfoTestWriteFile(LPCWSTR FileName, LPCVOID Buffer,
+                  DWORD NumberOfBytesToWrite, LPDWORD NumberOfBytesWritten,
+                  LONGLONG Offset, PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileName);
+  UNREFERENCED_PARAMETER(Buffer);
+  UNREFERENCED_PARAMETER(Offset);
+  UNREFERENCED_PARAMETER(FileInfo);
+
+  *NumberOfBytesWritten = NumberOfBytesToWrite;
+  return STATUS_SUCCESS;
+}
+
+static NTSTATUS DOKAN_CALLBACK InfoTestSetEndOfFile(LPCWSTR FileName,
+                                                    LONGLONG ByteOffset,
+                                                    PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileName);
+  UNREFERENCED_PARAMETER(ByteOffset);
+  UNREFERENCED_PARAMETER(FileInfo);
+  return STATUS_SUCCESS;
+}
+
+static NTSTATUS DOKAN_CALLBACK InfoTestLockFile(LPCWSTR FileName,
+                                                LONGLONG ByteOffset,
+                                                LONGLONG Length,
+                                                PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileName);
+  UNREFERENCED_PARAMETER(ByteOffset);
+  UNREFERENCED_PARAMETER(Length);
+  UNREFERENCED_PARAMETER(FileInfo);
+  return STATUS_SUCCESS;
+}
+
+static void DOKAN_CALLBACK InfoTestCleanup(LPCWSTR FileName,
+                                           PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileName);
+  UNREFERENCED_PARAMETER(FileInfo);
+}
+
+static DOKAN_OPERATIONS g_InfoOperations = {0};
+
+static DOKAN_OPTIONS g_InfoOptions;
+
+static PDOKAN_INSTANCE InfoTestMount(ULONG CacheTimeout) {
+  g_InfoOperations.GetFileInformation = InfoTestGetFileInformation;
+  g_InfoOperations.WriteFile = InfoTestWriteFile;
+  g_InfoOperations.SetEndOfFile = InfoTestSetEndOfFile;
+  g_InfoOperations.LockFile = InfoTestLockFile;
+  g_InfoOperations.Cleanup = InfoTestCleanup;
+
+  ZeroMemory(&g_InfoOptions, sizeof(DOKAN_OPTIONS));
+  g_InfoOptions.FileInfoCacheTimeout = CacheTimeout;
+  g_InfoCalls = 0;
+  return TestMount(&g_InfoOperations, &g_InfoOptions);
+}
+
+// FileStandardInformation of INFO_TEST_NAME, returns its end of file
+static LONGLONG InfoTestQuery(PDOKAN_INSTANCE Instance,
+                              PDOKAN_OPEN_INFO OpenInfo) {
+  PEVENT_CONTEXT eventContext = TestNewEvent(
+      IRP_MJ_QUERY_INFORMATION, OpenInfo, sizeof(INFO_TEST_NAME));
+  PEVENT_INFORMATION reply;
+  LONGLONG endOfFile = -1;
+
+  if (eventContext == NULL) {
+    return -1;
+  }
+  eventContext->Operation.File.FileInformationClass = FileStandardInformation;
+  eventContext->Operation.File.BufferLength =
+      sizeof(FILE_STANDARD_INFORMATION);
+  TestSetName(eventContext->Operation.File.FileName,
+              &eventContext->Operation.File.FileNameLength, INFO_TEST_NAME);
+
+  DispatchQueryInformation(TestMountHandle(), eventContext, Instance);
+
+  reply = TestLastReply(NULL);
+  CHECK(reply != NULL && reply->SerialNumber == eventContext->SerialNumber);
+  if (reply != NULL && reply->Status == STATUS_SUCCESS) {
+    endOfFile =
+        ((PFILE_STANDARD_INFORMATION)reply->Buffer)->EndOfFile.QuadPart;
+  }
+  free(eventContext);
+  return endOfFile;
+}
+
+static VOID InfoTestWrite(PDOKAN_INSTANCE Instance,
+                          PDOKAN_OPEN_INFO OpenInfo) {
+  const ULONG payload = 512;
+  PEVENT_CONTEXT eventContext = TestNewEvent(
+      IRP_MJ_WRITE, OpenInfo, sizeof(INFO_TEST_NAME) + payload);
+
+  if (eventContext == NULL) {
+    return;
+  }
+  TestSetName(eventContext->Operation.Write.FileName,
+              &eventContext->Operation.Write.FileNameLength, INFO_TEST_NAME);
+  eventContext->Operation.Write.BufferLength = payload;
+  eventContext->Operation.Write.BufferOffset =
+      sizeof(EVENT_CONTEXT) + sizeof(INFO_TEST_NAME);
+
+  DispatchWrite(TestMountHandle(), eventContext, Instance);
+  CHECK(TestLastReply(NULL)->Status == STATUS_SUCCESS);
+  free(eventContext);
+}
+
+static VOID InfoTestSetEndOfFileInfo(PDOKAN_INSTANCE Instance,
+                                     PDOKAN_OPEN_INFO OpenInfo) {
+  PEVENT_CONTEXT eventContext =
+      TestNewEvent(IRP_MJ_SET_INFORMATION, OpenInfo,
+                   sizeof(INFO_TEST_NAME) +
+                       sizeof(FILE_END_OF_FILE_INFORMATION));
+  PFILE_END_OF_FILE_INFORMATION endInfo;
+
+  if (eventContext == NULL) {
+    return;
+  }
+  TestSetName(eventContext->Operation.SetFile.FileName,
+              &eventContext->Operation.SetFile.FileNameLength,
+              INFO_TEST_NAME);
+  eventContext->Operation.SetFile.FileInformationClass =
+      FileEndOfFileInformation;
+  eventContext->Operation.SetFile.BufferLength =
+      sizeof(FILE_END_OF_FILE_INFORMATION);
+  eventContext->Operation.SetFile.BufferOffset =
+      sizeof(EVENT_CONTEXT) + sizeof(INFO_TEST_NAME);
+  endInfo = (PFILE_END_OF_FILE_INFORMATION)(
+      (PCHAR)eventContext + eventContext->Operation.SetFile.BufferOffset);
+  endInfo->EndOfFile.QuadPart = INFO_TEST_SIZE;
+
+  DispatchSetInformation(TestMountHandle(), eventContext, Instance);
+  CHECK(TestLastReply(NULL)->Status == STATUS_SUCCESS);
+  free(eventContext);
+}
+
+static VOID InfoTestLock(PDOKAN_INSTANCE Instance,
+                         PDOKAN_OPEN_INFO OpenInfo) {
+  PEVENT_CONTEXT eventContext = TestNewEvent(IRP_MJ_LOCK_CONTROL, OpenInfo,
+                                             sizeof(INFO_TEST_NAME));
+
+  if (eventContext == NULL) {
+    return;
+  }
+  eventContext->MinorFunction = IRP_MN_LOCK;
+  TestSetName(eventContext->Operation.Lock.FileName,
+              &eventContext->Operation.Lock.FileNameLength, INFO_TEST_NAME);
+  eventContext->Operation.Lock.Length.QuadPart = 16;
+
+  DispatchLock(TestMountHandle(), eventContext, Instance);
+  CHECK(TestLastReply(NULL)->Status == STATUS_SUCCESS);
+  free(eventContext);
+}
+
+static VOID InfoTestCleanupFile(PDOKAN_INSTANCE Instance,
+                                PDOKAN_OPEN_INFO OpenInfo) {
+  PEVENT_CONTEXT eventContext =
+      TestNewEvent(IRP_MJ_CLEANUP, OpenInfo, sizeof(INFO_TEST_NAME));
+
+  if (eventContext == NULL) {
+    return;
+  }
+  TestSetName(eventContext->Operation.Cleanup.FileName,
+              &eventContext->Operation.Cleanup.FileNameLength,
+              INFO_TEST_NAME);
+
+  DispatchCleanup(TestMountHandle(), eventContext, Instance);
+  CHECK(TestLastReply(NULL)->Status == STATUS_SUCCESS);
+  free(eventContext);
+}
+
+VOID InfoCacheTest(VOID) {
+  PDOKAN_INSTANCE instance;
+  PDOKAN_OPEN_INFO openInfo;
+
+  instance = InfoTestMount(60 * 1000);
+  openInfo = TestOpen(instance, FALSE);
+
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(g_InfoCalls == 1);
+
+  InfoTestWrite(instance, openInfo);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(g_InfoCalls == 2);
+
+  InfoTestSetEndOfFileInfo(instance, openInfo);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(g_InfoCalls == 3);
+
+  InfoTestLock(instance, openInfo);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(g_InfoCalls == 4);
+
+  InfoTestCleanupFile(instance, openInfo);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(g_InfoCalls == 5);
+
+  TestClose(instance, openInfo);
+  TestUnmount(instance);
+
+  // without a timeout every query reaches the file system
+  instance = InfoTestMount(0);
+  openInfo = TestOpen(instance, FALSE);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(InfoTestQuery(instance, openInfo) == INFO_TEST_SIZE);
+  CHECK(g_InfoCalls == 2);
+  TestClose(instance, openInfo);
+  TestUnmount(instance);
+
+  TestFreeThreadReply();
+}
+
+VOID InfoCacheBench(VOID) {
+  const ULONG queryCount = 1000000;
+  const ULONG timeouts[] = {0, 60 * 1000};
+  PDOKAN_INSTANCE instance;
+  PDOKAN_OPEN_INFO openInfo;
+  LARGE_INTEGER start;
+  double seconds;
+  ULONG i, j;
+
+  printf("%-16s %14s %14s %14s\n", "cache timeout", "calls/query",
+         "ns/query", "queries/s");
+  for (i = 0; i < sizeof(timeouts) / sizeof(timeouts[0]); ++i) {
+    instance = InfoTestMount(timeouts[i]);
+    openInfo = TestOpen(instance, FALSE);
+    QueryPerformanceCounter(&start);
+    for (j = 0; j < queryCount; ++j) {
+      InfoTestQuery(instance, openInfo);
+    }
+    seconds = TestElapsed(start);
+    printf("%-16lu %14.3f %14.1f %14.0f\n", timeouts[i],
+           (double)g_InfoCalls / queryCount, seconds * 1e9 / queryCount,
+           queryCount / seconds);
+    TestClose(instance, openInfo);
+    TestUnmount(instance);
+  }
+  TestFreeThreadReply();
+}
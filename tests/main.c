@@ -0,0 +1,112 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+// The whole library is built into the test, its globals are set up the way
+// the loader would do it for dokan.dll
+BOOL WINAPI DllMain(HINSTANCE Instance, DWORD Reason, LPVOID Reserved);
+
+ULONG g_TestFailures = 0;
+
+typedef struct _DOKAN_TEST_ENTRY {
+  const char *Name;
+  VOID (*Run)(VOID);
+} DOKAN_TEST_ENTRY;
+
+static const DOKAN_TEST_ENTRY g_Tests[] = {
+    {"arena", ArenaTest},
+    {"batch", BatchTest},
+    {"channel", ChannelTest},
+    {"directory", DirectoryTest},
+    {"dirstore", DirStoreTest},
+    {"dispatch", DispatchTest},
+    {"fileid", FileIdTest},
+    {"infocache", InfoCacheTest},
+    {"matcher", MatcherTest},
+    {"pathcache", PathCacheTest},
+    {"pool", PoolTest},
+    {"read", ReadTest},
+    {"ring", RingTest},
+    {"security", SecurityTest},
+    {"utf16", Utf16Test},
+    {"volume", VolumeTest},
+    {"write", WriteTest},
+};
+
+static const DOKAN_TEST_ENTRY g_Benchmarks[] = {
+    {"arena", ArenaBench},
+    {"batch", BatchBench},
+    {"channel", ChannelBench},
+    {"directory", DirectoryBench},
+    {"dirstore", DirStoreBench},
+    {"dispatch", DispatchBench},
+    {"fileid", FileIdBench},
+    {"infocache", InfoCacheBench},
+    {"matcher", MatcherBench},
+    {"pathcache", PathCacheBench},
+    {"pool", PoolBench},
+    {"read", ReadBench},
+    {"ring", RingBench},
+    {"security", SecurityBench},
+    {"utf16", Utf16Bench},
+    {"volume", VolumeBench},
+    {"write", WriteBench},
+};
+
+double TestElapsed(LARGE_INTEGER Start) {
+  LARGE_INTEGER now;
+  LARGE_INTEGER frequency;
+
+  QueryPerformanceCounter(&now);
+  QueryPerformanceFrequency(&frequency);
+  return (double)(now.QuadPart - Start.QuadPart) / (double)frequency.QuadPart;
+}
+
+static VOID RunEntries(const DOKAN_TEST_ENTRY *Entries, ULONG Count,
+                       const char *Filter) {
+  ULONG i;
+
+  for (i = 0; i < Count; ++i) {
+    ULONG failures = g_TestFailures;
+
+    if (Filter != NULL && strcmp(Filter, Entries[i].Name) != 0) {
+      continue;
+    }
+    Entries[i].Run();
+    fprintf(stderr, "%-16s %s\n", Entries[i].Name,
+            failures == g_TestFailures ? "ok" : "FAILED");
+  }
+}
+
+// dokan_test [name]        run the tests
+// dokan_test bench [name]  run the benchmarks
+int __cdecl main(int argc, char *argv[]) {
+  DllMain(NULL, DLL_PROCESS_ATTACH, NULL);
+  if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+    RunEntries(g_Benchmarks, sizeof(g_Benchmarks) / sizeof(g_Benchmarks[0]),
+               argc > 2 ? argv[2] : NULL);
+  } else {
+    RunEntries(g_Tests, sizeof(g_Tests) / sizeof(g_Tests[0]),
+               argc > 1 ? argv[1] : NULL);
+  }
+  return g_TestFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,329 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+Name expression matching against the recursive matcher
+
+ReferenceMatch is the backtracking DokanIsNameInExpression the library
+shipped before the compiled matcher. Random expressions and names over a
+small alphabet are run through it, DokanIsNameInExpression and every kind
+of compiled matcher, and the three must agree. The reference reads past
+the end of the name when '?' or DOS_QM step over it, names are kept in a
+zeroed buffer longer than any expression to keep that in bounds.
+
+*/
+
+#define DOS_STAR (L'<')
+#define DOS_QM (L'>')
+#define DOS_DOT (L'"')
+
+#define MATCHER_MAX_EXPRESSION 10
+#define MATCHER_MAX_NAME 12
+
+static const WCHAR g_ExpressionAlphabet[] = L"aAbB.c*?<>\"";
+static const WCHAR g_NameAlphabet[] = L"aAbB..c";
+
+static ULONG g_Seed;
+
+static ULONG MatcherRandom(ULONG Range) {
+  // xorshift, the sequence does not depend on the CRT
+  g_Seed ^= g_Seed << 13;
+  g_Seed ^= g_Seed >> 17;
+  g_Seed ^= g_Seed << 5;
+  return g_Seed % Range;
+}
+
+static BOOL ReferenceMatch(LPCWSTR Expression, LPCWSTR Name,
+                           BOOL IgnoreCase) {
+  ULONG ei = 0;
+  ULONG ni = 0;
+
+  while (Expression[ei] != '\0') {
+
+    if (Expression[ei] == L'*') {
+      ei++;
+      if (Expression[ei] == '\0')
+        return TRUE;
+
+      while (Name[ni] != '\0') {
+        if (ReferenceMatch(&Expression[ei], &Name[ni], IgnoreCase))
+          return TRUE;
+        ni++;
+      }
+
+    } else if (Expression[ei] == DOS_STAR) {
+
+      ULONG p = ni;
+      ULONG lastDot = 0;
+      BOOL endReached = FALSE;
+      ei++;
+
+      while (Name[p] != '\0') {
+        if (Name[p] == L'.')
+          lastDot = p;
+        p++;
+      }
+
+      while (!endReached) {
+
+        endReached = (Name[ni] == '\0' || ni == lastDot);
+
+        if (!endReached) {
+          if (ReferenceMatch(&Expression[ei], &Name[ni], IgnoreCase))
+            return TRUE;
+
+          ni++;
+        }
+      }
+
+    } else if (Expression[ei] == DOS_QM) {
+
+      ei++;
+      if (Name[ni] != L'.') {
+        ni++;
+      } else {
+
+        ULONG p = ni + 1;
+        while (Name[p] != '\0') {
+          if (Name[p] == L'.')
+            break;
+          p++;
+        }
+
+        if (Name[p] == L'.')
+          ni++;
+      }
+
+    } else if (Expression[ei] == DOS_DOT) {
+      ei++;
+
+      if (Name[ni] == L'.')
+        ni++;
+
+    } else {
+      if (Expression[ei] == L'?') {
+        ei++;
+        ni++;
+      } else if (IgnoreCase &&
+                 towupper(Expression[ei]) == towupper(Name[ni])) {
+        ei++;
+        ni++;
+      } else if (!IgnoreCase && Expression[ei] == Name[ni]) {
+        ei++;
+        ni++;
+      } else {
+        return FALSE;
+      }
+    }
+  }
+
+  if (ei == wcslen(Expression) && ni == wcslen(Name))
+    return TRUE;
+
+  return FALSE;
+}
+
+// Checks the three matchers agree on Expression and Name, returns the
+// reference result
+static BOOL MatcherCheck(LPCWSTR Expression, LPCWSTR Name, BOOL IgnoreCase) {
+  WCHAR name[MATCHER_MAX_NAME + DOKAN_MATCH_STACK_LENGTH + 2];
+  PDOKAN_NAME_MATCHER matcher;
+  ULONG nameLength = (ULONG)wcslen(Name);
+  BOOL expected;
+  BOOL match;
+  BOOL compiled = FALSE;
+
+  ZeroMemory(name, sizeof(name));
+  RtlCopyMemory(name, Name, nameLength * sizeof(WCHAR));
+  expected = ReferenceMatch(Expression, name, IgnoreCase);
+
+  match = DokanIsNameInExpression(Expression, name, IgnoreCase);
+  matcher = DokanCompileNameExpression(Expression, IgnoreCase);
+  CHECK(matcher != NULL);
+  if (matcher != NULL) {
+    compiled = DokanMatchName(matcher, name, nameLength);
+    DokanFreeNameMatcher(matcher);
+  }
+
+  if (match != expected || compiled != expected) {
+    fprintf(stderr, "  \"%ls\" ~ \"%ls\" (%s): reference %d, "
+                    "DokanIsNameInExpression %d, compiled %d\n",
+            Expression, Name, IgnoreCase ? "ignore case" : "case", expected,
+            match, compiled);
+    g_TestFailures++;
+  }
+  return expected;
+}
+
+typedef struct _MATCHER_CASE {
+  LPCWSTR Expression;
+  LPCWSTR Name;
+  BOOL IgnoreCase;
+  BOOL Match;
+} MATCHER_CASE;
+
+static const MATCHER_CASE g_MatcherCases[] = {
+    {L"*", L"file.txt", TRUE, TRUE},
+    {L"*", L"", TRUE, TRUE},
+    {L"FILE.TXT", L"file.txt", TRUE, TRUE},
+    {L"FILE.TXT", L"file.txt", FALSE, FALSE},
+    {L"file*", L"file.txt", FALSE, TRUE},
+    {L"file*", L"fil", FALSE, FALSE},
+    {L"*.TXT", L"file.txt", TRUE, TRUE},
+    {L"*.txt", L"file.txt.bak", TRUE, FALSE},
+    {L"f?le.*", L"file.c", TRUE, TRUE},
+    {L"*.*", L"file", TRUE, FALSE},
+    {L"<.TXT", L"a.b.txt", TRUE, TRUE},
+    {L"<\"*", L"file", TRUE, TRUE},
+    {L"FILE>>>>\"TXT", L"file.txt", TRUE, TRUE},
+    {L"a?", L"a", TRUE, FALSE},
+    {L"a?*", L"a", TRUE, TRUE},
+};
+
+static VOID MatcherTestCases(VOID) {
+  ULONG i;
+
+  for (i = 0; i < sizeof(g_MatcherCases) / sizeof(g_MatcherCases[0]); ++i) {
+    CHECK(MatcherCheck(g_MatcherCases[i].Expression, g_MatcherCases[i].Name,
+                       g_MatcherCases[i].IgnoreCase) ==
+          g_MatcherCases[i].Match);
+  }
+}
+
+static VOID MatcherTestRandom(VOID) {
+  WCHAR expression[MATCHER_MAX_EXPRESSION + 1];
+  WCHAR name[MATCHER_MAX_NAME + 1];
+  ULONG round;
+  ULONG i;
+
+  g_Seed = 0x2545F491;
+  for (round = 0; round < 200000; ++round) {
+    ULONG expressionLength = MatcherRandom(MATCHER_MAX_EXPRESSION + 1);
+    ULONG nameLength = MatcherRandom(MATCHER_MAX_NAME + 1);
+
+    for (i = 0; i < expressionLength; ++i) {
+      expression[i] = g_ExpressionAlphabet[MatcherRandom(
+          (ULONG)wcslen(g_ExpressionAlphabet))];
+    }
+    expression[expressionLength] = L'\0';
+    for (i = 0; i < nameLength; ++i) {
+      name[i] = g_NameAlphabet[MatcherRandom((ULONG)wcslen(g_NameAlphabet))];
+    }
+    name[nameLength] = L'\0';
+
+    MatcherCheck(expression, name, MatcherRandom(2));
+    if (g_TestFailures > 10) {
+      break;
+    }
+  }
+}
+
+// Expressions longer than DOKAN_MATCH_STACK_LENGTH are compiled by
+// DokanIsNameInExpression instead of being matched on the stack
+static VOID MatcherTestLongExpression(VOID) {
+  WCHAR expression[DOKAN_MATCH_STACK_LENGTH + 8];
+  WCHAR name[DOKAN_MATCH_STACK_LENGTH + 8];
+  ULONG length = DOKAN_MATCH_STACK_LENGTH + 4;
+  ULONG i;
+
+  for (i = 0; i < length; ++i) {
+    expression[i] = i % 2 ? L'?' : L'A';
+    name[i] = i % 2 ? L'b' : L'a';
+  }
+  expression[length] = L'\0';
+  name[length] = L'\0';
+  CHECK(MatcherCheck(expression, name, TRUE));
+  CHECK(!MatcherCheck(expression, name, FALSE));
+
+  expression[length - 1] = L'*';
+  name[length - 1] = L'\0';
+  CHECK(MatcherCheck(expression, name, TRUE));
+}
+
+VOID MatcherTest(VOID) {
+  MatcherTestCases();
+  MatcherTestRandom();
+  MatcherTestLongExpression();
+}
+
+// A listing of names filtered by a pattern, like FilterFindData does
+VOID MatcherBench(VOID) {
+  static const LPCWSTR patterns[] = {L"*", L"*.TXT", L"FILE_1*",
+                                     L"<.TXT", L"F?LE_*7.*"};
+  const ULONG nameCount = 200000;
+  WCHAR(*names)[32] = malloc(nameCount * sizeof(*names));
+  PULONG lengths = malloc(nameCount * sizeof(ULONG));
+  LARGE_INTEGER start;
+  double reference;
+  double compiled;
+  ULONG i, j;
+
+  CHECK(names != NULL && lengths != NULL);
+  if (names == NULL || lengths == NULL) {
+    free(names);
+    free(lengths);
+    return;
+  }
+  // names of a listing come with their length
+  for (j = 0; j < nameCount; ++j) {
+    lengths[j] = (ULONG)swprintf(names[j], 32,
+                                 j % 3 ? L"file_%u.txt" : L"file_%u.dat", j);
+  }
+
+  printf("%-16s %14s %14s\n", "pattern", "reference ns", "compiled ns");
+  for (i = 0; i < sizeof(patterns) / sizeof(patterns[0]); ++i) {
+    PDOKAN_NAME_MATCHER matcher =
+        DokanCompileNameExpression(patterns[i], TRUE);
+    ULONG referenceMatches = 0;
+    ULONG matches = 0;
+
+    CHECK(matcher != NULL);
+    if (matcher == NULL) {
+      break;
+    }
+
+    QueryPerformanceCounter(&start);
+    for (j = 0; j < nameCount; ++j) {
+      if (ReferenceMatch(patterns[i], names[j], TRUE)) {
+        referenceMatches++;
+      }
+    }
+    reference = TestElapsed(start);
+
+    QueryPerformanceCounter(&start);
+    for (j = 0; j < nameCount; ++j) {
+      if (DokanMatchName(matcher, names[j], lengths[j])) {
+        matches++;
+      }
+    }
+    compiled = TestElapsed(start);
+
+    CHECK(matches == referenceMatches);
+    DokanFreeNameMatcher(matcher);
+    printf("%-16ls %14.1f %14.1f\n", patterns[i],
+           reference * 1e9 / nameCount, compiled * 1e9 / nameCount);
+  }
+  free(names);
+  free(lengths);
+}
@@ -0,0 +1,405 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+Path-keyed cache shared by the directory, file information, negative and
+security caches
+
+Entries carry a ULONG payload. The tests cover lookups by spelling and tag,
+invalidation of a path and of its subtree, the generation check of inserts,
+expiry and the count and size limits, the sharing of descriptors by the
+security cache, then what a create tells the negative cache.
+
+*/
+
+typedef struct _TEST_CACHE_ENTRY {
+  DOKAN_PATH_CACHE_ENTRY Header;
+  ULONG Value;
+} TEST_CACHE_ENTRY, *PTEST_CACHE_ENTRY;
+
+static ULONG g_PathCacheFreed;
+
+static VOID PathCacheTestFree(PDOKAN_PATH_CACHE Cache,
+                              PDOKAN_PATH_CACHE_ENTRY Entry) {
+  UNREFERENCED_PARAMETER(Cache);
+  g_PathCacheFreed++;
+  free(Entry);
+}
+
+static BOOL PathCacheTestCopy(PDOKAN_PATH_CACHE_ENTRY Entry, PVOID Context) {
+  *(PULONG)Context = ((PTEST_CACHE_ENTRY)Entry)->Value;
+  return TRUE;
+}
+
+static VOID PathCacheTestInsert(PDOKAN_PATH_CACHE Cache, LPCWSTR Path,
+                                ULONG Tag, ULONG Value) {
+  PTEST_CACHE_ENTRY entry;
+  ULONG value;
+  ULONG64 generation;
+
+  DokanPathCacheLookup(Cache, Path, Tag, PathCacheTestCopy, &value,
+                       &generation);
+  entry = (PTEST_CACHE_ENTRY)DokanPathCacheAllocEntry(
+      Path, sizeof(TEST_CACHE_ENTRY), Tag);
+  CHECK(entry != NULL);
+  if (entry == NULL) {
+    return;
+  }
+  entry->Value = Value;
+  DokanPathCacheInsert(Cache, &entry->Header, generation);
+}
+
+// the cached value of Path and Tag, 0 when there is none
+static ULONG PathCacheTestLookup(PDOKAN_PATH_CACHE Cache, LPCWSTR Path,
+                                 ULONG Tag) {
+  ULONG value = 0;
+  ULONG64 generation;
+
+  if (!DokanPathCacheLookup(Cache, Path, Tag, PathCacheTestCopy, &value,
+                            &generation)) {
+    return 0;
+  }
+  return value;
+}
+
+static VOID PathCacheTestLookups(VOID) {
+  DOKAN_PATH_CACHE cache;
+  DOKAN_CACHE_STATS stats;
+
+  DokanInitPathCache(&cache, "test", PathCacheTestFree);
+  // disabled until started
+  PathCacheTestInsert(&cache, L"\\a", 0, 1);
+  CHECK(PathCacheTestLookup(&cache, L"\\a", 0) == 0);
+
+  DokanStartPathCache(&cache, 60000, 0, 0, FALSE);
+  PathCacheTestInsert(&cache, L"\\dir\\File.txt", 0, 1);
+  PathCacheTestInsert(&cache, L"\\dir\\File.txt", 1, 2);
+  PathCacheTestInsert(&cache, L"\\dir", 0, 3);
+  CHECK(PathCacheTestLookup(&cache, L"\\dir\\File.txt", 0) == 1);
+  CHECK(PathCacheTestLookup(&cache, L"\\DIR\\file.TXT", 0) == 1);
+  CHECK(PathCacheTestLookup(&cache, L"\\dir\\File.txt", 1) == 2);
+  CHECK(PathCacheTestLookup(&cache, L"\\dir\\File.txt", 2) == 0);
+  CHECK(PathCacheTestLookup(&cache, L"\\dir\\", 0) == 3);
+  CHECK(PathCacheTestLookup(&cache, L"\\di", 0) == 0);
+
+  // same key, replaced
+  PathCacheTestInsert(&cache, L"\\DIR", 0, 4);
+  CHECK(PathCacheTestLookup(&cache, L"\\dir", 0) == 4);
+
+  DokanGetPathCacheStats(&cache, &stats);
+  CHECK(stats.EntryCount == 3);
+  CHECK(stats.Hits == 6);
+  DokanDeletePathCache(&cache);
+
+  DokanInitPathCache(&cache, "test", PathCacheTestFree);
+  DokanStartPathCache(&cache, 60000, 0, 0, TRUE);
+  PathCacheTestInsert(&cache, L"\\dir\\File.txt", 0, 1);
+  PathCacheTestInsert(&cache, L"\\dir\\file.txt", 0, 2);
+  CHECK(PathCacheTestLookup(&cache, L"\\dir\\File.txt", 0) == 1);
+  CHECK(PathCacheTestLookup(&cache, L"\\dir\\file.txt", 0) == 2);
+  CHECK(PathCacheTestLookup(&cache, L"\\DIR\\FILE.TXT", 0) == 0);
+  // whatever the spelling
+  DokanPathCacheInvalidate(&cache, L"\\DIR\\FILE.TXT", 13, FALSE);
+  CHECK(PathCacheTestLookup(&cache, L"\\dir\\File.txt", 0) == 0);
+  CHECK(PathCacheTestLookup(&cache, L"\\dir\\file.txt", 0) == 0);
+  DokanDeletePathCache(&cache);
+}
+
+static VOID PathCacheTestInvalidate(VOID) {
+  DOKAN_PATH_CACHE cache;
+  PTEST_CACHE_ENTRY entry;
+  ULONG value;
+  ULONG64 generation;
+
+  DokanInitPathCache(&cache, "test", PathCacheTestFree);
+  DokanStartPathCache(&cache, 60000, 0, 0, FALSE);
+  PathCacheTestInsert(&cache, L"\\", 0, 1);
+  PathCacheTestInsert(&cache, L"\\a", 0, 2);
+  PathCacheTestInsert(&cache, L"\\a", 1, 3);
+  PathCacheTestInsert(&cache, L"\\a\\b", 0, 4);
+  PathCacheTestInsert(&cache, L"\\a\\b\\c", 0, 5);
+  PathCacheTestInsert(&cache, L"\\ab", 0, 6);
+
+  // every tag, not the subtree
+  DokanPathCacheInvalidate(&cache, L"\\A", 2, FALSE);
+  CHECK(PathCacheTestLookup(&cache, L"\\a", 0) == 0);
+  CHECK(PathCacheTestLookup(&cache, L"\\a", 1) == 0);
+  CHECK(PathCacheTestLookup(&cache, L"\\a\\b", 0) == 4);
+
+  // a prefix of the given path only
+  DokanPathCacheInvalidate(&cache, L"\\a\\b\\c", 4, TRUE);
+  CHECK(PathCacheTestLookup(&cache, L"\\a\\b", 0) == 0);
+  CHECK(PathCacheTestLookup(&cache, L"\\a\\b\\c", 0) == 0);
+  CHECK(PathCacheTestLookup(&cache, L"\\ab", 0) == 6);
+  CHECK(PathCacheTestLookup(&cache, L"\\", 0) == 1);
+
+  PathCacheTestInsert(&cache, L"\\a\\b", 0, 4);
+  DokanPathCacheInvalidate(&cache, L"\\", 1, TRUE);
+  CHECK(PathCacheTestLookup(&cache, L"\\", 0) == 0);
+  CHECK(PathCacheTestLookup(&cache, L"\\a\\b", 0) == 0);
+  CHECK(PathCacheTestLookup(&cache, L"\\ab", 0) == 0);
+
+  // an entry made across an invalidation is not kept
+  g_PathCacheFreed = 0;
+  CHECK(!DokanPathCacheLookup(&cache, L"\\x", 0, PathCacheTestCopy, &value,
+                              &generation));
+  DokanPathCacheInvalidate(&cache, L"\\y", 2, FALSE);
+  entry = (PTEST_CACHE_ENTRY)DokanPathCacheAllocEntry(
+      L"\\x", sizeof(TEST_CACHE_ENTRY), 0);
+  CHECK(entry != NULL);
+  if (entry != NULL) {
+    entry->Value = 7;
+    DokanPathCacheInsert(&cache, &entry->Header, generation);
+  }
+  CHECK(g_PathCacheFreed == 1);
+  CHECK(PathCacheTestLookup(&cache, L"\\x", 0) == 0);
+  DokanDeletePathCache(&cache);
+}
+
+static VOID PathCacheTestLimits(VOID) {
+  DOKAN_PATH_CACHE cache;
+  DOKAN_CACHE_STATS stats;
+  WCHAR path[16];
+  ULONG entrySize;
+  ULONG i;
+
+  DokanInitPathCache(&cache, "test", PathCacheTestFree);
+  DokanStartPathCache(&cache, 60000, 0, 4, FALSE);
+  for (i = 1; i <= 4; ++i) {
+    swprintf(path, 16, L"\\%u", i);
+    PathCacheTestInsert(&cache, path, 0, i);
+  }
+  // used, so \2 is now the least recently used
+  CHECK(PathCacheTestLookup(&cache, L"\\1", 0) == 1);
+  PathCacheTestInsert(&cache, L"\\5", 0, 5);
+  CHECK(PathCacheTestLookup(&cache, L"\\2", 0) == 0);
+  CHECK(PathCacheTestLookup(&cache, L"\\1", 0) == 1);
+  CHECK(PathCacheTestLookup(&cache, L"\\5", 0) == 5);
+  DokanGetPathCacheStats(&cache, &stats);
+  CHECK(stats.EntryCount == 4);
+  DokanDeletePathCache(&cache);
+
+  entrySize = sizeof(TEST_CACHE_ENTRY) + 2 * sizeof(WCHAR);
+  DokanInitPathCache(&cache, "test", PathCacheTestFree);
+  DokanStartPathCache(&cache, 60000, 3 * entrySize, 0, FALSE);
+  for (i = 1; i <= 5; ++i) {
+    swprintf(path, 16, L"\\%u", i);
+    PathCacheTestInsert(&cache, path, 0, i);
+  }
+  DokanGetPathCacheStats(&cache, &stats);
+  CHECK(stats.EntryCount == 3);
+  CHECK(stats.Size == 3 * entrySize);
+  CHECK(PathCacheTestLookup(&cache, L"\\2", 0) == 0);
+  CHECK(PathCacheTestLookup(&cache, L"\\3", 0) == 3);
+  DokanDeletePathCache(&cache);
+
+  DokanInitPathCache(&cache, "test", PathCacheTestFree);
+  DokanStartPathCache(&cache, 20, 0, 0, FALSE);
+  PathCacheTestInsert(&cache, L"\\a", 0, 1);
+  CHECK(PathCacheTestLookup(&cache, L"\\a", 0) == 1);
+  Sleep(40);
+  CHECK(PathCacheTestLookup(&cache, L"\\a", 0) == 0);
+  DokanGetPathCacheStats(&cache, &stats);
+  CHECK(stats.EntryCount == 0);
+
+  // everything given to the cache is released
+  g_PathCacheFreed = 0;
+  PathCacheTestInsert(&cache, L"\\a", 0, 1);
+  PathCacheTestInsert(&cache, L"\\b", 0, 2);
+  DokanDeletePathCache(&cache);
+  CHECK(g_PathCacheFreed == 2);
+}
+
+// descriptors of the security cache are shared by the paths that have the
+// same one and released with the last of them
+static VOID PathCacheTestSecurity(VOID) {
+  PDOKAN_INSTANCE instance = calloc(1, sizeof(DOKAN_INSTANCE));
+  PDOKAN_SECURITY_CACHE cache;
+  UCHAR descriptor1[40];
+  UCHAR descriptor2[40];
+  UCHAR buffer[40];
+  ULONG lengthNeeded;
+  ULONG64 generation;
+  DOKAN_CACHE_STATS stats;
+
+  CHECK(instance != NULL);
+  if (instance == NULL) {
+    return;
+  }
+  cache = &instance->SecurityCache;
+  memset(descriptor1, 1, sizeof(descriptor1));
+  memset(descriptor2, 2, sizeof(descriptor2));
+
+  DokanInitSecurityCache(cache);
+  DokanStartPathCache(&cache->Paths, 60000, 0,
+                      DOKAN_SECURITY_CACHE_MAX_ENTRIES, FALSE);
+  DokanSecurityCacheStore(instance, L"\\a", DACL_SECURITY_INFORMATION,
+                          descriptor1, sizeof(descriptor1), 0);
+  DokanSecurityCacheStore(instance, L"\\b", DACL_SECURITY_INFORMATION,
+                          descriptor1, sizeof(descriptor1), 0);
+  DokanSecurityCacheStore(instance, L"\\b", OWNER_SECURITY_INFORMATION,
+                          descriptor2, sizeof(descriptor2), 0);
+  CHECK(cache->DescriptorCount == 2);
+  DokanGetSecurityCacheStats(cache, &stats);
+  CHECK(stats.EntryCount == 3);
+  CHECK(stats.Size == cache->Paths.Size + cache->DescriptorSize);
+
+  CHECK(DokanSecurityCacheLookup(instance, L"\\B", DACL_SECURITY_INFORMATION,
+                                 buffer, sizeof(buffer), &lengthNeeded,
+                                 &generation));
+  CHECK(lengthNeeded == sizeof(descriptor1));
+  CHECK(memcmp(buffer, descriptor1, sizeof(descriptor1)) == 0);
+  // too small, only the length is given
+  memset(buffer, 0, sizeof(buffer));
+  CHECK(DokanSecurityCacheLookup(instance, L"\\b",
+                                 OWNER_SECURITY_INFORMATION, buffer, 10,
+                                 &lengthNeeded, &generation));
+  CHECK(lengthNeeded == sizeof(descriptor2));
+  CHECK(buffer[0] == 0);
+  CHECK(!DokanSecurityCacheLookup(instance, L"\\a",
+                                  GROUP_SECURITY_INFORMATION, buffer,
+                                  sizeof(buffer), &lengthNeeded,
+                                  &generation));
+
+  // both descriptors of \b go, the one of \a stays
+  DokanSecurityCacheInvalidate(instance, L"\\b", FALSE);
+  CHECK(cache->DescriptorCount == 1);
+  CHECK(DokanSecurityCacheLookup(instance, L"\\a", DACL_SECURITY_INFORMATION,
+                                 buffer, sizeof(buffer), &lengthNeeded,
+                                 &generation));
+
+  // not kept across an invalidation, nor its descriptor
+  DokanSecurityCacheInvalidate(instance, L"\\c", FALSE);
+  DokanSecurityCacheStore(instance, L"\\b", OWNER_SECURITY_INFORMATION,
+                          descriptor2, sizeof(descriptor2), generation);
+  CHECK(cache->DescriptorCount == 1);
+  CHECK(cache->Paths.Count == 1);
+
+  DokanSecurityCacheInvalidate(instance, L"\\", TRUE);
+  CHECK(cache->DescriptorCount == 0);
+  CHECK(cache->DescriptorSize == 0);
+  DokanDeleteSecurityCache(cache);
+  free(instance);
+}
+
+// a probe below a missing directory is forgotten once the directory is made
+static VOID PathCacheTestCreated(VOID) {
+  PDOKAN_INSTANCE instance = NewDokanInstance();
+  EVENT_INFORMATION eventInfo;
+  NTSTATUS status;
+  ULONG64 generation;
+
+  CHECK(instance != NULL);
+  if (instance == NULL) {
+    return;
+  }
+  DokanStartPathCache(&instance->NegativeCache, 60000, 0,
+                      DOKAN_NEGATIVE_CACHE_MAX_ENTRIES, FALSE);
+  CHECK(!DokanNegativeCacheLookup(instance, L"\\a\\x", &status, &generation));
+  DokanNegativeCacheStore(instance, L"\\a\\x", STATUS_OBJECT_PATH_NOT_FOUND,
+                          generation);
+  CHECK(!DokanNegativeCacheLookup(instance, L"\\b", &status, &generation));
+  DokanNegativeCacheStore(instance, L"\\b", STATUS_OBJECT_NAME_NOT_FOUND,
+                          generation);
+  CHECK(DokanNegativeCacheLookup(instance, L"\\a\\x", &status, &generation));
+  CHECK(status == STATUS_OBJECT_PATH_NOT_FOUND);
+
+  // only a create that made the file counts
+  ZeroMemory(&eventInfo, sizeof(EVENT_INFORMATION));
+  eventInfo.Operation.Create.Information = FILE_OPENED;
+  DokanInvalidateCreatedFile(instance, L"\\a", &eventInfo);
+  CHECK(DokanNegativeCacheLookup(instance, L"\\a\\x", &status, &generation));
+
+  // mkdir \a
+  eventInfo.Operation.Create.Information = FILE_CREATED;
+  DokanInvalidateCreatedFile(instance, L"\\a", &eventInfo);
+  CHECK(!DokanNegativeCacheLookup(instance, L"\\a\\x", &status, &generation));
+  CHECK(DokanNegativeCacheLookup(instance, L"\\b", &status, &generation));
+  CHECK(status == STATUS_OBJECT_NAME_NOT_FOUND);
+  DeleteDokanInstance(instance);
+}
+
+VOID PathCacheTest(VOID) {
+  PathCacheTestLookups();
+  PathCacheTestInvalidate();
+  PathCacheTestLimits();
+  PathCacheTestSecurity();
+  PathCacheTestCreated();
+}
+
+// Lookups of the files of a tree, hits and misses, then invalidations of
+// single files
+VOID PathCacheBench(VOID) {
+  const ULONG pathCount = 16384;
+  const ULONG rounds = 50;
+  WCHAR(*paths)[64] = malloc(pathCount * sizeof(*paths));
+  DOKAN_PATH_CACHE cache;
+  LARGE_INTEGER start;
+  ULONG hits = 0;
+  ULONG value;
+  ULONG64 generation;
+  double seconds;
+  ULONG i, round;
+
+  CHECK(paths != NULL);
+  if (paths == NULL) {
+    return;
+  }
+  for (i = 0; i < pathCount; ++i) {
+    swprintf(paths[i], 64, L"\\src\\module_%u\\include\\Header_%u.h", i / 64,
+             i);
+  }
+
+  DokanInitPathCache(&cache, "bench", NULL);
+  DokanStartPathCache(&cache, 600000, 0, pathCount, FALSE);
+  // half of the paths are cached
+  for (i = 0; i < pathCount; i += 2) {
+    PathCacheTestInsert(&cache, paths[i], 0, i + 1);
+  }
+  printf("%-24s %10s\n", "", "ns/op");
+
+  QueryPerformanceCounter(&start);
+  for (round = 0; round < rounds; ++round) {
+    for (i = 0; i < pathCount; ++i) {
+      hits += DokanPathCacheLookup(&cache, paths[i], 0, PathCacheTestCopy,
+                                   &value, &generation);
+    }
+  }
+  seconds = TestElapsed(start);
+  printf("%-24s %10.1f\n", "lookup",
+         seconds * 1e9 / ((double)pathCount * rounds));
+  CHECK(hits == pathCount / 2 * rounds);
+
+  QueryPerformanceCounter(&start);
+  for (i = 0; i < pathCount; ++i) {
+    DokanPathCacheInvalidate(&cache, paths[i],
+                             DokanPathCacheKeyLength(paths[i]), FALSE);
+  }
+  seconds = TestElapsed(start);
+  printf("%-24s %10.1f\n", "invalidate",
+         seconds * 1e9 / (double)pathCount);
+
+  DokanDeletePathCache(&cache);
+  free(paths);
+}
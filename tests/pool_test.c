@@ -0,0 +1,174 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+Object pools of an instance
+
+Opens come from OpenInfoPool and go back to it when the close reply
+releases them. After the first opens, the churn of a build tool opening
+and closing files is served from the free list: the benchmark reports
+the mallocs per open next to the time of an open / close pair, pooled
+and with malloc, from 1 to 8 threads.
+
+*/
+
+#define POOL_TEST_MAX_FREE 4
+
+typedef struct _POOL_RUN {
+  PDOKAN_INSTANCE Instance;
+  ULONG OpensPerThread;
+  // open and close with malloc and free instead of the pool
+  BOOL Malloc;
+} POOL_RUN;
+
+static VOID PoolTestObjects(VOID) {
+  DOKAN_OBJECT_POOL pool;
+  PVOID objects[POOL_TEST_MAX_FREE + 2];
+  ULONG i;
+
+  DokanInitObjectPool(&pool, 3, POOL_TEST_MAX_FREE);
+  CHECK(pool.ObjectSize >= sizeof(SLIST_ENTRY));
+  CHECK(pool.ObjectSize % MEMORY_ALLOCATION_ALIGNMENT == 0);
+
+  for (i = 0; i < POOL_TEST_MAX_FREE + 2; ++i) {
+    objects[i] = DokanPoolAlloc(&pool);
+    CHECK(objects[i] != NULL);
+    CHECK(((ULONG_PTR)objects[i] % MEMORY_ALLOCATION_ALIGNMENT) == 0);
+  }
+  CHECK(pool.InUseCount == POOL_TEST_MAX_FREE + 2);
+  CHECK(pool.MallocCount == POOL_TEST_MAX_FREE + 2);
+
+  // only MaxFree objects are kept
+  for (i = 0; i < POOL_TEST_MAX_FREE + 2; ++i) {
+    DokanPoolFree(&pool, objects[i]);
+  }
+  CHECK(pool.InUseCount == 0);
+  CHECK(pool.FreeCount == POOL_TEST_MAX_FREE);
+
+  // and handed out again before anything is allocated
+  for (i = 0; i < POOL_TEST_MAX_FREE + 1; ++i) {
+    objects[i] = DokanPoolAlloc(&pool);
+  }
+  CHECK(pool.AllocCount == 2 * POOL_TEST_MAX_FREE + 3);
+  CHECK(pool.MallocCount == POOL_TEST_MAX_FREE + 3);
+  CHECK(pool.FreeCount == 0);
+  for (i = 0; i < POOL_TEST_MAX_FREE + 1; ++i) {
+    DokanPoolFree(&pool, objects[i]);
+  }
+  DokanPoolFree(&pool, NULL);
+  CHECK(pool.InUseCount == 0);
+
+  DokanDeleteObjectPool(&pool);
+  CHECK(pool.FreeCount == 0);
+}
+
+static UINT WINAPI PoolTestThread(PVOID Param) {
+  POOL_RUN *run = (POOL_RUN *)Param;
+  PDOKAN_OPEN_INFO openInfo;
+  ULONG i;
+
+  for (i = 0; i < run->OpensPerThread; ++i) {
+    if (run->Malloc) {
+      openInfo = (PDOKAN_OPEN_INFO)malloc(sizeof(DOKAN_OPEN_INFO));
+      if (openInfo != NULL) {
+        ZeroMemory(openInfo, sizeof(DOKAN_OPEN_INFO));
+        openInfo->OpenCount = 1;
+      }
+      free(openInfo);
+    } else {
+      openInfo = TestOpen(run->Instance, FALSE);
+      if (openInfo != NULL) {
+        TestClose(run->Instance, openInfo);
+      }
+    }
+  }
+  return 0;
+}
+
+static VOID PoolTestChurn(VOID) {
+  const ULONG threadCount = 8;
+  DOKAN_OPTIONS options;
+  DOKAN_OPERATIONS operations;
+  PDOKAN_OBJECT_POOL pool;
+  POOL_RUN run;
+
+  ZeroMemory(&options, sizeof(DOKAN_OPTIONS));
+  ZeroMemory(&operations, sizeof(DOKAN_OPERATIONS));
+  ZeroMemory(&run, sizeof(POOL_RUN));
+  run.Instance = TestMount(&operations, &options);
+  run.OpensPerThread = 10000;
+  pool = &run.Instance->OpenInfoPool;
+
+  TestRunThreads(threadCount, PoolTestThread, &run);
+
+  // at most one object per thread was ever allocated
+  CHECK(pool->AllocCount == threadCount * run.OpensPerThread);
+  CHECK(pool->MallocCount >= 1 && pool->MallocCount <= threadCount);
+  CHECK(pool->InUseCount == 0);
+  CHECK(pool->FreeCount == pool->MallocCount);
+  TestUnmount(run.Instance);
+}
+
+VOID PoolTest(VOID) {
+  PoolTestObjects();
+  PoolTestChurn();
+}
+
+VOID PoolBench(VOID) {
+  const ULONG openCount = 4000000;
+  const ULONG threadCounts[] = {1, 4, 8};
+  DOKAN_OPTIONS options;
+  DOKAN_OPERATIONS operations;
+  LARGE_INTEGER start;
+  double poolSeconds;
+  double mallocSeconds;
+  LONG64 mallocCount;
+  POOL_RUN run;
+  ULONG i;
+
+  ZeroMemory(&operations, sizeof(DOKAN_OPERATIONS));
+  printf("%-16s %14s %14s %14s\n", "threads", "malloc/open", "pool ns",
+         "malloc ns");
+  for (i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); ++i) {
+    ZeroMemory(&options, sizeof(DOKAN_OPTIONS));
+    ZeroMemory(&run, sizeof(POOL_RUN));
+    run.Instance = TestMount(&operations, &options);
+    run.OpensPerThread = openCount / threadCounts[i];
+
+    QueryPerformanceCounter(&start);
+    TestRunThreads(threadCounts[i], PoolTestThread, &run);
+    poolSeconds = TestElapsed(start);
+    mallocCount = run.Instance->OpenInfoPool.MallocCount;
+
+    run.Malloc = TRUE;
+    QueryPerformanceCounter(&start);
+    TestRunThreads(threadCounts[i], PoolTestThread, &run);
+    mallocSeconds = TestElapsed(start);
+
+    printf("%-16lu %14.6f %14.1f %14.1f\n", threadCounts[i],
+           (double)mallocCount / openCount, poolSeconds * 1e9 / openCount,
+           mallocSeconds * 1e9 / openCount);
+    TestUnmount(run.Instance);
+  }
+}
@@ -0,0 +1,205 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+Read buffers
+
+ReadFile writes either into the reply, which the driver then copies to
+the requester, or straight into the requester's buffer mapped by the
+driver, the reply then being only a header. The test transport copies
+inline replies like the driver does. The benchmark reports the throughput
+of both for reads of 4KB to 8MB, ReadFile copying the bytes once.
+
+*/
+
+#define READ_TEST_NAME L"\\read.bin"
+#define READ_TEST_MAX_SIZE (8 * 1024 * 1024)
+
+typedef struct _READ_TEST {
+  PUCHAR File;
+  LONGLONG FileSize;
+  // the requester's buffer of a mapped read
+  PUCHAR Requester;
+} READ_TEST;
+
+static READ_TEST g_ReadTest;
+
+static NTSTATUS DOKAN_CALLBACK ReadTestReadFile(LPCWSTR FileName,
+                                                LPVOID Buffer,
+                                                DWORD BufferLength,
+                                                LPDWORD ReadLength,
+                                                LONGLONG Offset,
+                                                PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileInfo);
+
+  CHECK(wcscmp(FileName, READ_TEST_NAME) == 0);
+  *ReadLength = 0;
+  if (Offset < g_ReadTest.FileSize) {
+    *ReadLength = (DWORD)min(BufferLength, g_ReadTest.FileSize - Offset);
+    CopyMemory(Buffer, g_ReadTest.File + Offset, *ReadLength);
+  }
+  return STATUS_SUCCESS;
+}
+
+static DOKAN_OPERATIONS g_ReadOperations = {0};
+
+static DOKAN_OPTIONS g_ReadOptions;
+
+static PDOKAN_INSTANCE ReadTestMount(VOID) {
+  ULONG i;
+
+  g_ReadTest.File = (PUCHAR)malloc(READ_TEST_MAX_SIZE);
+  g_ReadTest.Requester = (PUCHAR)malloc(READ_TEST_MAX_SIZE);
+  CHECK(g_ReadTest.File != NULL && g_ReadTest.Requester != NULL);
+  for (i = 0; i < READ_TEST_MAX_SIZE; ++i) {
+    g_ReadTest.File[i] = (UCHAR)(i * 13 + i / 4096);
+  }
+  g_ReadTest.FileSize = READ_TEST_MAX_SIZE;
+  g_ReadOperations.ReadFile = ReadTestReadFile;
+  ZeroMemory(&g_ReadOptions, sizeof(DOKAN_OPTIONS));
+  return TestMount(&g_ReadOperations, &g_ReadOptions);
+}
+
+static VOID ReadTestUnmount(PDOKAN_INSTANCE Instance) {
+  TestUnmount(Instance);
+  TestFreeThreadReply();
+  free(g_ReadTest.File);
+  free(g_ReadTest.Requester);
+  ZeroMemory(&g_ReadTest, sizeof(READ_TEST));
+}
+
+static PEVENT_CONTEXT ReadTestEvent(PDOKAN_OPEN_INFO OpenInfo, BOOL Mapped,
+                                    ULONG Length, LONGLONG Offset) {
+  PEVENT_CONTEXT eventContext =
+      TestNewEvent(IRP_MJ_READ, OpenInfo, sizeof(READ_TEST_NAME));
+
+  if (eventContext == NULL) {
+    return NULL;
+  }
+  TestSetName(eventContext->Operation.Read.FileName,
+              &eventContext->Operation.Read.FileNameLength, READ_TEST_NAME);
+  eventContext->Operation.Read.ByteOffset.QuadPart = Offset;
+  eventContext->Operation.Read.BufferLength = Length;
+  if (Mapped) {
+    eventContext->Operation.Read.UserBuffer =
+        (ULONG64)(ULONG_PTR)g_ReadTest.Requester;
+  }
+  return eventContext;
+}
+
+// Read Length bytes at Offset, Expected of them being left in the file
+static VOID ReadTestOne(PDOKAN_INSTANCE Instance, PDOKAN_OPEN_INFO OpenInfo,
+                        BOOL Mapped, ULONG Length, LONGLONG Offset,
+                        ULONG Expected) {
+  PEVENT_CONTEXT eventContext =
+      ReadTestEvent(OpenInfo, Mapped, Length, Offset);
+  PEVENT_INFORMATION reply;
+  ULONG replyLength;
+
+  ZeroMemory(g_ReadTest.Requester, READ_TEST_MAX_SIZE);
+  DispatchRead(TestMountHandle(), eventContext, Instance);
+  reply = TestLastReply(&replyLength);
+  CHECK(reply != NULL);
+  if (reply == NULL) {
+    free(eventContext);
+    return;
+  }
+  CHECK(reply->SerialNumber == eventContext->SerialNumber);
+  CHECK(reply->BufferLength == Expected);
+  if (Expected == 0) {
+    CHECK(reply->Status == STATUS_END_OF_FILE);
+  } else {
+    CHECK(reply->Status == STATUS_SUCCESS);
+    CHECK(reply->Operation.Read.CurrentByteOffset.QuadPart ==
+          Offset + Expected);
+  }
+  if (Mapped) {
+    // the bytes are already where the requester wants them
+    CHECK(replyLength == sizeof(EVENT_INFORMATION));
+    CHECK(memcmp(g_ReadTest.Requester, g_ReadTest.File + Offset, Expected) ==
+          0);
+    CHECK(Expected == Length || g_ReadTest.Requester[Expected] == 0);
+  } else {
+    CHECK(replyLength >= sizeof(EVENT_INFORMATION) - 8 + Expected);
+    CHECK(memcmp(reply->Buffer, g_ReadTest.File + Offset, Expected) == 0);
+  }
+  free(eventContext);
+}
+
+VOID ReadTest(VOID) {
+  PDOKAN_INSTANCE instance = ReadTestMount();
+  PDOKAN_OPEN_INFO openInfo = TestOpen(instance, FALSE);
+  BOOL mapped;
+
+  for (mapped = FALSE; mapped <= TRUE; ++mapped) {
+    ReadTestOne(instance, openInfo, mapped, 4096, 0, 4096);
+    ReadTestOne(instance, openInfo, mapped, 1024 * 1024, 4096, 1024 * 1024);
+    // short reads at the end of the file
+    ReadTestOne(instance, openInfo, mapped, 64 * 1024,
+                READ_TEST_MAX_SIZE - 1000, 1000);
+    ReadTestOne(instance, openInfo, mapped, 4096, READ_TEST_MAX_SIZE, 0);
+  }
+  ReadTestOne(instance, openInfo, TRUE, READ_TEST_MAX_SIZE, 0,
+              READ_TEST_MAX_SIZE);
+
+  TestClose(instance, openInfo);
+  ReadTestUnmount(instance);
+}
+
+VOID ReadBench(VOID) {
+  const ULONG sizes[] = {4096, 64 * 1024, 1024 * 1024, READ_TEST_MAX_SIZE};
+  const ULONG byteBudget = 512 * 1024 * 1024;
+  PDOKAN_INSTANCE instance = ReadTestMount();
+  PDOKAN_OPEN_INFO openInfo = TestOpen(instance, FALSE);
+  DOKAN_REPLY_ARENA arena;
+  PEVENT_CONTEXT eventContext;
+  LARGE_INTEGER start;
+  BOOL mapped;
+  ULONG count;
+  ULONG i, j;
+
+  // like a worker of DokanLoop
+  DokanInitReplyArena(&arena);
+  DokanSetThreadArena(&arena);
+  printf("%-16s %14s %14s\n", "KB, MB/s", "inline", "mapped");
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    count = max(16, byteBudget / sizes[i]);
+    printf("%-16lu", sizes[i] / 1024);
+    for (mapped = FALSE; mapped <= TRUE; ++mapped) {
+      eventContext = ReadTestEvent(openInfo, mapped, sizes[i], 0);
+      QueryPerformanceCounter(&start);
+      for (j = 0; j < count; ++j) {
+        DispatchRead(TestMountHandle(), eventContext, instance);
+      }
+      printf(" %14.0f",
+             (double)sizes[i] * count / (1024 * 1024) / TestElapsed(start));
+      free(eventContext);
+    }
+    printf("\n");
+  }
+  DokanSetThreadArena(NULL);
+  DokanDeleteReplyArena(&arena);
+  TestClose(instance, openInfo);
+  ReadTestUnmount(instance);
+}
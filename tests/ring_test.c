@@ -0,0 +1,556 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+Event ring of sys/ring.h
+
+The ring alone: full and empty, wraparound, one wakeup per empty to
+non-empty transition, Attach rejecting headers that do not describe a ring
+and slot lengths bounded on the consumer side. Then producers and consumers
+on 2 and 64 slots, sleeping on an auto-reset event like the driver and the
+library do: every item must arrive exactly once, intact, without a consumer
+left asleep on a non-empty ring.
+
+Through the library: the test plays the driver on the rings IOCTL_EVENT_RING
+maps in the fixture, submits flushes and reads the replies back.
+
+*/
+
+#define RING_TEST_NAME L"\\ring.txt"
+// a consumer asleep this long on a non-empty ring missed its wakeup
+#define RING_TEST_WAKEUP_TIMEOUT 2000
+
+typedef struct _RING_ITEM {
+  ULONG Item;
+  ULONG Check;
+  // a cache line per item
+  ULONG Padding[14];
+} RING_ITEM;
+
+typedef struct _RING_STRESS {
+  DOKAN_RING Ring;
+  PVOID Memory;
+  HANDLE NotEmpty;
+  ULONG Producers;
+  ULONG ItemsPerProducer;
+  volatile LONG NextThread;
+  volatile LONG ProducersLeft;
+  // times each item was consumed
+  volatile LONG *Seen;
+  volatile LONG Consumed;
+  volatile LONG Corrupted;
+  volatile LONG LostWakeups;
+} RING_STRESS;
+
+static PVOID RingTestNew(PDOKAN_RING Ring, ULONG SlotCount,
+                         ULONG PayloadSize) {
+  PVOID memory = calloc(1, DokanRingSize(SlotCount, PayloadSize));
+
+  CHECK(memory != NULL);
+  if (memory != NULL) {
+    CHECK(DokanRingInit(Ring, memory, SlotCount, PayloadSize));
+  }
+  return memory;
+}
+
+static VOID RingTestFullEmpty(VOID) {
+  DOKAN_RING ring;
+  PVOID memory = RingTestNew(&ring, 4, sizeof(ULONG));
+  ULONG value, length, tag;
+  ULONG i, lap;
+  int wake;
+
+  if (memory == NULL) {
+    return;
+  }
+  CHECK(DokanRingIsEmpty(&ring));
+  CHECK(!DokanRingConsume(&ring, &value, sizeof(value), &length, &tag));
+
+  // several laps over the 4 slots
+  for (lap = 0; lap < 5; ++lap) {
+    for (i = 0; i < 4; ++i) {
+      value = lap * 4 + i;
+      wake = 1;
+      CHECK(DokanRingProduce(&ring, &value, sizeof(value), 100 + value,
+                             &wake));
+      // nobody waits
+      CHECK(wake == 0);
+    }
+    CHECK(!DokanRingProduce(&ring, &value, sizeof(value), 0, &wake));
+    for (i = 0; i < 4; ++i) {
+      CHECK(DokanRingConsume(&ring, &value, sizeof(value), &length, &tag));
+      CHECK(value == lap * 4 + i);
+      CHECK(tag == 100 + value);
+      CHECK(length == sizeof(value));
+    }
+    CHECK(!DokanRingConsume(&ring, &value, sizeof(value), &length, &tag));
+  }
+
+  // larger than a slot
+  CHECK(!DokanRingProduce(&ring, &ring, DokanRingPayloadSize(&ring) + 1, 0,
+                          &wake));
+  free(memory);
+}
+
+static VOID RingTestWakeups(VOID) {
+  DOKAN_RING ring;
+  PVOID memory = RingTestNew(&ring, 4, sizeof(ULONG));
+  ULONG value = 7, length, tag;
+  int wake;
+
+  if (memory == NULL) {
+    return;
+  }
+
+  // a consumer goes to sleep on the empty ring
+  CHECK(DokanRingPrepareWait(&ring));
+  CHECK(ring.Header->Waiters == 1);
+  CHECK(DokanRingProduce(&ring, &value, sizeof(value), 0, &wake));
+  CHECK(wake != 0);
+  // still the same burst
+  CHECK(DokanRingProduce(&ring, &value, sizeof(value), 0, &wake));
+  CHECK(wake == 0);
+  DokanRingFinishWait(&ring);
+  CHECK(ring.Header->Waiters == 0);
+
+  // the ring is not empty: no sleep and no registration left behind
+  CHECK(!DokanRingPrepareWait(&ring));
+  CHECK(ring.Header->Waiters == 0);
+
+  // with another consumer asleep, the first one passes the wakeup on while
+  // slots are left
+  CHECK(DokanRingAddWaiters(&ring, 1));
+  CHECK(DokanRingConsume(&ring, &value, sizeof(value), &length, &tag));
+  CHECK(DokanRingWakeNext(&ring));
+  CHECK(DokanRingConsume(&ring, &value, sizeof(value), &length, &tag));
+  CHECK(!DokanRingWakeNext(&ring));
+  CHECK(DokanRingAddWaiters(&ring, -1));
+  CHECK(!DokanRingWakeNext(&ring));
+
+  free(memory);
+}
+
+static VOID RingTestAttach(VOID) {
+  DOKAN_RING ring;
+  DOKAN_RING view;
+  ULONG size = DokanRingSize(4, 8);
+  PVOID memory = RingTestNew(&ring, 4, 8);
+  PDOKAN_RING_HEADER header = (PDOKAN_RING_HEADER)memory;
+  ULONG value, length, tag;
+  ULONG64 big[4];
+  ULONG i;
+  int wake;
+
+  if (memory == NULL) {
+    return;
+  }
+  CHECK(DokanRingAttach(&view, memory, size));
+  CHECK(view.SlotCount == 4);
+  CHECK(DokanRingPayloadSize(&view) == 8);
+  CHECK(!DokanRingAttach(&view, memory, size - 1));
+  CHECK(!DokanRingAttach(&view, NULL, size));
+
+  header->Magic = 0;
+  CHECK(!DokanRingAttach(&view, memory, size));
+  header->Magic = DOKAN_RING_MAGIC;
+  header->SlotCount = 3;
+  CHECK(!DokanRingAttach(&view, memory, size));
+  header->SlotCount = 0x80000000;
+  CHECK(!DokanRingAttach(&view, memory, size));
+  header->SlotCount = 4;
+  header->SlotSize = sizeof(DOKAN_RING_SLOT) + 4;
+  CHECK(!DokanRingAttach(&view, memory, size));
+  header->SlotSize = 0;
+  CHECK(!DokanRingAttach(&view, memory, size));
+  header->SlotSize = DokanRingSlotSize(8);
+  CHECK(DokanRingAttach(&view, memory, size));
+
+  // the view keeps its geometry whatever the other side writes afterwards
+  header->SlotCount = 1024;
+  header->SlotSize = 4096;
+  for (i = 0; i < 8; ++i) {
+    CHECK(DokanRingProduce(&view, &i, sizeof(i), i, &wake));
+    CHECK(DokanRingConsume(&view, &value, sizeof(value), &length, &tag));
+    CHECK(value == i);
+  }
+
+  // a slot length out of bounds is cut to the slot, then to the buffer
+  CHECK(DokanRingProduce(&view, &i, sizeof(i), 0, &wake));
+  DokanRingSlot(&view, header->Head)->Length = 0xFFFFFFFF;
+  CHECK(DokanRingConsume(&view, big, sizeof(big), &length, &tag));
+  CHECK(length == DokanRingPayloadSize(&view));
+  CHECK(DokanRingProduce(&view, big, 8, 0, &wake));
+  CHECK(DokanRingConsume(&view, &value, sizeof(value), &length, &tag));
+  CHECK(length == sizeof(value));
+
+  free(memory);
+}
+
+static VOID RingStressProduce(RING_STRESS *Stress, ULONG Producer) {
+  RING_ITEM item;
+  ULONG i;
+  int wake;
+
+  ZeroMemory(&item, sizeof(RING_ITEM));
+  for (i = 0; i < Stress->ItemsPerProducer; ++i) {
+    item.Item = Producer * Stress->ItemsPerProducer + i;
+    item.Check = ~item.Item;
+    while (!DokanRingProduce(&Stress->Ring, &item, sizeof(RING_ITEM),
+                             item.Item, &wake)) {
+      SwitchToThread();
+    }
+    if (wake) {
+      SetEvent(Stress->NotEmpty);
+    }
+  }
+  if (InterlockedDecrement(&Stress->ProducersLeft) == 0) {
+    DokanRingClose(&Stress->Ring);
+    SetEvent(Stress->NotEmpty);
+  }
+}
+
+// the loop of DokanEventRingLoop
+static VOID RingStressConsume(RING_STRESS *Stress) {
+  ULONG total = Stress->Producers * Stress->ItemsPerProducer;
+  RING_ITEM item;
+  ULONG length, tag;
+
+  for (;;) {
+    if (DokanRingConsume(&Stress->Ring, &item, sizeof(RING_ITEM), &length,
+                         &tag)) {
+      if (DokanRingWakeNext(&Stress->Ring)) {
+        SetEvent(Stress->NotEmpty);
+      }
+      if (length != sizeof(RING_ITEM) || item.Check != ~item.Item ||
+          tag != item.Item || item.Item >= total) {
+        InterlockedIncrement(&Stress->Corrupted);
+        continue;
+      }
+      InterlockedIncrement(&Stress->Seen[item.Item]);
+      InterlockedIncrement(&Stress->Consumed);
+      continue;
+    }
+    if (DokanRingIsClosed(&Stress->Ring) && DokanRingIsEmpty(&Stress->Ring)) {
+      SetEvent(Stress->NotEmpty);
+      break;
+    }
+    if (DokanRingPrepareWait(&Stress->Ring)) {
+      if (WaitForSingleObject(Stress->NotEmpty, RING_TEST_WAKEUP_TIMEOUT) ==
+              WAIT_TIMEOUT &&
+          !DokanRingIsEmpty(&Stress->Ring)) {
+        InterlockedIncrement(&Stress->LostWakeups);
+      }
+      DokanRingFinishWait(&Stress->Ring);
+    }
+  }
+}
+
+static UINT WINAPI RingStressThread(PVOID Param) {
+  RING_STRESS *stress = (RING_STRESS *)Param;
+  ULONG index = (ULONG)InterlockedIncrement(&stress->NextThread) - 1;
+
+  if (index < stress->Producers) {
+    RingStressProduce(stress, index);
+  } else {
+    RingStressConsume(stress);
+  }
+  return 0;
+}
+
+// Returns the seconds taken, Stress is left for the checks
+static double RingStressRun(RING_STRESS *Stress, ULONG SlotCount,
+                            ULONG Producers, ULONG Consumers,
+                            ULONG ItemsPerProducer) {
+  LARGE_INTEGER start;
+  double seconds;
+
+  ZeroMemory(Stress, sizeof(RING_STRESS));
+  Stress->Memory = RingTestNew(&Stress->Ring, SlotCount, sizeof(RING_ITEM));
+  Stress->NotEmpty = CreateEvent(NULL, FALSE, FALSE, NULL);
+  Stress->Seen = (volatile LONG *)calloc(Producers * ItemsPerProducer,
+                                         sizeof(LONG));
+  CHECK(Stress->NotEmpty != NULL && Stress->Seen != NULL);
+  Stress->Producers = Producers;
+  Stress->ProducersLeft = (LONG)Producers;
+  Stress->ItemsPerProducer = ItemsPerProducer;
+
+  QueryPerformanceCounter(&start);
+  TestRunThreads(Producers + Consumers, RingStressThread, Stress);
+  seconds = TestElapsed(start);
+
+  CloseHandle(Stress->NotEmpty);
+  free(Stress->Memory);
+  return seconds;
+}
+
+static VOID RingTestStress(ULONG SlotCount) {
+  const ULONG producers = 4;
+  const ULONG itemsPerProducer = 20000;
+  RING_STRESS stress;
+  ULONG missing = 0;
+  ULONG i;
+
+  RingStressRun(&stress, SlotCount, producers, 4, itemsPerProducer);
+  for (i = 0; i < producers * itemsPerProducer; ++i) {
+    if (stress.Seen[i] != 1) {
+      missing++;
+    }
+  }
+  CHECK(missing == 0);
+  CHECK(stress.Consumed == (LONG)(producers * itemsPerProducer));
+  CHECK(stress.Corrupted == 0);
+  CHECK(stress.LostWakeups == 0);
+  free((PVOID)stress.Seen);
+}
+
+static volatile LONG g_RingTestFlushes = 0;
+
+static NTSTATUS DOKAN_CALLBACK RingTestFlush(LPCWSTR FileName,
+                                             PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileName);
+  UNREFERENCED_PARAMETER(FileInfo);
+
+  InterlockedIncrement(&g_RingTestFlushes);
+  return STATUS_SUCCESS;
+}
+
+static DOKAN_OPERATIONS g_RingOperations = {0};
+
+typedef struct _RING_ROUND_TRIP {
+  PDOKAN_INSTANCE Instance;
+  PDOKAN_OPEN_INFO OpenInfo;
+  ULONG EventCount;
+  ULONG FirstSerial;
+  // replies received for each event
+  volatile LONG *Seen;
+  // replies read from the completion ring and sent with IOCTL_EVENT_INFO
+  volatile LONG RingReplies;
+  volatile LONG IoctlReplies;
+  volatile LONG Mismatches;
+} RING_ROUND_TRIP;
+
+// run of RingRoundTrip, for RingTestIoctlReply
+static RING_ROUND_TRIP *g_RingRun = NULL;
+
+static VOID RingTestCheckReply(RING_ROUND_TRIP *Run,
+                               PEVENT_INFORMATION EventInfo, ULONG Length) {
+  ULONG index;
+
+  if (Length < sizeof(EVENT_INFORMATION)) {
+    InterlockedIncrement(&Run->Mismatches);
+    return;
+  }
+  index = EventInfo->SerialNumber - Run->FirstSerial;
+  if (index >= Run->EventCount ||
+      InterlockedIncrement(&Run->Seen[index]) != 1 ||
+      EventInfo->Status != STATUS_SUCCESS) {
+    InterlockedIncrement(&Run->Mismatches);
+  }
+}
+
+// replies that did not fit in the completion ring
+static BOOL RingTestIoctlReply(PEVENT_INFORMATION EventInfo, ULONG Length) {
+  RingTestCheckReply(g_RingRun, EventInfo, Length);
+  InterlockedIncrement(&g_RingRun->IoctlReplies);
+  return TRUE;
+}
+
+static PDOKAN_INSTANCE RingTestMount(DOKAN_OPTIONS *Options) {
+  ZeroMemory(Options, sizeof(DOKAN_OPTIONS));
+  g_RingOperations.FlushFileBuffers = RingTestFlush;
+  return TestMount(&g_RingOperations, Options);
+}
+
+// The driver side: submit EventCount flushes, read the replies back
+static VOID RingRoundTrip(RING_ROUND_TRIP *Run, ULONG SlotCount,
+                          ULONG ThreadCount, ULONG EventCount) {
+  static DOKAN_OPTIONS options;
+  TEST_EVENT_RING *driver = &g_TestEventRing;
+  PEVENT_CONTEXT eventContext = NULL;
+  PEVENT_INFORMATION reply;
+  ULONG replySize;
+  ULONG sent = 0;
+  ULONG length, tag;
+  int wake;
+
+  ZeroMemory(Run, sizeof(RING_ROUND_TRIP));
+  g_RingTestFlushes = 0;
+  g_RingRun = Run;
+  Run->EventCount = EventCount;
+  Run->Seen = (volatile LONG *)calloc(EventCount, sizeof(LONG));
+  CHECK(Run->Seen != NULL);
+  Run->Instance = RingTestMount(&options);
+  Run->OpenInfo = TestOpen(Run->Instance, FALSE);
+  TestSetReplyHook(RingTestIoctlReply);
+  TestGrantEventRing(Run->Instance, SlotCount,
+                     DOKAN_EVENT_RING_DEFAULT_PAYLOAD);
+  CHECK(DokanStartEventRing(Run->Instance, ThreadCount));
+  CHECK(Run->Instance->EventRing != NULL);
+  if (Run->Instance->EventRing == NULL) {
+    TestClose(Run->Instance, Run->OpenInfo);
+    TestUnmount(Run->Instance);
+    free((PVOID)Run->Seen);
+    return;
+  }
+
+  replySize = DokanRingPayloadSize(&driver->Complete);
+  reply = (PEVENT_INFORMATION)malloc(replySize);
+  CHECK(reply != NULL);
+
+  while ((ULONG)(Run->RingReplies + Run->IoctlReplies) < EventCount) {
+    BOOL progress = FALSE;
+
+    if (sent < EventCount && eventContext == NULL) {
+      eventContext = TestNewEvent(IRP_MJ_FLUSH_BUFFERS, Run->OpenInfo,
+                                  sizeof(RING_TEST_NAME));
+      TestSetName(eventContext->Operation.Flush.FileName,
+                  &eventContext->Operation.Flush.FileNameLength,
+                  RING_TEST_NAME);
+      if (sent == 0) {
+        Run->FirstSerial = eventContext->SerialNumber;
+      }
+    }
+    // DokanEventRingSubmit, the driver would use the waits when it is full
+    if (eventContext != NULL &&
+        DokanRingProduce(&driver->Submit, eventContext, eventContext->Length,
+                         eventContext->SerialNumber, &wake)) {
+      if (wake) {
+        SetEvent(driver->SubmitEvent);
+      }
+      free(eventContext);
+      eventContext = NULL;
+      sent++;
+      progress = TRUE;
+    }
+
+    // EventRingThread
+    while (DokanRingConsume(&driver->Complete, reply, replySize, &length,
+                            &tag)) {
+      if (length >= sizeof(EVENT_INFORMATION) && tag != reply->SerialNumber) {
+        InterlockedIncrement(&Run->Mismatches);
+      }
+      RingTestCheckReply(Run, reply, length);
+      InterlockedIncrement(&Run->RingReplies);
+      progress = TRUE;
+    }
+
+    // replies falling back to the ioctl do not signal the ring
+    if (!progress && DokanRingPrepareWait(&driver->Complete)) {
+      WaitForSingleObject(driver->CompleteEvent, 10);
+      DokanRingFinishWait(&driver->Complete);
+    }
+  }
+
+  CHECK(Run->Instance->EventRing->Events == (LONG64)EventCount);
+  CHECK(Run->Instance->EventRing->Replies == (LONG64)Run->RingReplies);
+  free(reply);
+
+  // every request gave its reference back
+  CHECK(Run->OpenInfo->OpenCount == 1);
+  TestClose(Run->Instance, Run->OpenInfo);
+  TestUnmount(Run->Instance);
+  free((PVOID)Run->Seen);
+  g_RingRun = NULL;
+}
+
+static VOID RingTestLibrary(VOID) {
+  const ULONG eventCount = 20000;
+  RING_ROUND_TRIP run;
+
+  RingRoundTrip(&run, 64, 4, eventCount);
+  CHECK(run.Mismatches == 0);
+  CHECK(g_RingTestFlushes == (LONG)eventCount);
+  CHECK((ULONG)(run.RingReplies + run.IoctlReplies) == eventCount);
+  CHECK(run.RingReplies > 0);
+
+  // the completion ring fills up, replies also take IOCTL_EVENT_INFO
+  RingRoundTrip(&run, 2, 4, eventCount);
+  CHECK(run.Mismatches == 0);
+  CHECK(g_RingTestFlushes == (LONG)eventCount);
+  CHECK((ULONG)(run.RingReplies + run.IoctlReplies) == eventCount);
+}
+
+static VOID RingTestNegotiation(VOID) {
+  static DOKAN_OPTIONS options;
+  PDOKAN_INSTANCE instance = RingTestMount(&options);
+
+  // not granted: nothing is mapped
+  CHECK(DokanStartEventRing(instance, 2));
+  CHECK(instance->EventRing == NULL);
+
+  // granted but IOCTL_EVENT_RING fails: the mount keeps the waits
+  TestGrantEventRing(instance, 0, DOKAN_EVENT_RING_DEFAULT_PAYLOAD);
+  CHECK(DokanStartEventRing(instance, 2));
+  CHECK(instance->EventRing == NULL);
+  CHECK(g_TestEventRing.Memory == NULL);
+
+  // mapped, but slots smaller than granted: the mount cannot start
+  TestGrantEventRing(instance, 8, 256);
+  instance->RingPayloadSize = 512;
+  CHECK(!DokanStartEventRing(instance, 2));
+  CHECK(instance->EventRing == NULL);
+  CHECK(g_TestEventRing.Memory != NULL);
+
+  TestUnmount(instance);
+}
+
+VOID RingTest(VOID) {
+  RingTestFullEmpty();
+  RingTestWakeups();
+  RingTestAttach();
+  RingTestStress(2);
+  RingTestStress(64);
+  RingTestNegotiation();
+  RingTestLibrary();
+}
+
+VOID RingBench(VOID) {
+  const ULONG itemCount = 2000000;
+  const ULONG threadCounts[] = {1, 2, 4, 8};
+  const ULONG eventCount = 200000;
+  RING_ROUND_TRIP run;
+  RING_STRESS stress;
+  LARGE_INTEGER start;
+  double seconds;
+  ULONG i;
+
+  printf("%-16s %14s %14s\n", "producers", "ns/item", "items/s");
+  for (i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); ++i) {
+    seconds = RingStressRun(&stress, 64, threadCounts[i], threadCounts[i],
+                            itemCount / threadCounts[i]);
+    free((PVOID)stress.Seen);
+    printf("%-16lu %14.1f %14.0f\n", threadCounts[i],
+           seconds * 1e9 / itemCount, itemCount / seconds);
+  }
+
+  printf("%-16s %14s %14s\n", "ring threads", "ns/event", "events/s");
+  for (i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); ++i) {
+    QueryPerformanceCounter(&start);
+    RingRoundTrip(&run, DOKAN_EVENT_RING_DEFAULT_SLOTS, threadCounts[i],
+                  eventCount);
+    seconds = TestElapsed(start);
+    printf("%-16lu %14.1f %14.0f\n", threadCounts[i],
+           seconds * 1e9 / eventCount, eventCount / seconds);
+  }
+}
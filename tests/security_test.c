@@ -0,0 +1,296 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+Security descriptors of a mount
+
+Files of a volume mostly share a handful of ACLs. Descriptors returned by
+GetFileSecurity are kept per path for SecurityCacheTimeout, one copy for
+all the paths that have the same bytes, and dropped by SetFileSecurity.
+The benchmark queries every file of a tree twice with a GetFileSecurity
+that spins like a remote call would, and reports the hit rate, the number
+of paths per stored descriptor and the bytes kept per path.
+
+*/
+
+#define SECURITY_TEST_ACLS 4
+#define SECURITY_TEST_DESCRIPTOR_SIZE 120
+#define SECURITY_TEST_NAME_LENGTH 64
+
+typedef struct _SECURITY_TEST {
+  // the descriptor of a file is chosen by the last digit of its name
+  UCHAR Descriptors[SECURITY_TEST_ACLS][SECURITY_TEST_DESCRIPTOR_SIZE];
+  ULONG GetCalls;
+  ULONG SetCalls;
+  // time GetFileSecurity takes, in microseconds
+  ULONG CallbackMicroseconds;
+} SECURITY_TEST;
+
+static SECURITY_TEST g_SecurityTest;
+
+static ULONG SecurityTestAcl(LPCWSTR FileName) {
+  return FileName[wcslen(FileName) - 1] % SECURITY_TEST_ACLS;
+}
+
+static NTSTATUS DOKAN_CALLBACK SecurityTestGetFileSecurity(
+    LPCWSTR FileName, PSECURITY_INFORMATION SecurityInformation,
+    PSECURITY_DESCRIPTOR SecurityDescriptor, ULONG BufferLength,
+    PULONG LengthNeeded, PDOKAN_FILE_INFO FileInfo) {
+  LARGE_INTEGER start;
+
+  UNREFERENCED_PARAMETER(SecurityInformation);
+  UNREFERENCED_PARAMETER(FileInfo);
+
+  g_SecurityTest.GetCalls++;
+  QueryPerformanceCounter(&start);
+  while (TestElapsed(start) * 1e6 < g_SecurityTest.CallbackMicroseconds) {
+  }
+  *LengthNeeded = SECURITY_TEST_DESCRIPTOR_SIZE;
+  if (BufferLength < SECURITY_TEST_DESCRIPTOR_SIZE) {
+    return STATUS_BUFFER_OVERFLOW;
+  }
+  CopyMemory(SecurityDescriptor,
+             g_SecurityTest.Descriptors[SecurityTestAcl(FileName)],
+             SECURITY_TEST_DESCRIPTOR_SIZE);
+  return STATUS_SUCCESS;
+}
+
+static NTSTATUS DOKAN_CALLBACK SecurityTestSetFileSecurity(
+    LPCWSTR FileName, PSECURITY_INFORMATION SecurityInformation,
+    PSECURITY_DESCRIPTOR SecurityDescriptor, ULONG BufferLength,
+    PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileName);
+  UNREFERENCED_PARAMETER(SecurityInformation);
+  UNREFERENCED_PARAMETER(SecurityDescriptor);
+  UNREFERENCED_PARAMETER(BufferLength);
+  UNREFERENCED_PARAMETER(FileInfo);
+
+  g_SecurityTest.SetCalls++;
+  return STATUS_SUCCESS;
+}
+
+static DOKAN_OPERATIONS g_SecurityOperations = {0};
+
+static DOKAN_OPTIONS g_SecurityOptions;
+
+static PDOKAN_INSTANCE SecurityTestMount(ULONG Timeout) {
+  ULONG i;
+
+  ZeroMemory(&g_SecurityTest, sizeof(SECURITY_TEST));
+  for (i = 0; i < SECURITY_TEST_ACLS; ++i) {
+    memset(g_SecurityTest.Descriptors[i], 'a' + i,
+           SECURITY_TEST_DESCRIPTOR_SIZE);
+  }
+  ZeroMemory(&g_SecurityOptions, sizeof(DOKAN_OPTIONS));
+  g_SecurityOptions.SecurityCacheTimeout = Timeout;
+  g_SecurityOperations.GetFileSecurity = SecurityTestGetFileSecurity;
+  g_SecurityOperations.SetFileSecurity = SecurityTestSetFileSecurity;
+  return TestMount(&g_SecurityOperations, &g_SecurityOptions);
+}
+
+// Query the DACL of FileName into a buffer of BufferLength bytes, returns
+// the reply of the calling thread
+static PEVENT_INFORMATION SecurityTestQuery(PDOKAN_INSTANCE Instance,
+                                            PDOKAN_OPEN_INFO OpenInfo,
+                                            LPCWSTR FileName,
+                                            ULONG BufferLength) {
+  PEVENT_CONTEXT eventContext =
+      TestNewEvent(IRP_MJ_QUERY_SECURITY, OpenInfo,
+                   SECURITY_TEST_NAME_LENGTH * sizeof(WCHAR));
+
+  if (eventContext == NULL) {
+    return NULL;
+  }
+  eventContext->Operation.Security.SecurityInformation =
+      DACL_SECURITY_INFORMATION;
+  eventContext->Operation.Security.BufferLength = BufferLength;
+  TestSetName(eventContext->Operation.Security.FileName,
+              &eventContext->Operation.Security.FileNameLength, FileName);
+  DispatchQuerySecurity(TestMountHandle(), eventContext, Instance);
+  free(eventContext);
+  return TestLastReply(NULL);
+}
+
+static VOID SecurityTestSet(PDOKAN_INSTANCE Instance,
+                            PDOKAN_OPEN_INFO OpenInfo, LPCWSTR FileName) {
+  PEVENT_CONTEXT eventContext = TestNewEvent(
+      IRP_MJ_SET_SECURITY, OpenInfo,
+      SECURITY_TEST_NAME_LENGTH * sizeof(WCHAR) +
+          SECURITY_TEST_DESCRIPTOR_SIZE);
+  PEVENT_INFORMATION reply;
+
+  if (eventContext == NULL) {
+    return;
+  }
+  eventContext->Operation.SetSecurity.SecurityInformation =
+      DACL_SECURITY_INFORMATION;
+  eventContext->Operation.SetSecurity.BufferLength =
+      SECURITY_TEST_DESCRIPTOR_SIZE;
+  eventContext->Operation.SetSecurity.BufferOffset =
+      sizeof(EVENT_CONTEXT) + SECURITY_TEST_NAME_LENGTH * sizeof(WCHAR);
+  TestSetName(eventContext->Operation.SetSecurity.FileName,
+              &eventContext->Operation.SetSecurity.FileNameLength, FileName);
+  DispatchSetSecurity(TestMountHandle(), eventContext, Instance);
+  reply = TestLastReply(NULL);
+  CHECK(reply != NULL && reply->Status == STATUS_SUCCESS);
+  free(eventContext);
+}
+
+// the DACL of FileName is answered with the descriptor of its ACL
+static VOID SecurityTestCheck(PDOKAN_INSTANCE Instance,
+                              PDOKAN_OPEN_INFO OpenInfo, LPCWSTR FileName) {
+  PEVENT_INFORMATION reply =
+      SecurityTestQuery(Instance, OpenInfo, FileName, 1024);
+
+  CHECK(reply != NULL);
+  if (reply == NULL) {
+    return;
+  }
+  CHECK(reply->Status == STATUS_SUCCESS);
+  CHECK(reply->BufferLength == SECURITY_TEST_DESCRIPTOR_SIZE);
+  CHECK(memcmp(reply->Buffer,
+               g_SecurityTest.Descriptors[SecurityTestAcl(FileName)],
+               SECURITY_TEST_DESCRIPTOR_SIZE) == 0);
+}
+
+static VOID SecurityTestName(PWCHAR Name, ULONG Index) {
+  swprintf(Name, SECURITY_TEST_NAME_LENGTH, L"\\dir%u\\file%u", Index / 100,
+           Index);
+}
+
+VOID SecurityTest(VOID) {
+  const ULONG fileCount = 400;
+  PDOKAN_INSTANCE instance = SecurityTestMount(60000);
+  PDOKAN_OPEN_INFO openInfo = TestOpen(instance, FALSE);
+  PDOKAN_OPEN_INFO dirInfo = TestOpen(instance, TRUE);
+  WCHAR name[SECURITY_TEST_NAME_LENGTH];
+  DOKAN_CACHE_STATS stats;
+  PEVENT_INFORMATION reply;
+  ULONG round;
+  ULONG i;
+
+  for (round = 0; round < 2; ++round) {
+    for (i = 0; i < fileCount; ++i) {
+      SecurityTestName(name, i);
+      SecurityTestCheck(instance, openInfo, name);
+    }
+  }
+  CHECK(g_SecurityTest.GetCalls == fileCount);
+  DokanGetSecurityCacheStats(&instance->SecurityCache, &stats);
+  CHECK(stats.Hits == fileCount);
+  CHECK(stats.EntryCount == fileCount);
+  // one copy of each ACL
+  CHECK(instance->SecurityCache.DescriptorCount == SECURITY_TEST_ACLS);
+
+  // a small buffer learns the length from the cache
+  reply = SecurityTestQuery(instance, openInfo, L"\\dir0\\file7", 16);
+  CHECK(reply != NULL && reply->Status == STATUS_BUFFER_OVERFLOW);
+  CHECK(reply != NULL && reply->BufferLength == SECURITY_TEST_DESCRIPTOR_SIZE);
+  CHECK(g_SecurityTest.GetCalls == fileCount);
+
+  // and is not cached from GetFileSecurity
+  reply = SecurityTestQuery(instance, openInfo, L"\\other", 16);
+  CHECK(reply != NULL && reply->Status == STATUS_BUFFER_OVERFLOW);
+  CHECK(g_SecurityTest.GetCalls == fileCount + 1);
+  SecurityTestCheck(instance, openInfo, L"\\other");
+  CHECK(g_SecurityTest.GetCalls == fileCount + 2);
+
+  // SetFileSecurity drops the file
+  SecurityTestSet(instance, openInfo, L"\\dir0\\file7");
+  SecurityTestCheck(instance, openInfo, L"\\dir0\\file7");
+  CHECK(g_SecurityTest.GetCalls == fileCount + 3);
+  SecurityTestCheck(instance, openInfo, L"\\dir0\\file8");
+  CHECK(g_SecurityTest.GetCalls == fileCount + 3);
+
+  // and on a directory, the files below that may inherit from it
+  SecurityTestSet(instance, dirInfo, L"\\dir1");
+  for (i = 0; i < fileCount; ++i) {
+    SecurityTestName(name, i);
+    SecurityTestCheck(instance, openInfo, name);
+  }
+  CHECK(g_SecurityTest.GetCalls == fileCount + 3 + 100);
+  CHECK(g_SecurityTest.SetCalls == 2);
+  CHECK(instance->SecurityCache.DescriptorCount == SECURITY_TEST_ACLS);
+
+  TestClose(instance, openInfo);
+  TestClose(instance, dirInfo);
+  TestUnmount(instance);
+
+  // nothing is kept without a timeout
+  instance = SecurityTestMount(0);
+  openInfo = TestOpen(instance, FALSE);
+  SecurityTestCheck(instance, openInfo, L"\\a");
+  SecurityTestCheck(instance, openInfo, L"\\a");
+  CHECK(g_SecurityTest.GetCalls == 2);
+  CHECK(instance->SecurityCache.DescriptorCount == 0);
+  TestClose(instance, openInfo);
+  TestUnmount(instance);
+  TestFreeThreadReply();
+}
+
+VOID SecurityBench(VOID) {
+  const ULONG fileCounts[] = {1000, 10000};
+  const ULONG timeouts[] = {0, 60000};
+  PDOKAN_INSTANCE instance;
+  PDOKAN_OPEN_INFO openInfo;
+  WCHAR name[SECURITY_TEST_NAME_LENGTH];
+  DOKAN_CACHE_STATS stats;
+  LARGE_INTEGER start;
+  double seconds;
+  ULONG round;
+  ULONG i, j, k;
+
+  printf("%-16s %14s %14s %14s %14s %14s\n", "files, cache", "queries/s",
+         "hit rate", "descriptors", "paths/desc", "bytes/path");
+  for (i = 0; i < sizeof(fileCounts) / sizeof(fileCounts[0]); ++i) {
+    for (j = 0; j < sizeof(timeouts) / sizeof(timeouts[0]); ++j) {
+      instance = SecurityTestMount(timeouts[j]);
+      openInfo = TestOpen(instance, FALSE);
+      g_SecurityTest.CallbackMicroseconds = 20;
+      QueryPerformanceCounter(&start);
+      for (round = 0; round < 2; ++round) {
+        for (k = 0; k < fileCounts[i]; ++k) {
+          SecurityTestName(name, k);
+          SecurityTestQuery(instance, openInfo, name, 1024);
+        }
+      }
+      seconds = TestElapsed(start);
+      DokanGetSecurityCacheStats(&instance->SecurityCache, &stats);
+      printf("%-8lu %-7s %14.0f %14.3f %14lu %14.1f %14.1f\n",
+             fileCounts[i], timeouts[j] != 0 ? "on" : "off",
+             2 * fileCounts[i] / seconds,
+             (double)stats.Hits / (2 * fileCounts[i]),
+             instance->SecurityCache.DescriptorCount,
+             instance->SecurityCache.DescriptorCount != 0
+                 ? (double)stats.EntryCount /
+                       instance->SecurityCache.DescriptorCount
+                 : 0.0,
+             stats.EntryCount != 0 ? (double)stats.Size / stats.EntryCount
+                                   : 0.0);
+      TestClose(instance, openInfo);
+      TestUnmount(instance);
+    }
+  }
+  TestFreeThreadReply();
+}
@@ -0,0 +1,198 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_TEST_H_
+#define DOKAN_TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../dokan/dokani.h"
+
+// Number of failed CHECKs, the process exit code is non zero when set
+extern ULONG g_TestFailures;
+
+#define CHECK(expr)                                                            \
+  do {                                                                         \
+    if (!(expr)) {                                                             \
+      fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__,        \
+              #expr);                                                          \
+      g_TestFailures++;                                                        \
+    }                                                                          \
+  } while (0)
+
+// Seconds elapsed since Start, Start being a QueryPerformanceCounter value
+double TestElapsed(LARGE_INTEGER Start);
+
+// Mount without a driver, see fixture.c
+
+#define TEST_MAX_THREADS 16
+
+typedef struct _TEST_MOUNT_COUNTERS {
+  volatile LONG64 Replies;
+  volatile LONG64 ResetTimeouts;
+  volatile LONG64 Controls;
+  volatile LONG64 PulledWrites;
+} TEST_MOUNT_COUNTERS;
+
+extern TEST_MOUNT_COUNTERS g_TestMountCounters;
+
+PDOKAN_INSTANCE TestMount(PDOKAN_OPERATIONS Operations,
+                          PDOKAN_OPTIONS Options);
+
+VOID TestUnmount(PDOKAN_INSTANCE Instance);
+
+// Handle to give to the Dispatch* functions
+HANDLE TestMountHandle(VOID);
+
+// Driver side of the event ring of the mount
+typedef struct _TEST_EVENT_RING {
+  // geometry IOCTL_EVENT_RING maps
+  ULONG SlotCount;
+  ULONG PayloadSize;
+  // both rings, NULL until IOCTL_EVENT_RING
+  PVOID Memory;
+  ULONG RingSize;
+  DOKAN_RING Submit;
+  DOKAN_RING Complete;
+  // events of the library, not owned
+  HANDLE SubmitEvent;
+  HANDLE CompleteEvent;
+} TEST_EVENT_RING;
+
+extern TEST_EVENT_RING g_TestEventRing;
+
+// Grant DOKAN_FEATURE_EVENT_RING to Instance like IOCTL_EVENT_START does,
+// DokanStartEventRing then maps SlotCount slots of PayloadSize bytes. A
+// SlotCount of 0 makes IOCTL_EVENT_RING fail.
+VOID TestGrantEventRing(PDOKAN_INSTANCE Instance, ULONG SlotCount,
+                        ULONG PayloadSize);
+
+// Close the submission ring like IOCTL_EVENT_RELEASE, TestUnmount does it
+VOID TestCloseEventRing(VOID);
+
+typedef BOOL (*TEST_REPLY_HOOK)(PEVENT_INFORMATION EventInfo, ULONG Length);
+
+// IOCTL_EVENT_INFO of every thread goes to Hook instead of being recorded,
+// until TestUnmount
+VOID TestSetReplyHook(TEST_REPLY_HOOK Hook);
+
+PDOKAN_OPEN_INFO TestOpen(PDOKAN_INSTANCE Instance, BOOL IsDirectory);
+
+VOID TestClose(PDOKAN_INSTANCE Instance, PDOKAN_OPEN_INFO OpenInfo);
+
+// Event on OpenInfo with ExtraLength bytes past EVENT_CONTEXT, free it
+PEVENT_CONTEXT TestNewEvent(UCHAR MajorFunction, PDOKAN_OPEN_INFO OpenInfo,
+                            ULONG ExtraLength);
+
+// Copy Name to an event, returns its length in bytes
+ULONG TestSetName(PWCHAR FileName, PULONG FileNameLength, LPCWSTR Name);
+
+// Last reply sent by the calling thread, NULL if none
+PEVENT_INFORMATION TestLastReply(PULONG Length);
+
+// Serial number of the last IOCTL_RESET_TIMEOUT of the calling thread
+ULONG TestLastResetSerial(VOID);
+
+// Event returned to the next IOCTL_EVENT_WRITE of the calling thread with
+// the same serial number, NULL to have it aborted
+VOID TestSetPulledWrite(PEVENT_CONTEXT EventContext);
+
+VOID TestFreeThreadReply(VOID);
+
+// Run Start(Context) on ThreadCount threads and wait for them
+VOID TestRunThreads(ULONG ThreadCount, UINT(WINAPI *Start)(PVOID),
+                    PVOID Context);
+
+// Tests, run by default
+
+VOID ArenaTest(VOID);
+
+VOID BatchTest(VOID);
+
+VOID ChannelTest(VOID);
+
+VOID DirectoryTest(VOID);
+
+VOID DirStoreTest(VOID);
+
+VOID DispatchTest(VOID);
+
+VOID FileIdTest(VOID);
+
+VOID InfoCacheTest(VOID);
+
+VOID MatcherTest(VOID);
+
+VOID PathCacheTest(VOID);
+
+VOID PoolTest(VOID);
+
+VOID ReadTest(VOID);
+
+VOID RingTest(VOID);
+
+VOID SecurityTest(VOID);
+
+VOID Utf16Test(VOID);
+
+VOID VolumeTest(VOID);
+
+VOID WriteTest(VOID);
+
+// Benchmarks, run with "dokan_test bench"
+
+VOID ArenaBench(VOID);
+
+VOID BatchBench(VOID);
+
+VOID ChannelBench(VOID);
+
+VOID DirectoryBench(VOID);
+
+VOID DirStoreBench(VOID);
+
+VOID DispatchBench(VOID);
+
+VOID FileIdBench(VOID);
+
+VOID InfoCacheBench(VOID);
+
+VOID MatcherBench(VOID);
+
+VOID PathCacheBench(VOID);
+
+VOID PoolBench(VOID);
+
+VOID ReadBench(VOID);
+
+VOID RingBench(VOID);
+
+VOID SecurityBench(VOID);
+
+VOID Utf16Bench(VOID);
+
+VOID VolumeBench(VOID);
+
+VOID WriteBench(VOID);
+
+#endif // DOKAN_TEST_H_
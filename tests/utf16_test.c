@@ -0,0 +1,258 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+UTF-16 helpers against towupper
+
+Strings are drawn from ASCII letters and separators mixed with a few
+non-ASCII characters, at every length and offset around the 8 character
+blocks handled with SSE2, and checked against a towupper loop.
+
+*/
+
+#define UTF16_MAX_LENGTH 40
+
+static const WCHAR g_Utf16Alphabet[] = L"aZz{@`\\._\x00e9\x00c9\x0101\x4e2d";
+
+static ULONG g_Utf16Seed;
+
+static ULONG Utf16Random(ULONG Range) {
+  g_Utf16Seed ^= g_Utf16Seed << 13;
+  g_Utf16Seed ^= g_Utf16Seed >> 17;
+  g_Utf16Seed ^= g_Utf16Seed << 5;
+  return g_Utf16Seed % Range;
+}
+
+static VOID Utf16RandomString(LPWSTR String, ULONG Length, BOOL Ascii) {
+  ULONG alphabet = Ascii ? 9 : (ULONG)wcslen(g_Utf16Alphabet);
+  ULONG i;
+
+  for (i = 0; i < Length; ++i) {
+    String[i] = g_Utf16Alphabet[Utf16Random(alphabet)];
+  }
+}
+
+// Another spelling of String, case changed at random
+static VOID Utf16RandomCase(LPWSTR Dest, LPCWSTR String, ULONG Length) {
+  ULONG i;
+
+  for (i = 0; i < Length; ++i) {
+    Dest[i] =
+        (WCHAR)(Utf16Random(2) ? towupper(String[i]) : towlower(String[i]));
+  }
+}
+
+static BOOL ReferenceEqual(LPCWSTR String1, LPCWSTR String2, ULONG Length,
+                           BOOL IgnoreCase) {
+  ULONG i;
+
+  for (i = 0; i < Length; ++i) {
+    WCHAR c1 = IgnoreCase ? (WCHAR)towupper(String1[i]) : String1[i];
+    WCHAR c2 = IgnoreCase ? (WCHAR)towupper(String2[i]) : String2[i];
+    if (c1 != c2) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static VOID Utf16TestUpcase(VOID) {
+  WCHAR source[UTF16_MAX_LENGTH + 8];
+  WCHAR upcased[UTF16_MAX_LENGTH + 8];
+  ULONG length, offset, round;
+  ULONG i;
+
+  for (round = 0; round < 200; ++round) {
+    for (length = 0; length <= UTF16_MAX_LENGTH; ++length) {
+      // unaligned loads and stores
+      for (offset = 0; offset < 3; ++offset) {
+        Utf16RandomString(source + offset, length, round % 2);
+        for (i = 0; i < sizeof(upcased) / sizeof(WCHAR); ++i) {
+          upcased[i] = L'#';
+        }
+        DokanUpcaseUtf16(upcased + offset, source + offset, length);
+        for (i = 0; i < length; ++i) {
+          if (upcased[offset + i] != (WCHAR)towupper(source[offset + i])) {
+            CHECK(upcased[offset + i] == (WCHAR)towupper(source[offset + i]));
+            return;
+          }
+        }
+        // nothing written past Length
+        CHECK(upcased[offset + length] == L'#');
+      }
+    }
+  }
+}
+
+static VOID Utf16TestEqual(VOID) {
+  WCHAR string1[UTF16_MAX_LENGTH + 1];
+  WCHAR string2[UTF16_MAX_LENGTH + 1];
+  ULONG length, round;
+
+  for (round = 0; round < 500; ++round) {
+    for (length = 0; length <= UTF16_MAX_LENGTH; ++length) {
+      BOOL ascii = round % 2;
+
+      Utf16RandomString(string1, length, ascii);
+      Utf16RandomCase(string2, string1, length);
+      // differ on one character now and then
+      if (length > 0 && Utf16Random(4) == 0) {
+        string2[Utf16Random(length)] =
+            g_Utf16Alphabet[Utf16Random((ULONG)wcslen(g_Utf16Alphabet))];
+      }
+
+      CHECK(DokanEqualUtf16(string1, string2, length, TRUE) ==
+            ReferenceEqual(string1, string2, length, TRUE));
+      CHECK(DokanEqualUtf16(string1, string2, length, FALSE) ==
+            ReferenceEqual(string1, string2, length, FALSE));
+      if (ReferenceEqual(string1, string2, length, TRUE)) {
+        CHECK(DokanHashUtf16(string1, length, TRUE) ==
+              DokanHashUtf16(string2, length, TRUE));
+      }
+      CHECK(DokanStartsWithUtf16(string1, length, string2, length / 2,
+                                 TRUE) ==
+            ReferenceEqual(string1, string2, length / 2, TRUE));
+      CHECK(!DokanStartsWithUtf16(string1, length / 2, string2, length / 2 + 1,
+                                  TRUE));
+    }
+  }
+}
+
+static VOID Utf16TestHash(VOID) {
+  WCHAR path[100];
+  WCHAR upcased[100];
+  ULONG i;
+
+  // longer than the upcase block of DokanHashUtf16
+  for (i = 0; i < 100; ++i) {
+    path[i] = L"\\documents\\Report"[i % 17];
+  }
+  DokanUpcaseUtf16(upcased, path, 100);
+  CHECK(DokanHashUtf16(path, 100, TRUE) == DokanHashUtf16(upcased, 100, TRUE));
+  CHECK(DokanHashUtf16(path, 100, FALSE) !=
+        DokanHashUtf16(upcased, 100, FALSE));
+  CHECK(DokanHashUtf16(path, 99, TRUE) != DokanHashUtf16(upcased, 100, TRUE));
+}
+
+VOID Utf16Test(VOID) {
+  g_Utf16Seed = 0x9E3779B9;
+  Utf16TestUpcase();
+  Utf16TestEqual();
+  Utf16TestHash();
+}
+
+// Paths of a mirrored tree: a few directories deep, short components,
+// lengths spread from about 10 to 150 characters
+static ULONG Utf16RandomPath(LPWSTR Path, ULONG MaxLength) {
+  static const LPCWSTR components[] = {
+      L"Users", L"Documents", L"src", L"dokan", L"Program Files", L"AppData",
+      L"Local", L"Temp", L"node_modules", L"build", L"file.txt",
+      L"README.md", L"a.out", L"report.docx", L"image.png"};
+  ULONG depth = 1 + Utf16Random(8);
+  ULONG length = 0;
+  ULONG i;
+
+  for (i = 0; i < depth; ++i) {
+    LPCWSTR component = components[Utf16Random(
+        sizeof(components) / sizeof(components[0]))];
+    ULONG componentLength = (ULONG)wcslen(component);
+
+    if (length + 1 + componentLength >= MaxLength) {
+      break;
+    }
+    Path[length++] = L'\\';
+    RtlCopyMemory(&Path[length], component, componentLength * sizeof(WCHAR));
+    length += componentLength;
+  }
+  Path[length] = L'\0';
+  return length;
+}
+
+VOID Utf16Bench(VOID) {
+  const ULONG pathCount = 4096;
+  const ULONG rounds = 200;
+  WCHAR(*paths)[160] = malloc(pathCount * sizeof(*paths));
+  WCHAR(*spellings)[160] = malloc(pathCount * sizeof(*spellings));
+  PULONG lengths = malloc(pathCount * sizeof(ULONG));
+  ULONG64 totalLength = 0;
+  LARGE_INTEGER start;
+  ULONG equal = 0;
+  ULONG hash = 0;
+  double seconds;
+  ULONG i, round;
+
+  CHECK(paths != NULL && spellings != NULL && lengths != NULL);
+  if (paths == NULL || spellings == NULL || lengths == NULL) {
+    free(paths);
+    free(spellings);
+    free(lengths);
+    return;
+  }
+
+  g_Utf16Seed = 0x9E3779B9;
+  for (i = 0; i < pathCount; ++i) {
+    lengths[i] = Utf16RandomPath(paths[i], 160);
+    Utf16RandomCase(spellings[i], paths[i], lengths[i] + 1);
+    totalLength += lengths[i];
+  }
+  printf("%u paths, %.1f characters on average\n", pathCount,
+         (double)totalLength / pathCount);
+  printf("%-24s %10s\n", "", "ns/path");
+
+  QueryPerformanceCounter(&start);
+  for (round = 0; round < rounds; ++round) {
+    for (i = 0; i < pathCount; ++i) {
+      equal += _wcsnicmp(paths[i], spellings[i], lengths[i]) == 0;
+    }
+  }
+  seconds = TestElapsed(start);
+  printf("%-24s %10.1f\n", "_wcsnicmp",
+         seconds * 1e9 / ((double)pathCount * rounds));
+
+  QueryPerformanceCounter(&start);
+  for (round = 0; round < rounds; ++round) {
+    for (i = 0; i < pathCount; ++i) {
+      equal += DokanEqualUtf16(paths[i], spellings[i], lengths[i], TRUE);
+    }
+  }
+  seconds = TestElapsed(start);
+  printf("%-24s %10.1f\n", "DokanEqualUtf16",
+         seconds * 1e9 / ((double)pathCount * rounds));
+
+  QueryPerformanceCounter(&start);
+  for (round = 0; round < rounds; ++round) {
+    for (i = 0; i < pathCount; ++i) {
+      hash ^= DokanHashUtf16(spellings[i], lengths[i], TRUE);
+    }
+  }
+  seconds = TestElapsed(start);
+  printf("%-24s %10.1f\n", "DokanHashUtf16",
+         seconds * 1e9 / ((double)pathCount * rounds));
+
+  CHECK(equal == 2 * pathCount * rounds);
+  UNREFERENCED_PARAMETER(hash);
+  free(paths);
+  free(spellings);
+  free(lengths);
+}
@@ -0,0 +1,257 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+#include "../dokan/fileinfo.h"
+
+/*
+
+Volume queries
+
+Label, serial and flags come from GetVolumeInformation once per mount.
+Free space is kept FreeSpaceCacheTimeout milliseconds, and with
+DOKAN_OPTION_FREE_SPACE_REFRESH expired figures are answered while they
+are refreshed. The callbacks spin like a remote stat would: the benchmark
+queries for half a second and reports the queries per second and
+callbacks per query without the cache, with it, and with the background
+refresh.
+
+*/
+
+#define VOLUME_TEST_LABEL L"DokanTest"
+
+typedef struct _VOLUME_TEST {
+  volatile LONG VolumeCalls;
+  volatile LONG FreeSpaceCalls;
+  // time the callbacks take, in microseconds
+  ULONG CallbackMicroseconds;
+} VOLUME_TEST;
+
+static VOLUME_TEST g_VolumeTest;
+
+static VOID VolumeTestSpin(VOID) {
+  LARGE_INTEGER start;
+
+  QueryPerformanceCounter(&start);
+  while (TestElapsed(start) * 1e6 < g_VolumeTest.CallbackMicroseconds) {
+  }
+}
+
+static NTSTATUS DOKAN_CALLBACK VolumeTestGetVolumeInformation(
+    LPWSTR VolumeNameBuffer, DWORD VolumeNameSize, LPDWORD VolumeSerialNumber,
+    LPDWORD MaximumComponentLength, LPDWORD FileSystemFlags,
+    LPWSTR FileSystemNameBuffer, DWORD FileSystemNameSize,
+    PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileInfo);
+
+  InterlockedIncrement(&g_VolumeTest.VolumeCalls);
+  VolumeTestSpin();
+  wcscpy_s(VolumeNameBuffer, VolumeNameSize, VOLUME_TEST_LABEL);
+  wcscpy_s(FileSystemNameBuffer, FileSystemNameSize, L"NTFS");
+  *VolumeSerialNumber = 0x19831116;
+  *MaximumComponentLength = 255;
+  *FileSystemFlags = FILE_CASE_PRESERVED_NAMES | FILE_UNICODE_ON_DISK;
+  return STATUS_SUCCESS;
+}
+
+// the free space shrinks by a cluster on each call
+static NTSTATUS DOKAN_CALLBACK VolumeTestGetDiskFreeSpace(
+    PULONGLONG FreeBytesAvailable, PULONGLONG TotalNumberOfBytes,
+    PULONGLONG TotalNumberOfFreeBytes, PDOKAN_FILE_INFO FileInfo) {
+  LONG calls = InterlockedIncrement(&g_VolumeTest.FreeSpaceCalls);
+
+  UNREFERENCED_PARAMETER(FileInfo);
+
+  VolumeTestSpin();
+  *TotalNumberOfBytes = 1024 * 1024 * 1024;
+  *FreeBytesAvailable = *TotalNumberOfBytes - (ULONGLONG)calls * 4096;
+  *TotalNumberOfFreeBytes = *FreeBytesAvailable;
+  return STATUS_SUCCESS;
+}
+
+static DOKAN_OPERATIONS g_VolumeOperations = {0};
+
+static DOKAN_OPTIONS g_VolumeOptions;
+
+static PDOKAN_INSTANCE VolumeTestMount(ULONG FreeSpaceTimeout,
+                                       BOOL BackgroundRefresh) {
+  ZeroMemory(&g_VolumeTest, sizeof(VOLUME_TEST));
+  ZeroMemory(&g_VolumeOptions, sizeof(DOKAN_OPTIONS));
+  g_VolumeOperations.GetVolumeInformation = VolumeTestGetVolumeInformation;
+  g_VolumeOperations.GetDiskFreeSpace = VolumeTestGetDiskFreeSpace;
+  g_VolumeOptions.FreeSpaceCacheTimeout = FreeSpaceTimeout;
+  if (BackgroundRefresh) {
+    g_VolumeOptions.Options |= DOKAN_OPTION_FREE_SPACE_REFRESH;
+  }
+  return TestMount(&g_VolumeOperations, &g_VolumeOptions);
+}
+
+// Query FsInformationClass, returns the reply of the calling thread
+static PEVENT_INFORMATION VolumeTestQuery(PDOKAN_INSTANCE Instance,
+                                          ULONG FsInformationClass) {
+  PEVENT_CONTEXT eventContext =
+      TestNewEvent(IRP_MJ_QUERY_VOLUME_INFORMATION, NULL, 0);
+
+  if (eventContext == NULL) {
+    return NULL;
+  }
+  eventContext->Operation.Volume.FsInformationClass = FsInformationClass;
+  eventContext->Operation.Volume.BufferLength = 512;
+  DispatchQueryVolumeInformation(TestMountHandle(), eventContext, Instance);
+  free(eventContext);
+  return TestLastReply(NULL);
+}
+
+// Free bytes of a FileFsFullSizeInformation reply
+static ULONGLONG VolumeTestFreeBytes(PDOKAN_INSTANCE Instance) {
+  PEVENT_INFORMATION reply =
+      VolumeTestQuery(Instance, FileFsFullSizeInformation);
+  PFILE_FS_FULL_SIZE_INFORMATION sizeInfo;
+
+  CHECK(reply != NULL && reply->Status == STATUS_SUCCESS);
+  if (reply == NULL || reply->Status != STATUS_SUCCESS) {
+    return 0;
+  }
+  sizeInfo = (PFILE_FS_FULL_SIZE_INFORMATION)reply->Buffer;
+  return sizeInfo->CallerAvailableAllocationUnits.QuadPart *
+         g_VolumeOptions.AllocationUnitSize;
+}
+
+static VOID VolumeTestInformation(VOID) {
+  PDOKAN_INSTANCE instance = VolumeTestMount(0, FALSE);
+  PEVENT_INFORMATION reply;
+  PFILE_FS_VOLUME_INFORMATION volumeInfo;
+  PFILE_FS_ATTRIBUTE_INFORMATION attrInfo;
+  DOKAN_CACHE_STATS stats;
+  ULONG i;
+
+  for (i = 0; i < 100; ++i) {
+    reply = VolumeTestQuery(instance, FileFsVolumeInformation);
+    CHECK(reply != NULL && reply->Status == STATUS_SUCCESS);
+    if (reply != NULL) {
+      volumeInfo = (PFILE_FS_VOLUME_INFORMATION)reply->Buffer;
+      CHECK(volumeInfo->VolumeSerialNumber == 0x19831116);
+      CHECK(volumeInfo->VolumeLabelLength ==
+            sizeof(VOLUME_TEST_LABEL) - sizeof(WCHAR));
+      CHECK(memcmp(volumeInfo->VolumeLabel, VOLUME_TEST_LABEL,
+                   volumeInfo->VolumeLabelLength) == 0);
+    }
+    reply = VolumeTestQuery(instance, FileFsAttributeInformation);
+    CHECK(reply != NULL && reply->Status == STATUS_SUCCESS);
+    if (reply != NULL) {
+      attrInfo = (PFILE_FS_ATTRIBUTE_INFORMATION)reply->Buffer;
+      CHECK(attrInfo->MaximumComponentNameLength == 255);
+      CHECK(attrInfo->FileSystemNameLength == 4 * sizeof(WCHAR));
+    }
+  }
+  // asked once for the lifetime of the mount
+  CHECK(g_VolumeTest.VolumeCalls == 1);
+  DokanGetVolumeCacheStats(&instance->VolumeCache, &stats);
+  CHECK(stats.Misses == 1);
+  CHECK(stats.Hits == 199);
+
+  // without a timeout, every free space query calls GetDiskFreeSpace
+  for (i = 0; i < 10; ++i) {
+    CHECK(VolumeTestFreeBytes(instance) ==
+          1024 * 1024 * 1024 - (ULONGLONG)(i + 1) * 4096);
+  }
+  CHECK(g_VolumeTest.FreeSpaceCalls == 10);
+  TestUnmount(instance);
+}
+
+static VOID VolumeTestFreeSpace(VOID) {
+  const ULONGLONG firstFree = 1024 * 1024 * 1024 - 4096;
+  PDOKAN_INSTANCE instance = VolumeTestMount(60000, FALSE);
+  ULONG i;
+
+  for (i = 0; i < 100; ++i) {
+    CHECK(VolumeTestFreeBytes(instance) == firstFree);
+    CHECK(VolumeTestQuery(instance, FileFsSizeInformation)->Status ==
+          STATUS_SUCCESS);
+  }
+  CHECK(g_VolumeTest.FreeSpaceCalls == 1);
+  TestUnmount(instance);
+
+  // expired figures are asked again before answering
+  instance = VolumeTestMount(20, FALSE);
+  CHECK(VolumeTestFreeBytes(instance) == firstFree);
+  Sleep(40);
+  CHECK(VolumeTestFreeBytes(instance) == firstFree - 4096);
+  CHECK(g_VolumeTest.FreeSpaceCalls == 2);
+  TestUnmount(instance);
+
+  // or answered while they are refreshed
+  instance = VolumeTestMount(20, TRUE);
+  CHECK(VolumeTestFreeBytes(instance) == firstFree);
+  Sleep(40);
+  CHECK(VolumeTestFreeBytes(instance) == firstFree);
+  DokanStopVolumeCache(&instance->VolumeCache);
+  CHECK(g_VolumeTest.FreeSpaceCalls == 2);
+  CHECK(VolumeTestFreeBytes(instance) == firstFree - 4096);
+  TestUnmount(instance);
+}
+
+VOID VolumeTest(VOID) {
+  VolumeTestInformation();
+  VolumeTestFreeSpace();
+  TestFreeThreadReply();
+}
+
+VOID VolumeBench(VOID) {
+  const double duration = 0.5;
+  const struct {
+    const char *Name;
+    ULONG FsInformationClass;
+    ULONG FreeSpaceTimeout;
+    BOOL BackgroundRefresh;
+  } runs[] = {
+      {"label", FileFsVolumeInformation, 0, FALSE},
+      {"free, no cache", FileFsFullSizeInformation, 0, FALSE},
+      {"free, 100ms", FileFsFullSizeInformation, 100, FALSE},
+      {"free, refresh", FileFsFullSizeInformation, 100, TRUE},
+  };
+  PDOKAN_INSTANCE instance;
+  LARGE_INTEGER start;
+  double seconds;
+  ULONG queryCount;
+  ULONG calls;
+  ULONG i;
+
+  printf("%-16s %14s %14s %14s\n", "query", "callback us", "queries/s",
+         "calls/query");
+  for (i = 0; i < sizeof(runs) / sizeof(runs[0]); ++i) {
+    instance =
+        VolumeTestMount(runs[i].FreeSpaceTimeout, runs[i].BackgroundRefresh);
+    g_VolumeTest.CallbackMicroseconds = 50;
+    queryCount = 0;
+    QueryPerformanceCounter(&start);
+    do {
+      VolumeTestQuery(instance, runs[i].FsInformationClass);
+      queryCount++;
+    } while ((seconds = TestElapsed(start)) < duration);
+    calls = g_VolumeTest.VolumeCalls + g_VolumeTest.FreeSpaceCalls;
+    printf("%-16s %14lu %14.0f %14.6f\n", runs[i].Name,
+           g_VolumeTest.CallbackMicroseconds, queryCount / seconds,
+           (double)calls / queryCount);
+    TestUnmount(instance);
+  }
+  TestFreeThreadReply();
+}
@@ -0,0 +1,281 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2015 - 2018 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+/*
+
+Write payloads
+
+A write reaches WriteFile in one of three ways: inline after the file
+name when it fits in the event, mapped by the driver when it is larger,
+or pulled with IOCTL_EVENT_WRITE as drivers without the mapping do. The
+pulled event is copied by the test transport, like the driver copies it
+into the service buffer. The benchmark reports the throughput of each
+way for writes of 4KB to 8MB, WriteFile copying the bytes once.
+
+*/
+
+#define WRITE_TEST_NAME L"\\write.bin"
+#define WRITE_TEST_MAX_SIZE (8 * 1024 * 1024)
+
+typedef enum _WRITE_MODE {
+  WRITE_INLINE,
+  WRITE_PULLED,
+  WRITE_MAPPED,
+  WRITE_MODE_COUNT
+} WRITE_MODE;
+
+static const char *g_WriteModeNames[] = {"inline", "pulled", "mapped"};
+
+typedef struct _WRITE_TEST {
+  PUCHAR Payload;
+  // where WriteFile copies the payload
+  PUCHAR Sink;
+  ULONG Calls;
+  ULONG LastLength;
+  LONGLONG LastOffset;
+} WRITE_TEST;
+
+static WRITE_TEST g_WriteTest;
+
+static NTSTATUS DOKAN_CALLBACK WriteTestWriteFile(LPCWSTR FileName,
+                                                  LPCVOID Buffer,
+                                                  DWORD NumberOfBytesToWrite,
+                                                  LPDWORD NumberOfBytesWritten,
+                                                  LONGLONG Offset,
+                                                  PDOKAN_FILE_INFO FileInfo) {
+  UNREFERENCED_PARAMETER(FileInfo);
+
+  CHECK(wcscmp(FileName, WRITE_TEST_NAME) == 0);
+  CopyMemory(g_WriteTest.Sink, Buffer, NumberOfBytesToWrite);
+  g_WriteTest.Calls++;
+  g_WriteTest.LastLength = NumberOfBytesToWrite;
+  g_WriteTest.LastOffset = Offset;
+  *NumberOfBytesWritten = NumberOfBytesToWrite;
+  return STATUS_SUCCESS;
+}
+
+static DOKAN_OPERATIONS g_WriteOperations = {0};
+
+static DOKAN_OPTIONS g_WriteOptions;
+
+static PDOKAN_INSTANCE WriteTestMount(VOID) {
+  ULONG i;
+
+  g_WriteTest.Payload = (PUCHAR)malloc(WRITE_TEST_MAX_SIZE);
+  g_WriteTest.Sink = (PUCHAR)malloc(WRITE_TEST_MAX_SIZE);
+  CHECK(g_WriteTest.Payload != NULL && g_WriteTest.Sink != NULL);
+  for (i = 0; i < WRITE_TEST_MAX_SIZE; ++i) {
+    g_WriteTest.Payload[i] = (UCHAR)(i * 7 + i / 4096);
+  }
+  g_WriteOperations.WriteFile = WriteTestWriteFile;
+  ZeroMemory(&g_WriteOptions, sizeof(DOKAN_OPTIONS));
+  return TestMount(&g_WriteOperations, &g_WriteOptions);
+}
+
+static VOID WriteTestUnmount(PDOKAN_INSTANCE Instance) {
+  TestUnmount(Instance);
+  TestFreeThreadReply();
+  free(g_WriteTest.Payload);
+  free(g_WriteTest.Sink);
+  ZeroMemory(&g_WriteTest, sizeof(WRITE_TEST));
+}
+
+// Write event of Length bytes at Offset carrying the payload inline
+static PEVENT_CONTEXT WriteTestInlineEvent(PDOKAN_OPEN_INFO OpenInfo,
+                                           ULONG Length, LONGLONG Offset) {
+  PEVENT_CONTEXT eventContext =
+      TestNewEvent(IRP_MJ_WRITE, OpenInfo, sizeof(WRITE_TEST_NAME) + Length);
+
+  if (eventContext == NULL) {
+    return NULL;
+  }
+  TestSetName(eventContext->Operation.Write.FileName,
+              &eventContext->Operation.Write.FileNameLength, WRITE_TEST_NAME);
+  eventContext->Operation.Write.ByteOffset.QuadPart = Offset;
+  eventContext->Operation.Write.BufferLength = Length;
+  eventContext->Operation.Write.BufferOffset =
+      sizeof(EVENT_CONTEXT) + sizeof(WRITE_TEST_NAME);
+  CopyMemory((PCHAR)eventContext + eventContext->Operation.Write.BufferOffset,
+             g_WriteTest.Payload, Length);
+  return eventContext;
+}
+
+// Event handed to DispatchWrite for Mode, *Pulled is what IOCTL_EVENT_WRITE
+// returns in WRITE_PULLED mode
+static PEVENT_CONTEXT WriteTestEvent(PDOKAN_OPEN_INFO OpenInfo,
+                                     WRITE_MODE Mode, ULONG Length,
+                                     LONGLONG Offset, PEVENT_CONTEXT *Pulled) {
+  PEVENT_CONTEXT eventContext;
+
+  *Pulled = NULL;
+  switch (Mode) {
+  case WRITE_INLINE:
+    return WriteTestInlineEvent(OpenInfo, Length, Offset);
+  case WRITE_PULLED:
+    *Pulled = WriteTestInlineEvent(OpenInfo, Length, Offset);
+    if (*Pulled == NULL) {
+      return NULL;
+    }
+    eventContext =
+        TestNewEvent(IRP_MJ_WRITE, OpenInfo, sizeof(WRITE_TEST_NAME));
+    if (eventContext == NULL) {
+      return NULL;
+    }
+    // the driver queues the event up to the file name and the length of
+    // the whole event
+    CopyMemory(eventContext, *Pulled, (*Pulled)->Operation.Write.BufferOffset);
+    eventContext->Length = (*Pulled)->Operation.Write.BufferOffset;
+    eventContext->Operation.Write.RequestLength = (*Pulled)->Length;
+    return eventContext;
+  default:
+    eventContext =
+        TestNewEvent(IRP_MJ_WRITE, OpenInfo, sizeof(WRITE_TEST_NAME));
+    if (eventContext == NULL) {
+      return NULL;
+    }
+    TestSetName(eventContext->Operation.Write.FileName,
+                &eventContext->Operation.Write.FileNameLength,
+                WRITE_TEST_NAME);
+    eventContext->Operation.Write.ByteOffset.QuadPart = Offset;
+    eventContext->Operation.Write.BufferLength = Length;
+    eventContext->Operation.Write.UserBuffer =
+        (ULONG64)(ULONG_PTR)g_WriteTest.Payload;
+    return eventContext;
+  }
+}
+
+static VOID WriteTestOne(PDOKAN_INSTANCE Instance, PDOKAN_OPEN_INFO OpenInfo,
+                         WRITE_MODE Mode, ULONG Length) {
+  const LONGLONG offset = 3 * 4096;
+  PEVENT_CONTEXT pulled;
+  PEVENT_CONTEXT eventContext =
+      WriteTestEvent(OpenInfo, Mode, Length, offset, &pulled);
+  PEVENT_INFORMATION reply;
+  LONG64 pulledWrites = g_TestMountCounters.PulledWrites;
+
+  ZeroMemory(g_WriteTest.Sink, Length);
+  g_WriteTest.Calls = 0;
+  TestSetPulledWrite(pulled);
+  DispatchWrite(TestMountHandle(), eventContext, Instance);
+  TestSetPulledWrite(NULL);
+
+  CHECK(g_WriteTest.Calls == 1);
+  CHECK(g_WriteTest.LastLength == Length);
+  CHECK(g_WriteTest.LastOffset == offset);
+  CHECK(memcmp(g_WriteTest.Sink, g_WriteTest.Payload, Length) == 0);
+  CHECK(g_TestMountCounters.PulledWrites ==
+        pulledWrites + (Mode == WRITE_PULLED ? 1 : 0));
+
+  reply = TestLastReply(NULL);
+  CHECK(reply != NULL);
+  if (reply != NULL) {
+    CHECK(reply->SerialNumber == eventContext->SerialNumber);
+    CHECK(reply->Status == STATUS_SUCCESS);
+    CHECK(reply->BufferLength == Length);
+    CHECK(reply->Operation.Write.CurrentByteOffset.QuadPart ==
+          offset + Length);
+  }
+  free(eventContext);
+  free(pulled);
+}
+
+VOID WriteTest(VOID) {
+  PDOKAN_INSTANCE instance = WriteTestMount();
+  PDOKAN_OPEN_INFO openInfo = TestOpen(instance, FALSE);
+  PEVENT_CONTEXT pulled;
+  PEVENT_CONTEXT eventContext;
+  PEVENT_INFORMATION reply;
+
+  WriteTestOne(instance, openInfo, WRITE_INLINE, 4096);
+  WriteTestOne(instance, openInfo, WRITE_PULLED, 4096);
+  WriteTestOne(instance, openInfo, WRITE_PULLED, 1024 * 1024);
+  WriteTestOne(instance, openInfo, WRITE_MAPPED, 1024 * 1024);
+  WriteTestOne(instance, openInfo, WRITE_MAPPED, WRITE_TEST_MAX_SIZE);
+
+  // a write cancelled before its payload was pulled never reaches WriteFile
+  eventContext = WriteTestEvent(openInfo, WRITE_PULLED, 4096, 0, &pulled);
+  g_WriteTest.Calls = 0;
+  DispatchWrite(TestMountHandle(), eventContext, instance);
+  CHECK(g_WriteTest.Calls == 0);
+  reply = TestLastReply(NULL);
+  CHECK(reply != NULL);
+  if (reply != NULL) {
+    CHECK(reply->SerialNumber == eventContext->SerialNumber);
+    CHECK(reply->Status == STATUS_CANCELLED);
+    CHECK(reply->BufferLength == 0);
+  }
+  free(eventContext);
+  free(pulled);
+
+  TestClose(instance, openInfo);
+  WriteTestUnmount(instance);
+}
+
+VOID WriteBench(VOID) {
+  const ULONG sizes[] = {4096, 64 * 1024, 1024 * 1024, WRITE_TEST_MAX_SIZE};
+  const ULONG byteBudget = 512 * 1024 * 1024;
+  PDOKAN_INSTANCE instance = WriteTestMount();
+  PDOKAN_OPEN_INFO openInfo = TestOpen(instance, FALSE);
+  DOKAN_REPLY_ARENA arena;
+  PEVENT_CONTEXT eventContext;
+  PEVENT_CONTEXT pulled;
+  LARGE_INTEGER start;
+  ULONG count;
+  ULONG mode;
+  ULONG i, j;
+
+  // like a worker of DokanLoop
+  DokanInitReplyArena(&arena);
+  DokanSetThreadArena(&arena);
+  printf("%-16s %14s %14s %14s\n", "KB, MB/s",
+         g_WriteModeNames[WRITE_INLINE], g_WriteModeNames[WRITE_PULLED],
+         g_WriteModeNames[WRITE_MAPPED]);
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    count = max(16, byteBudget / sizes[i]);
+    printf("%-16lu", sizes[i] / 1024);
+    for (mode = 0; mode < WRITE_MODE_COUNT; ++mode) {
+      // the driver only sends inline what fits in an event
+      if (mode == WRITE_INLINE && sizes[i] > WRITE_MAX_SIZE) {
+        printf(" %14s", "-");
+        continue;
+      }
+      eventContext =
+          WriteTestEvent(openInfo, (WRITE_MODE)mode, sizes[i], 0, &pulled);
+      TestSetPulledWrite(pulled);
+      QueryPerformanceCounter(&start);
+      for (j = 0; j < count; ++j) {
+        DispatchWrite(TestMountHandle(), eventContext, instance);
+      }
+      printf(" %14.0f",
+             (double)sizes[i] * count / (1024 * 1024) / TestElapsed(start));
+      TestSetPulledWrite(NULL);
+      free(eventContext);
+      free(pulled);
+    }
+    printf("\n");
+  }
+  DokanSetThreadArena(NULL);
+  DokanDeleteReplyArena(&arena);
+  TestClose(instance, openInfo);
+  WriteTestUnmount(instance);
+}